@@ -7,6 +7,14 @@ import matplotlib.pyplot as plt
 
 RESULTS_FILE = "results.csv"
 
+# Columns only filled by instrumented builds (make INSTRUMENT=1) ...
+LATENCY_COLS = ["lat_p50_ns", "lat_p99_ns", "lat_p999_ns", "lat_max_ns"]
+PHASE_COLS = ["filter_cyc_per_q", "hot_cyc_per_q", "cold_cyc_per_q",
+              "adapt_cyc_per_q", "promote_cyc_per_q"]
+# ... and by --perf runs on hosts with hardware counters.
+HW_COLS = ["hw_cycles_per_q", "hw_instructions_per_q",
+           "hw_llc_misses_per_q", "hw_branch_misses_per_q"]
+
 def load_results(path=RESULTS_FILE):
     rows = []
     with open(path, newline="") as f:
@@ -19,10 +27,15 @@ def load_results(path=RESULTS_FILE):
                 "elapsed_sec", "qps",
                 "hot_hits", "cold_hits", "not_found",
                 "hot_keys", "cold_keys",
-                "avg_hot_nodes_per_q", "avg_cold_nodes_per_q"
-            ]:
-                if k in r and r[k] != "":
+                "avg_hot_nodes_per_q", "avg_cold_nodes_per_q",
+                "build_sec", "batch", "threads", "qps_thread_min",
+                "qps_thread_max", "write_fraction",
+                "hot_bytes", "cold_bytes", "cold_height", "write_buffer"
+            ] + LATENCY_COLS + PHASE_COLS + HW_COLS:
+                if k in r and r[k] not in ("", None):
                     r[k] = float(r[k])
+                else:
+                    r[k] = None
             rows.append(r)
     return rows
 
@@ -31,8 +44,22 @@ def group_key(row):
     return (row["workload"], row["theta"], row["nkeys"], row["nqueries"])
 
 def summarize(rows):
+    """Single-threaded rows by group_key and mode; see plot_scaling for the rest."""
     grouped = defaultdict(dict)
     for r in rows:
+        if ((r["threads"] or 1) != 1 or r.get("tiering") == "exclusive"
+                or r.get("write_buffer") or r.get("leaf_format") == "packed"
+                or r.get("learned_eps") not in (None, "", "0")
+                or r.get("hot_pages") == "huge"
+                or r.get("hot_copies") not in (None, "", "1")
+                or r.get("cold_placement") == "interleave"
+                or r.get("hot_kind") == "hash"
+                or r.get("evict") not in (None, "", "none")
+                or r.get("freq") not in (None, "", "dense")
+                or r.get("filter_bits") not in (None, "", "0")
+                or r.get("shards") not in (None, "", "1")
+                or r.get("promote") not in (None, "", "inline")):
+            continue
         gk = group_key(r)
         grouped[gk][r["mode"]] = r
     return grouped
@@ -60,6 +87,29 @@ def print_comparison_table(grouped):
               f"{nodes_base:.3f},{nodes_hc:.3f},"
               f"{hot_frac:.4f},{hot_hits_frac:.4f}")
 
+def print_tiering_table(rows):
+    """Inclusive vs exclusive hctree runs (--exclusive): memory and QPS."""
+    grouped = defaultdict(dict)
+    for r in rows:
+        if r["mode"] == "hctree" and (r["threads"] or 1) == 1 and r.get("tiering"):
+            grouped[group_key(r) + (r["hot_fraction"],)][r["tiering"]] = r
+    lines = []
+    for (workload, theta, nkeys, nqueries, hot_frac), t in grouped.items():
+        inc, exc = t.get("inclusive"), t.get("exclusive")
+        if not inc or not exc:
+            continue
+        mem = [r["hot_bytes"] + r["cold_bytes"] for r in (inc, exc)]
+        lines.append(f"{workload},{theta:.3f},{int(nkeys)},{hot_frac:.3f},"
+                     f"{inc['qps']:.1f},{exc['qps']:.1f},"
+                     f"{mem[0]:.0f},{mem[1]:.0f},"
+                     f"{int(inc['cold_height'])},{int(exc['cold_height'])}")
+    if lines:
+        print("\n=== Tiering (inclusive vs exclusive hctree) ===")
+        print("workload,theta,nkeys,hot_fraction,qps_inclusive,qps_exclusive,"
+              "bytes_inclusive,bytes_exclusive,cold_height_inclusive,"
+              "cold_height_exclusive")
+        print("\n".join(lines))
+
 def plot_qps_vs_mode(grouped):
     # One panel per (workload, theta)
     fig, ax = plt.subplots()
@@ -160,6 +210,110 @@ def plot_hot_fraction_vs_theta(grouped):
     fig.savefig("fig_hot_fraction_vs_theta.png", dpi=300)
     plt.close(fig)
 
+def has(row, cols):
+    return row is not None and all(row.get(c) is not None for c in cols)
+
+def plot_latency_vs_mode(grouped):
+    """p50 / p99 / p99.9 lookup latency per mode (instrumented runs only)."""
+    labels, series = [], {("baseline", c): [] for c in LATENCY_COLS[:3]}
+    series.update({("hctree", c): [] for c in LATENCY_COLS[:3]})
+    for (workload, theta, nkeys, nqueries), modes in grouped.items():
+        base, hc = modes.get("baseline"), modes.get("hctree")
+        if not has(base, LATENCY_COLS) or not has(hc, LATENCY_COLS):
+            continue
+        labels.append(f"{workload}-θ={theta:.1f}")
+        for c in LATENCY_COLS[:3]:
+            series[("baseline", c)].append(base[c])
+            series[("hctree", c)].append(hc[c])
+    if not labels:
+        return False
+
+    fig, ax = plt.subplots()
+    width = 0.13
+    x = range(len(labels))
+    for j, (key, vals) in enumerate(series.items()):
+        mode, col = key
+        name = "Baseline" if mode == "baseline" else "HCIndex"
+        pct = col[len("lat_"):-len("_ns")]
+        ax.bar([i + (j - 2.5) * width for i in x], vals, width, label=f"{name} {pct}")
+    ax.set_xticks(list(x))
+    ax.set_xticklabels(labels, rotation=30, ha="right")
+    ax.set_yscale("log")
+    ax.set_ylabel("Lookup latency (ns)")
+    ax.set_title("Lookup latency percentiles: Baseline vs HCIndex")
+    ax.legend(fontsize="small")
+    fig.tight_layout()
+    fig.savefig("fig_latency_vs_mode.png", dpi=300)
+    plt.close(fig)
+    return True
+
+def plot_phase_cycles(grouped):
+    """Stacked per-phase cycles per query for HCIndex runs."""
+    labels, rows = [], []
+    for (workload, theta, nkeys, nqueries), modes in grouped.items():
+        hc = modes.get("hctree")
+        if not has(hc, PHASE_COLS):
+            continue
+        labels.append(f"{workload}-θ={theta:.1f}")
+        rows.append(hc)
+    if not labels:
+        return False
+
+    fig, ax = plt.subplots()
+    x = list(range(len(labels)))
+    bottom = [0.0] * len(labels)
+    for c in PHASE_COLS:
+        vals = [r[c] for r in rows]
+        ax.bar(x, vals, 0.6, bottom=bottom, label=c[:-len("_cyc_per_q")])
+        bottom = [b + v for b, v in zip(bottom, vals)]
+    ax.set_xticks(x)
+    ax.set_xticklabels(labels, rotation=30, ha="right")
+    ax.set_ylabel("Cycles / query")
+    ax.set_title("Where HCIndex lookups spend their time")
+    ax.legend()
+    fig.tight_layout()
+    fig.savefig("fig_phase_cycles.png", dpi=300)
+    plt.close(fig)
+    return True
+
+def print_hw_table(grouped):
+    lines = []
+    for (workload, theta, nkeys, nqueries), modes in grouped.items():
+        for mode in ("baseline", "hctree"):
+            r = modes.get(mode)
+            if has(r, HW_COLS):
+                lines.append(f"{workload},{theta:.3f},{mode}," +
+                             ",".join(f"{r[c]:.3f}" for c in HW_COLS))
+    if lines:
+        print("\n=== Hardware counters per query ===")
+        print("workload,theta,mode," + ",".join(HW_COLS))
+        print("\n".join(lines))
+
+def plot_scaling(rows):
+    """Aggregate QPS vs threads (--threads sweeps), one line per mode and workload."""
+    series = defaultdict(dict)
+    for r in rows:
+        w = r["write_fraction"] or 0.0
+        series[(r["mode"], r["workload"], r["theta"], w)][int(r["threads"] or 1)] = r["qps"]
+    series = {k: v for k, v in series.items() if len(v) > 1}
+    if not series:
+        return False
+
+    fig, ax = plt.subplots()
+    for (mode, workload, theta, w), pts in sorted(series.items()):
+        threads = sorted(pts)
+        label = f"{mode} {workload}-θ={theta:.1f}" + (f" w={w:.2f}" if w else "")
+        ax.plot(threads, [pts[t] for t in threads], marker="o", label=label)
+    ax.set_xscale("log", base=2)
+    ax.set_xlabel("Threads")
+    ax.set_ylabel("Aggregate throughput (queries/sec)")
+    ax.set_title("Throughput scaling with query threads")
+    ax.legend(fontsize="small")
+    fig.tight_layout()
+    fig.savefig("fig_scaling.png", dpi=300)
+    plt.close(fig)
+    return True
+
 def main():
     rows = load_results()
     grouped = summarize(rows)
@@ -167,7 +321,16 @@ def main():
     plot_qps_vs_mode(grouped)
     plot_nodes_vs_mode(grouped)
     plot_hot_fraction_vs_theta(grouped)
-    print("\nGenerated: fig_qps_vs_mode.png, fig_nodes_vs_mode.png, fig_hot_fraction_vs_theta.png")
+    figs = ["fig_qps_vs_mode.png", "fig_nodes_vs_mode.png", "fig_hot_fraction_vs_theta.png"]
+    if plot_latency_vs_mode(grouped):
+        figs.append("fig_latency_vs_mode.png")
+    if plot_phase_cycles(grouped):
+        figs.append("fig_phase_cycles.png")
+    if plot_scaling(rows):
+        figs.append("fig_scaling.png")
+    print_hw_table(grouped)
+    print_tiering_table(rows)
+    print("\nGenerated: " + ", ".join(figs))
 
 if __name__ == "__main__":
     main()
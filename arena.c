@@ -0,0 +1,98 @@
+// arena.c
+#include "arena.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define ARENA_CHUNK_BYTES ((size_t)2 << 20)   // one x86-64 huge page
+
+// Chunk header; objects start at the next ARENA_ALIGN boundary.
+typedef struct ArenaChunk {
+    struct ArenaChunk *next;
+} ArenaChunk;
+
+#define ARENA_CHUNK_HDR \
+    ((sizeof(ArenaChunk) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+struct Arena {
+    size_t      obj_bytes;    // rounded up to ARENA_ALIGN
+    size_t      chunk_bytes;
+    ArenaChunk *chunks;
+    size_t      nchunks;
+    char       *bump;         // unused tail of the newest chunk
+    char       *bump_end;
+    void       *free_list;    // released objects, linked through their last word
+    size_t      live;
+    NMPolicy    policy;       // for new chunks
+};
+
+Arena* arena_create(size_t obj_bytes) {
+    Arena *a = (Arena*)calloc(1, sizeof(Arena));
+    if (!a) return NULL;
+    a->obj_bytes = (obj_bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    // At least a handful of objects per chunk, in whole huge pages.
+    size_t need = ARENA_CHUNK_HDR + 8 * a->obj_bytes;
+    a->chunk_bytes = (need + ARENA_CHUNK_BYTES - 1) & ~(ARENA_CHUNK_BYTES - 1);
+    a->policy = NM_POLICY_DEFAULT;
+    return a;
+}
+
+void arena_set_policy(Arena *a, NMPolicy p) {
+    a->policy = p;
+    for (ArenaChunk *c = a->chunks; c; c = c->next)
+        nm_place(c, a->chunk_bytes, p.node);
+}
+
+void arena_free(Arena *a) {
+    if (!a) return;
+    ArenaChunk *c = a->chunks;
+    while (c) {
+        ArenaChunk *next = c->next;
+        nm_free(c, a->chunk_bytes);
+        c = next;
+    }
+    free(a);
+}
+
+static int arena_grow(Arena *a) {
+    ArenaChunk *c = (ArenaChunk*)nm_alloc(a->chunk_bytes, a->policy);
+    if (!c) return 0;
+    c->next = a->chunks;
+    a->chunks = c;
+    a->nchunks++;
+    a->bump = (char*)c + ARENA_CHUNK_HDR;
+    a->bump_end = (char*)c + a->chunk_bytes;
+    return 1;
+}
+
+static inline void** arena_link(const Arena *a, void *obj) {
+    return (void**)((char*)obj + a->obj_bytes - sizeof(void*));
+}
+
+void* arena_alloc(Arena *a) {
+    void *obj = a->free_list;
+    if (obj) {
+        a->free_list = *arena_link(a, obj);
+    } else {
+        if ((size_t)(a->bump_end - a->bump) < a->obj_bytes && !arena_grow(a))
+            return NULL;
+        obj = a->bump;
+        a->bump += a->obj_bytes;
+    }
+    a->live++;
+    return obj;
+}
+
+void arena_release(Arena *a, void *obj) {
+    if (!obj) return;
+    *arena_link(a, obj) = a->free_list;
+    a->free_list = obj;
+    a->live--;
+}
+
+size_t arena_bytes(const Arena *a) {
+    return a->nchunks * a->chunk_bytes;
+}
+
+size_t arena_live(const Arena *a) {
+    return a->live;
+}
@@ -0,0 +1,42 @@
+// arena.h
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include "hcnuma.h"
+
+// Fixed-size object arena (slab allocator) for tree nodes.
+//
+// Objects are carved out of large chunks (whole 2 MiB huge pages from
+// hcnuma.h, placed by the arena's policy), so a tree with millions of nodes costs a few
+// hundred allocator calls instead of millions, and nodes of one tree sit
+// close together in memory. Released objects go on an intrusive free list
+// and are reused first. arena_free() returns every chunk at once, without
+// visiting the objects. Objects are ARENA_ALIGN-aligned.
+//
+// Memory is only returned to the system by arena_free(), and the free
+// list link lives in an object's last word, so the start of a released
+// object (e.g. a node header with a version counter) stays readable and
+// unchanged. Lock-free readers of B-tree nodes depend on both.
+//
+// An arena is not thread-safe; each tree owns its own, so trees never
+// contend on a shared allocator lock.
+#define ARENA_ALIGN 64
+
+typedef struct Arena Arena;
+
+Arena* arena_create(size_t obj_bytes);
+void   arena_free(Arena *a);
+
+// Page size and node for chunks allocated from now on (the default is
+// NM_POLICY_DEFAULT); chunks already there move to p.node.
+void   arena_set_policy(Arena *a, NMPolicy p);
+
+void*  arena_alloc(Arena *a);
+void   arena_release(Arena *a, void *obj);
+
+// Bytes reserved from the system (all chunks) and objects currently live.
+size_t arena_bytes(const Arena *a);
+size_t arena_live(const Arena *a);
+
+#endif // ARENA_H
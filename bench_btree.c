@@ -0,0 +1,187 @@
+// bench_btree.c
+//
+// Runtime-degree B-tree (btree.h) against the compile-time specialized
+// variants of btfixed.h, on the same keys and lookups:
+//
+//   ./bench_btree [--nkeys N] [--nqueries Q] [--reps R] [--seed S]
+//
+// Every tree gets keys 0..N-1 inserted in a random order, with payload =
+// key, then R passes of Q uniform lookups over [0, N + N/8), so about one
+// in nine misses; the fastest pass is reported. Lookups go through the
+// found-aware APIs (bt_find, P_find), and each run checks its hit count
+// and payload sum against the expected ones, so key 0 with its 0 payload
+// counts as a hit.
+#define _POSIX_C_SOURCE 200809L
+#include "btree.h"
+#include "btvariants.h"
+#include "rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+typedef struct {
+    int64_t  nkeys;
+    int64_t  nqueries;
+    int      reps;
+    BTKey   *order;      // insert order: a permutation of 0..nkeys-1
+    BTKey   *queries;
+    long     want_hits;
+    uint64_t want_sum;   // sum of the payloads the hits return
+} Bench;
+
+static void report(const char *name, int degree, int key_bits, double build,
+                   double lookup, const Bench *b, long hits, uint64_t sum,
+                   size_t bytes, int height) {
+    double mqps = lookup > 0.0 ? (double)b->nqueries / lookup / 1e6 : 0.0;
+    int ok = hits == b->want_hits && sum == b->want_sum;
+    printf("%-10s %6d %8d %9.3f %9.2f %9.1f %6d  %s\n", name, degree, key_bits,
+           build, mqps, (double)bytes / (1 << 20), height, ok ? "ok" : "WRONG");
+}
+
+static int run_runtime(const Bench *b, int t, int bplus) {
+    double t0 = now_seconds();
+    BTree *tree = bplus ? bt_create_bplus(t) : bt_create(t);
+    for (int64_t i = 0; i < b->nkeys; i++)
+        bt_insert(tree, b->order[i], (BTPayload)(intptr_t)b->order[i]);
+    double build = now_seconds() - t0;
+
+    long hits = 0;
+    uint64_t sum = 0;
+    double lookup = 0.0;
+    for (int rep = 0; rep < b->reps; rep++) {
+        hits = 0;
+        sum = 0;
+        t0 = now_seconds();
+        for (int64_t q = 0; q < b->nqueries; q++) {
+            BTPayload v;
+            if (bt_find(tree, b->queries[q], &v, NULL)) {
+                hits++;
+                sum += (uint64_t)(intptr_t)v;
+            }
+        }
+        double t = now_seconds() - t0;
+        if (rep == 0 || t < lookup) lookup = t;
+    }
+    report(bplus ? "bplus" : "btree", t, 64, build, lookup, b, hits, sum,
+           bt_live_bytes(tree), bt_height(tree));
+    int ok = hits == b->want_hits && sum == b->want_sum;
+    bt_free(tree);
+    return ok;
+}
+
+// One btfixed.h variant; keys and payloads are narrowed to KeyT / ValT,
+// which holds every key below 2^31 for the 32-bit variants.
+#define RUN_FIXED(P, T, KeyT, ValT, bits)                                     \
+    static int run_##P(const Bench *b) {                                      \
+        double t0 = now_seconds();                                            \
+        P *tree = P##_create();                                               \
+        for (int64_t i = 0; i < b->nkeys; i++)                                \
+            P##_insert(tree, (KeyT)b->order[i], (ValT)b->order[i]);           \
+        double build = now_seconds() - t0;                                    \
+        long hits = 0;                                                        \
+        uint64_t sum = 0;                                                     \
+        double lookup = 0.0;                                                  \
+        for (int rep = 0; rep < b->reps; rep++) {                             \
+            hits = 0;                                                         \
+            sum = 0;                                                          \
+            t0 = now_seconds();                                               \
+            for (int64_t q = 0; q < b->nqueries; q++) {                       \
+                ValT v;                                                       \
+                if (P##_find(tree, (KeyT)b->queries[q], &v)) {                \
+                    hits++;                                                   \
+                    sum += (uint64_t)v;                                       \
+                }                                                             \
+            }                                                                 \
+            double t = now_seconds() - t0;                                    \
+            if (rep == 0 || t < lookup) lookup = t;                           \
+        }                                                                     \
+        report(#P, T, bits, build, lookup, b, hits, sum, P##_bytes(tree),     \
+               P##_height(tree));                                             \
+        int ok = hits == b->want_hits && sum == b->want_sum;                  \
+        P##_free(tree);                                                       \
+        return ok;                                                            \
+    }
+
+RUN_FIXED(btf8_64,   8, int64_t, uint64_t, 64)
+RUN_FIXED(btf16_64, 16, int64_t, uint64_t, 64)
+RUN_FIXED(btf32_64, 32, int64_t, uint64_t, 64)
+RUN_FIXED(btf64_64, 64, int64_t, uint64_t, 64)
+RUN_FIXED(btf8_32,   8, int32_t, uint32_t, 32)
+RUN_FIXED(btf16_32, 16, int32_t, uint32_t, 32)
+RUN_FIXED(btf32_32, 32, int32_t, uint32_t, 32)
+RUN_FIXED(btf64_32, 64, int32_t, uint32_t, 32)
+
+int main(int argc, char **argv) {
+    Bench b;
+    memset(&b, 0, sizeof(b));
+    b.nkeys = 1000000;
+    b.nqueries = 4000000;
+    b.reps = 3;
+    uint64_t seed = 42;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--nkeys") && i+1 < argc) {
+            b.nkeys = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--nqueries") && i+1 < argc) {
+            b.nqueries = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--reps") && i+1 < argc) {
+            b.reps = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+            seed = (uint64_t)atoll(argv[++i]);
+        } else {
+            fprintf(stderr, "Usage: %s [--nkeys N] [--nqueries Q] [--reps R] [--seed S]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (b.nkeys <= 0 || b.nkeys > INT32_MAX / 2 || b.nqueries < 0 || b.reps < 1) {
+        fprintf(stderr, "Need 0 < nkeys <= %d (32-bit variants), nqueries >= 0"
+                        " and reps >= 1\n", INT32_MAX / 2);
+        return 1;
+    }
+
+    Rng r;
+    rng_seed(&r, seed);
+    b.order = (BTKey*)malloc(sizeof(BTKey) * (size_t)b.nkeys);
+    for (int64_t i = 0; i < b.nkeys; i++) b.order[i] = i;
+    for (int64_t i = b.nkeys - 1; i > 0; i--) {
+        int64_t j = (int64_t)rng_below(&r, (uint64_t)i + 1);
+        BTKey t = b.order[i]; b.order[i] = b.order[j]; b.order[j] = t;
+    }
+    b.queries = (BTKey*)malloc(sizeof(BTKey) * (size_t)(b.nqueries > 0 ? b.nqueries : 1));
+    uint64_t span = (uint64_t)(b.nkeys + b.nkeys / 8);
+    for (int64_t q = 0; q < b.nqueries; q++) {
+        b.queries[q] = (BTKey)rng_below(&r, span);
+        if (b.queries[q] < b.nkeys) {
+            b.want_hits++;
+            b.want_sum += (uint64_t)b.queries[q];
+        }
+    }
+
+    printf("nkeys %" PRId64 ", nqueries %" PRId64 " (best of %d), random insert order\n\n",
+           b.nkeys, b.nqueries, b.reps);
+    printf("%-10s %6s %8s %9s %9s %9s %6s\n",
+           "tree", "degree", "key_bits", "build_s", "Mlookup/s", "nodes_MB", "height");
+    int ok = 1;
+    static const int degrees[] = { 8, 16, 32, 64 };
+    for (int i = 0; i < 4; i++) ok &= run_runtime(&b, degrees[i], 0);
+    for (int i = 0; i < 4; i++) ok &= run_runtime(&b, degrees[i], 1);
+    ok &= run_btf8_64(&b);
+    ok &= run_btf16_64(&b);
+    ok &= run_btf32_64(&b);
+    ok &= run_btf64_64(&b);
+    ok &= run_btf8_32(&b);
+    ok &= run_btf16_32(&b);
+    ok &= run_btf32_32(&b);
+    ok &= run_btf64_32(&b);
+
+    free(b.order);
+    free(b.queries);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,87 @@
+// bloom.c
+#include "bloom.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BF_WORDS 8   // 8 x 32-bit words = one 32-byte block
+
+typedef struct {
+    _Alignas(32) uint32_t w[BF_WORDS];
+} BFBlock;
+
+struct BloomFilter {
+    BFBlock *blocks;
+    uint64_t nblocks;
+    int      concurrent;
+};
+
+// Odd multipliers picking one bit per word from the low hash half.
+static const uint32_t bf_salt[BF_WORDS] = {
+    0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+    0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+};
+
+// splitmix64 finalizer, as in freq.c.
+static inline uint64_t bf_hash(int64_t k) {
+    uint64_t z = (uint64_t)k + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// High 32 hash bits pick the block (multiply-shift, no power-of-two
+// size needed); the low 32 bits pick the bits within it.
+static inline BFBlock* bf_block(const BloomFilter *f, uint64_t h) {
+    return &f->blocks[((h >> 32) * f->nblocks) >> 32];
+}
+
+static inline uint32_t bf_bit(uint32_t lo, int i) {
+    return 1u << ((lo * bf_salt[i]) >> 27);
+}
+
+BloomFilter* bf_create(size_t nkeys, unsigned bits_per_key, int concurrent) {
+    BloomFilter *f = (BloomFilter*)malloc(sizeof(BloomFilter));
+    uint64_t bits = (uint64_t)nkeys * bits_per_key;
+    f->nblocks = bits / (8 * sizeof(BFBlock)) + 1;
+    if (f->nblocks > UINT32_MAX) f->nblocks = UINT32_MAX;
+    size_t bytes = (sizeof(BFBlock) * f->nblocks + 63) & ~(size_t)63;
+    f->blocks = (BFBlock*)aligned_alloc(64, bytes);
+    memset(f->blocks, 0, bytes);
+    f->concurrent = concurrent;
+    return f;
+}
+
+void bf_free(BloomFilter *f) {
+    if (!f) return;
+    free(f->blocks);
+    free(f);
+}
+
+void bf_add(BloomFilter *f, int64_t k) {
+    uint64_t h = bf_hash(k);
+    BFBlock *b = bf_block(f, h);
+    uint32_t lo = (uint32_t)h;
+    for (int i = 0; i < BF_WORDS; i++) {
+        if (f->concurrent)
+            __atomic_fetch_or(&b->w[i], bf_bit(lo, i), __ATOMIC_RELAXED);
+        else
+            b->w[i] |= bf_bit(lo, i);
+    }
+}
+
+// Branch-free over all eight words; they share one cache line anyway.
+int bf_may_contain(const BloomFilter *f, int64_t k) {
+    uint64_t h = bf_hash(k);
+    const BFBlock *b = bf_block(f, h);
+    uint32_t lo = (uint32_t)h;
+    uint32_t missing = 0;
+    for (int i = 0; i < BF_WORDS; i++) {
+        uint32_t bit = bf_bit(lo, i);
+        missing |= bit & ~__atomic_load_n(&b->w[i], __ATOMIC_RELAXED);
+    }
+    return missing == 0;
+}
+
+size_t bf_bytes(const BloomFilter *f) {
+    return sizeof(BloomFilter) + sizeof(BFBlock) * f->nblocks;
+}
@@ -0,0 +1,26 @@
+// bloom.h
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Split-block Bloom filter: a key maps to one 32-byte block and sets one
+// bit in each of the block's eight 32-bit words, so an add or a lookup
+// touches a single cache line. With 10 bits per key the false-positive
+// rate is about 1%. Keys cannot be removed; a filter only ever answers
+// "maybe present" for keys that were added.
+//
+// With concurrent = 1, adds from any thread may run alongside lookups.
+typedef struct BloomFilter BloomFilter;
+
+// Sized for nkeys keys at bits_per_key; more keys raise the FP rate.
+BloomFilter* bf_create(size_t nkeys, unsigned bits_per_key, int concurrent);
+void         bf_free(BloomFilter *f);
+
+void         bf_add(BloomFilter *f, int64_t k);
+int          bf_may_contain(const BloomFilter *f, int64_t k);  // 0 = absent
+
+size_t       bf_bytes(const BloomFilter *f);
+
+#endif // BLOOM_H
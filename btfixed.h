@@ -0,0 +1,193 @@
+// btfixed.h
+#ifndef BTFIXED_H
+#define BTFIXED_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Compile-time specialized B+trees: the minimum degree T, the key type
+// and the payload type are fixed when a variant is instantiated, so node
+// capacities are constants and nodes hold keys and payloads of their
+// real width. The runtime tree (btree.h) computes 2*t - 1 from tree->t
+// in every loop and stores int64 keys with pointer payloads.
+//
+//   BTF_DECLARE(P, T, KeyT, ValT)           in a header: type P and API
+//   BTF_DEFINE(P, T, KeyT, ValT, KEY_MAX)   in one .c: the functions
+//
+// KEY_MAX is the largest KeyT. Unused key slots hold it, and one slot
+// past the last one always does, so a node search is a fixed-length count
+// of keys[j] < k over 2*T slots that the compiler can unroll and
+// vectorize, with no branch on the node's key count.
+//
+// Variants support insert and lookup only (no delete, concurrency or
+// persistence); they exist to measure layout and specialization against
+// the runtime tree (bench_btree.c). Lookups report found separately from
+// the payload, so any payload value, 0 included, can be stored.
+//
+//   P*     P_create(void);
+//   void   P_free(P *tree);
+//   int    P_insert(P *tree, KeyT k, ValT v);     // 1 added, 0 overwritten
+//   int    P_find(const P *tree, KeyT k, ValT *out);  // 1 and *out if found
+//   size_t P_count(const P *tree);                // keys
+//   size_t P_bytes(const P *tree);                // node memory
+//   int    P_height(const P *tree);               // levels, 1 = root leaf
+
+// Node search strategy, a compile-time constant per variant: the count
+// for key areas up to BTF_LINEAR_BYTES, else (T a power of two) a
+// branchless binary search of exactly log2(2T) steps.
+#ifndef BTF_LINEAR_BYTES
+#define BTF_LINEAR_BYTES 256
+#endif
+#define BTF_BINARY(T, key_bytes) \
+    (((T) & ((T) - 1)) == 0 && 2 * (T) * (key_bytes) > BTF_LINEAR_BYTES)
+
+#define BTF_DECLARE(P, T, KeyT, ValT)                                         \
+    typedef struct P##_node P##_node;                                         \
+    typedef struct {                                                          \
+        P##_node *root;                                                       \
+        Arena    *arena;                                                      \
+        size_t    nkeys;                                                      \
+        int       height;                                                     \
+    } P;                                                                      \
+    P*     P##_create(void);                                                  \
+    void   P##_free(P *tree);                                                 \
+    int    P##_insert(P *tree, KeyT k, ValT v);                               \
+    int    P##_find(const P *tree, KeyT k, ValT *out);                        \
+    size_t P##_count(const P *tree);                                          \
+    size_t P##_bytes(const P *tree);                                          \
+    int    P##_height(const P *tree);
+
+// Leaves split T / T-1 with the right half's first key copied up; inner
+// nodes split T-1 / T-1 around the median, which moves up. Inserts split
+// full nodes on the way down, so they never walk back up.
+#define BTF_DEFINE(P, T, KeyT, ValT, KEY_MAX)                                 \
+    struct P##_node {                                                         \
+        KeyT keys[2 * (T)];   /* [2T-1] is always KEY_MAX */                  \
+        int  n;                                                               \
+        int  leaf;                                                            \
+        union {                                                               \
+            ValT      vals[2 * (T) - 1];                                      \
+            P##_node *child[2 * (T)];                                         \
+        } u;                                                                  \
+    };                                                                        \
+                                                                              \
+    static P##_node* P##_new_node(P *tree, int leaf) {                        \
+        P##_node *x = (P##_node*)arena_alloc(tree->arena);                    \
+        for (int j = 0; j < 2 * (T); j++) x->keys[j] = (KEY_MAX);             \
+        x->n = 0;                                                             \
+        x->leaf = leaf;                                                       \
+        return x;                                                             \
+    }                                                                         \
+                                                                              \
+    /* First slot with keys[i] >= k. */                                       \
+    static inline int P##_lower(const P##_node *x, KeyT k) {                  \
+        int i = 0;                                                            \
+        if (BTF_BINARY(T, sizeof(KeyT))) {                                    \
+            /* Let the misses on the key lines overlap; the steps */         \
+            /* would otherwise take them one at a time. */                    \
+            for (size_t off = 0; off < sizeof(x->keys); off += 64)            \
+                __builtin_prefetch((const char*)x->keys + off);               \
+            for (int step = (T); step > 0; step >>= 1)                        \
+                i += x->keys[i + step - 1] < k ? step : 0;                    \
+        } else {                                                              \
+            for (int j = 0; j < 2 * (T); j++) i += x->keys[j] < k;            \
+        }                                                                     \
+        return i;                                                             \
+    }                                                                         \
+                                                                              \
+    /* Child holding k: the number of separators <= k. */                     \
+    static inline int P##_route(const P##_node *x, KeyT k) {                  \
+        int i = P##_lower(x, k);                                              \
+        return i + (i < x->n && x->keys[i] == k);                             \
+    }                                                                         \
+                                                                              \
+    /* Split x's full child i. */                                             \
+    static void P##_split(P *tree, P##_node *x, int i) {                      \
+        P##_node *y = x->u.child[i];                                          \
+        P##_node *z = P##_new_node(tree, y->leaf);                            \
+        KeyT sep;                                                             \
+        z->n = (T) - 1;                                                       \
+        memcpy(z->keys, y->keys + (T), sizeof(KeyT) * ((T) - 1));             \
+        if (y->leaf) {                                                        \
+            memcpy(z->u.vals, y->u.vals + (T), sizeof(ValT) * ((T) - 1));     \
+            y->n = (T);                                                       \
+            sep = z->keys[0];                                                 \
+        } else {                                                              \
+            memcpy(z->u.child, y->u.child + (T), sizeof(P##_node*) * (T));    \
+            y->n = (T) - 1;                                                   \
+            sep = y->keys[(T) - 1];                                           \
+        }                                                                     \
+        for (int j = y->n; j < 2 * (T) - 1; j++) y->keys[j] = (KEY_MAX);      \
+        memmove(x->keys + i + 1, x->keys + i, sizeof(KeyT) * (size_t)(x->n - i)); \
+        memmove(x->u.child + i + 2, x->u.child + i + 1,                       \
+                sizeof(P##_node*) * (size_t)(x->n - i));                      \
+        x->keys[i] = sep;                                                     \
+        x->u.child[i + 1] = z;                                                \
+        x->n++;                                                               \
+    }                                                                         \
+                                                                              \
+    P* P##_create(void) {                                                     \
+        P *tree = (P*)malloc(sizeof(P));                                      \
+        tree->arena  = arena_create(sizeof(P##_node));                        \
+        tree->nkeys  = 0;                                                     \
+        tree->height = 1;                                                     \
+        tree->root   = P##_new_node(tree, 1);                                 \
+        return tree;                                                          \
+    }                                                                         \
+                                                                              \
+    void P##_free(P *tree) {                                                  \
+        if (!tree) return;                                                    \
+        arena_free(tree->arena);                                              \
+        free(tree);                                                           \
+    }                                                                         \
+                                                                              \
+    int P##_insert(P *tree, KeyT k, ValT v) {                                 \
+        if (tree->root->n == 2 * (T) - 1) {                                   \
+            P##_node *s = P##_new_node(tree, 0);                              \
+            s->u.child[0] = tree->root;                                       \
+            P##_split(tree, s, 0);                                            \
+            tree->root = s;                                                   \
+            tree->height++;                                                   \
+        }                                                                     \
+        P##_node *x = tree->root;                                             \
+        while (!x->leaf) {                                                    \
+            int i = P##_route(x, k);                                          \
+            if (x->u.child[i]->n == 2 * (T) - 1) {                            \
+                P##_split(tree, x, i);                                        \
+                if (k >= x->keys[i]) i++;                                     \
+            }                                                                 \
+            x = x->u.child[i];                                                \
+        }                                                                     \
+        int i = P##_lower(x, k);                                              \
+        if (i < x->n && x->keys[i] == k) {                                    \
+            x->u.vals[i] = v;                                                 \
+            return 0;                                                         \
+        }                                                                     \
+        memmove(x->keys + i + 1, x->keys + i, sizeof(KeyT) * (size_t)(x->n - i)); \
+        memmove(x->u.vals + i + 1, x->u.vals + i, sizeof(ValT) * (size_t)(x->n - i)); \
+        x->keys[i] = k;                                                       \
+        x->u.vals[i] = v;                                                     \
+        x->n++;                                                               \
+        tree->nkeys++;                                                        \
+        return 1;                                                             \
+    }                                                                         \
+                                                                              \
+    int P##_find(const P *tree, KeyT k, ValT *out) {                          \
+        const P##_node *x = tree->root;                                       \
+        while (!x->leaf) x = x->u.child[P##_route(x, k)];                     \
+        int i = P##_lower(x, k);                                              \
+        if (i < x->n && x->keys[i] == k) {                                    \
+            *out = x->u.vals[i];                                              \
+            return 1;                                                         \
+        }                                                                     \
+        return 0;                                                             \
+    }                                                                         \
+                                                                              \
+    size_t P##_count(const P *tree) { return tree->nkeys; }                   \
+    size_t P##_bytes(const P *tree) { return arena_live(tree->arena) * sizeof(P##_node); } \
+    int    P##_height(const P *tree) { return tree->height; }
+
+#endif // BTFIXED_H
@@ -1,203 +1,2144 @@
 // btree.c
+#define _DEFAULT_SOURCE   // mmap() / fstat() for bt_open_mmap
 #include "btree.h"
+#include "keysearch.h"
+#include "leafpack.h"
+#include "segindex.h"
+#include "arena.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <assert.h>
+#include <sched.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Node layout: one contiguous, 64-byte-aligned block per node.
+//
+//   [ header | keys[2t-1] | children[2t] (internal only) | values[2t-1] ]
+//
+// Keys come first so the key scan starts in the same cache line as the
+// header, and leaves do not reserve space for child pointers at all.
+// The degree t is fixed at bt_create() time, so every offset below is a
+// function of t and the leaf flag only. In B+tree mode internal nodes
+// hold separators only and have no values array.
+#define BT_NODE_ALIGN 64
 
 struct BTreeNode {
+    uint64_t  version; // concurrent mode: odd while a writer modifies the node
     int       nkeys;
-    BTKey    *keys;
-    BTPayload *values;
-    BTreeNode **children;
     int       leaf;
+    BTreeNode *next;   // B+tree mode: right sibling leaf (NULL at the end)
+    BTKey     keys[];
 };
 
-static BTreeNode* bt_new_node(int t, int leaf) {
-    BTreeNode *node = (BTreeNode*)malloc(sizeof(BTreeNode));
+static inline BTreeNode** bt_children(BTreeNode *node, int t) {
+    return (BTreeNode**)(node->keys + (2*t - 1));
+}
+
+static inline BTPayload* bt_values(BTreeNode *node, int t) {
+    BTPayload *base = (BTPayload*)(node->keys + (2*t - 1));
+    return node->leaf ? base : base + 2*t;
+}
+
+// Child and sibling links hold addresses in a tree built in memory and
+// file offsets in a mapped one (bt_open_mmap). map_base is NULL for the
+// former, so one add resolves both on the read paths. Offset 0 is the
+// file header, so a zero sibling link means "none" either way.
+#define BT_BASE(tree) ((uintptr_t)(tree)->map_base)
+
+static inline BTreeNode* bt_link(uintptr_t base, BTreeNode *link) {
+    return (BTreeNode*)(base + (uintptr_t)link);
+}
+
+static inline BTreeNode* bt_next_leaf(uintptr_t base, const BTreeNode *leaf) {
+    return leaf->next ? bt_link(base, leaf->next) : NULL;
+}
+
+static size_t bt_node_bytes(int t, int leaf, int with_values) {
+    size_t bytes = sizeof(BTreeNode) + sizeof(BTKey) * (size_t)(2*t - 1);
+    if (with_values) bytes += sizeof(BTPayload) * (size_t)(2*t - 1);
+    if (!leaf) bytes += sizeof(BTreeNode*) * (size_t)(2*t);
+    return (bytes + BT_NODE_ALIGN - 1) & ~(size_t)(BT_NODE_ALIGN - 1);
+}
+
+// Leaf access for both leaf formats. A packed leaf's keys[] area holds a
+// leafpack.h block of pack_room bytes instead of the two arrays.
+static inline int bt_leaf_lower(int packed, BTreeNode *leaf, int n, BTKey k) {
+    return packed ? lp_lower_bound(leaf->keys, n, k)
+                  : ks_lower_bound(leaf->keys, n, k);
+}
+
+static inline BTKey bt_leaf_key(int packed, BTreeNode *leaf, int i) {
+    return packed ? lp_key(leaf->keys, i) : leaf->keys[i];
+}
+
+static inline BTPayload bt_leaf_val(int packed, BTreeNode *leaf, int t, int n, int i) {
+    return packed ? lp_val(leaf->keys, n, i) : bt_values(leaf, t)[i];
+}
+
+// --- Concurrent mode -------------------------------------------------
+//
+// Writers are serialized by tree->write_lock. Before a writer changes a
+// node it marks it (version becomes odd) and remembers it; when the
+// operation is complete every marked node is unmarked (version becomes
+// even again, one step later). Readers take no locks: they note a node's
+// version before reading it, wait while it is odd, and re-check it
+// afterwards and before following a child pointer read from it. Any
+// mismatch restarts the lookup from the root. Nodes are never returned
+// to the system while the tree lives (see arena.h), and a node's version
+// survives reuse, so a reader holding a stale pointer fails validation
+// instead of reading freed memory.
+//
+// With concurrent mode off, marking is a no-op and lookups use the plain
+// descent below.
+
+#define BT_MAX_MARKED (4 * BT_MAX_HEIGHT + 8)
+
+static inline void bt_wmark(BTree *tree, BTreeNode *node) {
+    if (!tree->concurrent || (node->version & 1)) return;
+    assert(tree->nmarked < BT_MAX_MARKED);
+    __atomic_store_n(&node->version, node->version + 1, __ATOMIC_RELAXED);
+    // Order the mark before the writes to the node it protects.
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    tree->marked[tree->nmarked++] = node;
+}
+
+static void bt_dir_build(BTree *tree);
+static void bt_dir_refresh(BTree *tree);
+
+static void bt_write_begin(BTree *tree) {
+    if (tree->concurrent) pthread_mutex_lock(&tree->write_lock);
+}
+
+// Bumping writes last, with release order, means a lookup that read the
+// old count before it started cannot have seen any of this write.
+static void bt_write_end(BTree *tree) {
+    bt_dir_refresh(tree);
+    __atomic_store_n(&tree->writes, tree->writes + 1, __ATOMIC_RELEASE);
+    if (!tree->concurrent) return;
+    for (int j = 0; j < tree->nmarked; j++) {
+        BTreeNode *node = tree->marked[j];
+        __atomic_store_n(&node->version, node->version + 1, __ATOMIC_RELEASE);
+    }
+    tree->nmarked = 0;
+    pthread_mutex_unlock(&tree->write_lock);
+}
+
+static inline void bt_set_root(BTree *tree, BTreeNode *node) {
+    __atomic_store_n(&tree->root, node, __ATOMIC_RELEASE);
+}
+
+static inline void bt_add_nkeys(BTree *tree, long d) {
+    __atomic_store_n(&tree->nkeys, tree->nkeys + (size_t)d, __ATOMIC_RELAXED);
+}
+
+static inline void bt_cpu_relax(unsigned *spins) {
+    if (++*spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();   // the writer may be descheduled; let it finish
+    }
+}
+
+// Version of node once no writer holds it.
+static inline uint64_t bt_read_begin(const BTreeNode *node) {
+    unsigned spins = 0;
+    uint64_t v;
+    while ((v = __atomic_load_n(&node->version, __ATOMIC_ACQUIRE)) & 1)
+        bt_cpu_relax(&spins);
+    return v;
+}
+
+// 1 if nothing read from node since bt_read_begin() returned v can have
+// been changed by a writer.
+static inline int bt_read_valid(const BTreeNode *node, uint64_t v) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&node->version, __ATOMIC_RELAXED) == v;
+}
+
+// A mapped tree has no writers, so plain lookups are already safe.
+void bt_set_concurrent(BTree *tree) {
+    if (tree->concurrent || tree->map_base) return;
+    pthread_mutex_init(&tree->write_lock, NULL);
+    tree->marked = (BTreeNode**)malloc(sizeof(BTreeNode*) * BT_MAX_MARKED);
+    tree->nmarked = 0;
+    tree->concurrent = 1;
+}
+
+void bt_lock_writers(BTree *tree) {
+    if (tree->concurrent) pthread_mutex_lock(&tree->write_lock);
+}
+
+void bt_unlock_writers(BTree *tree) {
+    if (tree->concurrent) pthread_mutex_unlock(&tree->write_lock);
+}
+
+void bt_set_placement(BTree *tree, NMPolicy p) {
+    if (!tree || tree->map_base) return;
+    bt_lock_writers(tree);   // writers allocate from the arenas
+    arena_set_policy(tree->leaf_arena, p);
+    arena_set_policy(tree->inner_arena, p);
+    bt_unlock_writers(tree);
+}
+
+// --- Learned leaf directory ------------------------------------------
+//
+// B+tree layouts only. Entry j holds a leaf and the lower end of the key
+// range the tree routes to it (its fence: the separator on its left, or
+// INT64_MIN for the first leaf), and the segindex.h model over the fences
+// finds the entry for a key. Only leaf splits, merges and borrows move a
+// fence; each marks the entries of the leaves it changes, before it
+// changes them, and a marked entry sends lookups through the descent. An
+// unmarked entry therefore still routes exactly as the tree does.
+//
+// In concurrent mode a reader notes the leaf's version, then checks the
+// mark: the writer that marks an entry also marks its leaf, and unmarks
+// the leaf last, so a reader that saw the leaf after that write sees the
+// entry's mark too. A replaced directory is marked dead as a whole, for
+// readers that loaded it before the swap.
+
+typedef struct BTDir {
+    SegIndex      *si;        // over fences[0, n)
+    BTreeNode    **leaves;
+    uint8_t       *stale;
+    size_t         n;
+    size_t         nstale;
+    size_t         changes;   // leaf range changes since the build
+    int            dead;      // replaced: later writes no longer mark it
+    struct BTDir  *retired;   // next on tree->dir_retired
+} BTDir;
+
+static void bt_dir_free(BTDir *d) {
+    if (!d) return;
+    si_free(d->si);
+    free(d->leaves);
+    free(d->stale);
+    free(d);
+}
+
+// Replace the directory. The old one may still be in use by lock-free
+// readers, so in concurrent mode it is only freed with the tree.
+static void bt_dir_install(BTree *tree, BTDir *d) {
+    BTDir *old = tree->dir;
+    __atomic_store_n(&tree->dir, d, __ATOMIC_RELEASE);
+    if (!old) return;
+    if (tree->concurrent) {
+        __atomic_store_n(&old->dead, 1, __ATOMIC_RELAXED);
+        old->retired = tree->dir_retired;
+        tree->dir_retired = old;
+    } else {
+        bt_dir_free(old);
+    }
+}
+
+static void bt_dir_fill(BTree *tree, BTreeNode *node, BTKey lo, BTKey *fences,
+                        BTreeNode **leaves, size_t *n) {
+    if (node->leaf) {
+        // A leaf whose range is empty (equal fences) routes nothing.
+        if (*n > 0 && fences[*n - 1] == lo) (*n)--;
+        fences[*n] = lo;
+        leaves[(*n)++] = node;
+        return;
+    }
+    BTreeNode **c = bt_children(node, tree->t);
+    for (int i = 0; i <= node->nkeys; i++)
+        bt_dir_fill(tree, bt_link(BT_BASE(tree), c[i]), i > 0 ? node->keys[i-1] : lo,
+                    fences, leaves, n);
+}
+
+// Rebuild from the current tree (writers excluded), or drop the
+// directory if it is turned off or the tree is empty.
+static void bt_dir_build(BTree *tree) {
+    if (tree->learn_eps <= 0 || tree->nkeys == 0) {
+        bt_dir_install(tree, NULL);
+        return;
+    }
+    size_t nleaves = 0;
+    BTreeNode *leaf = tree->root;
+    while (!leaf->leaf) leaf = bt_link(BT_BASE(tree), bt_children(leaf, tree->t)[0]);
+    for (; leaf; leaf = bt_next_leaf(BT_BASE(tree), leaf)) nleaves++;
+
+    BTDir *d = (BTDir*)malloc(sizeof(BTDir));
+    BTKey *fences = (BTKey*)malloc(sizeof(BTKey) * nleaves);
+    d->leaves = (BTreeNode**)malloc(sizeof(BTreeNode*) * nleaves);
+    d->n = 0;
+    bt_dir_fill(tree, tree->root, INT64_MIN, fences, d->leaves, &d->n);
+    d->si = si_build(fences, d->n, tree->learn_eps);
+    d->stale = (uint8_t*)calloc(d->n, 1);
+    d->nstale = 0;
+    d->changes = 0;
+    d->dead = 0;
+    d->retired = NULL;
+    free(fences);
+    tree->dir_builds++;
+    bt_dir_install(tree, d);
+}
+
+// At the end of a write: build the first directory once the tree has
+// keys, and rebuild after leaf changes amounting to a quarter of the
+// entries. Leaves that are new since the build count too, so a tree that
+// grows by splits gets rebuilt each time it is about a quarter larger.
+static void bt_dir_refresh(BTree *tree) {
+    BTDir *d = tree->dir;
+    if (d ? d->changes * 4 > d->n : tree->learn_eps > 0 && tree->nkeys > 0)
+        bt_dir_build(tree);
+}
+
+// Leaf child i of x is about to change its key range: mark its entry. A
+// key inside the child's range locates the entry, and if that entry is
+// still unmarked it is the child's.
+static void bt_dir_stale(BTree *tree, BTreeNode *x, int i) {
+    BTDir *d = tree->dir;
+    if (!d) return;
+    d->changes++;
+    size_t lo = 0, hi = d->n;   // x is a new root: its only child is every leaf
+    if (x->nkeys > 0) {
+        BTKey probe = i > 0 ? x->keys[i-1]
+                    : x->keys[0] > INT64_MIN ? x->keys[0] - 1 : x->keys[0];
+        lo = si_find(d->si, probe);
+        hi = lo + 1;
+    }
+    for (size_t j = lo; j < hi; j++) {
+        if (d->stale[j]) continue;
+        __atomic_store_n(&d->stale[j], 1, __ATOMIC_RELAXED);
+        d->nstale++;
+    }
+}
+
+// Leaf for k from the directory, or NULL if its entry is marked.
+static inline BTreeNode* bt_dir_leaf(const BTDir *d, BTKey k) {
+    size_t j = si_find(d->si, k);
+    return d->stale[j] ? NULL : d->leaves[j];
+}
+
+int bt_set_learned(BTree *tree, int eps) {
+    if (!tree || !tree->bplus) return -1;
+    if (tree->map_base) {   // no writers to exclude
+        tree->learn_eps = eps > 0 ? eps : 0;
+        bt_dir_build(tree);
+        return 0;
+    }
+    bt_write_begin(tree);
+    tree->learn_eps = eps > 0 ? eps : 0;
+    bt_dir_build(tree);
+    bt_write_end(tree);
+    return 0;
+}
+
+void bt_learned_stats(BTree *tree, BTLearnedStats *out) {
+    memset(out, 0, sizeof(*out));
+    if (!tree) return;
+    bt_lock_writers(tree);
+    BTDir *d = tree->dir;
+    if (d) {
+        out->leaves   = d->n;
+        out->segments = si_segments(d->si);
+        out->stale    = d->nstale;
+        out->bytes    = sizeof(BTDir) + si_bytes(d->si)
+                      + d->n * (sizeof(BTreeNode*) + 1);
+    }
+    out->builds = tree->dir_builds;
+    bt_unlock_writers(tree);
+}
+
+// Optimistic lookup through the directory: 1 or 0 (k found, *out set),
+// or -1 if k's entry is marked and the caller must descend.
+static int bt_search_dir_olc(BTree *tree, const BTDir *d, BTKey k, BTStats *stats,
+                             BTHint *hint, BTPayload *out) {
+    int t = tree->t;
+    size_t j = si_find(d->si, k);
+    BTreeNode *leaf = d->leaves[j];
+    for (;;) {
+        uint64_t v = bt_read_begin(leaf);
+        if (__atomic_load_n(&d->stale[j], __ATOMIC_RELAXED)
+            || __atomic_load_n(&d->dead, __ATOMIC_RELAXED)) return -1;
+        int n = leaf->nkeys, i, hit;
+        if (n < 0) n = 0;
+        if (tree->packed) {
+            if (n > tree->pack_cap) n = tree->pack_cap;
+            n = lp_clamp(leaf->keys, n, tree->pack_room);
+            i = lp_lower_bound(leaf->keys, n, k);
+            hit = i < n && lp_key(leaf->keys, i) == k;
+            *out = hit ? lp_val(leaf->keys, n, i) : NULL;
+        } else {
+            if (n > 2*t - 1) n = 2*t - 1;
+            i = ks_lower_bound(leaf->keys, n, k);
+            hit = i < n && leaf->keys[i] == k;
+            *out = hit ? bt_values(leaf, t)[i] : NULL;
+        }
+        if (!bt_read_valid(leaf, v)) continue;
+        if (stats) stats->node_visits++;
+        if (hint) {
+            hint->leaf = (hit || tree->packed) ? NULL : leaf;
+            hint->pos  = i;
+        }
+        return hit;
+    }
+}
+
+// Optimistic lookup (both layouts). A node's key count can be torn while
+// a writer is active, so it is clamped before use; the value is then
+// discarded by validation.
+static int bt_find_olc(BTree *tree, BTKey k, BTStats *stats, BTHint *hint,
+                       BTPayload *out) {
+    int t = tree->t;
+    long visits = 0;
+    const BTDir *d = __atomic_load_n(&tree->dir, __ATOMIC_ACQUIRE);
+restart:
+    if (hint) hint->writes = __atomic_load_n(&tree->writes, __ATOMIC_ACQUIRE);
+    if (d) {
+        int hit = bt_search_dir_olc(tree, d, k, stats, hint, out);
+        if (hit >= 0) return hit;
+        d = NULL;   // marked: descend from here on
+    }
+    for (;;) {
+        BTreeNode *node = __atomic_load_n(&tree->root, __ATOMIC_ACQUIRE);
+        uint64_t v = bt_read_begin(node);
+        if (__atomic_load_n(&tree->root, __ATOMIC_ACQUIRE) != node)
+            continue;
+        for (;;) {
+            visits++;
+            int n = node->nkeys;
+            if (n < 0) n = 0;
+            if (tree->packed && node->leaf) {
+                if (n > tree->pack_cap) n = tree->pack_cap;
+                n = lp_clamp(node->keys, n, tree->pack_room);
+                int i = lp_lower_bound(node->keys, n, k);
+                int hit = i < n && lp_key(node->keys, i) == k;
+                *out = hit ? lp_val(node->keys, n, i) : NULL;
+                if (!bt_read_valid(node, v)) goto restart;
+                if (stats) stats->node_visits += visits;
+                if (hint) hint->leaf = NULL;   // packed leaves take no hints
+                return hit;
+            }
+            if (n > 2*t - 1) n = 2*t - 1;
+            int i = ks_lower_bound(node->keys, n, k);
+            int hit = (i < n && node->keys[i] == k);
+            if (tree->bplus && !node->leaf) {
+                i += hit;
+                hit = 0;
+            }
+            if (hit || node->leaf) {
+                *out = hit ? bt_values(node, t)[i] : NULL;
+                if (!bt_read_valid(node, v)) goto restart;
+                if (stats) stats->node_visits += visits;
+                if (hint) {
+                    hint->leaf = hit ? NULL : node;
+                    hint->pos  = i;
+                }
+                return hit;
+            }
+            BTreeNode *child = bt_children(node, t)[i];
+            if (!bt_read_valid(node, v)) goto restart;
+            uint64_t cv = bt_read_begin(child);
+            // The child pointer was current when read; make sure the
+            // parent did not change before we pinned the child's version.
+            if (!bt_read_valid(node, v)) goto restart;
+            node = child;
+            v = cv;
+        }
+    }
+}
+
+// Nodes come from the tree's two arenas (one per node size: leaves and
+// internal nodes), never from malloc directly.
+static BTreeNode* bt_alloc_node(BTree *tree, int leaf) {
+    int t = tree->t;
+    BTreeNode *node = (BTreeNode*)arena_alloc(leaf ? tree->leaf_arena
+                                                   : tree->inner_arena);
+    // The version survives release and reuse (the arena keeps its free
+    // list link elsewhere), so stale optimistic readers of a recycled
+    // node always see it change. Only a never-used slot needs a clean one.
+    // A new node that becomes reachable mid-operation (split, new root)
+    // is marked by the caller before it is linked in.
+    node->version &= ~(uint64_t)1;
     node->nkeys = 0;
     node->leaf = leaf;
-    node->keys = (BTKey*)malloc(sizeof(BTKey) * (2*t - 1));
-    node->values = (BTPayload*)malloc(sizeof(BTPayload) * (2*t - 1));
-    node->children = (BTreeNode**)malloc(sizeof(BTreeNode*) * (2*t));
-    for (int i = 0; i < 2*t; i++) node->children[i] = NULL;
+    node->next = NULL;
+    if (!leaf) {
+        BTreeNode **children = bt_children(node, t);
+        for (int i = 0; i < 2*t; i++) children[i] = NULL;
+    }
     return node;
 }
 
-static void bt_free_node(BTreeNode *node, int t) {
-    if (!node) return;
-    if (!node->leaf) {
-        for (int i = 0; i <= node->nkeys; i++)
-            bt_free_node(node->children[i], t);
-    }
-    free(node->keys);
-    free(node->values);
-    free(node->children);
-    free(node);
+static inline BTreeNode* bt_new_node(BTree *tree, int leaf) {
+    return bt_alloc_node(tree, leaf);
 }
 
-BTree* bt_create(int t) {
+// B+tree mode: values only in leaves (the inner arena's node size
+// already leaves them out).
+static inline BTreeNode* bp_new_node(BTree *tree, int leaf) {
+    return bt_alloc_node(tree, leaf);
+}
+
+// Return a node emptied by a merge or root shrink to its arena.
+static void bt_release_node(BTree *tree, BTreeNode *node) {
+    arena_release(node->leaf ? tree->leaf_arena : tree->inner_arena, node);
+}
+
+static BTree* bt_create_mode(int t, int bplus) {
     BTree *tree = (BTree*)malloc(sizeof(BTree));
     tree->t = t;
-    tree->root = bt_new_node(t, 1);
+    tree->nkeys = 0;
+    tree->bplus = bplus;
+    tree->packed = 0;
+    tree->pack_cap = 0;
+    tree->pack_room = 0;
+    tree->pack_keys = NULL;
+    tree->pack_vals = NULL;
+    tree->concurrent = 0;
+    tree->marked = NULL;
+    tree->nmarked = 0;
+    tree->writes = 0;
+    tree->map_base = NULL;
+    tree->map_len = 0;
+    tree->dir = NULL;
+    tree->dir_retired = NULL;
+    tree->learn_eps = 0;
+    tree->dir_builds = 0;
+    tree->leaf_arena  = arena_create(bt_node_bytes(t, 1, 1));
+    tree->inner_arena = arena_create(bt_node_bytes(t, 0, !bplus));
+    tree->root = bt_new_node(tree, 1);
     return tree;
 }
 
+BTree* bt_create(int t) {
+    return bt_create_mode(t, 0);
+}
+
+BTree* bt_create_bplus(int t) {
+    return bt_create_mode(t, 1);
+}
+
+// A leaf's block may use every byte after the header; at one byte per
+// entry (1-byte keys, equal payloads) that bounds the entry count.
+static void bt_init_packed(BTree *tree, int writable) {
+    tree->packed = 1;
+    tree->pack_room = bt_node_bytes(tree->t, 1, 1) - sizeof(BTreeNode);
+    tree->pack_cap = (int)(tree->pack_room - LP_HDR);
+    if (writable) {
+        size_t n = 2 * ((size_t)tree->pack_cap + 1);
+        tree->pack_keys = (BTKey*)malloc(sizeof(BTKey) * n);
+        tree->pack_vals = (BTPayload*)malloc(sizeof(BTPayload) * n);
+    }
+}
+
+BTree* bt_create_packed(int t) {
+    BTree *tree = bt_create_mode(t, 1);
+    bt_init_packed(tree, 1);
+    return tree;
+}
+
+// B+tree routing: child i holds keys in [sep[i-1], sep[i]), so descend
+// into the number of separators <= k.
+static inline int bp_child_index(const BTreeNode *node, BTKey k) {
+    int i = ks_lower_bound(node->keys, node->nkeys, k);
+    return i + (i < node->nkeys && node->keys[i] == k);
+}
+
+static BTreeNode* bp_find_leaf(BTree *tree, BTKey k, BTStats *stats) {
+    BTreeNode *node = tree->root;
+    while (!node->leaf) {
+        if (stats) stats->node_visits++;
+        node = bt_link(BT_BASE(tree), bt_children(node, tree->t)[bp_child_index(node, k)]);
+    }
+    if (stats) stats->node_visits++;
+    return node;
+}
+
+// Every node lives in one of the two arenas, so teardown is one free()
+// per chunk instead of a walk over the whole tree.
 void bt_free(BTree *tree) {
     if (!tree) return;
-    bt_free_node(tree->root, tree->t);
+    if (tree->map_base) munmap(tree->map_base, tree->map_len);
+    arena_free(tree->leaf_arena);
+    arena_free(tree->inner_arena);
+    free(tree->pack_keys);
+    free(tree->pack_vals);
+    bt_dir_free(tree->dir);
+    while (tree->dir_retired) {
+        BTDir *d = tree->dir_retired;
+        tree->dir_retired = d->retired;
+        bt_dir_free(d);
+    }
+    if (tree->concurrent) {
+        pthread_mutex_destroy(&tree->write_lock);
+        free(tree->marked);
+    }
     free(tree);
 }
 
-static BTPayload bt_search_node(BTreeNode *node, BTKey k, BTStats *stats, int t) {
-    if (stats) stats->node_visits++;
+// Shared by bt_find, bt_search and bt_search_hint; inlined, so the hint
+// bookkeeping disappears from the others.
+static inline int bt_find_at(BTree *tree, BTKey k, BTStats *stats,
+                             BTHint *hint, BTPayload *out) {
+    if (hint) hint->leaf = NULL;
+    *out = NULL;
+    if (!tree || !tree->root) return 0;
+    if (tree->concurrent) return bt_find_olc(tree, k, stats, hint, out);
+    int t = tree->t;
+    if (hint) hint->writes = tree->writes;
+    if (tree->bplus) {
+        BTreeNode *leaf = tree->dir ? bt_dir_leaf(tree->dir, k) : NULL;
+        if (leaf) {
+            if (stats) stats->node_visits++;
+        } else {
+            leaf = bp_find_leaf(tree, k, stats);
+        }
+        int pk = tree->packed, n = leaf->nkeys;
+        int i = bt_leaf_lower(pk, leaf, n, k);
+        if (i < n && bt_leaf_key(pk, leaf, i) == k) {
+            *out = bt_leaf_val(pk, leaf, t, n, i);
+            return 1;
+        }
+        if (hint && !tree->map_base && !pk) {
+            hint->leaf = leaf;
+            hint->pos  = i;
+        }
+        return 0;
+    }
+    BTreeNode *node = tree->root;
+    for (;;) {
+        if (stats) stats->node_visits++;
 
-    int i = 0;
-    while (i < node->nkeys && k > node->keys[i]) i++;
+        int i = ks_lower_bound(node->keys, node->nkeys, k);
 
-    if (i < node->nkeys && k == node->keys[i]) {
-        return node->values[i];
-    }
+        if (i < node->nkeys && k == node->keys[i]) {
+            *out = bt_values(node, t)[i];
+            return 1;
+        }
 
-    if (node->leaf) {
-        return NULL;
-    } else {
-        return bt_search_node(node->children[i], k, stats, t);
+        if (node->leaf) {
+            if (hint && !tree->map_base) {
+                hint->leaf = node;
+                hint->pos  = i;
+            }
+            return 0;
+        }
+        node = bt_link(BT_BASE(tree), bt_children(node, t)[i]);
     }
 }
 
+int bt_find(BTree *tree, BTKey k, BTPayload *out, BTStats *stats) {
+    BTPayload v;
+    int hit = bt_find_at(tree, k, stats, NULL, &v);
+    if (out) *out = v;
+    return hit;
+}
+
 BTPayload bt_search(BTree *tree, BTKey k, BTStats *stats) {
-    if (!tree || !tree->root) return NULL;
-    return bt_search_node(tree->root, k, stats, tree->t);
+    BTPayload v;
+    bt_find_at(tree, k, stats, NULL, &v);
+    return v;
+}
+
+BTPayload bt_search_hint(BTree *tree, BTKey k, BTStats *stats, BTHint *hint) {
+    BTPayload v;
+    bt_find_at(tree, k, stats, hint, &v);
+    return v;
+}
+
+// Prefetch the header and key area of a node we are about to search.
+static inline void bt_prefetch_keys(const BTreeNode *node, int t) {
+    const char *p = (const char*)node;
+    size_t bytes = sizeof(BTreeNode) + sizeof(BTKey) * (size_t)(2*t - 1);
+    for (size_t off = 0; off < bytes; off += BT_NODE_ALIGN)
+        __builtin_prefetch(p + off);
+}
+
+// Batched lookup. Keys are processed in groups of BT_BATCH_GROUP that
+// descend one level at a time in lock step: each pass visits the current
+// node of every still-active lookup and prefetches its next child, so the
+// misses of independent lookups overlap instead of serializing.
+#define BT_BATCH_GROUP 16
+
+void bt_search_batch(BTree *tree, const BTKey *keys, size_t n,
+                     BTPayload *out, BTStats *stats) {
+    if (!tree || !tree->root) {
+        for (size_t j = 0; j < n; j++) out[j] = NULL;
+        return;
+    }
+    if (tree->concurrent) {
+        // Interleaved descents cannot restart one lane from the root
+        // cheaply; fall back to one optimistic lookup per key.
+        for (size_t j = 0; j < n; j++) bt_find_olc(tree, keys[j], stats, NULL, &out[j]);
+        return;
+    }
+    int t = tree->t;
+    long visits = 0;
+
+    for (size_t base = 0; base < n; base += BT_BATCH_GROUP) {
+        size_t m = n - base;
+        if (m > BT_BATCH_GROUP) m = BT_BATCH_GROUP;
+
+        BTreeNode *cur[BT_BATCH_GROUP];
+        int lane[BT_BATCH_GROUP];   // indices of lookups still descending
+        int active = (int)m;
+        for (int j = 0; j < active; j++) {
+            BTreeNode *leaf = tree->dir ? bt_dir_leaf(tree->dir, keys[base + j]) : NULL;
+            if (leaf) __builtin_prefetch(leaf);
+            cur[j] = leaf ? leaf : tree->root;
+            lane[j] = j;
+        }
+
+        while (active > 0) {
+            int still = 0;
+            for (int a = 0; a < active; a++) {
+                int j = lane[a];
+                BTreeNode *node = cur[j];
+                BTKey k = keys[base + j];
+                visits++;
+
+                if (tree->packed && node->leaf) {
+                    int n = node->nkeys;
+                    int i = lp_lower_bound(node->keys, n, k);
+                    out[base + j] = (i < n && lp_key(node->keys, i) == k)
+                                  ? lp_val(node->keys, n, i) : NULL;
+                    continue;
+                }
+                int i = ks_lower_bound(node->keys, node->nkeys, k);
+                int hit = (i < node->nkeys && k == node->keys[i]);
+                if (tree->bplus && !node->leaf) {
+                    i += hit;   // separators route equal keys right
+                    hit = 0;
+                }
+                if (hit) {
+                    out[base + j] = bt_values(node, t)[i];
+                } else if (node->leaf) {
+                    out[base + j] = NULL;
+                } else {
+                    BTreeNode *child = bt_link(BT_BASE(tree), bt_children(node, t)[i]);
+                    bt_prefetch_keys(child, t);
+                    cur[j] = child;
+                    lane[still++] = j;
+                }
+            }
+            active = still;
+        }
+    }
+
+    if (stats) stats->node_visits += visits;
 }
 
 // Split child y of node x at index i.
 static void bt_split_child(BTree *tree, BTreeNode *x, int i) {
     int t = tree->t;
-    BTreeNode *y = x->children[i];
-    BTreeNode *z = bt_new_node(t, y->leaf);
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *y = xc[i];
+    BTreeNode *z = bt_new_node(tree, y->leaf);
+    bt_wmark(tree, x);
+    bt_wmark(tree, y);
+    bt_wmark(tree, z);
+    BTPayload *xv = bt_values(x, t);
+    BTPayload *yv = bt_values(y, t);
+    BTPayload *zv = bt_values(z, t);
     z->nkeys = t - 1;
 
     // Copy upper half of y to z
-    for (int j = 0; j < t-1; j++) {
-        z->keys[j] = y->keys[j + t];
-        z->values[j] = y->values[j + t];
-    }
+    memcpy(z->keys, y->keys + t, sizeof(BTKey) * (size_t)(t - 1));
+    memcpy(zv, yv + t, sizeof(BTPayload) * (size_t)(t - 1));
 
     // Copy children
     if (!y->leaf) {
-        for (int j = 0; j < t; j++) {
-            z->children[j] = y->children[j + t];
-        }
+        memcpy(bt_children(z, t), bt_children(y, t) + t,
+               sizeof(BTreeNode*) * (size_t)t);
     }
 
     y->nkeys = t - 1;
 
     // Shift children of x
     for (int j = x->nkeys; j >= i+1; j--) {
-        x->children[j+1] = x->children[j];
+        xc[j+1] = xc[j];
     }
-    x->children[i+1] = z;
+    xc[i+1] = z;
 
     // Shift keys of x
     for (int j = x->nkeys - 1; j >= i; j--) {
         x->keys[j+1] = x->keys[j];
-        x->values[j+1] = x->values[j];
+        xv[j+1] = xv[j];
     }
 
     // Move middle key from y to x
     x->keys[i] = y->keys[t-1];
-    x->values[i] = y->values[t-1];
+    xv[i] = yv[t-1];
     x->nkeys++;
 }
 
-static void bt_insert_nonfull(BTree *tree, BTreeNode *x, BTKey k, BTPayload v) {
-    int i = x->nkeys - 1;
+// Put k at slot i of leaf x, which has room (both layouts).
+static void bt_leaf_insert_at(BTree *tree, BTreeNode *x, int i, BTKey k, BTPayload v) {
+    BTPayload *xv = bt_values(x, tree->t);
+    int tail = x->nkeys - i;
+    bt_wmark(tree, x);
+    memmove(x->keys + i + 1, x->keys + i, sizeof(BTKey) * (size_t)tail);
+    memmove(xv + i + 1, xv + i, sizeof(BTPayload) * (size_t)tail);
+    x->keys[i] = k;
+    xv[i] = v;
+    x->nkeys++;
+}
+
+// Returns 1 if k was added, 0 if an existing key was overwritten.
+static int bt_insert_nonfull(BTree *tree, BTreeNode *x, BTKey k, BTPayload v) {
+    int t = tree->t;
+    BTPayload *xv = bt_values(x, t);
+    int i = ks_lower_bound(x->keys, x->nkeys, k);
+
+    // Overwrite if equal (simple “update” semantics). Keys in internal
+    // nodes carry payloads too, so this applies at every level.
+    if (i < x->nkeys && x->keys[i] == k) {
+        bt_wmark(tree, x);
+        xv[i] = v;
+        return 0;
+    }
 
     if (x->leaf) {
-        // Find position to insert
-        while (i >= 0 && k < x->keys[i]) {
-            x->keys[i+1] = x->keys[i];
-            x->values[i+1] = x->values[i];
-            i--;
-        }
-        // Overwrite if equal (simple “update” semantics)
-        if (i >= 0 && x->keys[i] == k) {
-            x->values[i] = v;
-            return;
-        }
-        x->keys[i+1] = k;
-        x->values[i+1] = v;
-        x->nkeys++;
+        bt_leaf_insert_at(tree, x, i, k, v);
+        return 1;
     } else {
-        // Find child to descend
-        while (i >= 0 && k < x->keys[i]) i--;
-        i++;
-        if (x->children[i]->nkeys == 2*tree->t - 1) {
+        BTreeNode **xc = bt_children(x, t);
+        if (xc[i]->nkeys == 2*t - 1) {
             bt_split_child(tree, x, i);
+            if (k == x->keys[i]) {
+                xv[i] = v;
+                return 0;
+            }
             if (k > x->keys[i]) i++;
         }
-        bt_insert_nonfull(tree, x->children[i], k, v);
+        return bt_insert_nonfull(tree, xc[i], k, v);
     }
 }
 
-void bt_insert(BTree *tree, BTKey k, BTPayload v) {
+static int bp_insert(BTree *tree, BTKey k, BTPayload v);
+static int bp_insert_packed(BTree *tree, BTKey k, BTPayload v);
+static size_t bp_pack_merge(BTree *tree, BTreeNode *x, const BTKey *keys,
+                            const BTPayload *vals, size_t n,
+                            int has_fence, BTKey fence, size_t *added);
+
+// Top-down insert; the caller holds the write lock. Returns 1 if k was
+// added, 0 if an existing key was overwritten.
+static int bt_insert_locked(BTree *tree, BTKey k, BTPayload v) {
+    if (tree->packed)
+        return bp_insert_packed(tree, k, v);
+    if (tree->bplus)
+        return bp_insert(tree, k, v);
     BTreeNode *r = tree->root;
     int t = tree->t;
     if (r->nkeys == 2*t - 1) {
-        BTreeNode *s = bt_new_node(t, 0);
-        s->children[0] = r;
-        tree->root = s;
+        // s is marked before it is published, so readers that find it as
+        // the new root wait until the split below is complete.
+        BTreeNode *s = bt_new_node(tree, 0);
+        bt_wmark(tree, s);
+        bt_children(s, t)[0] = r;
+        bt_set_root(tree, s);
         bt_split_child(tree, s, 0);
-        bt_insert_nonfull(tree, s, k, v);
+        r = s;
+    }
+    if (!bt_insert_nonfull(tree, r, k, v))
+        return 0;
+    bt_add_nkeys(tree, 1);
+    return 1;
+}
+
+void bt_insert(BTree *tree, BTKey k, BTPayload v) {
+    if (tree->map_base) return;   // read-only mapping
+    bt_write_begin(tree);
+    bt_insert_locked(tree, k, v);
+    bt_write_end(tree);
+}
+
+// A lookup miss ends in the leaf k belongs to, at k's slot, for both
+// layouts. Splitting full nodes on the way down is only needed to make
+// room, so when that leaf still has room the key goes in directly and
+// the descent is skipped entirely.
+int bt_insert_hint(BTree *tree, BTKey k, BTPayload v, const BTHint *hint) {
+    if (tree->map_base) return 0;   // read-only mapping
+    bt_write_begin(tree);
+    int added;
+    BTreeNode *x = hint && !tree->packed ? hint->leaf : NULL;
+    if (x && hint->writes == tree->writes && x->nkeys < 2*tree->t - 1) {
+        bt_leaf_insert_at(tree, x, hint->pos, k, v);
+        bt_add_nkeys(tree, 1);
+        added = 1;
+    } else {
+        added = bt_insert_locked(tree, k, v);
+    }
+    bt_write_end(tree);
+    return added;
+}
+
+// --- Sorted batch insert ----------------------------------------------
+//
+// One descent serves a whole leaf group: it finds the leaf for the first
+// pending key and that leaf's upper fence (the separator above it on the
+// path), and every following key below the fence belongs to the same leaf.
+// As many of them as fit are merged into the leaf in one backward pass.
+// When the leaf is full, the next key goes through the top-down insert,
+// whose splits make room, and the rest of the group re-descends. Each
+// group is one write operation, which in concurrent mode bounds the nodes
+// a writer holds marked.
+
+// Descend to the leaf for k without changing the tree. Returns NULL if an
+// internal node holds k (B-tree layout); its payload is then replaced.
+static BTreeNode* bt_group_leaf(BTree *tree, BTKey k, BTPayload v,
+                                int *has_fence, BTKey *fence) {
+    int t = tree->t;
+    BTreeNode *x = tree->root;
+    *has_fence = 0;
+    while (!x->leaf) {
+        int i;
+        if (tree->bplus) {
+            i = bp_child_index(x, k);
+        } else {
+            i = ks_lower_bound(x->keys, x->nkeys, k);
+            if (i < x->nkeys && x->keys[i] == k) {
+                bt_wmark(tree, x);
+                bt_values(x, t)[i] = v;
+                return NULL;
+            }
+        }
+        if (i < x->nkeys) {
+            *has_fence = 1;
+            *fence = x->keys[i];
+        }
+        x = bt_children(x, t)[i];
+    }
+    return x;
+}
+
+// Merge the sorted keys[0, n) that fall below the fence (if any) into leaf
+// x. Keys already in x are overwritten; new ones are taken while x has
+// room. Returns how many keys were consumed; *added counts the new ones.
+static size_t bt_leaf_merge(BTree *tree, BTreeNode *x, const BTKey *keys,
+                            const BTPayload *vals, size_t n,
+                            int has_fence, BTKey fence, size_t *added) {
+    int t = tree->t;
+    BTPayload *xv = bt_values(x, t);
+    int room = 2*t - 1 - x->nkeys;
+    bt_wmark(tree, x);
+
+    // Forward pass: overwrite matches, count the new keys that fit.
+    size_t used = 0;
+    int fresh = 0, p = 0;
+    for (; used < n && (!has_fence || keys[used] < fence); used++) {
+        while (p < x->nkeys && x->keys[p] < keys[used]) p++;
+        if (p < x->nkeys && x->keys[p] == keys[used]) {
+            xv[p] = vals[used];
+        } else {
+            if (fresh == room) break;
+            fresh++;
+        }
+    }
+
+    // Backward pass: place the fresh keys, shifting x's keys right once.
+    int nfresh = fresh;
+    int dst = x->nkeys + fresh - 1, src = x->nkeys - 1;
+    for (size_t j = used; j-- > 0 && fresh > 0; ) {
+        while (src >= 0 && x->keys[src] > keys[j]) {
+            x->keys[dst] = x->keys[src];
+            xv[dst--] = xv[src--];
+        }
+        if (src >= 0 && x->keys[src] == keys[j]) {
+            x->keys[dst] = x->keys[src];      // overwritten above
+            xv[dst--] = xv[src--];
+            continue;
+        }
+        x->keys[dst] = keys[j];
+        xv[dst--] = vals[j];
+        fresh--;
+    }
+    x->nkeys += nfresh;
+    *added = (size_t)nfresh;
+    return used;
+}
+
+size_t bt_insert_sorted(BTree *tree, const BTKey *keys, const BTPayload *vals,
+                        size_t n) {
+    if (tree->map_base) return 0;   // read-only mapping
+    size_t added = 0, i = 0;
+    while (i < n) {
+        bt_write_begin(tree);
+        int has_fence;
+        BTKey fence = 0;
+        BTreeNode *x = bt_group_leaf(tree, keys[i], vals[i], &has_fence, &fence);
+        if (x == NULL) {
+            i++;
+        } else {
+            size_t got;
+            i += tree->packed
+                ? bp_pack_merge(tree, x, keys + i, vals + i, n - i, has_fence, fence, &got)
+                : bt_leaf_merge(tree, x, keys + i, vals + i, n - i, has_fence, fence, &got);
+            bt_add_nkeys(tree, (long)got);
+            added += got;
+            if (i < n && (!has_fence || keys[i] < fence)) {
+                // Leaf full: split on the way down for the next key.
+                added += (size_t)bt_insert_locked(tree, keys[i], vals[i]);
+                i++;
+            }
+        }
+        bt_write_end(tree);
+    }
+    return added;
+}
+
+// The payload is replaced in place: the key set, and so the node layout,
+// does not change, and only the node holding k is marked.
+int bt_update(BTree *tree, BTKey k, BTPayload v) {
+    if (!tree || !tree->root || tree->map_base) return 0;
+    bt_write_begin(tree);
+    int t = tree->t, found = 0;
+    if (tree->packed) {
+        // The new payload may not fit the leaf's lanes; the insert path
+        // re-encodes it and splits the leaf if need be.
+        BTreeNode *leaf = bp_find_leaf(tree, k, NULL);
+        int i = lp_lower_bound(leaf->keys, leaf->nkeys, k);
+        if (i < leaf->nkeys && lp_key(leaf->keys, i) == k) {
+            bp_insert_packed(tree, k, v);
+            found = 1;
+        }
+        bt_write_end(tree);
+        return found;
+    }
+    BTreeNode *node = tree->bplus ? bp_find_leaf(tree, k, NULL) : tree->root;
+    for (;;) {
+        int i = ks_lower_bound(node->keys, node->nkeys, k);
+        if (i < node->nkeys && node->keys[i] == k) {
+            bt_wmark(tree, node);
+            bt_values(node, t)[i] = v;
+            found = 1;
+            break;
+        }
+        if (node->leaf) break;
+        node = bt_children(node, t)[i];
+    }
+    bt_write_end(tree);
+    return found;
+}
+
+// --- Delete ----------------------------------------------------------
+//
+// Classic single-pass top-down delete (CLRS 18.3): before descending into
+// a child we make sure it holds at least t keys, borrowing from a sibling
+// or merging with one, so removing a key never underflows a node.
+
+static void bt_remove_at(BTreeNode *x, int i, int t) {
+    BTPayload *xv = bt_values(x, t);
+    int tail = x->nkeys - i - 1;
+    memmove(x->keys + i, x->keys + i + 1, sizeof(BTKey) * (size_t)tail);
+    memmove(xv + i, xv + i + 1, sizeof(BTPayload) * (size_t)tail);
+    x->nkeys--;
+}
+
+// Merge child i+1 and separator key i of x into child i; frees child i+1.
+static void bt_merge_children(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *y = xc[i];
+    BTreeNode *z = xc[i+1];
+    BTPayload *xv = bt_values(x, t);
+    BTPayload *yv = bt_values(y, t);
+    BTPayload *zv = bt_values(z, t);
+    int yn = y->nkeys;
+    bt_wmark(tree, x);
+    bt_wmark(tree, y);
+    bt_wmark(tree, z);
+
+    y->keys[yn] = x->keys[i];
+    yv[yn] = xv[i];
+    memcpy(y->keys + yn + 1, z->keys, sizeof(BTKey) * (size_t)z->nkeys);
+    memcpy(yv + yn + 1, zv, sizeof(BTPayload) * (size_t)z->nkeys);
+    if (!y->leaf) {
+        memcpy(bt_children(y, t) + yn + 1, bt_children(z, t),
+               sizeof(BTreeNode*) * (size_t)(z->nkeys + 1));
+    }
+    y->nkeys = yn + 1 + z->nkeys;
+
+    bt_remove_at(x, i, t);
+    memmove(xc + i + 1, xc + i + 2, sizeof(BTreeNode*) * (size_t)(x->nkeys - i));
+    bt_release_node(tree, z);
+}
+
+// Move one key from child i-1 through the separator into child i.
+static void bt_borrow_left(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *c = xc[i];
+    BTreeNode *l = xc[i-1];
+    BTPayload *xv = bt_values(x, t);
+    BTPayload *cv = bt_values(c, t);
+    BTPayload *lv = bt_values(l, t);
+    bt_wmark(tree, x);
+    bt_wmark(tree, c);
+    bt_wmark(tree, l);
+
+    memmove(c->keys + 1, c->keys, sizeof(BTKey) * (size_t)c->nkeys);
+    memmove(cv + 1, cv, sizeof(BTPayload) * (size_t)c->nkeys);
+    c->keys[0] = x->keys[i-1];
+    cv[0] = xv[i-1];
+    if (!c->leaf) {
+        BTreeNode **cc = bt_children(c, t);
+        memmove(cc + 1, cc, sizeof(BTreeNode*) * (size_t)(c->nkeys + 1));
+        cc[0] = bt_children(l, t)[l->nkeys];
+    }
+    c->nkeys++;
+
+    x->keys[i-1] = l->keys[l->nkeys - 1];
+    xv[i-1] = lv[l->nkeys - 1];
+    l->nkeys--;
+}
+
+// Move one key from child i+1 through the separator into child i.
+static void bt_borrow_right(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *c = xc[i];
+    BTreeNode *r = xc[i+1];
+    BTPayload *xv = bt_values(x, t);
+    BTPayload *cv = bt_values(c, t);
+    BTPayload *rv = bt_values(r, t);
+    bt_wmark(tree, x);
+    bt_wmark(tree, c);
+    bt_wmark(tree, r);
+
+    c->keys[c->nkeys] = x->keys[i];
+    cv[c->nkeys] = xv[i];
+    if (!c->leaf) {
+        BTreeNode **rc = bt_children(r, t);
+        bt_children(c, t)[c->nkeys + 1] = rc[0];
+        memmove(rc, rc + 1, sizeof(BTreeNode*) * (size_t)r->nkeys);
+    }
+    c->nkeys++;
+
+    x->keys[i] = r->keys[0];
+    xv[i] = rv[0];
+    bt_remove_at(r, 0, t);
+}
+
+// Ensure child i of x has at least t keys; returns the (possibly shifted)
+// index of the child that now covers the same key range.
+static int bt_fill_child(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    if (xc[i]->nkeys >= t) return i;
+    if (i > 0 && xc[i-1]->nkeys >= t) {
+        bt_borrow_left(tree, x, i);
+    } else if (i < x->nkeys && xc[i+1]->nkeys >= t) {
+        bt_borrow_right(tree, x, i);
+    } else if (i < x->nkeys) {
+        bt_merge_children(tree, x, i);
     } else {
-        bt_insert_nonfull(tree, r, k, v);
+        bt_merge_children(tree, x, i - 1);
+        i--;
     }
+    return i;
 }
 
-// Range search helper.
+static int bt_delete_node(BTree *tree, BTreeNode *x, BTKey k) {
+    int t = tree->t;
+    for (;;) {
+        int i = ks_lower_bound(x->keys, x->nkeys, k);
+        int here = (i < x->nkeys && x->keys[i] == k);
+
+        if (x->leaf) {
+            if (!here) return 0;
+            bt_wmark(tree, x);
+            bt_remove_at(x, i, t);
+            return 1;
+        }
+
+        BTreeNode **xc = bt_children(x, t);
+        BTPayload *xv = bt_values(x, t);
+        if (here) {
+            BTreeNode *y = xc[i];
+            BTreeNode *z = xc[i+1];
+            if (y->nkeys >= t) {
+                // Replace k by its predecessor, then delete that from y.
+                BTreeNode *p = y;
+                while (!p->leaf) p = bt_children(p, t)[p->nkeys];
+                bt_wmark(tree, x);
+                x->keys[i] = p->keys[p->nkeys - 1];
+                xv[i] = bt_values(p, t)[p->nkeys - 1];
+                k = x->keys[i];
+                x = y;
+            } else if (z->nkeys >= t) {
+                // Symmetric: replace by successor and delete it from z.
+                BTreeNode *s = z;
+                while (!s->leaf) s = bt_children(s, t)[0];
+                bt_wmark(tree, x);
+                x->keys[i] = s->keys[0];
+                xv[i] = bt_values(s, t)[0];
+                k = x->keys[i];
+                x = z;
+            } else {
+                bt_merge_children(tree, x, i);
+                x = y;
+            }
+            continue;
+        }
+
+        i = bt_fill_child(tree, x, i);
+        x = xc[i];
+    }
+}
+
+static int bp_delete_node(BTree *tree, BTreeNode *x, BTKey k);
+
+int bt_delete(BTree *tree, BTKey k) {
+    if (!tree || !tree->root || tree->map_base) return 0;
+    bt_write_begin(tree);
+    int found = tree->bplus ? bp_delete_node(tree, tree->root, k)
+                            : bt_delete_node(tree, tree->root, k);
+    if (found) bt_add_nkeys(tree, -1);
+
+    // Shrink the tree when the root has been emptied by a merge.
+    BTreeNode *r = tree->root;
+    if (r->nkeys == 0 && !r->leaf) {
+        bt_wmark(tree, r);
+        bt_set_root(tree, bt_children(r, tree->t)[0]);
+        bt_release_node(tree, r);
+    }
+    bt_write_end(tree);
+    return found;
+}
+
+// Range search helper. Descends straight to the first key >= lo in each
+// node, then walks keys and subtrees in order until a key exceeds hi.
 static void bt_range_node(BTreeNode *node, BTKey lo, BTKey hi,
-                          BTRangeCallback cb, void *arg, BTStats *stats, int t) {
+                          BTRangeCallback cb, void *arg, BTStats *stats, int t,
+                          uintptr_t base) {
     if (!node) return;
     if (stats) stats->node_visits++;
 
-    int i;
-    for (i = 0; i < node->nkeys; i++) {
-        if (!node->leaf) {
-            if (lo <= node->keys[i])
-                bt_range_node(node->children[i], lo, hi, cb, arg, stats, t);
-        }
-        if (node->keys[i] >= lo && node->keys[i] <= hi) {
-            cb(node->keys[i], node->values[i], arg);
-        }
-        if (node->keys[i] > hi) {
-            if (!node->leaf)
-                bt_range_node(node->children[i], lo, hi, cb, arg, stats, t);
+    BTPayload *values = bt_values(node, t);
+    BTreeNode **children = node->leaf ? NULL : bt_children(node, t);
+    int i = ks_lower_bound(node->keys, node->nkeys, lo);
+    for (; i < node->nkeys; i++) {
+        if (!node->leaf)
+            bt_range_node(bt_link(base, children[i]), lo, hi, cb, arg, stats, t, base);
+        if (node->keys[i] > hi)
             return;
-        }
+        cb(node->keys[i], values[i], arg);
     }
     if (!node->leaf) {
-        bt_range_node(node->children[i], lo, hi, cb, arg, stats, t);
+        bt_range_node(bt_link(base, children[i]), lo, hi, cb, arg, stats, t, base);
+    }
+}
+
+static void bt_range_scan(BTree *tree, BTKey lo, BTKey hi,
+                          BTRangeCallback cb, void *arg, BTStats *stats) {
+    if (!tree->bplus) {
+        bt_range_node(tree->root, lo, hi, cb, arg, stats, tree->t, BT_BASE(tree));
+        return;
+    }
+    // B+tree: one descent, then a sequential walk along the leaf chain.
+    int t = tree->t, pk = tree->packed;
+    BTreeNode *leaf = bp_find_leaf(tree, lo, stats);
+    int i = bt_leaf_lower(pk, leaf, leaf->nkeys, lo);
+    while (leaf) {
+        int n = leaf->nkeys;
+        for (; i < n; i++) {
+            BTKey key = bt_leaf_key(pk, leaf, i);
+            if (key > hi) return;
+            cb(key, bt_leaf_val(pk, leaf, t, n, i), arg);
+        }
+        leaf = bt_next_leaf(BT_BASE(tree), leaf);
+        i = 0;
+        if (leaf) {
+            __builtin_prefetch(bt_next_leaf(BT_BASE(tree), leaf));
+            if (stats) stats->node_visits++;
+        }
     }
 }
 
+// A scan pins many nodes at once, so in concurrent mode it excludes
+// writers for its duration instead of validating optimistically.
 void bt_range_search(BTree *tree, BTKey lo, BTKey hi,
                      BTRangeCallback cb, void *arg, BTStats *stats) {
     if (!tree || !tree->root) return;
-    bt_range_node(tree->root, lo, hi, cb, arg, stats, tree->t);
+    bt_lock_writers(tree);
+    bt_range_scan(tree, lo, hi, cb, arg, stats);
+    bt_unlock_writers(tree);
 }
 
-static size_t bt_count_keys_node(BTreeNode *node) {
-    if (!node) return 0;
-    size_t res = node->nkeys;
-    if (!node->leaf) {
-        for (int i = 0; i <= node->nkeys; i++)
-            res += bt_count_keys_node(node->children[i]);
+// --- B+tree mode ------------------------------------------------------
+//
+// Same top-down, one-pass insert and delete as above, but every key and
+// value lives in a leaf. Internal nodes hold separators (copies of a key
+// from the right subtree), and leaves are chained left to right through
+// next. A leaf split copies its first right-hand key up; an internal
+// split moves its median up as usual.
+
+static void bp_split_child(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *y = xc[i];
+    if (y->leaf) bt_dir_stale(tree, x, i);
+    BTreeNode *z = bp_new_node(tree, y->leaf);
+    BTKey sep;
+    bt_wmark(tree, x);
+    bt_wmark(tree, y);
+    bt_wmark(tree, z);
+
+    if (y->leaf) {
+        // y keeps t keys, z takes the other t-1; z's first key is copied up.
+        z->nkeys = t - 1;
+        memcpy(z->keys, y->keys + t, sizeof(BTKey) * (size_t)(t - 1));
+        memcpy(bt_values(z, t), bt_values(y, t) + t, sizeof(BTPayload) * (size_t)(t - 1));
+        y->nkeys = t;
+        z->next = y->next;
+        y->next = z;
+        sep = z->keys[0];
+    } else {
+        z->nkeys = t - 1;
+        memcpy(z->keys, y->keys + t, sizeof(BTKey) * (size_t)(t - 1));
+        memcpy(bt_children(z, t), bt_children(y, t) + t, sizeof(BTreeNode*) * (size_t)t);
+        y->nkeys = t - 1;
+        sep = y->keys[t-1];
+    }
+
+    memmove(xc + i + 2, xc + i + 1, sizeof(BTreeNode*) * (size_t)(x->nkeys - i));
+    xc[i+1] = z;
+    memmove(x->keys + i + 1, x->keys + i, sizeof(BTKey) * (size_t)(x->nkeys - i));
+    x->keys[i] = sep;
+    x->nkeys++;
+}
+
+// Returns 1 if k was added, 0 if an existing key was overwritten.
+static int bp_insert_nonfull(BTree *tree, BTreeNode *x, BTKey k, BTPayload v) {
+    int t = tree->t;
+    while (!x->leaf) {
+        int i = bp_child_index(x, k);
+        BTreeNode **xc = bt_children(x, t);
+        if (xc[i]->nkeys == 2*t - 1) {
+            bp_split_child(tree, x, i);
+            if (k >= x->keys[i]) i++;
+        }
+        x = xc[i];
+    }
+
+    int i = ks_lower_bound(x->keys, x->nkeys, k);
+    if (i < x->nkeys && x->keys[i] == k) {
+        bt_wmark(tree, x);
+        bt_values(x, t)[i] = v;
+        return 0;
+    }
+    bt_leaf_insert_at(tree, x, i, k, v);
+    return 1;
+}
+
+static int bp_insert(BTree *tree, BTKey k, BTPayload v) {
+    BTreeNode *r = tree->root;
+    int t = tree->t;
+    if (r->nkeys == 2*t - 1) {
+        BTreeNode *s = bp_new_node(tree, 0);
+        bt_wmark(tree, s);
+        bt_children(s, t)[0] = r;
+        bt_set_root(tree, s);
+        bp_split_child(tree, s, 0);
+        r = s;
+    }
+    if (!bp_insert_nonfull(tree, r, k, v))
+        return 0;
+    bt_add_nkeys(tree, 1);
+    return 1;
+}
+
+// Remove separator i and child i+1 from internal node x.
+static void bp_remove_sep(BTreeNode *x, int i, int t) {
+    BTreeNode **xc = bt_children(x, t);
+    memmove(x->keys + i, x->keys + i + 1, sizeof(BTKey) * (size_t)(x->nkeys - i - 1));
+    memmove(xc + i + 1, xc + i + 2, sizeof(BTreeNode*) * (size_t)(x->nkeys - i - 1));
+    x->nkeys--;
+}
+
+static void bp_merge_children(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *y = xc[i];
+    BTreeNode *z = xc[i+1];
+    int yn = y->nkeys;
+    if (y->leaf) {
+        bt_dir_stale(tree, x, i);
+        bt_dir_stale(tree, x, i + 1);
+    }
+    bt_wmark(tree, x);
+    bt_wmark(tree, y);
+    bt_wmark(tree, z);
+
+    if (y->leaf) {
+        // Leaves: concatenate; the separator just disappears.
+        memcpy(y->keys + yn, z->keys, sizeof(BTKey) * (size_t)z->nkeys);
+        memcpy(bt_values(y, t) + yn, bt_values(z, t), sizeof(BTPayload) * (size_t)z->nkeys);
+        y->nkeys = yn + z->nkeys;
+        y->next = z->next;
+    } else {
+        // Internal: the separator comes down between the two halves.
+        y->keys[yn] = x->keys[i];
+        memcpy(y->keys + yn + 1, z->keys, sizeof(BTKey) * (size_t)z->nkeys);
+        memcpy(bt_children(y, t) + yn + 1, bt_children(z, t),
+               sizeof(BTreeNode*) * (size_t)(z->nkeys + 1));
+        y->nkeys = yn + 1 + z->nkeys;
+    }
+    bp_remove_sep(x, i, t);
+    bt_release_node(tree, z);
+}
+
+static void bp_borrow_left(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *c = xc[i];
+    BTreeNode *l = xc[i-1];
+    if (c->leaf) {
+        bt_dir_stale(tree, x, i - 1);
+        bt_dir_stale(tree, x, i);
+    }
+    bt_wmark(tree, x);
+    bt_wmark(tree, c);
+    bt_wmark(tree, l);
+
+    memmove(c->keys + 1, c->keys, sizeof(BTKey) * (size_t)c->nkeys);
+    if (c->leaf) {
+        BTPayload *cv = bt_values(c, t);
+        memmove(cv + 1, cv, sizeof(BTPayload) * (size_t)c->nkeys);
+        c->keys[0] = l->keys[l->nkeys - 1];
+        cv[0] = bt_values(l, t)[l->nkeys - 1];
+        x->keys[i-1] = c->keys[0];
+    } else {
+        BTreeNode **cc = bt_children(c, t);
+        memmove(cc + 1, cc, sizeof(BTreeNode*) * (size_t)(c->nkeys + 1));
+        c->keys[0] = x->keys[i-1];
+        cc[0] = bt_children(l, t)[l->nkeys];
+        x->keys[i-1] = l->keys[l->nkeys - 1];
+    }
+    c->nkeys++;
+    l->nkeys--;
+}
+
+static void bp_borrow_right(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *c = xc[i];
+    BTreeNode *r = xc[i+1];
+    if (c->leaf) {
+        bt_dir_stale(tree, x, i);
+        bt_dir_stale(tree, x, i + 1);
+    }
+    bt_wmark(tree, x);
+    bt_wmark(tree, c);
+    bt_wmark(tree, r);
+
+    if (c->leaf) {
+        BTPayload *rv = bt_values(r, t);
+        c->keys[c->nkeys] = r->keys[0];
+        bt_values(c, t)[c->nkeys] = rv[0];
+        memmove(r->keys, r->keys + 1, sizeof(BTKey) * (size_t)(r->nkeys - 1));
+        memmove(rv, rv + 1, sizeof(BTPayload) * (size_t)(r->nkeys - 1));
+        x->keys[i] = r->keys[0];
+    } else {
+        BTreeNode **rc = bt_children(r, t);
+        c->keys[c->nkeys] = x->keys[i];
+        bt_children(c, t)[c->nkeys + 1] = rc[0];
+        x->keys[i] = r->keys[0];
+        memmove(r->keys, r->keys + 1, sizeof(BTKey) * (size_t)(r->nkeys - 1));
+        memmove(rc, rc + 1, sizeof(BTreeNode*) * (size_t)r->nkeys);
+    }
+    c->nkeys++;
+    r->nkeys--;
+}
+
+static int bp_pack_fill(BTree *tree, BTreeNode *x, int i);
+static int bp_pack_remove(BTree *tree, BTreeNode *x, BTKey k);
+
+static int bp_delete_node(BTree *tree, BTreeNode *x, BTKey k) {
+    int t = tree->t;
+    while (!x->leaf) {
+        int i = bp_child_index(x, k);
+        BTreeNode **xc = bt_children(x, t);
+        if (tree->packed && xc[i]->leaf) {
+            i = bp_pack_fill(tree, x, i);
+        } else if (xc[i]->nkeys < t) {
+            if (i > 0 && xc[i-1]->nkeys >= t) {
+                bp_borrow_left(tree, x, i);
+            } else if (i < x->nkeys && xc[i+1]->nkeys >= t) {
+                bp_borrow_right(tree, x, i);
+            } else if (i < x->nkeys) {
+                bp_merge_children(tree, x, i);
+            } else {
+                bp_merge_children(tree, x, i - 1);
+                i--;
+            }
+        }
+        x = xc[i];
+    }
+
+    if (tree->packed) return bp_pack_remove(tree, x, k);
+    int i = ks_lower_bound(x->keys, x->nkeys, k);
+    if (i >= x->nkeys || x->keys[i] != k) return 0;
+    // Separators equal to k may stay behind; they still route correctly.
+    bt_wmark(tree, x);
+    bt_remove_at(x, i, t);
+    return 1;
+}
+
+// --- Packed leaves ----------------------------------------------------
+//
+// A packed tree is a B+tree (same internal nodes, separators and leaf
+// chain) whose leaves each hold one leafpack.h block. Writers decode the
+// leaf into tree->pack_keys / pack_vals, change the copy and encode it
+// back. A leaf is full when its block would not fit, not at a key count,
+// so inserts split at the leaf instead of on the way down. Deletes never
+// borrow between leaves: a leaf that has become small is merged with a
+// neighbour when the two fit in one block, and otherwise left as it is.
+
+// Encode entries into leaf x; -1 (x unchanged) if they do not fit.
+static int bp_pack_store(BTree *tree, BTreeNode *x, const BTKey *keys,
+                         const BTPayload *vals, int n) {
+    if (n > tree->pack_cap) return -1;
+    bt_wmark(tree, x);
+    if (lp_encode(x->keys, tree->pack_room, keys, vals, n) != 0) return -1;
+    x->nkeys = n;
+    return 0;
+}
+
+// k -> v into leaf x: 1 if added, 0 if overwritten, -1 if it does not fit.
+static int bp_pack_put(BTree *tree, BTreeNode *x, BTKey k, BTPayload v) {
+    BTKey *keys = tree->pack_keys;
+    BTPayload *vals = tree->pack_vals;
+    int n = x->nkeys;
+    int i = lp_lower_bound(x->keys, n, k);
+    int hit = i < n && lp_key(x->keys, i) == k;
+    // Most writes keep the block's bases and widths: edit it in place.
+    bt_wmark(tree, x);
+    if (hit && lp_set_val(x->keys, n, i, v) == 0) return 0;
+    if (!hit && lp_insert(x->keys, tree->pack_room, n, i, k, v) == 0) {
+        x->nkeys = n + 1;
+        return 1;
+    }
+    lp_decode(x->keys, n, keys, vals);
+    if (hit) {
+        vals[i] = v;
+        return bp_pack_store(tree, x, keys, vals, n) == 0 ? 0 : -1;
+    }
+    memmove(keys + i + 1, keys + i, sizeof(BTKey) * (size_t)(n - i));
+    memmove(vals + i + 1, vals + i, sizeof(BTPayload) * (size_t)(n - i));
+    keys[i] = k;
+    vals[i] = v;
+    return bp_pack_store(tree, x, keys, vals, n + 1) == 0 ? 1 : -1;
+}
+
+// Halve leaf i of x, which has room for one more separator. Each half is
+// a subset of a block that fit, so it fits too.
+static void bp_pack_split(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *y = xc[i];
+    bt_dir_stale(tree, x, i);
+    BTreeNode *z = bp_new_node(tree, 1);
+    bt_wmark(tree, x);
+    bt_wmark(tree, y);
+    bt_wmark(tree, z);
+
+    BTKey *keys = tree->pack_keys;
+    BTPayload *vals = tree->pack_vals;
+    int n = y->nkeys, m = n / 2;
+    lp_decode(y->keys, n, keys, vals);
+    lp_encode(y->keys, tree->pack_room, keys, vals, m);
+    lp_encode(z->keys, tree->pack_room, keys + m, vals + m, n - m);
+    y->nkeys = m;
+    z->nkeys = n - m;
+    z->next = y->next;
+    y->next = z;
+
+    memmove(xc + i + 2, xc + i + 1, sizeof(BTreeNode*) * (size_t)(x->nkeys - i));
+    xc[i+1] = z;
+    memmove(x->keys + i + 1, x->keys + i, sizeof(BTKey) * (size_t)(x->nkeys - i));
+    x->keys[i] = keys[m];
+    x->nkeys++;
+}
+
+// Top-down as bp_insert for the internal levels. When k does not fit its
+// leaf, the leaf is halved and the insert starts over from the root (the
+// split may have filled the parent). Every round halves the leaf k goes
+// to, and a leaf of t-1 entries always has room, so this ends quickly.
+static int bp_insert_packed(BTree *tree, BTKey k, BTPayload v) {
+    int t = tree->t;
+    for (;;) {
+        BTreeNode *r = tree->root;
+        if (!r->leaf && r->nkeys == 2*t - 1) {
+            BTreeNode *s = bp_new_node(tree, 0);
+            bt_wmark(tree, s);
+            bt_children(s, t)[0] = r;
+            bt_set_root(tree, s);
+            bp_split_child(tree, s, 0);
+            r = s;
+        }
+        BTreeNode *x = r, *parent = NULL;
+        int pi = 0;
+        while (!x->leaf) {
+            int i = bp_child_index(x, k);
+            BTreeNode **xc = bt_children(x, t);
+            if (!xc[i]->leaf && xc[i]->nkeys == 2*t - 1) {
+                bp_split_child(tree, x, i);
+                if (k >= x->keys[i]) i++;
+            }
+            parent = x;
+            pi = i;
+            x = xc[i];
+        }
+
+        int added = bp_pack_put(tree, x, k, v);
+        if (added >= 0) {
+            bt_add_nkeys(tree, added);
+            return added;
+        }
+        if (!parent) {
+            parent = bp_new_node(tree, 0);
+            bt_wmark(tree, parent);
+            bt_children(parent, t)[0] = x;
+            bt_set_root(tree, parent);
+            pi = 0;
+        }
+        bp_pack_split(tree, parent, pi);
     }
-    return res;
+}
+
+// Merge b into a (both sorted; b wins on equal keys) into out. Returns
+// the merged count, or -1 if it would exceed cap; *fresh counts b's keys
+// that were not in a.
+static int bp_pack_union(const BTKey *ak, const BTPayload *av, int an,
+                         const BTKey *bk, const BTPayload *bv, size_t bn,
+                         BTKey *ok, BTPayload *ov, int cap, int *fresh) {
+    int m = 0, p = 0;
+    size_t j = 0;
+    *fresh = 0;
+    while (p < an || j < bn) {
+        if (m == cap) return -1;
+        if (j == bn || (p < an && ak[p] < bk[j])) {
+            ok[m] = ak[p];
+            ov[m++] = av[p++];
+        } else {
+            if (p < an && ak[p] == bk[j]) p++;
+            else                          (*fresh)++;
+            ok[m] = bk[j];
+            ov[m++] = bv[j++];
+        }
+    }
+    return m;
+}
+
+// bt_leaf_merge for a packed leaf: takes the keys below the fence, or the
+// largest halving of them whose union with the leaf still fits.
+static size_t bp_pack_merge(BTree *tree, BTreeNode *x, const BTKey *keys,
+                            const BTPayload *vals, size_t n,
+                            int has_fence, BTKey fence, size_t *added) {
+    int cap = tree->pack_cap;
+    BTKey *lk = tree->pack_keys, *mk = lk + cap + 1;
+    BTPayload *lv = tree->pack_vals, *mv = lv + cap + 1;
+    int xn = x->nkeys;
+    lp_decode(x->keys, xn, lk, lv);
+
+    size_t take = 0;
+    while (take < n && take < (size_t)cap && (!has_fence || keys[take] < fence))
+        take++;
+    *added = 0;
+    for (; take > 0; take /= 2) {
+        int fresh;
+        int m = bp_pack_union(lk, lv, xn, keys, vals, take, mk, mv, cap, &fresh);
+        if (m >= 0 && bp_pack_store(tree, x, mk, mv, m) == 0) {
+            *added = (size_t)fresh;
+            return take;
+        }
+    }
+    return 0;
+}
+
+// Before descending into leaf i of x: if it is down to a quarter of its
+// bytes, merge it with a neighbour when the two fit in one block. Returns
+// the index of the leaf that now covers leaf i's keys.
+static int bp_pack_fill(BTree *tree, BTreeNode *x, int i) {
+    int t = tree->t;
+    BTreeNode **xc = bt_children(x, t);
+    BTreeNode *c = xc[i];
+    if (x->nkeys == 0 || lp_block_bytes(c->keys, c->nkeys) > tree->pack_room / 4)
+        return i;
+    int l = i < x->nkeys ? i : i - 1;   // merge children l and l+1
+    BTreeNode *y = xc[l];
+    BTreeNode *z = xc[l+1];
+    int yn = y->nkeys, zn = z->nkeys;
+    if (yn + zn > tree->pack_cap) return i;
+
+    BTKey *keys = tree->pack_keys;
+    BTPayload *vals = tree->pack_vals;
+    lp_decode(y->keys, yn, keys, vals);
+    lp_decode(z->keys, zn, keys + yn, vals + yn);
+    if (lp_size(keys, vals, yn + zn) > tree->pack_room) return i;
+
+    bt_dir_stale(tree, x, l);
+    bt_dir_stale(tree, x, l + 1);
+    bt_wmark(tree, x);
+    bt_wmark(tree, z);
+    bp_pack_store(tree, y, keys, vals, yn + zn);
+    y->next = z->next;
+    bp_remove_sep(x, l, t);
+    bt_release_node(tree, z);
+    return l;
+}
+
+static int bp_pack_remove(BTree *tree, BTreeNode *x, BTKey k) {
+    int n = x->nkeys;
+    int i = lp_lower_bound(x->keys, n, k);
+    if (i >= n || lp_key(x->keys, i) != k) return 0;
+    BTKey *keys = tree->pack_keys;
+    BTPayload *vals = tree->pack_vals;
+    lp_decode(x->keys, n, keys, vals);
+    memmove(keys + i, keys + i + 1, sizeof(BTKey) * (size_t)(n - i - 1));
+    memmove(vals + i, vals + i + 1, sizeof(BTPayload) * (size_t)(n - i - 1));
+    bp_pack_store(tree, x, keys, vals, n - 1);   // a subset always fits
+    return 1;
+}
+
+// --- Bulk load -------------------------------------------------------
+//
+// Bottom-up build from sorted input in one pass per level. Each level is
+// cut into groups of near-equal size aimed at fill_factor * (2t-1) keys
+// per node, adjusted so every node stays within [t-1, 2t-1]. In classic
+// mode the key between two neighbouring groups moves up to the next level
+// as a separator (with its payload); in B+ mode leaves keep every key and
+// the first key of each leaf after the first is copied up instead.
+
+static int bt_fill_target(int t, double fill_factor) {
+    if (fill_factor < 0.0) fill_factor = 0.0;
+    if (fill_factor > 1.0) fill_factor = 1.0;
+    int k = (int)(fill_factor * (double)(2*t - 1) + 0.5);
+    if (k < t - 1) k = t - 1;
+    if (k < 1) k = 1;
+    return k;
+}
+
+// Number of nodes to cut `slots` items into, aiming at per_node items per
+// node. Rounds up first, then gives one node back if that would leave
+// nodes with fewer than min_per items; neither step can overfill a node.
+static size_t bt_group_count(size_t slots, int per_node, int min_per) {
+    size_t g = (slots + (size_t)per_node - 1) / (size_t)per_node;
+    if (g == 0) g = 1;
+    if (g > 1 && slots / g < (size_t)min_per) g--;
+    return g;
+}
+
+// Build one level over n items with n+1 children (children == NULL for the
+// leaf level). Writes the g level nodes to out_nodes and the g-1 promoted
+// separators to out_keys/out_vals; returns g.
+static size_t bt_build_level(BTree *tree, const BTKey *keys, const BTPayload *vals,
+                             BTreeNode **children, size_t n, int target,
+                             BTreeNode **out_nodes, BTKey *out_keys,
+                             BTPayload *out_vals) {
+    int t = tree->t;
+    int leaf = (children == NULL);
+    int with_values = !tree->bplus || leaf;
+    // Each node takes (its keys + 1) slots: the +1 is the separator after
+    // it, or the end of input for the last node.
+    size_t slots = n + 1;
+    size_t g = bt_group_count(slots, target + 1, t);
+    size_t base = slots / g, rem = slots % g;
+
+    size_t ki = 0;
+    for (size_t j = 0; j < g; j++) {
+        int nk = (int)(base + (j < rem) - 1);
+        BTreeNode *node = bt_alloc_node(tree, leaf);
+        node->nkeys = nk;
+        memcpy(node->keys, keys + ki, sizeof(BTKey) * (size_t)nk);
+        if (with_values)
+            memcpy(bt_values(node, t), vals + ki, sizeof(BTPayload) * (size_t)nk);
+        if (!leaf)
+            memcpy(bt_children(node, t), children + ki,
+                   sizeof(BTreeNode*) * (size_t)(nk + 1));
+        ki += (size_t)nk;
+        out_nodes[j] = node;
+        if (j + 1 < g) {
+            out_keys[j] = keys[ki];
+            if (out_vals) out_vals[j] = vals[ki];
+            ki++;
+        }
+    }
+    return g;
+}
+
+// B+ leaf level: n keys over g linked leaves; separators are copies of
+// each leaf's first key (except the first leaf's).
+static size_t bp_build_leaves(BTree *tree, const BTKey *keys, const BTPayload *vals,
+                              size_t n, int target, BTreeNode **out_nodes,
+                              BTKey *out_keys) {
+    int t = tree->t;
+    size_t g = bt_group_count(n, target, t - 1);
+    size_t base = n / g, rem = n % g;
+
+    size_t ki = 0;
+    BTreeNode *prev = NULL;
+    for (size_t j = 0; j < g; j++) {
+        int nk = (int)(base + (j < rem));
+        BTreeNode *leaf = bp_new_node(tree, 1);
+        leaf->nkeys = nk;
+        memcpy(leaf->keys, keys + ki, sizeof(BTKey) * (size_t)nk);
+        memcpy(bt_values(leaf, t), vals + ki, sizeof(BTPayload) * (size_t)nk);
+        if (j > 0) out_keys[j-1] = keys[ki];
+        if (prev) prev->next = leaf;
+        prev = leaf;
+        out_nodes[j] = leaf;
+        ki += (size_t)nk;
+    }
+    return g;
+}
+
+// Packed leaf level: each leaf takes keys greedily while its block stays
+// within fill_factor of the leaf's bytes, and at least t-1 keys (which
+// always fit at full width). Separators as for bp_build_leaves.
+static size_t bp_build_packed(BTree *tree, const BTKey *keys, const BTPayload *vals,
+                              size_t n, double fill_factor, BTreeNode **out_nodes,
+                              BTKey *out_keys) {
+    int t = tree->t;
+    if (fill_factor < 0.0) fill_factor = 0.0;
+    if (fill_factor > 1.0) fill_factor = 1.0;
+    size_t budget = (size_t)(fill_factor * (double)tree->pack_room);
+
+    size_t g = 0, ki = 0;
+    BTreeNode *prev = NULL;
+    while (ki < n) {
+        size_t nk = 1;
+        uint64_t vlo = (uint64_t)(uintptr_t)vals[ki], vhi = vlo;
+        while (ki + nk < n && nk < (size_t)tree->pack_cap) {
+            uint64_t v = (uint64_t)(uintptr_t)vals[ki + nk];
+            uint64_t lo = v < vlo ? v : vlo, hi = v > vhi ? v : vhi;
+            size_t bytes = lp_size_span((int)nk + 1,
+                                        (uint64_t)keys[ki + nk] - (uint64_t)keys[ki],
+                                        hi - lo);
+            if (nk + 1 > (size_t)(t - 1) && bytes > budget) break;
+            vlo = lo;
+            vhi = hi;
+            nk++;
+        }
+        BTreeNode *leaf = bp_new_node(tree, 1);
+        lp_encode(leaf->keys, tree->pack_room, keys + ki, vals + ki, (int)nk);
+        leaf->nkeys = (int)nk;
+        if (g > 0) out_keys[g-1] = keys[ki];
+        if (prev) prev->next = leaf;
+        prev = leaf;
+        out_nodes[g++] = leaf;
+        ki += nk;
+    }
+    return g;
+}
+
+int bt_bulk_load(BTree *tree, const BTKey *keys, const BTPayload *payloads,
+                 size_t n, double fill_factor) {
+    if (!tree || !tree->root || tree->map_base) return -1;
+    for (size_t j = 1; j < n; j++)
+        if (keys[j] <= keys[j-1]) return -1;
+    bt_write_begin(tree);
+    if (tree->nkeys != 0) {
+        bt_write_end(tree);
+        return -1;
+    }
+    if (n == 0) {
+        bt_write_end(tree);
+        return 0;
+    }
+
+    int t = tree->t;
+    int target = bt_fill_target(t, fill_factor);
+
+    // Per-level working arrays, sized for the widest level (the leaves:
+    // at most one node per t-1 keys). Two sets, swapped level to level.
+    size_t cap = n / (size_t)(t > 2 ? t - 1 : 1) + 2;
+    BTreeNode **nodes = (BTreeNode**)malloc(sizeof(BTreeNode*) * cap);
+    BTKey     *seps   = (BTKey*)malloc(sizeof(BTKey) * cap);
+    BTPayload *svals  = tree->bplus ? NULL : (BTPayload*)malloc(sizeof(BTPayload) * cap);
+    BTreeNode **up_nodes = (BTreeNode**)malloc(sizeof(BTreeNode*) * cap);
+    BTKey     *up_seps   = (BTKey*)malloc(sizeof(BTKey) * cap);
+    BTPayload *up_vals   = tree->bplus ? NULL : (BTPayload*)malloc(sizeof(BTPayload) * cap);
+
+    size_t g = tree->packed
+        ? bp_build_packed(tree, keys, payloads, n, fill_factor, nodes, seps)
+        : tree->bplus
+        ? bp_build_leaves(tree, keys, payloads, n, target, nodes, seps)
+        : bt_build_level(tree, keys, payloads, NULL, n, target, nodes, seps, svals);
+
+    while (g > 1) {
+        size_t ng = bt_build_level(tree, seps, svals, nodes, g - 1, target,
+                                   up_nodes, up_seps, up_vals);
+        BTreeNode **tn = nodes; nodes = up_nodes; up_nodes = tn;
+        BTKey *ts = seps; seps = up_seps; up_seps = ts;
+        BTPayload *tv = svals; svals = up_vals; up_vals = tv;
+        g = ng;
+    }
+
+    // The new nodes are unreachable until the root swap, so only the old
+    // (empty) root leaf needs marking.
+    BTreeNode *old_root = tree->root;
+    bt_wmark(tree, old_root);
+    bt_set_root(tree, nodes[0]);
+    bt_release_node(tree, old_root);
+    bt_add_nkeys(tree, (long)n);
+    bt_dir_build(tree);
+    bt_write_end(tree);
+
+    free(nodes); free(seps); free(svals);
+    free(up_nodes); free(up_seps); free(up_vals);
+    return 0;
+}
+
+// --- Cursors ---------------------------------------------------------
+
+static void bt_cursor_push(BTCursor *c, BTreeNode *node, int pos) {
+    assert(c->depth < BT_MAX_HEIGHT);
+    c->node[c->depth] = node;
+    c->pos[c->depth] = pos;
+    c->depth++;
+    if (c->stats) c->stats->node_visits++;
+}
+
+void bt_cursor_seek(BTCursor *c, BTree *tree, BTKey lo, BTStats *stats) {
+    c->depth = 0;
+    c->stats = stats;
+    if (!tree || !tree->root) return;
+    c->t = tree->t;
+    c->bplus = tree->bplus;
+    c->packed = tree->packed;
+    c->base = BT_BASE(tree);
+
+    if (c->bplus) {
+        // Only the current leaf is needed; next pointers do the rest.
+        BTreeNode *leaf = bp_find_leaf(tree, lo, stats);
+        c->node[0] = leaf;
+        c->pos[0] = bt_leaf_lower(c->packed, leaf, leaf->nkeys, lo);
+        c->depth = 1;
+        return;
+    }
+
+    BTreeNode *node = tree->root;
+    for (;;) {
+        int i = ks_lower_bound(node->keys, node->nkeys, lo);
+        bt_cursor_push(c, node, i);
+        // Stop at a leaf, or at an internal node holding lo itself:
+        // everything in its left subtree is < lo.
+        if (node->leaf || (i < node->nkeys && node->keys[i] == lo))
+            return;
+        node = bt_link(c->base, bt_children(node, c->t)[i]);
+    }
+}
+
+int bt_cursor_next(BTCursor *c, BTKey *k, BTPayload *v) {
+    while (c->depth > 0) {
+        int top = c->depth - 1;
+        BTreeNode *node = c->node[top];
+        int pos = c->pos[top];
+        if (pos >= node->nkeys) {
+            if (c->bplus) {
+                // Step to the right sibling leaf.
+                c->depth = 0;
+                if (node->next) bt_cursor_push(c, bt_next_leaf(c->base, node), 0);
+                continue;
+            }
+            // Node exhausted; the parent frame already points at the
+            // separator that follows this subtree.
+            c->depth--;
+            continue;
+        }
+
+        if (c->packed) {
+            *k = lp_key(node->keys, pos);
+            *v = lp_val(node->keys, node->nkeys, pos);
+        } else {
+            *k = node->keys[pos];
+            *v = bt_values(node, c->t)[pos];
+        }
+        c->pos[top] = pos + 1;
+
+        // In-order successor of an internal key: leftmost path of the
+        // subtree to its right.
+        if (!node->leaf) {
+            BTreeNode *child = bt_link(c->base, bt_children(node, c->t)[pos + 1]);
+            for (;;) {
+                bt_cursor_push(c, child, 0);
+                if (child->leaf) break;
+                child = bt_link(c->base, bt_children(child, c->t)[0]);
+            }
+        }
+        return 1;
+    }
+    return 0;
 }
 
 size_t bt_count_keys(BTree *tree) {
-    if (!tree || !tree->root) return 0;
-    return bt_count_keys_node(tree->root);
+    if (!tree) return 0;
+    return __atomic_load_n(&tree->nkeys, __ATOMIC_RELAXED);
+}
+
+size_t bt_memory_bytes(BTree *tree) {
+    if (tree->map_base) return tree->map_len;
+    return arena_bytes(tree->leaf_arena) + arena_bytes(tree->inner_arena);
+}
+
+size_t bt_live_bytes(BTree *tree) {
+    if (tree->map_base) return tree->map_len;
+    return arena_live(tree->leaf_arena)  * bt_node_bytes(tree->t, 1, 1) +
+           arena_live(tree->inner_arena) * bt_node_bytes(tree->t, 0, !tree->bplus);
+}
+
+// Every leaf is at the same depth, so the leftmost path measures it.
+int bt_height(BTree *tree) {
+    int h = 1;
+    uintptr_t base = BT_BASE(tree);
+    for (BTreeNode *node = tree->root; !node->leaf; h++)
+        node = bt_link(base, bt_children(node, tree->t)[0]);
+    return h;
+}
+
+// --- On-disk format ----------------------------------------------------
+
+#define BT_FILE_MAGIC   "HCBTREE"
+#define BT_FILE_VERSION 2
+#define BT_FILE_HDR     4096   // header page; node pages follow
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t t;
+    uint32_t bplus;
+    uint32_t packed;       // leaves are leafpack.h blocks
+    uint32_t node_hdr;     // sizeof(BTreeNode): rejects foreign layouts
+    uint64_t page_bytes;   // fixed size of every node page
+    uint64_t npages;
+    uint64_t nkeys;
+    uint64_t root;         // file offset of the root page
+} BTFileHeader;
+
+static size_t bt_page_bytes(int t, int bplus) {
+    size_t leaf  = bt_node_bytes(t, 1, 1);
+    size_t inner = bt_node_bytes(t, 0, !bplus);
+    size_t need  = leaf > inner ? leaf : inner;
+    size_t page  = BT_NODE_ALIGN;
+    while (page < need) page *= 2;
+    return page;
+}
+
+static inline uint64_t bt_page_off(size_t page, size_t page_bytes) {
+    return BT_FILE_HDR + (uint64_t)page * page_bytes;
+}
+
+// Breadth-first order makes the links easy to translate: the children of
+// the node on page i are consecutive pages starting at first[i], and B+
+// leaves (all on the last level) follow each other in key order.
+int bt_save(BTree *tree, const char *path) {
+    if (!tree || !tree->root) return -1;
+    int t = tree->t;
+    uintptr_t base = BT_BASE(tree);
+    size_t page_bytes = bt_page_bytes(t, tree->bplus);
+
+    size_t cap = 1024, n = 1;
+    BTreeNode **order = (BTreeNode**)malloc(sizeof(BTreeNode*) * cap);
+    size_t *first = (size_t*)malloc(sizeof(size_t) * cap);
+    order[0] = tree->root;
+    for (size_t i = 0; i < n; i++) {
+        BTreeNode *node = order[i];
+        first[i] = n;
+        if (node->leaf) continue;
+        for (int j = 0; j <= node->nkeys; j++) {
+            if (n == cap) {
+                cap *= 2;
+                order = (BTreeNode**)realloc(order, sizeof(BTreeNode*) * cap);
+                first = (size_t*)realloc(first, sizeof(size_t) * cap);
+            }
+            order[n++] = bt_link(base, bt_children(node, t)[j]);
+        }
+    }
+
+    FILE *f = fopen(path, "wb");
+    int rc = f ? 0 : -1;
+    char *page = (char*)calloc(1, page_bytes > BT_FILE_HDR ? page_bytes : BT_FILE_HDR);
+
+    if (rc == 0) {
+        BTFileHeader h;
+        memset(&h, 0, sizeof(h));
+        memcpy(h.magic, BT_FILE_MAGIC, sizeof(BT_FILE_MAGIC));
+        h.version    = BT_FILE_VERSION;
+        h.t          = (uint32_t)t;
+        h.bplus      = (uint32_t)tree->bplus;
+        h.packed     = (uint32_t)tree->packed;
+        h.node_hdr   = (uint32_t)sizeof(BTreeNode);
+        h.page_bytes = page_bytes;
+        h.npages     = n;
+        h.nkeys      = bt_count_keys(tree);
+        h.root       = bt_page_off(0, page_bytes);
+        memcpy(page, &h, sizeof(h));
+        if (fwrite(page, 1, BT_FILE_HDR, f) != BT_FILE_HDR) rc = -1;
+    }
+
+    for (size_t i = 0; rc == 0 && i < n; i++) {
+        BTreeNode *node = order[i];
+        size_t bytes = bt_node_bytes(t, node->leaf, node->leaf || !tree->bplus);
+        memset(page, 0, page_bytes);
+        memcpy(page, node, bytes);
+        BTreeNode *out = (BTreeNode*)page;
+        out->version = 0;
+        out->next = NULL;
+        if (!node->leaf) {
+            BTreeNode **oc = bt_children(out, t);
+            for (int j = 0; j <= node->nkeys; j++)
+                oc[j] = (BTreeNode*)(uintptr_t)bt_page_off(first[i] + (size_t)j, page_bytes);
+        } else if (tree->bplus && node->next) {
+            assert(i + 1 < n && order[i + 1] == bt_next_leaf(base, node));
+            out->next = (BTreeNode*)(uintptr_t)bt_page_off(i + 1, page_bytes);
+        }
+        if (fwrite(page, 1, page_bytes, f) != page_bytes) rc = -1;
+    }
+
+    if (f && fclose(f) != 0) rc = -1;
+    free(page);
+    free(order);
+    free(first);
+    return rc;
+}
+
+BTree* bt_open_mmap(const char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < BT_FILE_HDR) {
+        close(fd);
+        return NULL;
+    }
+    size_t len = (size_t)st.st_size;
+    char *map = (char*)mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);   // the mapping keeps the file open
+    if (map == MAP_FAILED) return NULL;
+
+    BTFileHeader h;
+    memcpy(&h, map, sizeof(h));
+    int ok = memcmp(h.magic, BT_FILE_MAGIC, sizeof(BT_FILE_MAGIC)) == 0
+          && h.version == BT_FILE_VERSION
+          && h.node_hdr == sizeof(BTreeNode)
+          && h.t >= 2
+          && (!h.packed || h.bplus)
+          && h.page_bytes == bt_page_bytes((int)h.t, (int)h.bplus)
+          && h.npages > 0
+          && (uint64_t)len == bt_page_off(h.npages, h.page_bytes)
+          && h.root == BT_FILE_HDR;
+    if (!ok) {
+        munmap(map, len);
+        return NULL;
+    }
+
+    BTree *tree = (BTree*)calloc(1, sizeof(BTree));
+    tree->t        = (int)h.t;
+    tree->bplus    = (int)h.bplus;
+    tree->nkeys    = h.nkeys;
+    tree->root     = (BTreeNode*)(map + h.root);
+    tree->map_base = map;
+    tree->map_len  = len;
+    if (h.packed) bt_init_packed(tree, 0);
+    return tree;
 }
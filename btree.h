@@ -4,6 +4,8 @@
 
 #include <stddef.h>
 #include <stdint.h>
+#include <pthread.h>
+#include "hcnuma.h"
 
 typedef int64_t BTKey;
 typedef void*   BTPayload;
@@ -14,28 +16,236 @@ typedef struct {
 } BTStats;
 
 typedef struct BTreeNode BTreeNode;
+struct Arena;
+struct BTDir;
 
 typedef struct {
     BTreeNode *root;
-    int        t;   // minimum degree (B-tree parameter)
+    int        t;      // minimum degree (B-tree parameter)
+    size_t     nkeys;  // exact key count, maintained by insert/delete
+    int        bplus;  // 1 = B+tree layout (see bt_create_bplus)
+    int        packed; // 1 = B+tree with packed leaves (bt_create_packed)
+    int        pack_cap;    // most entries a packed leaf can hold
+    size_t     pack_room;   // bytes of a leaf's block
+    BTKey     *pack_keys;   // writer scratch: two decoded leaves
+    BTPayload *pack_vals;
+    struct Arena *leaf_arena;   // node storage, one arena per node size
+    struct Arena *inner_arena;
+
+    // Learned leaf directory (bt_set_learned); NULL when off. Directories
+    // replaced while lock-free readers may still use them wait on
+    // dir_retired until bt_free.
+    struct BTDir *dir;
+    struct BTDir *dir_retired;
+    int           learn_eps;
+    uint64_t      dir_builds;
+
+    // Concurrent mode (bt_set_concurrent): writers serialize on
+    // write_lock; marked[] holds the nodes the current writer changed.
+    int              concurrent;
+    pthread_mutex_t  write_lock;
+    BTreeNode      **marked;
+    int              nmarked;
+
+    uint64_t         writes;   // completed write operations (see BTHint)
+
+    // Read-only tree opened with bt_open_mmap(): nodes live in the file
+    // mapping, and child/next slots hold file offsets instead of pointers.
+    // NULL for trees built in memory.
+    char   *map_base;
+    size_t  map_len;
 } BTree;
 
 BTree*  bt_create(int t);
+
+// B+tree variant: payloads live only in leaves, internal nodes hold
+// separator keys, and leaves are linked left to right. Range scans and
+// cursors then do one root-to-leaf descent followed by a sequential walk
+// of the leaf chain. Same API and semantics as bt_create() trees.
+BTree*  bt_create_bplus(int t);
+
+// B+tree whose leaves are frame-of-reference packed (leafpack.h): keys as
+// deltas from the leaf's first key and payloads as deltas from its
+// smallest one, in 1/2/4/8-byte lanes chosen per leaf. A leaf holds as
+// many entries as fit in its bytes (up to about 8x a raw leaf for dense
+// keys and integer payloads), so the same key set needs far fewer leaves
+// and levels. Internal nodes are unchanged. Lookups compare the probe
+// against the packed key lanes without unpacking them; writes decode a
+// leaf, change it and encode it again. A leaf is split when its entries
+// no longer fit, and merged with a neighbour when both fit in one.
+BTree*  bt_create_packed(int t);
 void    bt_free(BTree *tree);
 
+// Learned leaf directory for B+tree layouts (bt_create_bplus and
+// bt_create_packed). The routing fence of every leaf goes into one array,
+// and a piecewise-linear model over it (segindex.h, error at most eps
+// positions) replaces the descent: bt_search and bt_search_batch jump to
+// the leaf after one search of a few fences. Built now if the tree holds
+// keys (otherwise after the first write that adds some), and again by
+// every bt_bulk_load. A leaf split, merge or borrow marks the directory
+// entries it invalidates, and lookups that land on one take the normal
+// descent; the directory is rebuilt once the leaf changes since the last
+// build reach a quarter of its entries. eps <= 0 removes it. Returns 0,
+// or -1 for a B-tree layout.
+int     bt_set_learned(BTree *tree, int eps);
+
+typedef struct {
+    size_t leaves;     // directory entries (leaves when it was built)
+    size_t segments;   // segments of the model
+    size_t stale;      // entries invalidated since the build
+    size_t bytes;      // memory of the directory and model
+    uint64_t builds;   // directories built
+} BTLearnedStats;
+
+// All zero if the tree has no directory.
+void    bt_learned_stats(BTree *tree, BTLearnedStats *out);
+
+// Page size and NUMA node for the tree's nodes (hcnuma.h): new nodes come
+// from memory placed by p, and nodes already allocated move to p.node.
+// A no-op for a mapped tree.
+void    bt_set_placement(BTree *tree, NMPolicy p);
+
+// Make the tree safe to share between threads: any number of concurrent
+// bt_search / bt_search_batch calls alongside writers (bt_insert,
+// bt_delete, bt_bulk_load), which are serialized by a per-tree mutex.
+// Lookups take no locks and write no shared memory: they validate
+// per-node version counters and restart on a conflicting write.
+// bt_range_search excludes writers while it runs; cursors do not, so
+// hold bt_lock_writers() around a cursor scan. Call before sharing the
+// tree; it cannot be turned off again.
+void    bt_set_concurrent(BTree *tree);
+void    bt_lock_writers(BTree *tree);
+void    bt_unlock_writers(BTree *tree);
+
 // Insert key → payload. (No duplicates handling; last insert "wins")
 void    bt_insert(BTree *tree, BTKey k, BTPayload v);
 
+// Bulk load an EMPTY tree from n strictly increasing keys (payloads[j]
+// belongs to keys[j]). Nodes are packed bottom-up to about fill_factor
+// of capacity (1.0 = full; never below the B-tree minimum), in one pass
+// per level. Returns 0 on success, -1 if the tree is not empty or the
+// keys are not strictly increasing.
+int     bt_bulk_load(BTree *tree, const BTKey *keys, const BTPayload *payloads,
+                     size_t n, double fill_factor);
+
+// Insert n strictly increasing keys (payloads[j] belongs to keys[j]) into
+// a tree that may already hold keys; existing ones are overwritten. Keys
+// that share a leaf cost one descent and one merge into the leaf, instead
+// of a descent each. Returns how many keys were added.
+size_t  bt_insert_sorted(BTree *tree, const BTKey *keys, const BTPayload *payloads,
+                         size_t n);
+
+// Replace the payload of an existing key; returns 1 if k was present, 0
+// otherwise (nothing is inserted). Never splits or merges nodes, except
+// in a packed tree when the new payload widens a full leaf.
+int     bt_update(BTree *tree, BTKey k, BTPayload v);
+
+// Delete key; returns 1 if it was present, 0 otherwise. Rebalances by
+// borrowing from or merging with siblings, so all B-tree invariants hold.
+int     bt_delete(BTree *tree, BTKey k);
+
 // Search for key; returns payload or NULL if not found.
 // If stats != NULL, it accumulates node visits.
 BTPayload bt_search(BTree *tree, BTKey k, BTStats *stats);
 
+// bt_search that tells a miss from a NULL payload: returns 1 and sets
+// *out (if out != NULL) when k is present, 0 (and *out = NULL) otherwise.
+int     bt_find(BTree *tree, BTKey k, BTPayload *out, BTStats *stats);
+
+// Insert position left behind by a lookup that missed: the leaf the
+// descent ended in and the slot k belongs at. It stays usable until the
+// next write to the tree; bt_insert_hint checks that (tree->writes).
+typedef struct {
+    BTreeNode *leaf;     // NULL = no position (k was found, or mapped tree)
+    int        pos;
+    uint64_t   writes;   // tree->writes when the lookup started
+} BTHint;
+
+// bt_search() that also fills *hint, at no extra node visits.
+BTPayload bt_search_hint(BTree *tree, BTKey k, BTStats *stats, BTHint *hint);
+
+// Insert k → v at a position from bt_search_hint(). If the tree has not
+// been written since and the leaf has room, this touches only that leaf;
+// otherwise it falls back to bt_insert(). hint may be NULL. Returns 1 if
+// k was added, 0 if it was already present (its payload is overwritten).
+int     bt_insert_hint(BTree *tree, BTKey k, BTPayload v, const BTHint *hint);
+
+// Batched lookup: out[j] = bt_search(tree, keys[j]) for j in [0, n).
+// Independent lookups descend level by level in an interleaved fashion
+// with software prefetch of each next child, overlapping cache misses.
+// If stats != NULL, it accumulates node visits for the whole batch.
+void    bt_search_batch(BTree *tree, const BTKey *keys, size_t n,
+                        BTPayload *out, BTStats *stats);
+
 // Range scan: call callback(k, v, arg) for all keys in [lo, hi].
 typedef void (*BTRangeCallback)(BTKey k, BTPayload v, void *arg);
 void    bt_range_search(BTree *tree, BTKey lo, BTKey hi,
                         BTRangeCallback cb, void *arg, BTStats *stats);
 
-// For stats: approximate number of keys in tree.
+// Ordered cursor: iterator-style scan without callbacks.
+//
+//   BTCursor c;
+//   bt_cursor_seek(&c, tree, lo, &stats);
+//   while (bt_cursor_next(&c, &k, &v) && k <= hi) { ... }
+//
+// The cursor keeps the root-to-node path (O(height) space), so a scan can
+// be suspended and resumed at any point. The tree must not be modified
+// while a cursor is open on it.
+#define BT_MAX_HEIGHT 64
+
+typedef struct {
+    BTreeNode *node[BT_MAX_HEIGHT];
+    int        pos[BT_MAX_HEIGHT];   // next key index to emit per level
+    int        depth;                // frames on the path; 0 = exhausted
+    int        t;
+    int        bplus;                // walk the leaf chain instead
+    int        packed;               // leaves are leafpack.h blocks
+    uintptr_t  base;                 // tree->map_base (offset links)
+    BTStats   *stats;                // node visits are added here if set
+} BTCursor;
+
+// Position c before the first key >= lo.
+void    bt_cursor_seek(BTCursor *c, BTree *tree, BTKey lo, BTStats *stats);
+
+// Yield the next key/payload in ascending key order; returns 0 at the end.
+int     bt_cursor_next(BTCursor *c, BTKey *k, BTPayload *v);
+
+// --- On-disk format ----------------------------------------------------
+//
+// bt_save() writes the tree as a 4 KiB header followed by one fixed-size
+// page per node (a power of two, so no node straddles an OS page),
+// breadth-first from the root. Child and sibling links are stored as
+// file offsets. Payloads are stored as their raw 64-bit values, so only
+// payloads that are not pointers into the saving process (integers,
+// offsets, record IDs) survive a round trip.
+//
+// bt_open_mmap() maps such a file read-only and shared, without reading
+// or rewriting any page. Opening is instant, and processes that open
+// the same file share one copy of it in the page cache. The handle
+// supports bt_search, bt_search_batch, bt_range_search, cursors and
+// bt_save. bt_insert, bt_delete and bt_bulk_load leave it unchanged, and
+// bt_delete returns 0. bt_free unmaps it. Files are tied to the build's
+// node layout: a file whose degree, layout or format version differs is
+// rejected.
+
+// Returns 0 on success, -1 on an I/O error.
+int     bt_save(BTree *tree, const char *path);
+
+// NULL if the file cannot be mapped or is not a valid tree file.
+BTree*  bt_open_mmap(const char *path);
+
+// Number of keys in tree. O(1): reads the counter kept by bt_insert.
 size_t  bt_count_keys(BTree *tree);
 
+// Bytes reserved for the tree's nodes (whole arena chunks, including
+// released and not yet used slots); the file size for a mapped tree.
+size_t  bt_memory_bytes(BTree *tree);
+
+// Bytes of the nodes in use now: unlike bt_memory_bytes, this shrinks
+// when deletes merge nodes away.
+size_t  bt_live_bytes(BTree *tree);
+
+// Levels from the root to the leaves (1 = the root is a leaf).
+int     bt_height(BTree *tree);
+
 #endif // BTREE_H
@@ -0,0 +1,11 @@
+// btvariants.c
+#include "btvariants.h"
+
+BTF_DEFINE(btf8_64,   8, int64_t, uint64_t, INT64_MAX)
+BTF_DEFINE(btf16_64, 16, int64_t, uint64_t, INT64_MAX)
+BTF_DEFINE(btf32_64, 32, int64_t, uint64_t, INT64_MAX)
+BTF_DEFINE(btf64_64, 64, int64_t, uint64_t, INT64_MAX)
+BTF_DEFINE(btf8_32,   8, int32_t, uint32_t, INT32_MAX)
+BTF_DEFINE(btf16_32, 16, int32_t, uint32_t, INT32_MAX)
+BTF_DEFINE(btf32_32, 32, int32_t, uint32_t, INT32_MAX)
+BTF_DEFINE(btf64_32, 64, int32_t, uint32_t, INT32_MAX)
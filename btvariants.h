@@ -0,0 +1,19 @@
+// btvariants.h
+#ifndef BTVARIANTS_H
+#define BTVARIANTS_H
+
+#include "btfixed.h"
+
+// The btfixed.h instantiations bench_btree compares: minimum degree 8,
+// 16, 32 and 64, each with 64-bit keys and payloads (btfT_64) and with
+// 32-bit keys and payloads (btfT_32), whose nodes are half the size.
+BTF_DECLARE(btf8_64,   8, int64_t, uint64_t)
+BTF_DECLARE(btf16_64, 16, int64_t, uint64_t)
+BTF_DECLARE(btf32_64, 32, int64_t, uint64_t)
+BTF_DECLARE(btf64_64, 64, int64_t, uint64_t)
+BTF_DECLARE(btf8_32,   8, int32_t, uint32_t)
+BTF_DECLARE(btf16_32, 16, int32_t, uint32_t)
+BTF_DECLARE(btf32_32, 32, int32_t, uint32_t)
+BTF_DECLARE(btf64_32, 64, int32_t, uint32_t)
+
+#endif // BTVARIANTS_H
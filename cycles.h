@@ -0,0 +1,27 @@
+// cycles.h
+#ifndef CYCLES_H
+#define CYCLES_H
+
+#include <stdint.h>
+#include <time.h>
+
+// Cheap monotonic timestamp for cost accounting. x86 reads the TSC
+// (constant-rate on every CPU this targets), AArch64 the virtual counter;
+// elsewhere it falls back to nanoseconds from the monotonic clock. Only
+// differences on one machine are meaningful: the unit is "cycles" of the
+// respective counter, not necessarily core clock cycles.
+static inline uint64_t hc_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __builtin_ia32_rdtsc();
+#elif defined(__aarch64__)
+    uint64_t v;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(v));
+    return v;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+#endif // CYCLES_H
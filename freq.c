@@ -0,0 +1,274 @@
+// freq.c
+#include "freq.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define FREQ_LINE          64
+#define FREQ_DEFAULT_BYTES (1u << 20)
+#define CMS_PER_LINE       16   // float counters per cache line
+#define CMS_DEPTH          4    // counters per key, all in one line
+#define TABLE_WAYS         4    // entries per cache-line bucket
+#define RESET_MULTIPLIER   10   // halve after 10x "capacity" updates (TinyLFU)
+
+typedef struct {
+    int64_t key;
+    float   score;
+    int32_t used;
+} FreqEntry;
+
+struct Freq {
+    FreqKind kind;
+    int64_t  max_key;
+
+    double    *dense;     // FREQ_DENSE: array[max_key+1]
+    float     *cms;       // FREQ_CMS:   nlines * CMS_PER_LINE counters
+    FreqEntry *table;     // FREQ_TABLE: nlines * TABLE_WAYS entries
+    size_t     nlines;    // power of two
+    size_t     bytes;
+    NMPolicy   policy;
+
+    uint64_t   updates;       // hits so far; also the halving cursor
+    uint64_t   line_period;   // hits between halving consecutive lines
+};
+
+// Counters may be hit by several threads at once (HCIndex concurrent
+// mode). Each counter access is a single relaxed atomic load or store:
+// racing hits can lose an update, but no value is ever torn. On x86-64
+// and AArch64 these are plain moves, so single-threaded use pays nothing.
+static inline float ld_f(const float *p) {
+    float v; __atomic_load(p, &v, __ATOMIC_RELAXED); return v;
+}
+static inline void st_f(float *p, float v) {
+    __atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+static inline double ld_d(const double *p) {
+    double v; __atomic_load(p, &v, __ATOMIC_RELAXED); return v;
+}
+static inline void st_d(double *p, double v) {
+    __atomic_store(p, &v, __ATOMIC_RELAXED);
+}
+
+// splitmix64 finalizer: cheap and well mixed in every bit.
+static inline uint64_t freq_hash(int64_t k) {
+    uint64_t z = (uint64_t)k + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// The one state array, whichever the kind.
+static void* freq_state(const Freq *f) {
+    switch (f->kind) {
+    case FREQ_CMS:   return f->cms;
+    case FREQ_TABLE: return f->table;
+    default:         return f->dense;
+    }
+}
+
+static size_t floor_pow2(size_t x) {
+    size_t p = 1;
+    while (p * 2 <= x) p *= 2;
+    return p;
+}
+
+Freq* freq_create(FreqKind kind, int64_t max_key, size_t mem_bytes) {
+    Freq *f = (Freq*)calloc(1, sizeof(Freq));
+    f->policy = NM_POLICY_DEFAULT;
+    f->kind = kind;
+    f->max_key = max_key;
+    if (mem_bytes == 0) mem_bytes = FREQ_DEFAULT_BYTES;
+
+    switch (kind) {
+    case FREQ_CMS:
+        f->nlines = floor_pow2(mem_bytes / FREQ_LINE > 0 ? mem_bytes / FREQ_LINE : 1);
+        f->bytes = f->nlines * FREQ_LINE;
+        f->cms = (float*)nm_alloc(f->bytes, f->policy);
+        // Roughly one distinct key per CMS_DEPTH counters.
+        f->line_period = RESET_MULTIPLIER * (CMS_PER_LINE / CMS_DEPTH);
+        break;
+    case FREQ_TABLE:
+        f->nlines = floor_pow2(mem_bytes / FREQ_LINE > 0 ? mem_bytes / FREQ_LINE : 1);
+        f->bytes = f->nlines * FREQ_LINE;
+        f->table = (FreqEntry*)nm_alloc(f->bytes, f->policy);
+        f->line_period = RESET_MULTIPLIER * TABLE_WAYS;
+        break;
+    default:
+        f->kind = FREQ_DENSE;
+        f->bytes = sizeof(double) * (size_t)(max_key + 1);
+        f->dense = (double*)nm_alloc(f->bytes, f->policy);
+        break;
+    }
+    return f;
+}
+
+void freq_free(Freq *f) {
+    if (!f) return;
+    nm_free(freq_state(f), f->bytes);
+    free(f);
+}
+
+void freq_set_placement(Freq *f, NMPolicy p) {
+    f->policy = p;
+    void *old = freq_state(f);
+    void *state = nm_alloc(f->bytes, p);
+    memcpy(state, old, f->bytes);
+    switch (f->kind) {
+    case FREQ_CMS:   f->cms = (float*)state;       break;
+    case FREQ_TABLE: f->table = (FreqEntry*)state; break;
+    default:         f->dense = (double*)state;    break;
+    }
+    nm_free(old, f->bytes);
+}
+
+size_t freq_bytes(const Freq *f) {
+    return f ? f->bytes : 0;
+}
+
+// State on disk: kind, bytes and updates (u64 each), then the counters.
+
+int freq_save(const Freq *f, FILE *out) {
+    uint64_t hdr[3] = { (uint64_t)f->kind, f->bytes,
+                        __atomic_load_n(&f->updates, __ATOMIC_RELAXED) };
+    if (fwrite(hdr, sizeof(hdr), 1, out) != 1) return -1;
+    return fwrite(freq_state(f), 1, f->bytes, out) == f->bytes ? 0 : -1;
+}
+
+int freq_load(Freq *f, FILE *in) {
+    uint64_t hdr[3];
+    if (fread(hdr, sizeof(hdr), 1, in) != 1) return -1;
+    if (hdr[0] != (uint64_t)f->kind || hdr[1] != f->bytes) return -1;
+    void *tmp = malloc(f->bytes);
+    if (fread(tmp, 1, f->bytes, in) != f->bytes) {
+        free(tmp);
+        return -1;
+    }
+    memcpy(freq_state(f), tmp, f->bytes);
+    free(tmp);
+    f->updates = hdr[2];
+    return 0;
+}
+
+// Periodic aging for the bounded estimators, so stale keys and collision
+// noise fade out: every counter is halved once per RESET_MULTIPLIER
+// "capacity" hits. Halving all of them at once would stall one hit for
+// the whole array (256K counters at 1 MiB), so a cursor sweeps it
+// instead, one line per line_period hits; each line is still halved once
+// per nlines * line_period hits.
+static void freq_halve_line(Freq *f, size_t line) {
+    if (f->kind == FREQ_CMS) {
+        float *c = f->cms + line * CMS_PER_LINE;
+        for (int i = 0; i < CMS_PER_LINE; i++) st_f(&c[i], ld_f(&c[i]) * 0.5f);
+    } else {
+        FreqEntry *b = f->table + line * TABLE_WAYS;
+        for (int w = 0; w < TABLE_WAYS; w++)
+            st_f(&b[w].score, ld_f(&b[w].score) * 0.5f);
+    }
+}
+
+// Count one update; the hits that complete a line period (exactly one per
+// period, even with concurrent callers) halve the next line.
+static inline void freq_tick(Freq *f) {
+    uint64_t n = __atomic_add_fetch(&f->updates, 1, __ATOMIC_RELAXED);
+    if (n % f->line_period == 0)
+        freq_halve_line(f, (size_t)(n / f->line_period) & (f->nlines - 1));
+}
+
+// The four counters of k within its cache line, from disjoint hash bits.
+static inline float* cms_line(const Freq *f, uint64_t h, int slot[CMS_DEPTH]) {
+    for (int d = 0; d < CMS_DEPTH; d++)
+        slot[d] = (int)((h >> (4 * d)) & (CMS_PER_LINE - 1));
+    return f->cms + ((h >> 32) & (f->nlines - 1)) * CMS_PER_LINE;
+}
+
+static inline float cms_min(const float *line, const int slot[CMS_DEPTH]) {
+    float m = ld_f(&line[slot[0]]);
+    for (int d = 1; d < CMS_DEPTH; d++) {
+        float c = ld_f(&line[slot[d]]);
+        if (c < m) m = c;
+    }
+    return m;
+}
+
+static inline FreqEntry* table_bucket(const Freq *f, int64_t k) {
+    return f->table + (freq_hash(k) & (f->nlines - 1)) * TABLE_WAYS;
+}
+
+static inline FreqEntry* table_find(FreqEntry *b, int64_t k) {
+    for (int w = 0; w < TABLE_WAYS; w++)
+        if (__atomic_load_n(&b[w].used, __ATOMIC_RELAXED) &&
+            __atomic_load_n(&b[w].key, __ATOMIC_RELAXED) == k) return &b[w];
+    return NULL;
+}
+
+double freq_hit(Freq *f, int64_t k, double alpha) {
+    switch (f->kind) {
+    case FREQ_DENSE: {
+        if (k < 0 || k > f->max_key) return 0.0;
+        double s = alpha * ld_d(&f->dense[k]) + 1.0;
+        st_d(&f->dense[k], s);
+        return s;
+    }
+    case FREQ_CMS: {
+        int slot[CMS_DEPTH];
+        float *line = cms_line(f, freq_hash(k), slot);
+        float s = (float)(alpha * cms_min(line, slot) + 1.0);
+        // Conservative update: only raise counters that are below s.
+        for (int d = 0; d < CMS_DEPTH; d++)
+            if (ld_f(&line[slot[d]]) < s) st_f(&line[slot[d]], s);
+        freq_tick(f);
+        return s;
+    }
+    default: {
+        FreqEntry *b = table_bucket(f, k);
+        FreqEntry *e = table_find(b, k);
+        if (!e) {
+            // Take a free way, or displace the coolest entry in the bucket.
+            // (Two threads may claim the same way for different keys; one
+            // of them simply loses its entry, as with any displacement.)
+            e = &b[0];
+            for (int w = 0; w < TABLE_WAYS; w++) {
+                if (!__atomic_load_n(&b[w].used, __ATOMIC_RELAXED)) { e = &b[w]; break; }
+                if (ld_f(&b[w].score) < ld_f(&e->score)) e = &b[w];
+            }
+            __atomic_store_n(&e->key, k, __ATOMIC_RELAXED);
+            st_f(&e->score, 0.0f);
+            __atomic_store_n(&e->used, 1, __ATOMIC_RELAXED);
+        }
+        float s = (float)(alpha * ld_f(&e->score) + 1.0);
+        st_f(&e->score, s);
+        freq_tick(f);
+        return s;
+    }
+    }
+}
+
+double freq_get(Freq *f, int64_t k) {
+    switch (f->kind) {
+    case FREQ_DENSE:
+        return (k >= 0 && k <= f->max_key) ? ld_d(&f->dense[k]) : 0.0;
+    case FREQ_CMS: {
+        int slot[CMS_DEPTH];
+        float *line = cms_line(f, freq_hash(k), slot);
+        return cms_min(line, slot);
+    }
+    default: {
+        FreqEntry *e = table_find(table_bucket(f, k), k);
+        return e ? ld_f(&e->score) : 0.0;
+    }
+    }
+}
+
+void freq_scale(Freq *f, int64_t k, double factor) {
+    switch (f->kind) {
+    case FREQ_DENSE:
+        if (k >= 0 && k <= f->max_key) st_d(&f->dense[k], ld_d(&f->dense[k]) * factor);
+        break;
+    case FREQ_CMS:
+        break;
+    default: {
+        FreqEntry *e = table_find(table_bucket(f, k), k);
+        if (e) st_f(&e->score, (float)(ld_f(&e->score) * factor));
+        break;
+    }
+    }
+}
@@ -0,0 +1,64 @@
+// freq.h
+#ifndef FREQ_H
+#define FREQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "hcnuma.h"
+
+// Access-frequency estimators behind HCIndex's hit scores.
+//
+// Every estimator tracks a decayed score per key: on each hit
+//     score(k) = alpha * score(k) + 1
+// and promotion compares that score against hot_threshold. They differ
+// in how much memory they need and which keys they can track:
+//
+//   FREQ_DENSE  exact, one double per key in [0, max_key]
+//               (memory grows with the key domain)
+//   FREQ_CMS    Count-Min sketch of float counters with conservative
+//               update; all four counters of a key share one cache line.
+//               Overestimates only; counters are halved periodically.
+//   FREQ_TABLE  open-addressing table of (key, score) pairs, four per
+//               cache-line bucket. On a full bucket, the lowest score is
+//               replaced. Scores are halved periodically.
+//
+// The CMS and table sizes are fixed by mem_bytes and accept any key.
+// All operations are O(1); the periodic halving is spread over the hits,
+// one cache line at a time.
+typedef enum {
+    FREQ_DENSE = 0,
+    FREQ_CMS   = 1,
+    FREQ_TABLE = 2
+} FreqKind;
+
+typedef struct Freq Freq;
+
+// mem_bytes is ignored for FREQ_DENSE; 0 picks a 1 MiB default otherwise.
+Freq*   freq_create(FreqKind kind, int64_t max_key, size_t mem_bytes);
+void    freq_free(Freq *f);
+
+// Page size and NUMA node of the counters (hcnuma.h); copies them to
+// new memory. Call before other threads use f.
+void    freq_set_placement(Freq *f, NMPolicy p);
+
+// Record a hit on k and return its new score.
+double  freq_hit(Freq *f, int64_t k, double alpha);
+
+// Current score of k (0 if untracked).
+double  freq_get(Freq *f, int64_t k);
+
+// Multiply k's score by factor (eviction aging). A no-op for FREQ_CMS,
+// whose counters are shared between keys; periodic halving ages it instead.
+void    freq_scale(Freq *f, int64_t k, double factor);
+
+// Bytes of estimator state.
+size_t  freq_bytes(const Freq *f);
+
+// Write / read the whole estimator state (used by hc_snapshot). freq_load
+// only accepts state from an estimator of the same kind and size, and
+// leaves f unchanged otherwise. Both return 0 on success, -1 on error.
+int     freq_save(const Freq *f, FILE *out);
+int     freq_load(Freq *f, FILE *in);
+
+#endif // FREQ_H
@@ -0,0 +1,196 @@
+// hcnuma.c
+#define _GNU_SOURCE   // sched_getcpu(), syscall(), MAP_HUGETLB
+#include "hcnuma.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
+#define NM_HUGE       ((size_t)2 << 20)
+#define NM_HUGE_MIN   ((size_t)1 << 20)   // smaller allocations use normal pages
+#define NM_MAX_NODES  1024
+
+// mbind(2) modes and flags, as in <numaif.h> (not always installed).
+#define NM_MPOL_PREFERRED  1
+#define NM_MPOL_INTERLEAVE 3
+#define NM_MPOL_MF_MOVE    2
+
+static int     nm_count = 1;
+static int     nm_real;                 // nodes the system really has
+static int     nm_ids[NM_MAX_NODES];    // node index -> system node id
+static int    *nm_cpu_node;             // CPU -> node index
+static int     nm_ncpu;
+static size_t  nm_asked, nm_got;
+
+// Calls f(v, arg) for every number in a list such as "0-3,8,10-11".
+static void nm_parse_list(const char *s, void (*f)(int, void*), void *arg) {
+    while (*s) {
+        char *end;
+        long a = strtol(s, &end, 10), b = a;
+        if (end == s) break;
+        s = end;
+        if (*s == '-') {
+            b = strtol(s + 1, &end, 10);
+            s = end;
+        }
+        for (long v = a; v <= b; v++) f((int)v, arg);
+        if (*s != ',') break;
+        s++;
+    }
+}
+
+static int nm_read_line(const char *path, char *buf, size_t len) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) return 0;
+    int ok = fgets(buf, (int)len, fp) != NULL;
+    fclose(fp);
+    return ok;
+}
+
+static void nm_add_node(int id, void *arg) {
+    (void)arg;
+    if (nm_real < NM_MAX_NODES) nm_ids[nm_real++] = id;
+}
+
+static void nm_add_cpu(int cpu, void *arg) {
+    if (cpu >= 0 && cpu < nm_ncpu) nm_cpu_node[cpu] = *(int*)arg;
+}
+
+__attribute__((constructor))
+static void nm_init(void) {
+    long ncpu = sysconf(_SC_NPROCESSORS_CONF);
+    nm_ncpu = ncpu > 0 ? (int)ncpu : 1;
+    nm_cpu_node = (int*)calloc((size_t)nm_ncpu, sizeof(int));
+
+    char buf[4096];
+    nm_real = 0;
+    if (nm_read_line("/sys/devices/system/node/online", buf, sizeof(buf)))
+        nm_parse_list(buf, nm_add_node, NULL);
+    if (nm_real == 0) {
+        nm_real = 1;
+        nm_ids[0] = 0;
+    }
+    for (int i = 0; i < nm_real && nm_real > 1; i++) {
+        char path[96];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", nm_ids[i]);
+        if (nm_read_line(path, buf, sizeof(buf)))
+            nm_parse_list(buf, nm_add_cpu, &i);
+    }
+    nm_count = nm_real;
+
+    const char *force = getenv("HC_NUMA_NODES");
+    int n = force ? atoi(force) : 0;
+    if (n > 0 && n <= NM_MAX_NODES) {
+        nm_count = n;
+        for (int c = 0; c < nm_ncpu; c++) nm_cpu_node[c] = c % n;
+        for (int i = nm_real; i < n; i++) nm_ids[i] = -1;   // no such node
+    }
+}
+
+int nm_nodes(void) {
+    return nm_count;
+}
+
+static __thread int      nm_tls_node = -1;
+static __thread unsigned nm_tls_calls;
+
+int nm_current_node(void) {
+    if (nm_count == 1) return 0;
+    if (nm_tls_node < 0 || (++nm_tls_calls & 255) == 0) {
+        int cpu = sched_getcpu();
+        nm_tls_node = (cpu >= 0 && cpu < nm_ncpu) ? nm_cpu_node[cpu] : 0;
+    }
+    return nm_tls_node;
+}
+
+// Apply node's policy to [ptr, ptr + bytes); flags = NM_MPOL_MF_MOVE also
+// migrates pages already there. Only for nodes that exist.
+static void nm_bind(void *ptr, size_t bytes, int node, unsigned flags) {
+#ifdef __linux__
+    if (nm_real <= 1 || node == NM_LOCAL) return;
+    unsigned long mask[NM_MAX_NODES / (8 * sizeof(unsigned long))];
+    memset(mask, 0, sizeof(mask));
+    int mode;
+    if (node == NM_INTERLEAVE) {
+        mode = NM_MPOL_INTERLEAVE;
+        for (int i = 0; i < nm_real; i++)
+            mask[nm_ids[i] / (8 * sizeof(long))] |= 1ul << (nm_ids[i] % (8 * sizeof(long)));
+    } else {
+        if (node < 0 || node >= nm_count || nm_ids[node] < 0) return;
+        mode = NM_MPOL_PREFERRED;
+        mask[nm_ids[node] / (8 * sizeof(long))] |= 1ul << (nm_ids[node] % (8 * sizeof(long)));
+    }
+    // A hint like madvise: if the kernel refuses, first touch decides.
+    (void)syscall(SYS_mbind, ptr, bytes, mode, mask, (unsigned long)NM_MAX_NODES + 1, flags);
+#else
+    (void)ptr; (void)bytes; (void)node; (void)flags;
+#endif
+}
+
+static size_t nm_round(size_t bytes) {
+    size_t unit = bytes >= NM_HUGE_MIN ? NM_HUGE : (size_t)sysconf(_SC_PAGESIZE);
+    return (bytes + unit - 1) & ~(unit - 1);
+}
+
+// len bytes aligned to a huge page: map more, then trim both ends.
+static void* nm_map_aligned(size_t len) {
+    size_t over = len + NM_HUGE;
+    char *p = (char*)mmap(NULL, over, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) return NULL;
+    char *a = (char*)(((uintptr_t)p + NM_HUGE - 1) & ~(uintptr_t)(NM_HUGE - 1));
+    if (a > p) munmap(p, (size_t)(a - p));
+    size_t tail = (size_t)(p + over - (a + len));
+    if (tail) munmap(a + len, tail);
+    return a;
+}
+
+void* nm_alloc(size_t bytes, NMPolicy p) {
+    size_t len = nm_round(bytes ? bytes : 1);
+    void *ptr = NULL;
+    if (len < NM_HUGE_MIN) {
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) return NULL;
+        nm_bind(ptr, len, p.node, 0);
+        return ptr;
+    }
+#ifdef MAP_HUGETLB
+    if (p.pages == NM_PAGES_HUGE) {
+        __atomic_add_fetch(&nm_asked, len, __ATOMIC_RELAXED);
+        ptr = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (ptr != MAP_FAILED) {
+            __atomic_add_fetch(&nm_got, len, __ATOMIC_RELAXED);
+            nm_bind(ptr, len, p.node, 0);
+            return ptr;
+        }
+    }
+#endif
+    ptr = nm_map_aligned(len);
+    if (!ptr) return NULL;
+#ifdef MADV_HUGEPAGE
+    madvise(ptr, len, MADV_HUGEPAGE);   // a hint; failure is fine
+#endif
+    nm_bind(ptr, len, p.node, 0);
+    return ptr;
+}
+
+void nm_free(void *ptr, size_t bytes) {
+    if (ptr) munmap(ptr, nm_round(bytes ? bytes : 1));
+}
+
+void nm_place(void *ptr, size_t bytes, int node) {
+    if (ptr) nm_bind(ptr, nm_round(bytes ? bytes : 1), node, NM_MPOL_MF_MOVE);
+}
+
+void nm_huge_stats(size_t *asked, size_t *got) {
+    *asked = __atomic_load_n(&nm_asked, __ATOMIC_RELAXED);
+    *got   = __atomic_load_n(&nm_got, __ATOMIC_RELAXED);
+}
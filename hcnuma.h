@@ -0,0 +1,59 @@
+// hcnuma.h
+#ifndef HCNUMA_H
+#define HCNUMA_H
+
+#include <stddef.h>
+
+// Page size and NUMA placement for the large allocations: tree node
+// chunks (arena.h), hot hash tables and frequency state.
+//
+// Memory comes straight from mmap. Allocations of 1 MiB and more are
+// rounded up to whole, 2 MiB-aligned huge pages and get transparent huge
+// pages where the kernel allows it (madvise); NM_PAGES_HUGE asks for
+// explicit hugetlb pages (MAP_HUGETLB) first and falls back to that when
+// the pool is empty. Smaller allocations use normal pages.
+//
+// Placement is set with mbind before the pages are first touched, or
+// moved later with nm_place. Nodes are numbered 0..nm_nodes()-1 in the
+// order the system lists its online nodes. On a single-node machine, on
+// other systems, or when the kernel refuses a policy, memory simply
+// stays where first touch puts it. HC_NUMA_NODES=N in the environment
+// pretends there are N nodes, with CPU c on node c % N, so replication
+// can be tried on a smaller machine (placement on nodes that do not
+// exist is then skipped).
+typedef enum {
+    NM_PAGES_DEFAULT = 0,   // transparent huge pages if enabled, else 4 KiB
+    NM_PAGES_HUGE    = 1    // hugetlb 2 MiB pages, else as NM_PAGES_DEFAULT
+} NMPages;
+
+#define NM_LOCAL      (-1)  // first touch: the node of the first writer
+#define NM_INTERLEAVE (-2)  // pages round-robin over every node
+
+typedef struct {
+    int pages;   // NMPages
+    int node;    // a node index, NM_LOCAL or NM_INTERLEAVE
+} NMPolicy;
+
+#define NM_POLICY_DEFAULT ((NMPolicy){ NM_PAGES_DEFAULT, NM_LOCAL })
+
+// Online NUMA nodes (1 if unknown).
+int    nm_nodes(void);
+
+// Node of the CPU the calling thread runs on. Cached per thread and
+// re-read every 256 calls, so a migrated thread catches up quickly.
+int    nm_current_node(void);
+
+// bytes of zeroed memory placed by p, or NULL. Free with nm_free and the
+// same size.
+void*  nm_alloc(size_t bytes, NMPolicy p);
+void   nm_free(void *ptr, size_t bytes);
+
+// Move the pages of an nm_alloc'd (or other page-aligned) range to node
+// (a node index, or NM_INTERLEAVE). NM_LOCAL leaves them where they are.
+void   nm_place(void *ptr, size_t bytes, int node);
+
+// Bytes requested with NM_PAGES_HUGE so far, and how many of them came
+// from the hugetlb pool.
+void   nm_huge_stats(size_t *asked, size_t *got);
+
+#endif // HCNUMA_H
@@ -0,0 +1,247 @@
+// hcshard.c
+#include "hcshard.h"
+#include "keysearch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define HCS_REBALANCE_EVERY 65536   // lookups per thread between rebalances
+#define HCS_LOAD_DECAY      0.5     // weight of history in the load estimate
+#define HCS_FLOOR_SHARE     0.10    // budget spread evenly regardless of load
+#define HCS_RESIZE_MIN      64      // budget changes smaller than this many
+#define HCS_RESIZE_SLACK    0.05    // keys, or this fraction, are deferred
+#define HCS_BATCH_GROUP     256
+
+HCShardedIndex* hcs_create(int64_t min_key, int64_t max_key, int nshards,
+                           int btree_degree, HCParams params) {
+    if (nshards < 1) nshards = 1;
+    if (nshards > HCS_MAX_SHARDS) nshards = HCS_MAX_SHARDS;
+    if ((int64_t)nshards > max_key - min_key + 1) nshards = (int)(max_key - min_key + 1);
+
+    HCShardedIndex *s = (HCShardedIndex*)malloc(sizeof(HCShardedIndex));
+    s->nshards = nshards;
+    s->fences = (BTKey*)malloc(sizeof(BTKey) * (size_t)(nshards > 1 ? nshards - 1 : 1));
+    s->shards = (HCIndex**)malloc(sizeof(HCIndex*) * (size_t)nshards);
+    s->last_queries = (long*)calloc((size_t)nshards, sizeof(long));
+    s->load = (double*)malloc(sizeof(double) * (size_t)nshards);
+    s->target = (size_t*)calloc((size_t)nshards, sizeof(size_t));
+    s->pending = 0;
+    pthread_mutex_init(&s->rebalance_lock, NULL);
+
+    // Equal-width ranges; the last shard absorbs the remainder.
+    int64_t span = (max_key - min_key + 1) / nshards;
+    int64_t lo = min_key;
+    for (int i = 0; i < nshards; i++) {
+        int64_t hi = (i == nshards - 1) ? max_key : lo + span - 1;
+        s->shards[i] = hc_create_range(lo, hi, btree_degree, params);
+        if (i > 0) s->fences[i-1] = lo;
+        s->load[i] = 1.0 / nshards;
+        lo = hi + 1;
+    }
+
+    s->hot_budget = (size_t)ceil(params.max_hot_fraction * (double)(max_key - min_key + 1));
+    hcs_rebalance(s);   // even split to start with
+    return s;
+}
+
+void hcs_free(HCShardedIndex *s) {
+    if (!s) return;
+    for (int i = 0; i < s->nshards; i++) hc_free(s->shards[i]);
+    pthread_mutex_destroy(&s->rebalance_lock);
+    free(s->shards);
+    free(s->fences);
+    free(s->last_queries);
+    free(s->load);
+    free(s->target);
+    free(s);
+}
+
+int hcs_shard_of(const HCShardedIndex *s, BTKey k) {
+    // Shard = number of fences <= k.
+    int n = s->nshards - 1;
+    if (n == 0) return 0;
+    if (k == INT64_MAX) return n;
+    return ks_lower_bound(s->fences, n, k + 1);
+}
+
+void hcs_insert(HCShardedIndex *s, BTKey k, BTPayload v) {
+    hc_insert(s->shards[hcs_shard_of(s, k)], k, v);
+}
+
+int hcs_update(HCShardedIndex *s, BTKey k, BTPayload v) {
+    return hc_update(s->shards[hcs_shard_of(s, k)], k, v);
+}
+
+int hcs_delete(HCShardedIndex *s, BTKey k) {
+    return hc_delete(s->shards[hcs_shard_of(s, k)], k);
+}
+
+int hcs_bulk_load(HCShardedIndex *s, const BTKey *keys, const BTPayload *payloads,
+                  size_t n, double fill_factor) {
+    size_t start = 0;
+    for (int i = 0; i < s->nshards; i++) {
+        size_t end = start;
+        if (i == s->nshards - 1) {
+            end = n;
+        } else {
+            while (end < n && keys[end] < s->fences[i]) end++;
+        }
+        if (hc_bulk_load(s->shards[i], keys + start, payloads + start,
+                         end - start, fill_factor) != 0)
+            return -1;
+        start = end;
+    }
+    return 0;
+}
+
+static void hcs_retarget_locked(HCShardedIndex *s);
+static void hcs_apply_locked(HCShardedIndex *s, int wait, int exact);
+
+// Count lookups per thread and rebalance every HCS_REBALANCE_EVERY. The
+// counter is thread-local, so routing itself writes no shared memory.
+// The rebalance only try-locks, so a lookup never waits on it.
+static _Thread_local unsigned long hcs_tl_lookups;
+
+static inline void hcs_tick(HCShardedIndex *s, unsigned long n) {
+    unsigned long before = hcs_tl_lookups;
+    hcs_tl_lookups += n;
+    if (s->nshards > 1 &&
+        before / HCS_REBALANCE_EVERY != hcs_tl_lookups / HCS_REBALANCE_EVERY &&
+        pthread_mutex_trylock(&s->rebalance_lock) == 0) {
+        hcs_retarget_locked(s);
+        hcs_apply_locked(s, 0, 0);
+        pthread_mutex_unlock(&s->rebalance_lock);
+    }
+}
+
+BTPayload hcs_search(HCShardedIndex *s, BTKey k) {
+    hcs_tick(s, 1);
+    return hc_search(s->shards[hcs_shard_of(s, k)], k);
+}
+
+void hcs_search_batch(HCShardedIndex *s, const BTKey *keys, size_t n, BTPayload *out) {
+    if (s->nshards == 1) {
+        hcs_tick(s, n);
+        hc_search_batch(s->shards[0], keys, n, out);
+        return;
+    }
+    BTKey     gk[HCS_BATCH_GROUP];
+    BTPayload gv[HCS_BATCH_GROUP];
+    unsigned  pos[HCS_BATCH_GROUP];
+    short     sh[HCS_BATCH_GROUP];
+    unsigned  start[HCS_MAX_SHARDS + 1];
+
+    for (size_t base = 0; base < n; base += HCS_BATCH_GROUP) {
+        size_t m = n - base;
+        if (m > HCS_BATCH_GROUP) m = HCS_BATCH_GROUP;
+
+        // Counting sort of the group by shard, keeping input order within
+        // a shard so per-shard bookkeeping sees keys in query order.
+        memset(start, 0, sizeof(unsigned) * (size_t)(s->nshards + 1));
+        for (size_t j = 0; j < m; j++) {
+            sh[j] = (short)hcs_shard_of(s, keys[base + j]);
+            start[sh[j] + 1]++;
+        }
+        for (int i = 0; i < s->nshards; i++) start[i + 1] += start[i];
+        for (size_t j = 0; j < m; j++) {
+            unsigned p = start[sh[j]]++;
+            gk[p] = keys[base + j];
+            pos[p] = (unsigned)j;
+        }
+        // start[i] now marks the end of shard i's run.
+        unsigned from = 0;
+        for (int i = 0; i < s->nshards; i++) {
+            unsigned to = start[i];
+            if (to > from)
+                hc_search_batch(s->shards[i], gk + from, to - from, gv + from);
+            from = to;
+        }
+        for (size_t p = 0; p < m; p++) out[base + pos[p]] = gv[p];
+        hcs_tick(s, m);
+    }
+}
+
+void hcs_range_search(HCShardedIndex *s, BTKey lo, BTKey hi,
+                      BTRangeCallback cb, void *arg) {
+    if (lo > hi) return;
+    int first = hcs_shard_of(s, lo);
+    int last  = hcs_shard_of(s, hi);
+    for (int i = first; i <= last; i++)
+        hc_range_search(s->shards[i], lo, hi, cb, arg);
+}
+
+void hcs_flush(HCShardedIndex *s) {
+    for (int i = 0; i < s->nshards; i++) hc_flush(s->shards[i]);
+}
+
+size_t hcs_maintain(HCShardedIndex *s) {
+    if (__atomic_load_n(&s->pending, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&s->rebalance_lock);
+        hcs_apply_locked(s, 1, 0);
+        pthread_mutex_unlock(&s->rebalance_lock);
+    }
+    size_t promoted = 0;
+    for (int i = 0; i < s->nshards; i++) promoted += hc_maintain(s->shards[i]);
+    return promoted;
+}
+
+// Budget: a floor of HCS_FLOOR_SHARE spread evenly, the rest in proportion
+// to each shard's smoothed share of recent lookups.
+static void hcs_retarget_locked(HCShardedIndex *s) {
+    int n = s->nshards;
+    long total = 0;
+    long delta[HCS_MAX_SHARDS];
+    for (int i = 0; i < n; i++) {
+        long q = hc_get_stats(s->shards[i]).queries;
+        delta[i] = q - s->last_queries[i];
+        s->last_queries[i] = q;
+        total += delta[i];
+    }
+    if (total > 0) {
+        for (int i = 0; i < n; i++)
+            s->load[i] = HCS_LOAD_DECAY * s->load[i] +
+                         (1.0 - HCS_LOAD_DECAY) * (double)delta[i] / (double)total;
+    }
+    double budget = (double)s->hot_budget;
+    for (int i = 0; i < n; i++) {
+        double share = HCS_FLOOR_SHARE / n + (1.0 - HCS_FLOOR_SHARE) * s->load[i];
+        s->target[i] = (size_t)(budget * share);
+    }
+}
+
+// Move the shards to their targets. Unless exact, a change below
+// HCS_RESIZE_MIN keys or HCS_RESIZE_SLACK of the current budget is left
+// for later: the next targets may well undo it. Without wait, a shard
+// whose maintenance lock is busy is skipped and stays pending.
+static void hcs_apply_locked(HCShardedIndex *s, int wait, int exact) {
+    int pending = 0;
+    for (int i = 0; i < s->nshards; i++) {
+        HCIndex *sh = s->shards[i];
+        size_t cur = __atomic_load_n(&sh->hot_budget, __ATOMIC_RELAXED);
+        size_t cap = s->target[i];
+        size_t diff = cap > cur ? cap - cur : cur - cap;
+        if (diff == 0) continue;
+        if (!exact && (diff < HCS_RESIZE_MIN || diff < (size_t)(HCS_RESIZE_SLACK * (double)cur)))
+            continue;
+        if (wait) hc_set_hot_capacity(sh, cap);
+        else      pending |= !hc_try_set_hot_capacity(sh, cap);
+    }
+    __atomic_store_n(&s->pending, pending, __ATOMIC_RELAXED);
+}
+
+void hcs_rebalance(HCShardedIndex *s) {
+    pthread_mutex_lock(&s->rebalance_lock);
+    hcs_retarget_locked(s);
+    hcs_apply_locked(s, 1, 1);
+    pthread_mutex_unlock(&s->rebalance_lock);
+}
+
+HCStats hcs_get_stats(HCShardedIndex *s) {
+    HCStats t;
+    memset(&t, 0, sizeof(t));
+    for (int i = 0; i < s->nshards; i++) {
+        HCStats x = hc_get_stats(s->shards[i]);
+        hc_stats_add(&t, &x);
+    }
+    return t;
+}
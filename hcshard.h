@@ -0,0 +1,82 @@
+// hcshard.h
+#ifndef HCSHARD_H
+#define HCSHARD_H
+
+#include "hctree.h"
+
+// Range-partitioned HCIndex.
+//
+// The key domain [min_key, max_key] is split into nshards contiguous
+// ranges of equal width. Each range is served by its own HCIndex (own hot
+// and cold trees, hit scores, sampling controller and eviction state), so
+// threads working on different ranges share no tree roots or locks. A
+// lookup is routed by a binary search over the nshards-1 fence keys.
+//
+// The total hot budget (max_hot_fraction of the whole domain) is divided
+// between shards according to observed load: every HCS_REBALANCE_EVERY
+// lookups (per thread) the budget is recomputed from each shard's share of
+// the lookups since the last rebalance, so a shard with a hotspot gets
+// more hot capacity than a quiet one. Every shard keeps a small floor.
+//
+// The lookup that completes a period applies the new budgets without
+// waiting: it skips a shard whose maintenance lock is busy, as well as
+// changes too small to be worth the evictions. A skipped shard stays
+// pending for the next period, or for hcs_maintain, which may wait.
+#define HCS_MAX_SHARDS 256
+
+typedef struct {
+    int        nshards;
+    BTKey     *fences;     // fences[i]: first key of shard i+1
+    HCIndex  **shards;
+    size_t     hot_budget; // total hot keys across all shards
+
+    // Load-proportional budget split
+    long      *last_queries;   // per shard: queries at the last rebalance
+    double    *load;           // per shard: smoothed share of lookups
+    size_t    *target;         // per shard: budget from the last rebalance
+    int        pending;        // 1 = some shard is not at its target yet
+    pthread_mutex_t rebalance_lock;
+} HCShardedIndex;
+
+HCShardedIndex* hcs_create(int64_t min_key, int64_t max_key, int nshards,
+                           int btree_degree, HCParams params);
+void            hcs_free(HCShardedIndex *s);
+
+// Index of the shard owning k.
+int             hcs_shard_of(const HCShardedIndex *s, BTKey k);
+
+void            hcs_insert(HCShardedIndex *s, BTKey k, BTPayload v);
+int             hcs_update(HCShardedIndex *s, BTKey k, BTPayload v);
+int             hcs_delete(HCShardedIndex *s, BTKey k);
+
+// Bulk load from n strictly increasing keys; each shard gets its slice.
+int             hcs_bulk_load(HCShardedIndex *s, const BTKey *keys,
+                              const BTPayload *payloads, size_t n,
+                              double fill_factor);
+
+BTPayload       hcs_search(HCShardedIndex *s, BTKey k);
+
+// Batched lookup: keys are grouped by shard and each group goes through
+// hc_search_batch of its shard; out[j] answers keys[j].
+void            hcs_search_batch(HCShardedIndex *s, const BTKey *keys, size_t n,
+                                 BTPayload *out);
+
+// Ascending range scan across the shards covering [lo, hi].
+void            hcs_range_search(HCShardedIndex *s, BTKey lo, BTKey hi,
+                                 BTRangeCallback cb, void *arg);
+
+// hc_flush() on every shard.
+void            hcs_flush(HCShardedIndex *s);
+
+// hc_maintain() on every shard, after applying any pending budgets;
+// returns the number of keys promoted.
+size_t          hcs_maintain(HCShardedIndex *s);
+
+// Recompute the per-shard hot budgets now and apply them all, waiting for
+// each shard as needed (normally automatic).
+void            hcs_rebalance(HCShardedIndex *s);
+
+// Sum of all shards' statistics.
+HCStats         hcs_get_stats(HCShardedIndex *s);
+
+#endif // HCSHARD_H
@@ -1,21 +1,550 @@
 // hctree.c
 #include "hctree.h"
+#include "rng.h"
+#include "cycles.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
 #include <inttypes.h>
+#include <time.h>
+#include <sched.h>
+
+// --- Per-thread state ------------------------------------------------
+//
+// Each thread gets a small process-wide ordinal on first use. It picks
+// the thread's stat shard (so counters are written by one thread only in
+// the common case) and seeds its sampling RNG. A single-threaded index
+// always uses shard 0; runs stay reproducible because ordinals and seeds
+// are assigned in a fixed order.
+
+#define HC_STAT_SHARDS 64   // power of two; more threads share shards
+#define HC_SHARD_ALIGN 128  // two lines: adjacent-line prefetch pairs them
+
+typedef struct {
+    long queries;
+    long hot_hits;
+    long cold_hits;
+    long not_found;
+    long hot_node_visits;
+    long cold_node_visits;
+    long promotions;
+    long evictions;
+    long promote_drops;
+    long writebacks;
+    long flushes;
+    long filter_negatives;
+    long filter_false_pos;
+    long lookup_cycles;      // HC_ADAPT_COST only
+    long promote_cycles;
+    long filter_cycles;      // HC_INSTRUMENT only
+    long hot_cycles;
+    long cold_cycles;
+    long adapt_cycles;
+} HCCounters;
+
+struct HCStatShard {
+    _Alignas(HC_SHARD_ALIGN) HCCounters c;
+};
+
+static int hc_next_ordinal;
+static _Thread_local int hc_ordinal = -1;
+static _Thread_local Rng hc_rng;
+
+static inline int hc_thread_ordinal(void) {
+    if (hc_ordinal < 0) {
+        hc_ordinal = __atomic_fetch_add(&hc_next_ordinal, 1, __ATOMIC_RELAXED);
+        rng_seed(&hc_rng, 0x5EED0000u + (uint64_t)hc_ordinal);
+    }
+    return hc_ordinal;
+}
+
+static inline Rng* hc_thread_rng(void) {
+    hc_thread_ordinal();
+    return &hc_rng;
+}
+
+static inline HCCounters* hc_shard(HCIndex *idx) {
+    if (!idx->params.concurrent) return &idx->shards[0].c;
+    return &idx->shards[hc_thread_ordinal() & (HC_STAT_SHARDS - 1)].c;
+}
+
+// A shard is normally written by one thread, so a plain add suffices;
+// in concurrent mode it is done as a relaxed load + store (no lock
+// prefix) so that readers summing the shards never see a torn value.
+// Only threads beyond HC_STAT_SHARDS that share a shard can lose counts.
+static inline void hc_count(HCIndex *idx, long *ctr, long n) {
+    if (idx->params.concurrent)
+        __atomic_store_n(ctr, __atomic_load_n(ctr, __ATOMIC_RELAXED) + n,
+                         __ATOMIC_RELAXED);
+    else
+        *ctr += n;
+}
+
+#define HC_COUNT(idx, shard, field, n) hc_count((idx), &(shard)->field, (n))
+
+// Per-phase timing. Built with HC_INSTRUMENT, HC_PHASE_STOP adds the
+// cycles since the matching HC_PHASE_START to a counter; otherwise both
+// compile to nothing.
+#ifdef HC_INSTRUMENT
+#define HC_PHASE_START(t)                 uint64_t t = hc_cycles()
+#define HC_PHASE_STOP(idx, shard, field, t) \
+    HC_COUNT((idx), (shard), field, (long)(hc_cycles() - (t)))
+#define HC_INSTRUMENTED 1
+#else
+#define HC_PHASE_START(t)                 ((void)0)
+#define HC_PHASE_STOP(idx, shard, field, t) ((void)0)
+#define HC_INSTRUMENTED 0
+#endif
+
+// Sum of one counter over all shards.
+#define HC_SUM(idx, field, out)                                          \
+    do {                                                                 \
+        long sum_ = 0;                                                   \
+        for (int j_ = 0; j_ < HC_STAT_SHARDS; j_++)                      \
+            sum_ += __atomic_load_n(&(idx)->shards[j_].c.field,          \
+                                    __ATOMIC_RELAXED);                   \
+        (out) = sum_;                                                    \
+    } while (0)
+
+// --- Hot tier --------------------------------------------------------
+//
+// The hot tier is a BTree or a HotHash (HCParams.hot_kind); only these
+// helpers look at which. Writes to it always happen with maint_lock held
+// in concurrent mode, which is the single writer HotHash requires.
+//
+// With replicas (params.hot_replicas) lookups read the copy on their own
+// node and writes go to every copy, the primary first; the other helpers
+// (counts, scans, snapshots) read the primary.
+
+// Copy the calling thread should read.
+static inline int hc_hot_copy(const HCIndex *idx) {
+    return idx->hot_copies > 1 ? nm_current_node() % idx->hot_copies : 0;
+}
+
+// Lookup that also leaves *hint, the tree position a promotion of k can
+// insert at (the hash tier needs none).
+static inline BTPayload hc_hot_get_hint(HCIndex *idx, BTKey k, BTStats *s,
+                                        BTHint *hint) {
+    int r = hc_hot_copy(idx);
+    if (idx->hot_hash) {
+        hint->leaf = NULL;
+        return hh_get(r ? idx->hot_hash_rep[r] : idx->hot_hash, k, s);
+    }
+    if (r == 0) return bt_search_hint(idx->hot, k, s, hint);
+    hint->leaf = NULL;   // a position in a replica is no use to the primary
+    return bt_search(idx->hot_rep[r], k, s);
+}
+
+static inline void hc_hot_get_batch(HCIndex *idx, const BTKey *keys, size_t n,
+                                    BTPayload *out, BTStats *s) {
+    int r = hc_hot_copy(idx);
+    if (idx->hot_hash) hh_get_batch(r ? idx->hot_hash_rep[r] : idx->hot_hash, keys, n, out, s);
+    else               bt_search_batch(r ? idx->hot_rep[r] : idx->hot, keys, n, out, s);
+}
+
+static inline size_t hc_hot_count(HCIndex *idx) {
+    return idx->hot_hash ? hh_count(idx->hot_hash) : bt_count_keys(idx->hot);
+}
+
+// Returns 1 if k was added, 0 if it was already hot.
+static inline int hc_hot_put(HCIndex *idx, BTKey k, BTPayload v,
+                             const BTHint *hint) {
+    int added = idx->hot_hash ? hh_put(idx->hot_hash, k, v)
+                              : bt_insert_hint(idx->hot, k, v, hint);
+    for (int r = 1; r < idx->hot_copies; r++) {
+        if (idx->hot_hash) hh_put(idx->hot_hash_rep[r], k, v);
+        else               bt_insert(idx->hot_rep[r], k, v);
+    }
+    return added;
+}
+
+// Returns 1 if k was hot and now maps to v.
+static inline int hc_hot_update(HCIndex *idx, BTKey k, BTPayload v) {
+    int found = idx->hot_hash ? hh_update(idx->hot_hash, k, v)
+                              : bt_update(idx->hot, k, v);
+    for (int r = 1; found && r < idx->hot_copies; r++) {
+        if (idx->hot_hash) hh_update(idx->hot_hash_rep[r], k, v);
+        else               bt_update(idx->hot_rep[r], k, v);
+    }
+    return found;
+}
+
+static inline void hc_hot_del(HCIndex *idx, BTKey k) {
+    for (int r = 0; r < idx->hot_copies; r++) {
+        if (idx->hot_hash) hh_del(r ? idx->hot_hash_rep[r] : idx->hot_hash, k);
+        else               bt_delete(r ? idx->hot_rep[r] : idx->hot, k);
+    }
+}
+
+static inline void hc_hot_reserve(HCIndex *idx, size_t capacity) {
+    for (int r = 0; r < idx->hot_copies; r++)
+        hh_reserve(r ? idx->hot_hash_rep[r] : idx->hot_hash, capacity);
+}
+
+// Writer-side lookup, without stats (and free when hot is empty).
+static inline BTPayload hc_hot_get(HCIndex *idx, BTKey k) {
+    if (hc_hot_count(idx) == 0) return NULL;
+    BTStats s = {0};
+    if (idx->hot_hash) return hh_get(idx->hot_hash, k, &s);
+    return bt_search(idx->hot, k, &s);
+}
+
+// --- Hot-tier writes --------------------------------------------------
+//
+// The hot tier is authoritative for the keys it holds: hc_insert,
+// hc_update and hc_delete change a hot key in hot alone and record it in
+// idx->dirty, and a delete leaves HC_TOMBSTONE as its payload. The cold
+// copy is brought up to date when the key leaves hot (hc_write_back), so
+// a key that is written repeatedly while hot costs one cold write. Cold
+// still holds every live key (possibly with an old payload), which keeps
+// reads that go to cold alone, like a hash tier's range scans, complete
+// once they consult hot for dirty keys.
+//
+// In exclusive mode (params.inclusive == 0) hot holds the only copy of
+// its keys, so there is nothing to mark: every key that leaves hot alive
+// is written back, and a tombstone simply disappears.
+
+// Payload of a deleted hot key. Never handed out: lookups report a miss.
+static const char hc_tomb_obj;
+#define HC_TOMBSTONE ((BTPayload)&hc_tomb_obj)
+
+static inline int hc_is_dirty(HCIndex *idx, BTKey k) {
+    BTStats s = {0};
+    return hh_count(idx->dirty) > 0 && hh_get(idx->dirty, k, &s) != NULL;
+}
+
+static inline void hc_mark_dirty(HCIndex *idx, BTKey k) {
+    if (idx->params.inclusive)
+        hh_put(idx->dirty, k, HC_TOMBSTONE);   // any non-NULL payload
+}
+
+// Apply a pending hot update or delete of k to cold; called with
+// maint_lock held before k leaves the hot tier.
+static void hc_write_back(HCIndex *idx, BTKey k) {
+    if (!idx->params.inclusive) {
+        BTPayload v = hc_hot_get(idx, k);
+        if (v != NULL && v != HC_TOMBSTONE) {
+            bt_insert(idx->cold, k, v);
+            HC_COUNT(idx, hc_shard(idx), writebacks, 1);
+        }
+        return;
+    }
+    if (hh_count(idx->dirty) == 0 || !hh_del(idx->dirty, k)) return;
+    BTPayload v = hc_hot_get(idx, k);
+    if (v == HC_TOMBSTONE)
+        bt_delete(idx->cold, k);
+    else if (!bt_update(idx->cold, k, v))
+        bt_insert(idx->cold, k, v);
+    HC_COUNT(idx, hc_shard(idx), writebacks, 1);
+}
+
+static void hc_write_back_all(HCIndex *idx) {
+    size_t n = hh_count(idx->dirty);
+    if (n == 0) return;
+    BTKey *keys = (BTKey*)malloc(sizeof(BTKey) * n);
+    n = hh_keys(idx->dirty, keys, n);
+    for (size_t i = 0; i < n; i++) hc_write_back(idx, keys[i]);
+    free(keys);
+}
+
+// cold->writes as of now. A payload read from cold after taking the stamp
+// is current unless the count has moved since (see hc_promote_body).
+static inline uint64_t hc_cold_stamp(const HCIndex *idx) {
+    return __atomic_load_n(&idx->cold->writes, __ATOMIC_ACQUIRE);
+}
+
+// Exclusive mode, concurrent: a promotion inserts k into hot and then
+// deletes it from cold, so a lookup whose hot probe ran before the first
+// step and whose cold probe ran after the second misses a live key. The
+// delete is a cold write; a miss retries if cold was written since the
+// stamp taken before its hot probe. (Eviction inserts into cold before
+// it deletes from hot, which cannot be missed this way.)
+static inline int hc_miss_raced(const HCIndex *idx, uint64_t stamp) {
+    return !idx->params.inclusive && idx->params.concurrent &&
+           hc_cold_stamp(idx) != stamp;
+}
+
+// --- Write buffer ------------------------------------------------------
+//
+// hc_insert of a key that is not hot appends (or overwrites) an entry in a
+// small staging log instead of descending cold, and a hash of entry
+// numbers finds it again on lookup. A full log is radix-sorted and applied
+// in one batch (bt_insert_sorted), so a burst of random keys costs about
+// one descent per cold leaf it touches rather than one per key. Lookups
+// probe hot, then the buffer, then cold: a buffered payload is newer.
+//
+// A key leaves the buffer only after cold has its payload (flush, or a
+// promotion, which moves the key to cold first) or after cold no longer
+// has it (delete), so a lookup that misses the buffer still finds the
+// right answer in cold. A removed entry stays in the log as HC_TOMBSTONE
+// until the flush. Hot keys are never buffered: their writes go to hot,
+// and promotion drains the key's entry first.
+
+static inline void hc_cpu_relax(unsigned *spins) {
+    if (++*spins < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();   // the writer may be descheduled; let it finish
+    }
+}
+
+static inline size_t hc_wb_home(const HCIndex *idx, BTKey k) {
+    uint64_t x = (uint64_t)k * 0x9E3779B97F4A7C15ull;
+    return (size_t)(x ^ (x >> 32)) & idx->wb_mask;
+}
+
+// Reader side; lock-free in concurrent mode (a write in progress makes the
+// lookup retry, as for HotHash). NULL if k has no live entry.
+static BTPayload hc_wb_get(HCIndex *idx, BTKey k) {
+    if (__atomic_load_n(&idx->wb_len, __ATOMIC_RELAXED) == 0) return NULL;
+    size_t cap = idx->params.write_buffer;
+    unsigned spins = 0;
+    for (;;) {
+        uint64_t seq = __atomic_load_n(&idx->wb_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) {
+            hc_cpu_relax(&spins);
+            continue;
+        }
+        BTPayload v = NULL;
+        size_t h = hc_wb_home(idx, k);
+        // Bounded: a torn read must not spin forever.
+        for (size_t p = 0; p <= idx->wb_mask; p++, h = (h + 1) & idx->wb_mask) {
+            uint32_t e = __atomic_load_n(&idx->wb_slots[h], __ATOMIC_RELAXED);
+            if (e == 0) break;
+            if (e <= cap && idx->wb_keys[e - 1] == k) {
+                v = idx->wb_vals[e - 1];
+                break;
+            }
+        }
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&idx->wb_seq, __ATOMIC_RELAXED) == seq)
+            return v == HC_TOMBSTONE ? NULL : v;
+    }
+}
+
+static inline void hc_wb_begin(HCIndex *idx) {
+    __atomic_store_n(&idx->wb_seq, idx->wb_seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void hc_wb_end(HCIndex *idx) {
+    __atomic_store_n(&idx->wb_seq, idx->wb_seq + 1, __ATOMIC_RELEASE);
+}
+
+// Writer side (maint_lock held): the slot holding k, or the empty slot
+// where it would go. The table is at least twice the log, so one exists.
+static size_t hc_wb_probe(const HCIndex *idx, BTKey k) {
+    size_t h = hc_wb_home(idx, k);
+    for (;;) {
+        uint32_t e = idx->wb_slots[h];
+        if (e == 0 || idx->wb_keys[e - 1] == k) return h;
+        h = (h + 1) & idx->wb_mask;
+    }
+}
+
+// Entry of k if it is live, or -1.
+static long hc_wb_find(const HCIndex *idx, BTKey k) {
+    uint32_t e = idx->wb_slots[hc_wb_probe(idx, k)];
+    if (e == 0 || idx->wb_vals[e - 1] == HC_TOMBSTONE) return -1;
+    return (long)e - 1;
+}
+
+static void hc_wb_set(HCIndex *idx, size_t i, BTPayload v) {
+    hc_wb_begin(idx);
+    idx->wb_vals[i] = v;
+    hc_wb_end(idx);
+}
+
+// LSD radix sort of the live entries by key, one pass per byte in which
+// the keys differ (a burst over a dense key range needs two or three).
+// Returns how many there are; *keys / *vals point at the sorted run.
+static size_t hc_wb_sort(HCIndex *idx, BTKey **keys, BTPayload **vals) {
+    size_t cap = idx->params.write_buffer;
+    BTKey     *ka = idx->wb_sort_keys, *kb = ka + cap;
+    BTPayload *va = idx->wb_sort_vals, *vb = va + cap;
+    uint64_t any = 0, all = ~0ull;
+    size_t n = 0;
+    for (size_t i = 0; i < idx->wb_len; i++) {
+        if (idx->wb_vals[i] == HC_TOMBSTONE) continue;
+        uint64_t u = (uint64_t)idx->wb_keys[i] ^ (1ull << 63);
+        any |= u;
+        all &= u;
+        ka[n] = idx->wb_keys[i];
+        va[n] = idx->wb_vals[i];
+        n++;
+    }
+    uint64_t differ = any ^ all;
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((differ >> shift) & 0xFF) == 0) continue;
+        size_t count[257] = {0};
+        for (size_t i = 0; i < n; i++)
+            count[((((uint64_t)ka[i] ^ (1ull << 63)) >> shift) & 0xFF) + 1]++;
+        for (int d = 0; d < 256; d++) count[d + 1] += count[d];
+        for (size_t i = 0; i < n; i++) {
+            size_t at = count[(((uint64_t)ka[i] ^ (1ull << 63)) >> shift) & 0xFF]++;
+            kb[at] = ka[i];
+            vb[at] = va[i];
+        }
+        BTKey *tk = ka; ka = kb; kb = tk;
+        BTPayload *tv = va; va = vb; vb = tv;
+    }
+    *keys = ka;
+    *vals = va;
+    return n;
+}
+
+// Cold gets the payloads before the buffer lets go of them.
+static void hc_flush_locked(HCIndex *idx) {
+    if (idx->wb_len == 0) return;
+    BTKey *keys;
+    BTPayload *vals;
+    size_t n = hc_wb_sort(idx, &keys, &vals);
+    if (n) bt_insert_sorted(idx->cold, keys, vals, n);
+    hc_wb_begin(idx);
+    memset(idx->wb_slots, 0, sizeof(uint32_t) * (idx->wb_mask + 1));
+    __atomic_store_n(&idx->wb_len, 0, __ATOMIC_RELAXED);
+    hc_wb_end(idx);
+    HC_COUNT(idx, hc_shard(idx), flushes, 1);
+}
+
+// Stage k -> v; flushes once the log is full.
+static void hc_wb_put(HCIndex *idx, BTKey k, BTPayload v) {
+    size_t h = hc_wb_probe(idx, k);
+    uint32_t e = idx->wb_slots[h];
+    if (e) {
+        hc_wb_set(idx, e - 1, v);
+        return;
+    }
+    size_t i = idx->wb_len;
+    hc_wb_begin(idx);
+    idx->wb_keys[i] = k;
+    idx->wb_vals[i] = v;
+    __atomic_store_n(&idx->wb_slots[h], (uint32_t)(i + 1), __ATOMIC_RELAXED);
+    __atomic_store_n(&idx->wb_len, i + 1, __ATOMIC_RELAXED);
+    hc_wb_end(idx);
+    if (i + 1 == idx->params.write_buffer)
+        hc_flush_locked(idx);
+}
+
+// Before k is promoted: hand its buffered payload to cold and drop the
+// entry, so the hot copy is the only newer one.
+static void hc_wb_drain_key(HCIndex *idx, BTKey k) {
+    if (idx->wb_len == 0) return;
+    long i = hc_wb_find(idx, k);
+    if (i < 0) return;
+    bt_insert(idx->cold, k, idx->wb_vals[i]);
+    hc_wb_set(idx, (size_t)i, HC_TOMBSTONE);
+}
+
+void hc_flush(HCIndex *idx) {
+    if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+    hc_flush_locked(idx);
+    if (idx->params.concurrent) pthread_mutex_unlock(&idx->maint_lock);
+}
 
 HCIndex* hc_create(int64_t max_key, int btree_degree, HCParams params) {
+    return hc_create_range(0, max_key, btree_degree, params);
+}
+
+HCIndex* hc_create_range(int64_t min_key, int64_t max_key, int btree_degree,
+                         HCParams params) {
+    BTree *cold = params.cold_packed ? bt_create_packed(btree_degree)
+                : params.cold_bplus  ? bt_create_bplus(btree_degree)
+                                     : bt_create(btree_degree);
+    return hc_create_on(cold, min_key, max_key, btree_degree, params);
+}
+
+HCIndex* hc_create_on(BTree *cold, int64_t min_key, int64_t max_key,
+                      int btree_degree, HCParams params) {
     HCIndex *idx = (HCIndex*)malloc(sizeof(HCIndex));
-    idx->hot  = bt_create(btree_degree);
-    idx->cold = bt_create(btree_degree);
+    idx->cold = cold;
+    if (cold->map_base) params.inclusive = 1;   // cold cannot be written
 
+    // The tracker sees keys relative to min_key (see hc_fkey).
+    idx->min_key   = min_key;
     idx->max_key   = max_key;
-    idx->hit_score = (double*)calloc((size_t)(max_key + 1), sizeof(double));
+    idx->freq      = freq_create((FreqKind)params.freq_kind, max_key - min_key,
+                                 params.freq_bytes);
+    idx->filter    = params.filter_bits
+        ? bf_create((size_t)(max_key - min_key + 1), params.filter_bits, params.concurrent)
+        : NULL;
+    if (idx->filter && bt_count_keys(cold) > 0) {
+        BTCursor c;
+        BTKey k;
+        BTPayload v;
+        bt_cursor_seek(&c, cold, INT64_MIN, NULL);
+        while (bt_cursor_next(&c, &k, &v))
+            bf_add(idx->filter, k);
+    }
 
     idx->params = params;
-    memset(&idx->stats, 0, sizeof(HCStats));
+    idx->hot_budget   = (size_t)ceil(params.max_hot_fraction * (double)(max_key - min_key + 1));
+    idx->hot_capacity = idx->hot_budget;
+    if (params.hot_kind == HC_HOT_HASH) {
+        idx->hot      = NULL;
+        idx->hot_hash = hh_create(idx->hot_capacity, params.concurrent);
+    } else {
+        idx->hot      = bt_create(btree_degree);
+        idx->hot_hash = NULL;
+    }
+    idx->hot_rep      = NULL;
+    idx->hot_hash_rep = NULL;
+    idx->hot_copies   = 1;
+    if (params.hot_replicas && nm_nodes() > 1) {
+        int n = nm_nodes();
+        idx->hot_copies = n;
+        if (idx->hot_hash) {
+            idx->hot_hash_rep = (HotHash**)malloc(sizeof(HotHash*) * (size_t)n);
+            idx->hot_hash_rep[0] = idx->hot_hash;
+            for (int r = 1; r < n; r++)
+                idx->hot_hash_rep[r] = hh_create(idx->hot_capacity, params.concurrent);
+        } else {
+            idx->hot_rep = (BTree**)malloc(sizeof(BTree*) * (size_t)n);
+            idx->hot_rep[0] = idx->hot;
+            for (int r = 1; r < n; r++)
+                idx->hot_rep[r] = bt_create(btree_degree);
+        }
+    }
+    if (params.hot_pages != NM_PAGES_DEFAULT || idx->hot_copies > 1) {
+        // Copy r lives on node r; the hit scores are written from every
+        // node, so spread them when there are several copies.
+        for (int r = 0; r < idx->hot_copies; r++) {
+            NMPolicy p = { params.hot_pages, idx->hot_copies > 1 ? r : NM_LOCAL };
+            if (idx->hot_hash) hh_set_placement(r ? idx->hot_hash_rep[r] : idx->hot_hash, p);
+            else               bt_set_placement(r ? idx->hot_rep[r] : idx->hot, p);
+        }
+        NMPolicy fp = { params.hot_pages, idx->hot_copies > 1 ? NM_INTERLEAVE : NM_LOCAL };
+        freq_set_placement(idx->freq, fp);
+    }
+    if (params.cold_interleave)
+        bt_set_placement(cold, (NMPolicy){ NM_PAGES_DEFAULT, NM_INTERLEAVE });
+    idx->dirty = hh_create(16, 0);
+    idx->shards = (struct HCStatShard*)aligned_alloc(HC_SHARD_ALIGN,
+                      sizeof(struct HCStatShard) * HC_STAT_SHARDS);
+    memset(idx->shards, 0, sizeof(struct HCStatShard) * HC_STAT_SHARDS);
+    if (params.concurrent) {
+        for (int r = 0; idx->hot && r < idx->hot_copies; r++)
+            bt_set_concurrent(r ? idx->hot_rep[r] : idx->hot);
+        bt_set_concurrent(idx->cold);
+        pthread_mutex_init(&idx->maint_lock, NULL);
+    }
+    if (params.cold_learned > 0) bt_set_learned(idx->cold, params.cold_learned);
+
+    idx->promoq = params.async_promote
+        ? pq_create(params.promote_queue ? params.promote_queue : 4096) : NULL;
+    idx->maint_running = 0;
+    idx->maint_stop    = 0;
+    idx->maint_idle_us = 0;
+
+    idx->hot_ring     = NULL;
+    idx->hot_ring_len = 0;
+    idx->clock_hand   = 0;
+    idx->hot_tombs    = 0;
+    if (params.evict_policy != HC_EVICT_NONE && idx->hot_capacity > 0)
+        idx->hot_ring = (BTKey*)malloc(sizeof(BTKey) * idx->hot_capacity);
 
     // Init ML / regression state
     idx->last_q_for_adapt = 0;
@@ -24,26 +553,104 @@ HCIndex* hc_create(int64_t max_key, int btree_degree, HCParams params) {
     idx->lr_w0            = 0.0;  // bias
     idx->lr_w1            = 0.0;  // weight on D
 
+    idx->wb_keys      = NULL;
+    idx->wb_vals      = NULL;
+    idx->wb_slots     = NULL;
+    idx->wb_mask      = 0;
+    idx->wb_len       = 0;
+    idx->wb_seq       = 0;
+    idx->wb_sort_keys = NULL;
+    idx->wb_sort_vals = NULL;
+    if (cold->map_base) idx->params.write_buffer = 0;
+    if (idx->params.write_buffer > UINT32_MAX / 2)
+        idx->params.write_buffer = UINT32_MAX / 2;
+    size_t cap = idx->params.write_buffer;
+    if (cap) {
+        size_t slots = 2;
+        while (slots < 2 * cap) slots <<= 1;
+        idx->wb_keys      = (BTKey*)malloc(sizeof(BTKey) * cap);
+        idx->wb_vals      = (BTPayload*)malloc(sizeof(BTPayload) * cap);
+        idx->wb_slots     = (uint32_t*)calloc(slots, sizeof(uint32_t));
+        idx->wb_mask      = slots - 1;
+        idx->wb_sort_keys = (BTKey*)malloc(sizeof(BTKey) * 2 * cap);
+        idx->wb_sort_vals = (BTPayload*)malloc(sizeof(BTPayload) * 2 * cap);
+    }
+
+    memset(&idx->tuner, 0, sizeof(idx->tuner));
+    idx->tuner.dir          = 1;
+    idx->tuner.step[0]      = 2.0;   // D
+    idx->tuner.step[1]      = 1.5;   // hot_threshold
+    idx->tuner.step[2]      = 2.0;   // budget scale
+    idx->tuner.best_cost    = -1.0;
+    idx->tuner.settling     = 1;     // caches and hot tier start cold
+    idx->tuner.budget_scale = 1.0;
+
     return idx;
 }
 
 void hc_free(HCIndex *idx) {
     if (!idx) return;
+    hc_stop_maintenance(idx);
+    pq_free(idx->promoq);
+    for (int r = 1; r < idx->hot_copies; r++) {
+        if (idx->hot_rep)      bt_free(idx->hot_rep[r]);
+        if (idx->hot_hash_rep) hh_free(idx->hot_hash_rep[r]);
+    }
+    free(idx->hot_rep);
+    free(idx->hot_hash_rep);
     bt_free(idx->hot);
+    hh_free(idx->hot_hash);
+    hh_free(idx->dirty);
     bt_free(idx->cold);
-    free(idx->hit_score);
+    bf_free(idx->filter);
+    freq_free(idx->freq);
+    free(idx->hot_ring);
+    free(idx->wb_keys);
+    free(idx->wb_vals);
+    free(idx->wb_slots);
+    free(idx->wb_sort_keys);
+    free(idx->wb_sort_vals);
+    free(idx->shards);
+    if (idx->params.concurrent)
+        pthread_mutex_destroy(&idx->maint_lock);
     free(idx);
 }
 
-void hc_insert(HCIndex *idx, BTKey k, BTPayload v) {
-    // For this project, we assume 0 <= k <= max_key.
-    if (k < 0 || k > idx->max_key) {
-        fprintf(stderr,
-                "hc_insert: key %" PRId64 " out of range [0, %" PRId64 "]\n",
-                (int64_t)k, (int64_t)idx->max_key);
-        return;
+int hc_bulk_load(HCIndex *idx, const BTKey *keys, const BTPayload *payloads,
+                 size_t n, double fill_factor) {
+    // Load first: a rejected load must not leave its keys in the filter.
+    if (bt_bulk_load(idx->cold, keys, payloads, n, fill_factor) != 0)
+        return -1;
+    if (idx->filter) {
+        for (size_t i = 0; i < n; i++) bf_add(idx->filter, keys[i]);
     }
-    bt_insert(idx->cold, k, v);
+    return 0;
+}
+
+// --- Shared state in concurrent mode ---------------------------------
+//
+// The sampling rate is rewritten by the adaptation step; read it
+// atomically so concurrent readers never see a torn double.
+static inline double hc_sampling_rate(const HCIndex *idx) {
+    double d;
+    __atomic_load(&idx->params.sampling_rate, &d, __ATOMIC_RELAXED);
+    return d;
+}
+
+// Same for the promotion threshold, which HC_ADAPT_COST also tunes.
+static inline double hc_hot_threshold(const HCIndex *idx) {
+    double t;
+    __atomic_load(&idx->params.hot_threshold, &t, __ATOMIC_RELAXED);
+    return t;
+}
+
+// Try to become the thread doing maintenance (promotion, adaptation).
+static inline int hc_maint_begin(HCIndex *idx) {
+    return !idx->params.concurrent || pthread_mutex_trylock(&idx->maint_lock) == 0;
+}
+
+static inline void hc_maint_end(HCIndex *idx) {
+    if (idx->params.concurrent) pthread_mutex_unlock(&idx->maint_lock);
 }
 
 // --- ML: Online linear regression to adapt sampling rate D ------------
@@ -57,20 +664,45 @@ void hc_insert(HCIndex *idx, BTKey k, BTPayload v) {
 // Then pick next D as argmin of cost_hat(D) over [0,1]:
 //          D* = clip( -w0 / w1, 0, 1 )
 //
-static void hc_maybe_adapt_sampling(HCIndex *idx) {
-    if (!idx->params.adapt_sampling)
+// Summing the shards is not free, so each thread only looks at the
+// global counters once per HC_ADAPT_CHECK of its own queries.
+#define HC_ADAPT_CHECK 256
+
+static void hc_tune(HCIndex *idx);
+
+static void hc_adapt_locked(HCIndex *idx);
+
+static void hc_maybe_adapt_sampling(HCIndex *idx, HCCounters *mine) {
+    if (idx->params.adapt_sampling == HC_ADAPT_NONE)
+        return;
+    if (mine->queries % HC_ADAPT_CHECK != 0)
         return;
 
+    if (!hc_maint_begin(idx))
+        return;  // another thread is adapting (or promoting) right now
+    HC_PHASE_START(t0);
+    hc_adapt_locked(idx);
+    HC_PHASE_STOP(idx, mine, adapt_cycles, t0);
+    hc_maint_end(idx);
+}
+
+// One adaptation step; the caller holds maint_lock in concurrent mode.
+static void hc_adapt_locked(HCIndex *idx) {
     const long MIN_DELTA_Q = 5000;   // adapt every 5k queries
     const double ETA       = 0.01;   // learning rate for SGD
 
-    long q  = idx->stats.queries;
-    long H  = idx->stats.hot_node_visits;
-    long C  = idx->stats.cold_node_visits;
-
-    long dq = q - idx->last_q_for_adapt;
-    if (dq < MIN_DELTA_Q)
+    if (idx->params.adapt_sampling == HC_ADAPT_COST) {
+        hc_tune(idx);
+        return;
+    }
+    long q, H, C;
+    HC_SUM(idx, queries, q);
+    if (q - idx->last_q_for_adapt < MIN_DELTA_Q) {
         return;  // not enough new queries since last update
+    }
+    HC_SUM(idx, hot_node_visits, H);
+    HC_SUM(idx, cold_node_visits, C);
+    long dq = q - idx->last_q_for_adapt;
 
     long dnodes = (H - idx->last_hot_nodes) + (C - idx->last_cold_nodes);
     if (dq <= 0 || dnodes <= 0) {
@@ -85,7 +717,7 @@ static void hc_maybe_adapt_sampling(HCIndex *idx) {
     double cost_interval = (double)dnodes / (double)dq;
 
     // Current D
-    double D = idx->params.sampling_rate;
+    double D = hc_sampling_rate(idx);
     if (D < 0.0) D = 0.0;
     if (D > 1.0) D = 1.0;
 
@@ -118,7 +750,7 @@ static void hc_maybe_adapt_sampling(HCIndex *idx) {
     if (D_new < 0.0) D_new = 0.0;
     if (D_new > 1.0) D_new = 1.0;
 
-    idx->params.sampling_rate = D_new;
+    __atomic_store(&idx->params.sampling_rate, &D_new, __ATOMIC_RELAXED);
 
     // Update interval bookkeeping
     idx->last_q_for_adapt = q;
@@ -126,135 +758,1113 @@ static void hc_maybe_adapt_sampling(HCIndex *idx) {
     idx->last_cold_nodes  = C;
 }
 
+// --- Hot-tier eviction --------------------------------------------------
+//
+// Every hot key sits in hot_ring. Scores only change when a key is looked
+// up, so a key that stopped being queried would keep its last score
+// forever. Both policies therefore age the keys they inspect and pass
+// over: score *= decay_alpha, the same decay a lookup applies. A key that
+// keeps being queried recovers (+1 per hit); a stale one cools down until
+// it can be evicted.
+//
+// A deleted hot key is the first victim either policy takes: while any
+// tombstones are hot, an inspected key is checked for one and scores
+// below every live key. Its tracker score cannot be relied on for that,
+// since a count-min sketch shares counters and has no way to clear one
+// key's.
+
+#define HC_CLOCK_MAX_STEPS   32  // bound on work per eviction attempt
+#define HC_EVICT_SAMPLES      8
+
+// Key as seen by the frequency tracker: offset into [0, max - min].
+static inline int64_t hc_fkey(const HCIndex *idx, BTKey k) {
+    return k - idx->min_key;
+}
+
+static double hc_score(HCIndex *idx, BTKey k) {
+    return freq_get(idx->freq, hc_fkey(idx, k));
+}
+
+static void hc_age(HCIndex *idx, BTKey k) {
+    freq_scale(idx->freq, hc_fkey(idx, k), idx->params.decay_alpha);
+}
+
+static inline int hc_is_tomb(HCIndex *idx, BTKey k) {
+    return idx->hot_tombs > 0 && hc_hot_get(idx, k) == HC_TOMBSTONE;
+}
+
+// Pick a ring slot to evict for a candidate with score cand_score, or
+// return -1 if every inspected key is still hotter than the candidate.
+static long hc_pick_victim(HCIndex *idx, double cand_score) {
+    size_t n = idx->hot_ring_len;
+    if (n == 0) return -1;
+
+    if (idx->params.evict_policy == HC_EVICT_CLOCK) {
+        for (int step = 0; step < HC_CLOCK_MAX_STEPS; step++) {
+            size_t slot = idx->clock_hand;
+            idx->clock_hand = (slot + 1) % n;
+            BTKey k = idx->hot_ring[slot];
+            if (hc_is_tomb(idx, k) || hc_score(idx, k) < hc_hot_threshold(idx))
+                return (long)slot;
+            hc_age(idx, k);  // second chance, at a lower score
+        }
+        return -1;
+    }
+
+    // HC_EVICT_SAMPLED
+    long   best = -1;
+    double best_score = cand_score;
+    size_t picked[HC_EVICT_SAMPLES];
+    for (int j = 0; j < HC_EVICT_SAMPLES; j++) {
+        size_t slot = (size_t)rng_below(hc_thread_rng(), n);
+        picked[j] = slot;
+        double sc = hc_is_tomb(idx, idx->hot_ring[slot])
+                  ? -1.0 : hc_score(idx, idx->hot_ring[slot]);
+        if (sc < best_score) {
+            best_score = sc;
+            best = (long)slot;
+        }
+    }
+    for (int j = 0; j < HC_EVICT_SAMPLES; j++) {
+        if ((long)picked[j] != best)
+            hc_age(idx, idx->hot_ring[picked[j]]);
+    }
+    return best;
+}
+
 // --- Sampling-based promotion ----------------------------------------
 
-static void maybe_promote(HCIndex *idx, BTKey k) {
-    if (!idx->params.inclusive) {
-        // We only implement inclusive mode in this standalone version.
-        return;
+// Steps 2-4 of promotion; the caller holds maint_lock in concurrent mode.
+// v is the payload when the caller already has it (the cold hit that
+// triggered promotion, or a queued candidate), NULL to fetch it from
+// cold. hint is the hot-tree position left by that lookup's hot miss, or
+// NULL. stamp is hc_cold_stamp() from before the lookup that found v.
+// Returns 1 if k was promoted.
+//
+// With a current hint, promotion does not descend either tree: k is
+// known to be absent from hot, and usually goes straight into the leaf
+// the miss ended in. Without one, a single hot descent both checks that
+// k is absent and yields the position: hot is only written with
+// maint_lock held, so nothing can invalidate it before the insert.
+static int hc_promote_body(HCIndex *idx, BTKey k, BTPayload v,
+                           const BTHint *hint, uint64_t stamp) {
+    // 2) Capacity check: keep hot index under max_hot_fraction of keyspace.
+    //    bt_count_keys() is O(1), so this is cheap on every sampled miss.
+    //    When full, try to make room by evicting a cooler hot key.
+    size_t hot_keys = hc_hot_count(idx);
+    long victim = -1;
+    if (hot_keys >= idx->hot_capacity) {
+        if (idx->params.evict_policy == HC_EVICT_NONE)
+            return 0; // hot index already at capacity
+        victim = hc_pick_victim(idx, hc_score(idx, k));
+        if (victim < 0)
+            return 0; // nothing cooler than k to displace
+    }
+
+    // 3) If key already in hot, nothing to do. For the hash tier the
+    //    insert below answers that in the same probe.
+    BTHint fresh;
+    if (idx->hot && !(hint && hint->leaf && hint->writes == idx->hot->writes)) {
+        BTStats s = {0};
+        if (bt_search_hint(idx->hot, k, &s, &fresh) != NULL) return 0;
+        hint = &fresh;
+    }
+
+    // 4) Key must exist in cold (a buffered key is moved there now); fetch
+    //    payload. Cold writes also hold
+    //    maint_lock, so if none happened since the lookup, v is current;
+    //    otherwise k may have been updated or deleted in between.
+    hc_wb_drain_key(idx, k);
+    if (v != NULL && __atomic_load_n(&idx->cold->writes, __ATOMIC_RELAXED) != stamp)
+        v = NULL;
+    if (v == NULL) {
+        BTStats s2 = {0};
+        v = bt_search(idx->cold, k, &s2);
+        if (v == NULL) return 0; // not found; nothing to promote
+    }
+
+    // Insert before evicting: deleting the victim first would change the
+    // tree and void the hint. Hot holds one key over budget in between.
+    // Exclusive mode then moves k out of cold, after it became visible in
+    // hot (see hc_miss_raced).
+    if (!hc_hot_put(idx, k, v, hint))
+        return 0;
+    if (!idx->params.inclusive)
+        bt_delete(idx->cold, k);
+    if (victim >= 0) {
+        // Inclusive mode: cold still holds the victim, so drop it once
+        // a pending update or delete has been applied there. Exclusive
+        // mode: the victim moves back into cold.
+        if (hc_is_tomb(idx, idx->hot_ring[victim])) idx->hot_tombs--;
+        hc_write_back(idx, idx->hot_ring[victim]);
+        hc_hot_del(idx, idx->hot_ring[victim]);
+        idx->hot_ring[victim] = k;
+        HC_COUNT(idx, hc_shard(idx), evictions, 1);
+    } else if (idx->hot_ring) {
+        idx->hot_ring[idx->hot_ring_len++] = k;
     }
+    HC_COUNT(idx, hc_shard(idx), promotions, 1);
+    return 1;
+}
+
+static int hc_promote_locked(HCIndex *idx, BTKey k, BTPayload v,
+                             const BTHint *hint, uint64_t stamp) {
+    if (!HC_INSTRUMENTED && idx->params.adapt_sampling != HC_ADAPT_COST)
+        return hc_promote_body(idx, k, v, hint, stamp);
+    uint64_t t0 = hc_cycles();
+    int r = hc_promote_body(idx, k, v, hint, stamp);
+    HC_COUNT(idx, hc_shard(idx), promote_cycles, (long)(hc_cycles() - t0));
+    return r;
+}
 
+static void maybe_promote(HCIndex *idx, BTKey k, BTPayload v, const BTHint *hint,
+                          uint64_t stamp) {
     // 1) Sampling-based promotion: with probability D.
-    double D = idx->params.sampling_rate;
+    double D = hc_sampling_rate(idx);
     if (D < 0.0) D = 0.0;
     if (D > 1.0) D = 1.0;
-    double u = (double)rand() / ((double)RAND_MAX + 1.0);
+    double u = rng_uniform(hc_thread_rng());
     if (u > D) {
         return; // sampled out, no promotion this time
     }
 
-    // 2) Capacity check: keep hot index under max_hot_fraction of keyspace.
-    size_t total_keys = (size_t)(idx->max_key + 1);
-    size_t hot_keys   = bt_count_keys(idx->hot);
-    size_t cold_keys  = bt_count_keys(idx->cold);
-    (void)cold_keys; // not used in inclusive mode
+    // Async mode: hand the candidate to hc_maintain() and return at once.
+    // A full queue drops it; the key will cross the threshold again.
+    if (idx->promoq) {
+        if (!pq_push(idx->promoq, k, v, stamp))
+            HC_COUNT(idx, hc_shard(idx), promote_drops, 1);
+        return;
+    }
+
+    // Promotion and the eviction ring are single-writer. A reader that
+    // finds another promotion in flight skips this one; k keeps its
+    // score and is retried on its next cold hit.
+    if (!hc_maint_begin(idx))
+        return;
+    hc_promote_locked(idx, k, v, hint, stamp);
+    hc_maint_end(idx);
+}
 
-    double max_hot = idx->params.max_hot_fraction * (double)total_keys;
-    if ((double)hot_keys >= max_hot) {
-        return; // hot index already at capacity
+// Apply a new hot_capacity; the caller holds maint_lock in concurrent mode.
+// Shrinking evicts the keys the eviction policy picks, as for promotion;
+// when CLOCK finds nothing below the threshold in its step limit, the key
+// under the hand goes anyway.
+static void hc_resize_hot_locked(HCIndex *idx, size_t capacity) {
+    if (idx->params.evict_policy != HC_EVICT_NONE) {
+        while (idx->hot_ring_len > capacity) {
+            long slot = hc_pick_victim(idx, HUGE_VAL);
+            if (slot < 0) slot = (long)idx->clock_hand;
+            BTKey k = idx->hot_ring[slot];
+            if (hc_is_tomb(idx, k)) idx->hot_tombs--;
+            hc_write_back(idx, k);
+            hc_hot_del(idx, k);
+            HC_COUNT(idx, hc_shard(idx), evictions, 1);
+            idx->hot_ring[slot] = idx->hot_ring[--idx->hot_ring_len];
+            if (idx->clock_hand >= idx->hot_ring_len)
+                idx->clock_hand = 0;
+        }
+        if (capacity > 0) {
+            idx->hot_ring = (BTKey*)realloc(idx->hot_ring, sizeof(BTKey) * capacity);
+        }
     }
+    if (idx->hot_hash) hc_hot_reserve(idx, capacity);
+    idx->hot_capacity = capacity;
+}
 
-    // 3) If key already in hot, nothing to do.
-    BTStats s = {0};
-    BTPayload existing = bt_search(idx->hot, k, &s);
-    if (existing != NULL) return;
+// Effective capacity for the current budget and tuner scale.
+static size_t hc_scaled_capacity(const HCIndex *idx) {
+    if (idx->hot_budget == 0) return 0;
+    size_t cap = (size_t)((double)idx->hot_budget * idx->tuner.budget_scale);
+    return cap > 0 ? cap : 1;
+}
 
-    // 4) Key must exist in cold; fetch payload.
-    BTStats s2 = {0};
-    BTPayload v = bt_search(idx->cold, k, &s2);
-    if (v == NULL) return; // not found; nothing to promote
+void hc_set_hot_capacity(HCIndex *idx, size_t capacity) {
+    if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+    idx->hot_budget = capacity;
+    hc_resize_hot_locked(idx, hc_scaled_capacity(idx));
+    hc_maint_end(idx);
+}
 
-    bt_insert(idx->hot, k, v);
+int hc_try_set_hot_capacity(HCIndex *idx, size_t capacity) {
+    if (!hc_maint_begin(idx)) return 0;
+    idx->hot_budget = capacity;
+    hc_resize_hot_locked(idx, hc_scaled_capacity(idx));
+    hc_maint_end(idx);
+    return 1;
 }
 
-// Point lookup: hot first, then cold.
-BTPayload hc_search(HCIndex *idx, BTKey k) {
-    idx->stats.queries++;
+// --- Inserts, updates and deletes ------------------------------------
+//
+// Writers take maint_lock (blocking) in concurrent mode: it orders them
+// with promotion, whose hot-or-cold decisions they must not interleave
+// with, and with each other. Lookups stay lock-free.
 
-    // Let the ML controller occasionally update D
-    hc_maybe_adapt_sampling(idx);
-
-    BTStats hot_s = {0};
-    BTPayload v = bt_search(idx->hot, k, &hot_s);
-    idx->stats.hot_node_visits += hot_s.node_visits;
-
-    if (v != NULL) {
-        idx->stats.hot_hits++;
-        if (k >= 0 && k <= idx->max_key) {
-            double old = idx->hit_score[k];
-            idx->hit_score[k] = idx->params.decay_alpha * old + 1.0;
-            // We don't re-promote; already hot.
+static inline void hc_write_lock(HCIndex *idx) {
+    if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+}
+
+// The filter learns a key before cold does, so a lookup that can find
+// the key in cold never has it filtered out. A tombstone whose delete
+// already reached cold (hc_snapshot writes back) takes the new payload
+// in cold too, since in inclusive mode cold must hold every live key.
+void hc_insert(HCIndex *idx, BTKey k, BTPayload v) {
+    if (idx->cold->map_base) return;   // read-only cold tier
+    if (idx->filter) bf_add(idx->filter, k);
+    hc_write_lock(idx);
+    BTPayload hv = hc_hot_get(idx, k);
+    if (hv == NULL) {
+        if (idx->params.write_buffer) hc_wb_put(idx, k, v);
+        else                          bt_insert(idx->cold, k, v);
+    } else {
+        if (idx->params.inclusive && hv == HC_TOMBSTONE && !hc_is_dirty(idx, k))
+            bt_insert(idx->cold, k, v);
+        else
+            hc_mark_dirty(idx, k);
+        if (hv == HC_TOMBSTONE) idx->hot_tombs--;
+        hc_hot_update(idx, k, v);
+    }
+    hc_maint_end(idx);
+}
+
+int hc_update(HCIndex *idx, BTKey k, BTPayload v) {
+    if (idx->cold->map_base) return 0;
+    hc_write_lock(idx);
+    BTPayload hv = hc_hot_get(idx, k);
+    int found = 0;
+    if (hv == NULL) {
+        long i = idx->wb_len ? hc_wb_find(idx, k) : -1;
+        if (i >= 0) {
+            hc_wb_set(idx, (size_t)i, v);
+            found = 1;
+        } else {
+            found = bt_update(idx->cold, k, v);
         }
-        return v;
+    } else if (hv != HC_TOMBSTONE) {
+        hc_mark_dirty(idx, k);
+        found = hc_hot_update(idx, k, v);
+    }
+    hc_maint_end(idx);
+    return found;
+}
+
+// A deleted hot key keeps its slot until eviction, which takes it ahead
+// of any live key (see hc_pick_victim), so the slot goes to a live key
+// at the next promotion that needs room.
+int hc_delete(HCIndex *idx, BTKey k) {
+    if (idx->cold->map_base) return 0;
+    hc_write_lock(idx);
+    BTPayload hv = hc_hot_get(idx, k);
+    int found = 0;
+    if (hv == NULL) {
+        // Cold first: a lookup that misses the buffer must not find k.
+        found = bt_delete(idx->cold, k);
+        long i = idx->wb_len ? hc_wb_find(idx, k) : -1;
+        if (i >= 0) {
+            hc_wb_set(idx, (size_t)i, HC_TOMBSTONE);
+            found = 1;
+        }
+    } else if (hv != HC_TOMBSTONE) {
+        hc_mark_dirty(idx, k);
+        found = hc_hot_update(idx, k, HC_TOMBSTONE);
+        idx->hot_tombs++;
+        freq_scale(idx->freq, hc_fkey(idx, k), 0.0);
+    }
+    hc_maint_end(idx);
+    return found;
+}
+
+// --- Cost-driven tuning (HC_ADAPT_COST) ------------------------------
+//
+// Node visits per query do not track throughput: a hot hit and a cold miss
+// visit similar node counts at very different cost, and promotion work
+// (hot-tier inserts, evictions) is not counted at all. This controller
+// instead measures what a query costs: hc_cycles() around (a sample of)
+// lookups and, separately, around every promotion. The objective is cycles
+// per query over an interval of HC_TUNE_INTERVAL queries; with async
+// promotion the promotions run outside the lookups and are added in,
+// otherwise they are already part of the lookup time.
+//
+// The cost surface is noisy and moves as the hot set fills, so it is
+// searched by coordinate-wise hill climbing rather than fitted: measure
+// the current setting for one interval, move one knob by a multiplicative
+// step and measure again. A change takes a while to show (the hot set has
+// to refill or drain), so the interval right after every change, like the
+// first one, is only used to settle and is not scored. A move that lowers
+// the cost by HC_TUNE_GAIN is kept and repeated; otherwise it is undone
+// and the other direction is tried. Once both directions failed the knob's
+// step shrinks (never below HC_TUNE_MIN_STEP, so the controller keeps
+// tracking drift) and the next knob gets its turn. Knobs: D,
+// hot_threshold, and the scale of the hot budget
+// (hot_capacity = hot_budget * scale).
+
+#define HC_TUNE_INTERVAL  32768
+#define HC_TUNE_GAIN      0.02
+#define HC_TUNE_MIN_STEP  1.1
+#define HC_TUNE_KNOBS     3
+
+static const char *const hc_knob_names[HC_TUNE_KNOBS] = {
+    "D", "hot_threshold", "budget"
+};
+static const double hc_knob_min[HC_TUNE_KNOBS] = { 0.01,  1.0, 1.0 / 16 };
+static const double hc_knob_max[HC_TUNE_KNOBS] = { 1.0,  64.0, 1.0 };
+
+static double hc_knob_get(const HCIndex *idx, int knob) {
+    switch (knob) {
+    case 0:  return hc_sampling_rate(idx);
+    case 1:  return hc_hot_threshold(idx);
+    default: return idx->tuner.budget_scale;
     }
+}
 
-    BTStats cold_s = {0};
-    v = bt_search(idx->cold, k, &cold_s);
-    idx->stats.cold_node_visits += cold_s.node_visits;
+static void hc_knob_set(HCIndex *idx, int knob, double v) {
+    switch (knob) {
+    case 0:
+        __atomic_store(&idx->params.sampling_rate, &v, __ATOMIC_RELAXED);
+        break;
+    case 1:
+        __atomic_store(&idx->params.hot_threshold, &v, __ATOMIC_RELAXED);
+        break;
+    default:
+        idx->tuner.budget_scale = v;
+        hc_resize_hot_locked(idx, hc_scaled_capacity(idx));
+        break;
+    }
+}
 
-    if (v != NULL) {
-        idx->stats.cold_hits++;
-        if (k >= 0 && k <= idx->max_key) {
-            double old = idx->hit_score[k];
-            double new_score = idx->params.decay_alpha * old + 1.0;
-            idx->hit_score[k] = new_score;
-            if (new_score >= idx->params.hot_threshold)
-                maybe_promote(idx, k);
+// Start a trial move of the current knob; returns 0 if no knob can move
+// (every one is at a bound in both directions).
+static int hc_tune_probe(HCIndex *idx) {
+    HCTuner *t = &idx->tuner;
+    for (int tries = 0; tries < 2 * HC_TUNE_KNOBS; tries++) {
+        double cur = hc_knob_get(idx, t->knob);
+        double v = t->dir > 0 ? cur * t->step[t->knob] : cur / t->step[t->knob];
+        if (v < hc_knob_min[t->knob]) v = hc_knob_min[t->knob];
+        if (v > hc_knob_max[t->knob]) v = hc_knob_max[t->knob];
+        if (v != cur) {
+            t->prev = cur;
+            hc_knob_set(idx, t->knob, v);
+            t->probing  = 1;
+            t->settling = 1;
+            return 1;
         }
-        return v;
+        // At the bound: this direction failed without a trial.
+        t->dir = -t->dir;
+        if (++t->flips >= 2) {
+            t->flips = 0;
+            t->knob = (t->knob + 1) % HC_TUNE_KNOBS;
+        }
+    }
+    return 0;
+}
+
+// One tuning step; the caller holds maint_lock in concurrent mode.
+static void hc_tune(HCIndex *idx) {
+    HCTuner *t = &idx->tuner;
+    long q;
+    HC_SUM(idx, queries, q);
+    long dq = q - t->last_q;
+    if (dq < HC_TUNE_INTERVAL)
+        return;
+
+    long hot, lc, pc;
+    HC_SUM(idx, hot_hits, hot);
+    HC_SUM(idx, lookup_cycles, lc);
+    HC_SUM(idx, promote_cycles, pc);
+    double lookup  = (double)(lc - t->last_lookup_cycles) / (double)dq;
+    double promote = (double)(pc - t->last_promote_cycles) / (double)dq;
+    double cost    = lookup + (idx->promoq ? promote : 0.0);
+    double hit     = (double)(hot - t->last_hot_hits) / (double)dq;
+    t->last_q              = q;
+    t->last_hot_hits       = hot;
+    t->last_lookup_cycles  = lc;
+    t->last_promote_cycles = pc;
+
+    // The setting this interval ran with, for the trace.
+    int    knob = t->knob;
+    double D    = hc_sampling_rate(idx);
+    double thr  = hc_hot_threshold(idx);
+    size_t cap  = idx->hot_capacity;
+
+    const char *action;
+    if (t->settling) {
+        action = "settle";
+        t->settling = 0;
+        goto trace;
+    }
+    if (!t->probing) {
+        action = "measure";
+        t->best_cost = cost;
+    } else if (cost < t->best_cost * (1.0 - HC_TUNE_GAIN)) {
+        action = "accept";
+        t->best_cost = cost;
+        t->flips = 0;
     } else {
-        idx->stats.not_found++;
+        // Undo, and measure the restored setting afresh: the workload
+        // and the hot set may have moved since it was last measured.
+        action = "revert";
+        hc_knob_set(idx, t->knob, t->prev);
+        t->settling  = 1;
+        t->best_cost = -1.0;
+        t->dir = -t->dir;
+        if (++t->flips >= 2) {
+            t->flips = 0;
+            t->step[t->knob] = sqrt(t->step[t->knob]);
+            if (t->step[t->knob] < HC_TUNE_MIN_STEP)
+                t->step[t->knob] = HC_TUNE_MIN_STEP;
+            t->knob = (t->knob + 1) % HC_TUNE_KNOBS;
+        }
+    }
+    t->probing = 0;
+    if (t->best_cost >= 0.0)
+        hc_tune_probe(idx);
+
+trace:
+    if (t->trace)
+        fprintf(t->trace, "%ld,%ld,%s,%s,%.4f,%.3f,%zu,%.1f,%.1f,%.1f,%.4f\n",
+                t->epoch, q, action, hc_knob_names[knob], D, thr, cap,
+                cost, lookup, promote, hit);
+    t->epoch++;
+}
+
+void hc_set_adapt_trace(HCIndex *idx, FILE *out) {
+    if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+    idx->tuner.trace = out;
+    if (out)
+        fprintf(out, "epoch,queries,action,knob,D,hot_threshold,hot_capacity,"
+                     "cycles_per_q,lookup_cycles_per_q,promote_cycles_per_q,"
+                     "hot_hit_rate\n");
+    hc_maint_end(idx);
+}
+
+// Drain in bounded batches so one call cannot run forever while
+// producers keep the queue full.
+#define HC_MAINTAIN_BATCH 256
+
+size_t hc_maintain(HCIndex *idx) {
+    if (!idx->promoq) return 0;
+    size_t promoted = 0;
+    for (;;) {
+        BTKey k;
+        BTPayload v;
+        uint64_t stamp;
+        if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+        int n = 0;
+        while (n < HC_MAINTAIN_BATCH && pq_pop(idx->promoq, &k, &v, &stamp)) {
+            promoted += (size_t)hc_promote_locked(idx, k, v, NULL, stamp);
+            n++;
+        }
+        hc_maint_end(idx);
+        if (n < HC_MAINTAIN_BATCH) return promoted;
+    }
+}
+
+static void* hc_maint_main(void *arg) {
+    HCIndex *idx = (HCIndex*)arg;
+    while (!__atomic_load_n(&idx->maint_stop, __ATOMIC_ACQUIRE)) {
+        if (hc_maintain(idx) == 0 && idx->maint_idle_us > 0) {
+            struct timespec ts = { (time_t)(idx->maint_idle_us / 1000000u),
+                                   (long)(idx->maint_idle_us % 1000000u) * 1000L };
+            nanosleep(&ts, NULL);
+        }
+    }
+    hc_maintain(idx);   // leave nothing behind
+    return NULL;
+}
+
+int hc_start_maintenance(HCIndex *idx, unsigned idle_us) {
+    if (!idx->params.concurrent || !idx->promoq || idx->maint_running)
+        return -1;
+    idx->maint_idle_us = idle_us;
+    idx->maint_stop = 0;
+    if (pthread_create(&idx->maint_thread, NULL, hc_maint_main, idx) != 0)
+        return -1;
+    idx->maint_running = 1;
+    return 0;
+}
+
+void hc_stop_maintenance(HCIndex *idx) {
+    if (!idx->maint_running) return;
+    __atomic_store_n(&idx->maint_stop, 1, __ATOMIC_RELEASE);
+    pthread_join(idx->maint_thread, NULL);
+    idx->maint_running = 0;
+}
+
+// Score bookkeeping shared by hc_search and hc_search_batch.
+static void hc_on_hot_hit(HCIndex *idx, HCCounters *c, BTKey k) {
+    HC_COUNT(idx, c, hot_hits, 1);
+    // We don't re-promote; already hot.
+    freq_hit(idx->freq, hc_fkey(idx, k), idx->params.decay_alpha);
+}
+
+// hint: the hot-tree position from this key's hot miss, or NULL; stamp:
+// hc_cold_stamp() from before the cold lookup.
+static void hc_on_cold_hit(HCIndex *idx, HCCounters *c, BTKey k, BTPayload v,
+                           const BTHint *hint, uint64_t stamp) {
+    HC_COUNT(idx, c, cold_hits, 1);
+    double new_score = freq_hit(idx->freq, hc_fkey(idx, k), idx->params.decay_alpha);
+    if (new_score >= hc_hot_threshold(idx))
+        maybe_promote(idx, k, v, hint, stamp);
+}
+
+// Point lookup: hot first, then cold.
+static inline BTPayload hc_search_one(HCIndex *idx, HCCounters *c, BTKey k) {
+    HC_COUNT(idx, c, queries, 1);
+
+    // Let the ML controller occasionally update D
+    hc_maybe_adapt_sampling(idx, c);
+
+    if (idx->filter) {
+        HC_PHASE_START(tf);
+        int maybe = bf_may_contain(idx->filter, k);
+        HC_PHASE_STOP(idx, c, filter_cycles, tf);
+        if (!maybe) {
+            HC_COUNT(idx, c, not_found, 1);
+            HC_COUNT(idx, c, filter_negatives, 1);
+            return NULL;
+        }
+    }
+
+    BTStats hot_s = {0}, cold_s = {0};
+    BTHint hint;
+    BTPayload v;
+    uint64_t stamp;
+    int in_cold;
+    do {
+        stamp = hc_cold_stamp(idx);
+        HC_PHASE_START(th);
+        v = hc_hot_get_hint(idx, k, &hot_s, &hint);
+        HC_PHASE_STOP(idx, c, hot_cycles, th);
+        in_cold = (v == NULL);
+        if (in_cold) {
+            HC_PHASE_START(tc);
+            v = hc_wb_get(idx, k);
+            if (v == NULL) v = bt_search(idx->cold, k, &cold_s);
+            HC_PHASE_STOP(idx, c, cold_cycles, tc);
+        }
+    } while (v == NULL && hc_miss_raced(idx, stamp));
+    HC_COUNT(idx, c, hot_node_visits, hot_s.node_visits);
+    HC_COUNT(idx, c, cold_node_visits, cold_s.node_visits);
+
+    if (v == HC_TOMBSTONE) {
+        HC_COUNT(idx, c, not_found, 1);
         return NULL;
     }
+    if (v == NULL) {
+        HC_COUNT(idx, c, not_found, 1);
+        if (idx->filter) HC_COUNT(idx, c, filter_false_pos, 1);
+        return NULL;
+    }
+    if (in_cold) hc_on_cold_hit(idx, c, k, v, &hint, stamp);
+    else         hc_on_hot_hit(idx, c, k);
+    return v;
 }
 
-// Helper for deduped range scan: simple callback wrapper
+// Reading the cycle counter around every lookup would cost a good part
+// of a hot hit, so single lookups are timed one in HC_TIME_EVERY and the
+// sample scaled up; batches are timed per group.
+#define HC_TIME_EVERY 16
+
+BTPayload hc_search(HCIndex *idx, BTKey k) {
+    HCCounters *c = hc_shard(idx);
+    if (idx->params.adapt_sampling != HC_ADAPT_COST ||
+        (c->queries & (HC_TIME_EVERY - 1)) != 0)
+        return hc_search_one(idx, c, k);
+    uint64_t t0 = hc_cycles();
+    BTPayload v = hc_search_one(idx, c, k);
+    HC_COUNT(idx, c, lookup_cycles, (long)(hc_cycles() - t0) * HC_TIME_EVERY);
+    return v;
+}
+
+// Batched lookup: probe the hot tier for a whole group, then the cold tier
+// for the group's hot misses, then do per-key bookkeeping in input order.
+// Keys promoted by this group only start hitting hot from the next group.
+// Keys the filter rules out are dropped up front, and the rest gathered
+// so both tiers still see a dense batch.
+#define HC_BATCH_GROUP 64   // at most 64: one bit per key in `dropped`
+
+// A batch miss that may have raced a promotion (hc_miss_raced), looked up
+// again one tier after the other. A hot copy found now is handed out as
+// if cold had answered; promoting it again is a no-op.
+static BTPayload hc_lookup_again(HCIndex *idx, BTKey k, BTStats *hot_s,
+                                 BTStats *cold_s) {
+    BTPayload v;
+    uint64_t stamp;
+    do {
+        stamp = hc_cold_stamp(idx);
+        BTHint hint;
+        v = hc_hot_get_hint(idx, k, hot_s, &hint);
+        if (v == HC_TOMBSTONE) return NULL;
+        if (v == NULL) v = hc_wb_get(idx, k);
+        if (v == NULL) v = bt_search(idx->cold, k, cold_s);
+    } while (v == NULL && hc_miss_raced(idx, stamp));
+    return v;
+}
+
+void hc_search_batch(HCIndex *idx, const BTKey *keys, size_t n, BTPayload *out) {
+    BTKey     pass_keys[HC_BATCH_GROUP];
+    BTPayload pass_vals[HC_BATCH_GROUP];
+    size_t    pass_pos[HC_BATCH_GROUP];
+    BTKey     miss_keys[HC_BATCH_GROUP];
+    BTPayload miss_vals[HC_BATCH_GROUP];
+    size_t    miss_pos[HC_BATCH_GROUP];
+    HCCounters *c = hc_shard(idx);
+    int timed = idx->params.adapt_sampling == HC_ADAPT_COST;
+
+    for (size_t base = 0; base < n; base += HC_BATCH_GROUP) {
+        size_t m = n - base;
+        if (m > HC_BATCH_GROUP) m = HC_BATCH_GROUP;
+        uint64_t t0 = timed ? hc_cycles() : 0;
+
+        uint64_t dropped = 0;
+        size_t np = 0;
+        if (idx->filter) {
+            HC_PHASE_START(tf);
+            for (size_t j = 0; j < m; j++) {
+                out[base + j] = NULL;
+                if (bf_may_contain(idx->filter, keys[base + j])) {
+                    pass_keys[np] = keys[base + j];
+                    pass_pos[np]  = j;
+                    np++;
+                } else {
+                    dropped |= 1ull << j;
+                }
+            }
+            HC_PHASE_STOP(idx, c, filter_cycles, tf);
+        }
+
+        BTStats hot_s = {0};
+        uint64_t stamp = hc_cold_stamp(idx);
+        HC_PHASE_START(th);
+        if (idx->filter) {
+            hc_hot_get_batch(idx, pass_keys, np, pass_vals, &hot_s);
+            for (size_t i = 0; i < np; i++)
+                out[base + pass_pos[i]] = pass_vals[i];
+        } else {
+            hc_hot_get_batch(idx, keys + base, m, out + base, &hot_s);
+        }
+        HC_PHASE_STOP(idx, c, hot_cycles, th);
+
+        // Hot misses are looked up in the write buffer, then in cold.
+        uint64_t buffered = 0;
+        size_t nmiss = 0;
+        for (size_t j = 0; j < m; j++) {
+            if (out[base + j] != NULL || (dropped >> j & 1)) continue;
+            if ((out[base + j] = hc_wb_get(idx, keys[base + j])) != NULL) {
+                buffered |= 1ull << j;
+            } else {
+                miss_keys[nmiss] = keys[base + j];
+                miss_pos[nmiss]  = j;
+                nmiss++;
+            }
+        }
+
+        BTStats cold_s = {0};
+        HC_PHASE_START(tc);
+        bt_search_batch(idx->cold, miss_keys, nmiss, miss_vals, &cold_s);
+        if (hc_miss_raced(idx, stamp)) {
+            for (size_t i = 0; i < nmiss; i++) {
+                if (miss_vals[i] == NULL)
+                    miss_vals[i] = hc_lookup_again(idx, miss_keys[i], &hot_s, &cold_s);
+            }
+        }
+        HC_PHASE_STOP(idx, c, cold_cycles, tc);
+        HC_COUNT(idx, c, hot_node_visits, hot_s.node_visits);
+        HC_COUNT(idx, c, cold_node_visits, cold_s.node_visits);
+
+        size_t mi = 0;
+        for (size_t j = 0; j < m; j++) {
+            BTKey k = keys[base + j];
+            HC_COUNT(idx, c, queries, 1);
+            hc_maybe_adapt_sampling(idx, c);
+
+            if (dropped >> j & 1) {
+                HC_COUNT(idx, c, not_found, 1);
+                HC_COUNT(idx, c, filter_negatives, 1);
+            } else if (mi < nmiss && miss_pos[mi] == j) {
+                BTPayload v = miss_vals[mi++];
+                out[base + j] = v;
+                if (v != NULL) {
+                    hc_on_cold_hit(idx, c, k, v, NULL, stamp);
+                } else {
+                    HC_COUNT(idx, c, not_found, 1);
+                    if (idx->filter) HC_COUNT(idx, c, filter_false_pos, 1);
+                }
+            } else if (buffered >> j & 1) {
+                hc_on_cold_hit(idx, c, k, out[base + j], NULL, stamp);
+            } else if (out[base + j] == HC_TOMBSTONE) {
+                out[base + j] = NULL;
+                HC_COUNT(idx, c, not_found, 1);
+            } else {
+                hc_on_hot_hit(idx, c, k);
+            }
+        }
+        if (timed) HC_COUNT(idx, c, lookup_cycles, (long)(hc_cycles() - t0));
+    }
+}
+
+// Range scan as a merge-join of two ordered cursors. Both tiers yield
+// keys in ascending order, so duplicates (a hot key is also in cold in
+// inclusive mode) are adjacent and dropped with O(1) extra state. The
+// cost depends on the range and result size, not on the key domain.
+// In concurrent mode the scan holds off writers to both trees (hot
+// first, the order promotion never inverts) while the cursors are open.
+// A hash hot tier is unordered; the cold tier alone then answers the
+// scan, since in inclusive mode it holds every live key. While some hot
+// keys are dirty, each key cold yields is looked up in hot as well. In
+// exclusive mode the hot keys in range are copied out and sorted instead,
+// then merged with cold like a hot tree's (hc_range_merge_hash).
 typedef struct {
-    BTRangeCallback user_cb;
-    void           *user_arg;
-    int64_t        *seen;     // seen[key] = 1 if already emitted (size max_key+1)
     HCIndex        *idx;
-} HCRangeCtx;
+    BTRangeCallback cb;
+    void           *arg;
+} HCDirtyScan;
 
-static void hc_range_cb_hot(BTKey k, BTPayload v, void *arg) {
-    HCRangeCtx *ctx = (HCRangeCtx*)arg;
-    if (k < 0 || k > ctx->idx->max_key) return;
-    if (!ctx->seen[k]) {
-        ctx->seen[k] = 1;
-        ctx->user_cb(k, v, ctx->user_arg);
-    }
+static int hc_cmp_key(const void *a, const void *b);
+
+static void hc_dirty_scan_cb(BTKey k, BTPayload v, void *arg) {
+    HCDirtyScan *ds = (HCDirtyScan*)arg;
+    BTStats s = {0};
+    BTPayload hv = hh_get(ds->idx->hot_hash, k, &s);
+    if (hv == HC_TOMBSTONE) return;
+    ds->cb(k, hv ? hv : v, ds->arg);
 }
 
-static void hc_range_cb_cold(BTKey k, BTPayload v, void *arg) {
-    HCRangeCtx *ctx = (HCRangeCtx*)arg;
-    if (k < 0 || k > ctx->idx->max_key) return;
-    if (!ctx->seen[k]) {
-        ctx->seen[k] = 1;
-        ctx->user_cb(k, v, ctx->user_arg);
+// Exclusive mode with a hash hot tier. maint_lock keeps the table still
+// while its keys are copied and read; cold writers are held off for the
+// merge as in the tree case.
+static void hc_range_merge_hash(HCIndex *idx, BTKey lo, BTKey hi,
+                                BTRangeCallback cb, void *arg) {
+    BTStats hot_s = {0}, cold_s = {0};
+    hc_write_lock(idx);
+    size_t n = hh_count(idx->hot_hash), m = 0;
+    BTKey *keys = (BTKey*)malloc(sizeof(BTKey) * (n ? n : 1));
+    n = hh_keys(idx->hot_hash, keys, n);
+    for (size_t i = 0; i < n; i++) {
+        if (keys[i] >= lo && keys[i] <= hi) keys[m++] = keys[i];
+    }
+    qsort(keys, m, sizeof(BTKey), hc_cmp_key);
+
+    BTCursor cc;
+    BTKey ck = 0;
+    BTPayload cv = NULL;
+    bt_lock_writers(idx->cold);
+    bt_cursor_seek(&cc, idx->cold, lo, &cold_s);
+    int cold_ok = bt_cursor_next(&cc, &ck, &cv) && ck <= hi;
+    size_t i = 0;
+    while (i < m || cold_ok) {
+        if (i < m && (!cold_ok || keys[i] <= ck)) {
+            BTPayload hv = hh_get(idx->hot_hash, keys[i], &hot_s);
+            if (hv != HC_TOMBSTONE) cb(keys[i], hv, arg);
+            if (cold_ok && ck == keys[i])
+                cold_ok = bt_cursor_next(&cc, &ck, &cv) && ck <= hi;
+            i++;
+        } else {
+            cb(ck, cv, arg);
+            cold_ok = bt_cursor_next(&cc, &ck, &cv) && ck <= hi;
+        }
     }
+    bt_unlock_writers(idx->cold);
+    hc_maint_end(idx);
+    free(keys);
+
+    HCCounters *c = hc_shard(idx);
+    HC_COUNT(idx, c, hot_node_visits, hot_s.node_visits);
+    HC_COUNT(idx, c, cold_node_visits, cold_s.node_visits);
 }
 
 void hc_range_search(HCIndex *idx, BTKey lo, BTKey hi,
                      BTRangeCallback cb, void *arg) {
-    HCRangeCtx ctx;
-    ctx.user_cb = cb;
-    ctx.user_arg = arg;
-    ctx.idx = idx;
-    ctx.seen = (int64_t*)calloc((size_t)(idx->max_key + 1), sizeof(int64_t));
-
     BTStats hot_s = {0}, cold_s = {0};
-    bt_range_search(idx->hot, lo, hi, hc_range_cb_hot, &ctx, &hot_s);
-    bt_range_search(idx->cold, lo, hi, hc_range_cb_cold, &ctx, &cold_s);
+    if (__atomic_load_n(&idx->wb_len, __ATOMIC_RELAXED) > 0)
+        hc_flush(idx);
+    if (idx->hot_hash && !idx->params.inclusive) {
+        hc_range_merge_hash(idx, lo, hi, cb, arg);
+        return;
+    }
+    if (idx->hot_hash) {
+        HCDirtyScan ds = { idx, cb, arg };
+        if (hh_count(idx->dirty) > 0)
+            bt_range_search(idx->cold, lo, hi, hc_dirty_scan_cb, &ds, &cold_s);
+        else
+            bt_range_search(idx->cold, lo, hi, cb, arg, &cold_s);
+        HC_COUNT(idx, hc_shard(idx), cold_node_visits, cold_s.node_visits);
+        return;
+    }
+    BTCursor hc, cc;
+    BTKey hk = 0, ck = 0;
+    BTPayload hv = NULL, cv = NULL;
+
+    bt_lock_writers(idx->hot);
+    bt_lock_writers(idx->cold);
+    bt_cursor_seek(&hc, idx->hot, lo, &hot_s);
+    bt_cursor_seek(&cc, idx->cold, lo, &cold_s);
+    int hot_ok  = bt_cursor_next(&hc, &hk, &hv) && hk <= hi;
+    int cold_ok = bt_cursor_next(&cc, &ck, &cv) && ck <= hi;
+
+    while (hot_ok || cold_ok) {
+        if (hot_ok && (!cold_ok || hk <= ck)) {
+            // The hot copy wins on ties; a tombstone hides the key.
+            if (hv != HC_TOMBSTONE) cb(hk, hv, arg);
+            if (cold_ok && ck == hk)
+                cold_ok = bt_cursor_next(&cc, &ck, &cv) && ck <= hi;
+            hot_ok = bt_cursor_next(&hc, &hk, &hv) && hk <= hi;
+        } else {
+            cb(ck, cv, arg);
+            cold_ok = bt_cursor_next(&cc, &ck, &cv) && ck <= hi;
+        }
+    }
 
-    idx->stats.hot_node_visits  += hot_s.node_visits;
-    idx->stats.cold_node_visits += cold_s.node_visits;
+    bt_unlock_writers(idx->cold);
+    bt_unlock_writers(idx->hot);
 
-    free(ctx.seen);
+    HCCounters *c = hc_shard(idx);
+    HC_COUNT(idx, c, hot_node_visits, hot_s.node_visits);
+    HC_COUNT(idx, c, cold_node_visits, cold_s.node_visits);
+}
+
+// All HCStats fields are 8 bytes wide; a field missing from
+// HC_STATS_FIELDS would be skipped by hc_stats_add.
+#define HC_STATS_ONE(f) + 1
+_Static_assert(sizeof(HCStats) == (0 HC_STATS_FIELDS(HC_STATS_ONE)) * sizeof(long),
+               "HC_STATS_FIELDS must list every HCStats field");
+
+void hc_stats_add(HCStats *sum, const HCStats *x) {
+#define HC_STATS_ADD(f) sum->f += x->f;
+    HC_STATS_FIELDS(HC_STATS_ADD)
+#undef HC_STATS_ADD
 }
 
 HCStats hc_get_stats(HCIndex *idx) {
-    HCStats s = idx->stats;
-    s.hot_keys  = bt_count_keys(idx->hot);
-    s.cold_keys = bt_count_keys(idx->cold);
+    HCStats s;
+    HC_SUM(idx, queries,          s.queries);
+    HC_SUM(idx, hot_hits,         s.hot_hits);
+    HC_SUM(idx, cold_hits,        s.cold_hits);
+    HC_SUM(idx, not_found,        s.not_found);
+    HC_SUM(idx, hot_node_visits,  s.hot_node_visits);
+    HC_SUM(idx, cold_node_visits, s.cold_node_visits);
+    HC_SUM(idx, promotions,       s.promotions);
+    HC_SUM(idx, evictions,        s.evictions);
+    HC_SUM(idx, promote_drops,    s.promote_drops);
+    HC_SUM(idx, writebacks,       s.writebacks);
+    HC_SUM(idx, flushes,          s.flushes);
+    HC_SUM(idx, filter_negatives, s.filter_negatives);
+    HC_SUM(idx, filter_false_pos, s.filter_false_pos);
+    HC_SUM(idx, lookup_cycles,    s.lookup_cycles);
+    HC_SUM(idx, promote_cycles,   s.promote_cycles);
+    HC_SUM(idx, filter_cycles,    s.filter_cycles);
+    HC_SUM(idx, hot_cycles,       s.hot_cycles);
+    HC_SUM(idx, cold_cycles,      s.cold_cycles);
+    HC_SUM(idx, adapt_cycles,     s.adapt_cycles);
+    s.hot_keys   = hc_hot_count(idx);
+    s.cold_keys  = bt_count_keys(idx->cold);
+    s.buffered_keys = __atomic_load_n(&idx->wb_len, __ATOMIC_RELAXED);
+    s.hot_bytes  = 0;
+    for (int r = 0; r < idx->hot_copies; r++)
+        s.hot_bytes += idx->hot_hash ? hh_bytes(r ? idx->hot_hash_rep[r] : idx->hot_hash)
+                                     : bt_live_bytes(r ? idx->hot_rep[r] : idx->hot);
+    s.cold_bytes = bt_live_bytes(idx->cold);
     return s;
 }
+
+// --- Snapshot / restore ----------------------------------------------
+//
+// File: HCSnapHeader, nhot ascending keys, their nhot payloads if the
+// index is exclusive, then the tracker state (freq_save).
+
+#define HC_SNAP_MAGIC   "HCSNAP"
+#define HC_SNAP_VERSION 2
+
+typedef struct {
+    char     magic[8];
+    uint32_t version;
+    uint32_t freq_kind;
+    int64_t  min_key;
+    int64_t  max_key;
+    double   sampling_rate;
+    double   lr_w0;
+    double   lr_w1;
+    uint64_t nhot;
+    uint64_t payloads;   // 1 = payloads follow the keys (exclusive mode)
+} HCSnapHeader;
+
+typedef struct {
+    BTKey  key;
+    double score;
+} HCScoredKey;
+
+static int hc_cmp_key(const void *a, const void *b) {
+    BTKey x = *(const BTKey*)a, y = *(const BTKey*)b;
+    return (x > y) - (x < y);
+}
+
+static int hc_cmp_hotter(const void *a, const void *b) {
+    double x = ((const HCScoredKey*)a)->score, y = ((const HCScoredKey*)b)->score;
+    return (x < y) - (x > y);
+}
+
+int hc_snapshot(HCIndex *idx, const char *path) {
+    FILE *f = fopen(path, "wb");
+    if (!f) return -1;
+
+    // Hold off promotion and eviction so the key set is consistent. The
+    // snapshot has no payloads, so cold must be current.
+    if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+    hc_flush_locked(idx);
+    hc_write_back_all(idx);
+    size_t n = hc_hot_count(idx);
+    BTKey *keys = (BTKey*)malloc(sizeof(BTKey) * (n ? n : 1));
+    BTPayload *vals = NULL;
+    if (idx->hot_hash) {
+        n = hh_keys(idx->hot_hash, keys, n);
+        qsort(keys, n, sizeof(BTKey), hc_cmp_key);
+    } else {
+        BTCursor c;
+        BTKey k;
+        BTPayload v;
+        size_t m = 0;
+        bt_lock_writers(idx->hot);
+        bt_cursor_seek(&c, idx->hot, INT64_MIN, NULL);
+        while (m < n && bt_cursor_next(&c, &k, &v)) keys[m++] = k;
+        bt_unlock_writers(idx->hot);
+        n = m;
+    }
+    if (!idx->params.inclusive) {
+        // Exclusive: hot holds the only copy. Deleted keys are left out.
+        size_t m = 0;
+        vals = (BTPayload*)malloc(sizeof(BTPayload) * (n ? n : 1));
+        for (size_t i = 0; i < n; i++) {
+            BTPayload v = hc_hot_get(idx, keys[i]);
+            if (v == NULL || v == HC_TOMBSTONE) continue;
+            keys[m] = keys[i];
+            vals[m] = v;
+            m++;
+        }
+        n = m;
+    }
+
+    HCSnapHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, HC_SNAP_MAGIC, sizeof(HC_SNAP_MAGIC));
+    h.version       = HC_SNAP_VERSION;
+    h.freq_kind     = (uint32_t)idx->params.freq_kind;
+    h.min_key       = idx->min_key;
+    h.max_key       = idx->max_key;
+    h.sampling_rate = hc_sampling_rate(idx);
+    h.lr_w0         = idx->lr_w0;
+    h.lr_w1         = idx->lr_w1;
+    h.nhot          = n;
+    h.payloads      = vals != NULL;
+
+    int rc = 0;
+    if (fwrite(&h, sizeof(h), 1, f) != 1 ||
+        fwrite(keys, sizeof(BTKey), n, f) != n ||
+        (vals && fwrite(vals, sizeof(BTPayload), n, f) != n) ||
+        freq_save(idx->freq, f) != 0)
+        rc = -1;
+    hc_maint_end(idx);
+
+    if (fclose(f) != 0) rc = -1;
+    free(keys);
+    free(vals);
+    return rc;
+}
+
+// Keep the cap highest-scoring of keys[0..n), still in ascending order.
+static size_t hc_keep_hottest(HCIndex *idx, BTKey *keys, size_t n, size_t cap) {
+    HCScoredKey *sk = (HCScoredKey*)malloc(sizeof(HCScoredKey) * n);
+    for (size_t i = 0; i < n; i++) {
+        sk[i].key = keys[i];
+        sk[i].score = hc_score(idx, keys[i]);
+    }
+    qsort(sk, n, sizeof(HCScoredKey), hc_cmp_hotter);
+    for (size_t i = 0; i < cap; i++) keys[i] = sk[i].key;
+    qsort(keys, cap, sizeof(BTKey), hc_cmp_key);
+    free(sk);
+    return cap;
+}
+
+// Restored hot nodes are left with room for the promotions that follow.
+#define HC_RESTORE_FILL 0.8
+
+int hc_restore(HCIndex *idx, const char *path) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return -1;
+
+    HCSnapHeader h;
+    BTKey *keys = NULL;
+    BTPayload *vals = NULL;
+    size_t n = 0, m = 0;
+    int rc = -1;
+    if (fread(&h, sizeof(h), 1, f) != 1 ||
+        memcmp(h.magic, HC_SNAP_MAGIC, sizeof(HC_SNAP_MAGIC)) != 0 ||
+        h.version != HC_SNAP_VERSION ||
+        h.freq_kind != (uint32_t)idx->params.freq_kind ||
+        h.min_key != idx->min_key || h.max_key != idx->max_key ||
+        h.payloads != (uint64_t)!idx->params.inclusive)
+        goto out;
+
+    n = (size_t)h.nhot;
+    keys = (BTKey*)malloc(sizeof(BTKey) * (n ? n : 1));
+    vals = (BTPayload*)malloc(sizeof(BTPayload) * (n ? n : 1));
+    if (fread(keys, sizeof(BTKey), n, f) != n) goto out;
+    if (h.payloads && fread(vals, sizeof(BTPayload), n, f) != n) goto out;
+
+    if (idx->params.concurrent) pthread_mutex_lock(&idx->maint_lock);
+    if (hc_hot_count(idx) != 0 || freq_load(idx->freq, f) != 0) {
+        hc_maint_end(idx);
+        goto out;
+    }
+    hc_flush_locked(idx);   // restored payloads come from cold
+    __atomic_store(&idx->params.sampling_rate, &h.sampling_rate, __ATOMIC_RELAXED);
+    idx->lr_w0 = h.lr_w0;
+    idx->lr_w1 = h.lr_w1;
+
+    // Exclusive: the file held the only copy, so cold gets every key now
+    // and gives up the ones loaded into hot below.
+    if (h.payloads) {
+        for (size_t i = 0; i < n; i++) {
+            if (idx->filter) bf_add(idx->filter, keys[i]);
+            bt_insert(idx->cold, keys[i], vals[i]);
+        }
+    }
+
+    // Payloads from cold, in one batched pass over ascending keys.
+    bt_search_batch(idx->cold, keys, n, vals, NULL);
+    for (size_t i = 0; i < n; i++) {
+        if (vals[i] != NULL) {
+            keys[m] = keys[i];
+            vals[m] = vals[i];
+            m++;
+        }
+    }
+    if (m > idx->hot_capacity) {
+        m = hc_keep_hottest(idx, keys, m, idx->hot_capacity);
+        bt_search_batch(idx->cold, keys, m, vals, NULL);
+    }
+
+    for (int r = 0; r < idx->hot_copies; r++) {
+        if (idx->hot_hash) {
+            HotHash *h = r ? idx->hot_hash_rep[r] : idx->hot_hash;
+            hh_reserve(h, m);
+            for (size_t i = 0; i < m; i++) hh_put(h, keys[i], vals[i]);
+        } else {
+            bt_bulk_load(r ? idx->hot_rep[r] : idx->hot, keys, vals, m, HC_RESTORE_FILL);
+        }
+    }
+    if (!idx->params.inclusive) {
+        for (size_t i = 0; i < m; i++) bt_delete(idx->cold, keys[i]);
+    }
+    if (idx->hot_ring) {
+        memcpy(idx->hot_ring, keys, sizeof(BTKey) * m);
+        idx->hot_ring_len = m;
+        idx->clock_hand   = 0;
+    }
+    hc_maint_end(idx);
+    rc = 0;
+
+out:
+    fclose(f);
+    free(keys);
+    free(vals);
+    return rc;
+}
@@ -2,18 +2,100 @@
 #ifndef HCTREE_H
 #define HCTREE_H
 
+#include <pthread.h>
+#include <stdio.h>
 #include "btree.h"
+#include "freq.h"
+#include "promoq.h"
+#include "hothash.h"
+#include "bloom.h"
+
+// Victim selection once the hot tier is full.
+typedef enum {
+    HC_EVICT_NONE    = 0,  // hot tier only grows; refuse promotions when full
+    HC_EVICT_CLOCK   = 1,  // CLOCK sweep that decays scores as it passes
+    HC_EVICT_SAMPLED = 2   // evict lowest score among a few random hot keys
+} HCEvictPolicy;
+
+// Online tuning of the promotion knobs (HCParams.adapt_sampling).
+typedef enum {
+    HC_ADAPT_NONE   = 0,   // knobs stay as configured
+    HC_ADAPT_VISITS = 1,   // regress node visits/query on D, step D by 0.05
+    HC_ADAPT_COST   = 2    // hill-climb D, hot_threshold and the hot budget
+                           // on measured cycles per query (see hc_tune)
+} HCAdaptMode;
+
+// Structure of the hot tier.
+typedef enum {
+    HC_HOT_BTREE = 0,      // a BTree, like the cold tier
+    HC_HOT_HASH  = 1       // open-addressing hash table (hothash.h)
+} HCHotKind;
 
 // Parameters controlling hot/cold behavior.
 typedef struct {
     double decay_alpha;      // e.g., 0.9
     double hot_threshold;    // e.g., 8.0
     double max_hot_fraction; // e.g., 0.10 (10% of keys)
-    int    inclusive;        // 1 = hot is a cache (no deletes in cold)
+    // 1 = every key stays in cold; hot holds copies. 0 = exclusive: a key
+    // lives in one tier only. Promotion moves it from cold to hot and
+    // eviction moves it back, so hot keys cost no cold memory.
+    int    inclusive;
 
     // Sampling + ML-style adaptation knobs
     double sampling_rate;    // D in the paper, 0 < D <= 1
-    int    adapt_sampling;   // 0 = fixed D, 1 = adaptive (ML) controller
+    int    adapt_sampling;   // HCAdaptMode
+
+    int    evict_policy;     // HCEvictPolicy
+
+    // Hit-score tracker (see freq.h). FREQ_DENSE is exact but needs
+    // 8 bytes per key of the domain; FREQ_CMS / FREQ_TABLE use a fixed
+    // freq_bytes budget (0 = 1 MiB) in O(1) per lookup.
+    int    freq_kind;        // FreqKind
+    size_t freq_bytes;
+
+    int    cold_bplus;       // 1 = cold tier is a linked-leaf B+tree
+    int    cold_packed;      // 1 = cold tier is a B+tree with frame-of-
+                             //     reference packed leaves (see leafpack.h)
+    // > 0: learned leaf directory on the cold tier with this error bound
+    // (bt_set_learned; B+tree and packed layouts only). Cold lookups then
+    // skip the root-to-leaf descent. Built by hc_bulk_load.
+    int    cold_learned;
+
+    // 1 = the index may be shared between threads (see hc_search). Both
+    // trees then use optimistic lock-free lookups (bt_set_concurrent).
+    int    concurrent;
+
+    // 1 = lookups only queue promotion candidates (key + payload found);
+    // hc_maintain() or the maintenance thread inserts them into hot.
+    int    async_promote;
+    size_t promote_queue;    // queue capacity (0 = 4096)
+
+    // HCHotKind. A hash hot tier answers a hit in about one cache line
+    // instead of a tree descent; range scans then read the cold tier
+    // alone, which holds every key in inclusive mode (in exclusive mode
+    // they also gather the hot keys in range, O(hot keys) per scan).
+    int    hot_kind;
+
+    // Bits per key of a Bloom filter over every inserted key (0 = none).
+    // Lookups it rules out skip both trees; ~10 gives a 1% FP rate.
+    unsigned filter_bits;
+
+    // Write buffer: hc_insert stages up to this many new or overwritten
+    // non-hot keys in a hashed log that lookups check between the two
+    // tiers, and sorts and applies them to cold in one bt_insert_sorted
+    // pass when it is full (0 = off: every insert descends cold).
+    size_t   write_buffer;
+
+    // Memory placement (see hcnuma.h). hot_pages (NMPages) is the page
+    // size of the hot tier's nodes or table and of the hit-score state.
+    // hot_replicas = 1 keeps one copy of the hot tier on each NUMA node
+    // and sends each lookup to the copy on its own node; every hot write
+    // then goes to all copies in turn (under maint_lock, so readers on
+    // other nodes may see a change a moment later). cold_interleave = 1
+    // spreads the cold tier's pages over all nodes (owned trees only).
+    int      hot_pages;
+    int      hot_replicas;
+    int      cold_interleave;
 } HCParams;
 
 // Statistics for evaluation.
@@ -26,20 +108,116 @@ typedef struct {
     long hot_node_visits;
     long cold_node_visits;
 
+    long promotions;
+    long evictions;
+    long promote_drops;      // async candidates dropped on a full queue
+    long writebacks;         // hot updates/deletes applied to cold on eviction;
+                             // in exclusive mode, every live key evicted
+    long flushes;            // write-buffer flushes into cold
+
+    long filter_negatives;   // misses answered by the filter alone
+    long filter_false_pos;   // filter said "maybe", neither tree had the key
+
+    long lookup_cycles;      // hc_cycles() spent in lookups (HC_ADAPT_COST)
+    long promote_cycles;     // ... in promotions (HC_ADAPT_COST or HC_INSTRUMENT)
+
+    // Per-phase hc_cycles(), only counted when built with HC_INSTRUMENT
+    // (make INSTRUMENT=1); zero otherwise.
+    long filter_cycles;      // Bloom filter probes
+    long hot_cycles;         // hot-tier probes
+    long cold_cycles;        // cold-tier probes
+    long adapt_cycles;       // adaptation steps (adapt_sampling)
+
     size_t hot_keys;
     size_t cold_keys;
+    size_t buffered_keys;    // write-buffer entries since the last flush
+    size_t hot_bytes;        // memory of each tier in use now (bt_live_bytes,
+    size_t cold_bytes;       // or hh_bytes for a hash hot tier)
 } HCStats;
 
+// The HCStats fields, for code that handles them all alike: counters
+// only grow, gauges are current sizes. hctree.c checks that the two lists
+// together name every field.
+#define HC_STATS_COUNTERS(X)                                                \
+    X(queries) X(hot_hits) X(cold_hits) X(not_found)                        \
+    X(hot_node_visits) X(cold_node_visits)                                  \
+    X(promotions) X(evictions) X(promote_drops) X(writebacks) X(flushes)    \
+    X(filter_negatives) X(filter_false_pos)                                 \
+    X(lookup_cycles) X(promote_cycles)                                      \
+    X(filter_cycles) X(hot_cycles) X(cold_cycles) X(adapt_cycles)
+#define HC_STATS_GAUGES(X)                                                  \
+    X(hot_keys) X(cold_keys) X(buffered_keys) X(hot_bytes) X(cold_bytes)
+#define HC_STATS_FIELDS(X) HC_STATS_COUNTERS(X) HC_STATS_GAUGES(X)
+
+// State of the HC_ADAPT_COST controller (see hc_tune in hctree.c).
+typedef struct {
+    int    knob;           // knob being tuned: 0 = D, 1 = threshold, 2 = budget
+    int    dir;            // +1 / -1: direction of the trial move
+    int    flips;          // directions tried for this knob at this step
+    int    probing;        // 1 = the interval just measured ran a trial move
+    int    settling;       // 1 = discard the next interval (a knob just moved)
+    double step[3];        // multiplicative step per knob
+    double prev;           // knob value before the trial move
+    double best_cost;      // cycles/query at the accepted setting; < 0 = unknown
+    double budget_scale;   // hot_capacity = hot_budget * budget_scale
+    long   epoch;
+    long   last_q;
+    long   last_hot_hits;
+    long   last_lookup_cycles;
+    long   last_promote_cycles;
+    FILE  *trace;          // CSV convergence trace (hc_set_adapt_trace)
+} HCTuner;
+
+// Per-thread counter blocks behind HCStats (defined in hctree.c).
+struct HCStatShard;
+
 // Main hot/cold index structure.
 typedef struct {
-    BTree  *hot;
-    BTree  *cold;
+    BTree   *hot;        // hot tier when params.hot_kind == HC_HOT_BTREE
+    HotHash *hot_hash;   // hot tier when params.hot_kind == HC_HOT_HASH
+    // With params.hot_replicas, one copy of the hot tier per NUMA node;
+    // copy 0 is hot / hot_hash itself. hot_copies is 1 (arrays NULL)
+    // otherwise.
+    BTree   **hot_rep;
+    HotHash **hot_hash_rep;
+    int       hot_copies;
+    BTree   *cold;
+    BloomFilter *filter; // keys ever inserted into cold (params.filter_bits)
+
+    // Hot keys whose cold copy is stale: updated or deleted (HC_TOMBSTONE)
+    // while hot. Only touched with maint_lock held; see hc_write_back.
+    HotHash *dirty;
 
-    int64_t max_key;     // keys ∈ [0, max_key]
-    double *hit_score;   // array[max_key+1]
+    int64_t min_key;     // key domain [min_key, max_key]: sizes the hot
+    int64_t max_key;     // budget and FREQ_DENSE; other keys are still indexed
+    Freq   *freq;        // decayed hit score per key
 
     HCParams params;
-    HCStats  stats;
+
+    // Statistics, split into cache-line-sized shards so threads do not
+    // share counter lines; hc_get_stats() sums them. A thread always uses
+    // the same shard, and single-threaded indexes only use shard 0.
+    struct HCStatShard *shards;
+
+    // Concurrent mode: serializes promotion, eviction and sampling-rate
+    // adaptation. Readers only ever try-lock it and skip that work when
+    // another thread holds it.
+    pthread_mutex_t maint_lock;
+
+    // --- Asynchronous promotion (params.async_promote) ---
+    PromoQueue *promoq;
+    pthread_t   maint_thread;
+    int         maint_running;
+    int         maint_stop;
+    unsigned    maint_idle_us;
+
+    // --- Hot-tier capacity and eviction state ---
+    size_t  hot_budget;    // hot-tier key budget: ceil(max_hot_fraction * keys)
+    size_t  hot_capacity;  // max keys in hot: the budget, scaled by the tuner
+    BTKey  *hot_ring;      // array[hot_capacity]: keys resident in hot
+    size_t  hot_ring_len;
+    size_t  clock_hand;    // next ring slot the CLOCK sweep inspects
+    size_t  hot_tombs;     // hot keys whose payload is a tombstone
 
     // --- Online linear regression state (classic ML) ---
     // We model: cost(D) ≈ w0 + w1 * D
@@ -48,22 +226,140 @@ typedef struct {
     long   last_cold_nodes;    // cold_node_visits at last adaptation
     double lr_w0;              // regression weight for bias
     double lr_w1;              // regression weight for D
+
+    HCTuner tuner;             // HC_ADAPT_COST
+
+    // --- Write buffer (params.write_buffer) ---
+    // Keys not in hot whose latest payload is staged here, ahead of cold,
+    // in arrival order; wb_slots is a linear-probing table of entry
+    // numbers (1-based, 0 = empty). Written with maint_lock held; wb_seq
+    // is odd while a writer changes it, and lock-free readers retry
+    // across such a change.
+    BTKey     *wb_keys;
+    BTPayload *wb_vals;
+    uint32_t  *wb_slots;
+    size_t     wb_mask;        // wb_slots has wb_mask + 1 entries
+    size_t     wb_len;
+    uint64_t   wb_seq;
+    BTKey     *wb_sort_keys;   // 2 * write_buffer: radix sort ping-pong
+    BTPayload *wb_sort_vals;
 } HCIndex;
 
 HCIndex* hc_create(int64_t max_key, int btree_degree, HCParams params);
+
+// Same as hc_create() for the key domain [min_key, max_key].
+HCIndex* hc_create_range(int64_t min_key, int64_t max_key, int btree_degree,
+                         HCParams params);
+
+// Index over an existing cold tree, e.g. one opened with bt_open_mmap():
+// the hot tier is built in memory as usual, and the index owns cold from
+// now on (hc_free frees it). params.cold_bplus is ignored. The filter, if
+// any, is seeded with cold's keys. A mapped cold tier cannot be written,
+// so the index is then inclusive whatever params.inclusive says.
+HCIndex* hc_create_on(BTree *cold, int64_t min_key, int64_t max_key,
+                      int btree_degree, HCParams params);
 void     hc_free(HCIndex *idx);
 
-// Build index: insert into COLD only (hot starts empty).
+// Insert or overwrite k. A key not in the hot tier goes into cold (via
+// the write buffer if params.write_buffer is set); a hot
+// key is overwritten in hot only and reaches cold when it is evicted.
+// In exclusive mode a promotion removes the key from cold, and its
+// eviction inserts it there again.
 void     hc_insert(HCIndex *idx, BTKey k, BTPayload v);
 
+// Replace the payload of an existing key; returns 1 if k was present.
+// Like hc_insert, a hot key is changed in hot only, without a cold descent.
+int      hc_update(HCIndex *idx, BTKey k, BTPayload v);
+
+// Delete k; returns 1 if it was present. A hot key is replaced by a
+// tombstone that answers lookups as a miss until eviction deletes the
+// key from cold as well; other keys are deleted from cold right away.
+// The filter keeps deleted keys (they become false positives).
+int      hc_delete(HCIndex *idx, BTKey k);
+
+// Build the cold tier from n strictly increasing keys in one bottom-up
+// pass (see bt_bulk_load). The index must not have had any inserts yet.
+// Returns 0 on success, -1 otherwise.
+int      hc_bulk_load(HCIndex *idx, const BTKey *keys, const BTPayload *payloads,
+                      size_t n, double fill_factor);
+
 // Point lookup: hot first, then cold if miss.
+//
+// With params.concurrent set, hc_search, hc_search_batch, hc_insert,
+// hc_update, hc_delete, hc_range_search and hc_get_stats may be called
+// from any number of threads at once. Writes serialize with each other
+// and with promotion; lookups do not block on writes or on promotion
+// into the hot tier; statistics and hit scores are updated with relaxed
+// atomics (a racing hit can be lost, which only perturbs the estimate).
 BTPayload hc_search(HCIndex *idx, BTKey k);
 
-// Range search: returns all keys in [lo, hi], hot + cold (dedup by key).
+// Batched point lookup: out[j] = hc_search(idx, keys[j]) for j in [0, n),
+// with the tree descents of independent keys interleaved and prefetched.
+// Stats, scores and promotion are updated as for hc_search, except that a
+// key promoted inside a batch only starts hitting hot from the next group.
+void     hc_search_batch(HCIndex *idx, const BTKey *keys, size_t n,
+                         BTPayload *out);
+
+// Range search: returns all keys in [lo, hi] in ascending order, merging
+// hot + cold (dedup by key, hot copy wins, tombstones hide the key). A
+// non-empty write buffer is flushed first. No per-call allocation, except
+// for an exclusive index with a hash hot tier, which copies out the hot
+// keys in range first.
 void     hc_range_search(HCIndex *idx, BTKey lo, BTKey hi,
                          BTRangeCallback cb, void *arg);
 
+// Apply the write buffer to cold now (normally done when it fills, and
+// before range scans and snapshots). A no-op without params.write_buffer.
+void     hc_flush(HCIndex *idx);
+
+// Asynchronous promotion: drain queued candidates into the hot tier and
+// return how many were promoted. Call it from any thread at any time
+// (in concurrent mode it serializes with other maintenance); a no-op
+// unless params.async_promote is set.
+size_t   hc_maintain(HCIndex *idx);
+
+// Run hc_maintain() on a background thread, sleeping idle_us between
+// passes that found nothing to do. Needs params.concurrent and
+// params.async_promote; returns 0 on success, -1 otherwise. hc_free()
+// stops the thread if it is still running.
+int      hc_start_maintenance(HCIndex *idx, unsigned idle_us);
+void     hc_stop_maintenance(HCIndex *idx);
+
+// Change the hot-tier budget at run time. Shrinking below the current
+// hot key count evicts keys right away under CLOCK / sampled eviction,
+// chosen by that policy as for promotion; with HC_EVICT_NONE it only
+// stops promotions until the hot tier is back under budget.
+void     hc_set_hot_capacity(HCIndex *idx, size_t capacity);
+
+// hc_set_hot_capacity that never waits: returns 0 and changes nothing if
+// another thread holds the index's maintenance lock, 1 once applied.
+int      hc_try_set_hot_capacity(HCIndex *idx, size_t capacity);
+
 // Get stats snapshot.
 HCStats  hc_get_stats(HCIndex *idx);
 
+// Add every field of *x to *sum (totals over several indexes).
+void     hc_stats_add(HCStats *sum, const HCStats *x);
+
+// HC_ADAPT_COST: append one CSV row per tuning interval to out (a header
+// row is written now), recording the setting measured, its cost and the
+// controller's decision. NULL stops tracing. The caller owns out.
+void     hc_set_adapt_trace(HCIndex *idx, FILE *out);
+
+// Warm restart. hc_snapshot writes the hot key set, the hit-score tracker
+// and the adapted sampling state (sampling_rate, lr_w0, lr_w1) to path,
+// in a compact binary file. Payloads are not written; pending hot
+// updates and deletes are applied to cold first. In exclusive mode cold
+// lacks the hot keys, so their payloads are written too, as raw 64-bit
+// values (see bt_save); hc_restore puts them into cold, then moves the
+// keys it keeps hot back out.
+// hc_restore loads such a file into an index whose cold tier is already
+// built and whose hot tier is empty, before the index serves lookups.
+// Payloads come from cold, keys cold no longer has are skipped, and if
+// the budget is now smaller only the highest-scoring keys are kept. The
+// hot tier is then bulk loaded. The key domain and tracker (kind and
+// size) must match the snapshot. Both return 0 on success, -1 otherwise.
+int      hc_snapshot(HCIndex *idx, const char *path);
+int      hc_restore(HCIndex *idx, const char *path);
+
 #endif // HCTREE_H
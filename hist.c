@@ -0,0 +1,48 @@
+// hist.c
+#include "hist.h"
+#include <string.h>
+
+void hist_init(Hist *h) {
+    memset(h, 0, sizeof(*h));
+}
+
+void hist_merge(Hist *into, const Hist *from) {
+    for (size_t i = 0; i < HIST_BUCKETS; i++)
+        into->counts[i] += from->counts[i];
+    into->count += from->count;
+    if (from->max > into->max) into->max = from->max;
+}
+
+// Inverse of hist_bucket(): [low, low + width) is the bucket's range.
+static void hist_bucket_range(unsigned b, uint64_t *low, uint64_t *width) {
+    if (b < HIST_SUB) {
+        *low = b;
+        *width = 1;
+        return;
+    }
+    unsigned shift = (b >> HIST_SUB_BITS) - 1;
+    uint64_t sub = b & (HIST_SUB - 1);
+    *low = (HIST_SUB + sub) << shift;
+    *width = (uint64_t)1 << shift;
+}
+
+uint64_t hist_quantile(const Hist *h, double q) {
+    if (h->count == 0) return 0;
+    if (q < 0.0) q = 0.0;
+    if (q > 1.0) q = 1.0;
+    // Rank of the sample sought, 1-based: the smallest value with at
+    // least q of all samples at or below it.
+    uint64_t rank = (uint64_t)(q * (double)h->count + 0.5);
+    if (rank < 1) rank = 1;
+    uint64_t seen = 0;
+    for (unsigned b = 0; b < HIST_BUCKETS; b++) {
+        seen += h->counts[b];
+        if (seen >= rank) {
+            uint64_t low, width;
+            hist_bucket_range(b, &low, &width);
+            uint64_t mid = low + width / 2;
+            return mid < h->max ? mid : h->max;
+        }
+    }
+    return h->max;
+}
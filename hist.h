@@ -0,0 +1,49 @@
+// hist.h
+#ifndef HIST_H
+#define HIST_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+// Log-linear latency histogram in the style of HdrHistogram: values
+// below 2^HIST_SUB_BITS get a bucket each, and every power of two above
+// that is split into 2^HIST_SUB_BITS equal buckets, so a recorded value
+// is known to within 1/32 (~3%) of itself over the whole 64-bit range.
+// Recording is a count-leading-zeros and an increment. Not thread-safe:
+// keep one per thread and hist_merge() them.
+#define HIST_SUB_BITS 5
+#define HIST_SUB      (1u << HIST_SUB_BITS)
+#define HIST_BUCKETS  ((64 - HIST_SUB_BITS + 1) * HIST_SUB)
+
+typedef struct {
+    uint64_t count;
+    uint64_t max;
+    uint64_t counts[HIST_BUCKETS];
+} Hist;
+
+static inline unsigned hist_bucket(uint64_t v) {
+    if (v < HIST_SUB) return (unsigned)v;
+    unsigned e = 63u - (unsigned)__builtin_clzll(v);   // e >= HIST_SUB_BITS
+    unsigned shift = e - HIST_SUB_BITS;
+    return ((shift + 1) << HIST_SUB_BITS) + (unsigned)((v >> shift) - HIST_SUB);
+}
+
+// Record n samples of value v.
+static inline void hist_record_n(Hist *h, uint64_t v, uint64_t n) {
+    h->counts[hist_bucket(v)] += n;
+    h->count += n;
+    if (v > h->max) h->max = v;
+}
+
+static inline void hist_record(Hist *h, uint64_t v) {
+    hist_record_n(h, v, 1);
+}
+
+void     hist_init(Hist *h);
+void     hist_merge(Hist *into, const Hist *from);
+
+// Value at quantile q in [0, 1] (e.g. 0.99): the midpoint of the bucket
+// holding it, capped at the largest value recorded. 0 if empty.
+uint64_t hist_quantile(const Hist *h, double q);
+
+#endif // HIST_H
@@ -0,0 +1,386 @@
+// hothash.c
+#include "hothash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <sched.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HH_X86 1
+#endif
+
+#define HH_LINE     64
+#define HH_SLOTS    4    // keys[4] + vals[4] = one 64-byte line
+#define HH_OPEN     0x10 // scan result: bucket has a never-used slot
+#define HH_HITS     0x0F // scan result: slots whose key matched
+
+// Payload of a deleted slot that a probe must still walk past. The
+// address of a private object, so no caller payload can equal it.
+static const char hh_tomb_obj;
+#define HH_TOMB ((BTPayload)&hh_tomb_obj)
+
+typedef struct {
+    _Alignas(HH_LINE) BTKey keys[HH_SLOTS];
+    BTPayload vals[HH_SLOTS];
+} HHBucket;
+
+// Bucket array plus the mask that goes with it, published as one
+// pointer so a lock-free reader always sees a matching pair.
+typedef struct HHTable {
+    size_t          mask;      // nbuckets - 1
+    struct HHTable *retired;   // older tables still reachable by readers
+    _Alignas(HH_LINE) HHBucket b[];
+} HHTable;
+
+struct HotHash {
+    HHTable *tab;
+    size_t   count;      // live keys
+    size_t   ntomb;      // deleted slots not yet reclaimed
+    int      concurrent;
+    NMPolicy policy;     // where tables are allocated
+    _Alignas(HH_LINE) uint64_t seq;   // odd while a write is in progress
+};
+
+// --- Bucket scan -----------------------------------------------------
+//
+// Returns the mask of slots holding k, plus HH_OPEN if the bucket has a
+// never-used slot (which ends the probe).
+
+static inline unsigned hh_scan_scalar(const HHBucket *b, BTKey k) {
+    unsigned r = 0;
+    for (int i = 0; i < HH_SLOTS; i++) {
+        BTPayload v = b->vals[i];
+        if (v == NULL) r |= HH_OPEN;
+        else if (v != HH_TOMB && b->keys[i] == k) r |= 1u << i;
+    }
+    return r;
+}
+
+static inline size_t hh_home(BTKey k, size_t mask) {
+    uint64_t x = (uint64_t)k * 0x9E3779B97F4A7C15ull;
+    return (size_t)(x ^ (x >> 32)) & mask;
+}
+
+// One probe sequence; instantiated once per scan kernel so the scan is
+// inlined into the loop.
+#define HH_FIND_BODY(scan)                                               \
+    size_t i = hh_home(k, t->mask);                                      \
+    for (size_t n = 0; n <= t->mask; n++) {                              \
+        const HHBucket *b = &t->b[i];                                    \
+        unsigned r = scan(b, k);                                         \
+        stats->node_visits++;                                            \
+        if (r & HH_HITS) return b->vals[__builtin_ctz(r & HH_HITS)];     \
+        if (r & HH_OPEN) return NULL;                                    \
+        i = (i + 1) & t->mask;                                           \
+    }                                                                    \
+    return NULL;
+
+static BTPayload hh_find_scalar(const HHTable *t, BTKey k, BTStats *stats) {
+    HH_FIND_BODY(hh_scan_scalar)
+}
+
+#ifdef HH_X86
+// All four keys and all four payloads are one aligned load each.
+__attribute__((target("avx2")))
+static inline unsigned hh_scan_avx2(const HHBucket *b, BTKey k) {
+    __m256i keys = _mm256_load_si256((const __m256i*)b->keys);
+    __m256i vals = _mm256_load_si256((const __m256i*)b->vals);
+    __m256i eq   = _mm256_cmpeq_epi64(keys, _mm256_set1_epi64x(k));
+    __m256i open = _mm256_cmpeq_epi64(vals, _mm256_setzero_si256());
+    __m256i tomb = _mm256_cmpeq_epi64(vals, _mm256_set1_epi64x((int64_t)(uintptr_t)HH_TOMB));
+    unsigned m_eq   = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(eq));
+    unsigned m_open = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(open));
+    unsigned m_tomb = (unsigned)_mm256_movemask_pd(_mm256_castsi256_pd(tomb));
+    return (m_eq & ~(m_open | m_tomb)) | (m_open ? HH_OPEN : 0);
+}
+
+__attribute__((target("avx2")))
+static BTPayload hh_find_avx2(const HHTable *t, BTKey k, BTStats *stats) {
+    HH_FIND_BODY(hh_scan_avx2)
+}
+#endif
+
+static BTPayload (*hh_find)(const HHTable *t, BTKey k, BTStats *stats) = hh_find_scalar;
+static const char *hh_name = "scalar";
+
+// Runs before main(), like the key search kernel selection.
+__attribute__((constructor))
+static void hh_init(void) {
+#ifdef HH_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        hh_find = hh_find_avx2;
+        hh_name = "avx2";
+    }
+#endif
+}
+
+const char* hh_kernel_name(void) {
+    return hh_name;
+}
+
+// --- Sequence counter ------------------------------------------------
+
+static inline void hh_cpu_relax(unsigned *spins) {
+    if (++*spins < 64) {
+#ifdef HH_X86
+        __builtin_ia32_pause();
+#endif
+    } else {
+        sched_yield();
+    }
+}
+
+static inline uint64_t hh_read_begin(const HotHash *h) {
+    unsigned spins = 0;
+    uint64_t s;
+    while ((s = __atomic_load_n(&h->seq, __ATOMIC_ACQUIRE)) & 1)
+        hh_cpu_relax(&spins);
+    return s;
+}
+
+static inline int hh_read_valid(const HotHash *h, uint64_t s) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&h->seq, __ATOMIC_RELAXED) == s;
+}
+
+static inline void hh_write_begin(HotHash *h) {
+    if (!h->concurrent) return;
+    __atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void hh_write_end(HotHash *h) {
+    if (!h->concurrent) return;
+    __atomic_store_n(&h->seq, h->seq + 1, __ATOMIC_RELEASE);
+}
+
+// --- Table management ------------------------------------------------
+
+static size_t hh_table_bytes(size_t nbuckets) {
+    return sizeof(HHTable) + sizeof(HHBucket) * nbuckets;
+}
+
+// Tables come zeroed and page-aligned from hcnuma.h.
+static HHTable* hh_table_alloc(const HotHash *h, size_t nbuckets) {
+    HHTable *t = (HHTable*)nm_alloc(hh_table_bytes(nbuckets), h->policy);
+    t->mask = nbuckets - 1;
+    return t;
+}
+
+static void hh_table_free(HHTable *t) {
+    nm_free(t, hh_table_bytes(t->mask + 1));
+}
+
+// Keep (count + tombstones) at or below 3/4 of the slots, so every probe
+// meets a never-used slot.
+static inline size_t hh_limit(const HHTable *t) {
+    return (t->mask + 1) * HH_SLOTS / 4 * 3;
+}
+
+static size_t hh_buckets_for(size_t capacity) {
+    size_t n = 2;
+    while (n * HH_SLOTS / 4 * 3 < capacity) n *= 2;
+    return n;
+}
+
+// Writer-side slot for k in t, or -1; *bucket gets its bucket index.
+static long hh_locate(const HHTable *t, BTKey k, size_t *bucket) {
+    size_t i = hh_home(k, t->mask);
+    for (size_t n = 0; n <= t->mask; n++) {
+        unsigned r = hh_scan_scalar(&t->b[i], k);
+        if (r & HH_HITS) {
+            *bucket = i;
+            return __builtin_ctz(r & HH_HITS);
+        }
+        if (r & HH_OPEN) return -1;
+        i = (i + 1) & t->mask;
+    }
+    return -1;
+}
+
+// First free or deleted slot on k's probe path. The caller guarantees
+// one exists and that k is absent. Returns 1 if it reused a tombstone.
+static int hh_place(HHTable *t, BTKey k, BTPayload v) {
+    size_t i = hh_home(k, t->mask);
+    for (;;) {
+        HHBucket *b = &t->b[i];
+        for (int j = 0; j < HH_SLOTS; j++) {
+            if (b->vals[j] == NULL || b->vals[j] == HH_TOMB) {
+                int reused = (b->vals[j] == HH_TOMB);
+                b->keys[j] = k;
+                b->vals[j] = v;
+                return reused;
+            }
+        }
+        i = (i + 1) & t->mask;
+    }
+}
+
+// Rehash every live key into a fresh table of nbuckets and publish it.
+// Readers may still be probing the old table, so in concurrent mode it
+// is kept until hh_free (growth doubles, so this stays under 2x).
+static void hh_rehash(HotHash *h, size_t nbuckets) {
+    HHTable *old = h->tab;
+    HHTable *t = hh_table_alloc(h, nbuckets);
+    for (size_t i = 0; i <= old->mask; i++) {
+        const HHBucket *b = &old->b[i];
+        for (int j = 0; j < HH_SLOTS; j++) {
+            if (b->vals[j] != NULL && b->vals[j] != HH_TOMB)
+                hh_place(t, b->keys[j], b->vals[j]);
+        }
+    }
+
+    if (h->concurrent && nbuckets == old->mask + 1) {
+        // Same size: reclaim tombstones in place rather than leaving a
+        // retired table behind on every purge. Readers spin meanwhile.
+        hh_write_begin(h);
+        memcpy(old->b, t->b, sizeof(HHBucket) * nbuckets);
+        hh_write_end(h);
+        hh_table_free(t);
+    } else {
+        hh_write_begin(h);
+        t->retired = h->concurrent ? old : NULL;
+        __atomic_store_n(&h->tab, t, __ATOMIC_RELEASE);
+        hh_write_end(h);
+        if (!h->concurrent) hh_table_free(old);
+    }
+    h->ntomb = 0;
+}
+
+HotHash* hh_create(size_t capacity, int concurrent) {
+    HotHash *h = (HotHash*)aligned_alloc(HH_LINE, sizeof(HotHash));
+    h->policy     = NM_POLICY_DEFAULT;
+    h->tab        = hh_table_alloc(h, hh_buckets_for(capacity));
+    h->count      = 0;
+    h->ntomb      = 0;
+    h->concurrent = concurrent;
+    h->seq        = 0;
+    return h;
+}
+
+void hh_free(HotHash *h) {
+    if (!h) return;
+    HHTable *t = h->tab;
+    while (t) {
+        HHTable *next = t->retired;
+        hh_table_free(t);
+        t = next;
+    }
+    free(h);
+}
+
+// Copying the table into memory placed by p gets it the new page size
+// too, which moving the old pages could not.
+void hh_set_placement(HotHash *h, NMPolicy p) {
+    h->policy = p;
+    HHTable *old = h->tab;
+    HHTable *t = hh_table_alloc(h, old->mask + 1);
+    memcpy(t->b, old->b, sizeof(HHBucket) * (old->mask + 1));
+    h->tab = t;
+    hh_table_free(old);
+}
+
+BTPayload hh_get(HotHash *h, BTKey k, BTStats *stats) {
+    if (!h->concurrent) return hh_find(h->tab, k, stats);
+    for (;;) {
+        uint64_t s = hh_read_begin(h);
+        const HHTable *t = __atomic_load_n(&h->tab, __ATOMIC_ACQUIRE);
+        BTStats probe = {0};
+        BTPayload v = hh_find(t, k, &probe);
+        if (hh_read_valid(h, s)) {
+            stats->node_visits += probe.node_visits;
+            return v;
+        }
+    }
+}
+
+// Prefetch a group's home buckets first so their misses overlap.
+#define HH_BATCH_GROUP 16
+
+void hh_get_batch(HotHash *h, const BTKey *keys, size_t n,
+                  BTPayload *out, BTStats *stats) {
+    for (size_t base = 0; base < n; base += HH_BATCH_GROUP) {
+        size_t m = n - base;
+        if (m > HH_BATCH_GROUP) m = HH_BATCH_GROUP;
+        const HHTable *t = __atomic_load_n(&h->tab, __ATOMIC_ACQUIRE);
+        for (size_t j = 0; j < m; j++)
+            __builtin_prefetch(&t->b[hh_home(keys[base + j], t->mask)]);
+        for (size_t j = 0; j < m; j++)
+            out[base + j] = hh_get(h, keys[base + j], stats);
+    }
+}
+
+int hh_put(HotHash *h, BTKey k, BTPayload v) {
+    size_t bi;
+    if (hh_locate(h->tab, k, &bi) >= 0) return 0;
+    if (h->count + 1 > hh_limit(h->tab))
+        hh_rehash(h, (h->tab->mask + 1) * 2);
+    else if (h->count + h->ntomb + 1 > hh_limit(h->tab))
+        hh_rehash(h, h->tab->mask + 1);
+
+    hh_write_begin(h);
+    if (hh_place(h->tab, k, v)) h->ntomb--;
+    hh_write_end(h);
+    __atomic_store_n(&h->count, h->count + 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+int hh_update(HotHash *h, BTKey k, BTPayload v) {
+    size_t bi;
+    long j = hh_locate(h->tab, k, &bi);
+    if (j < 0) return 0;
+    hh_write_begin(h);
+    h->tab->b[bi].vals[j] = v;
+    hh_write_end(h);
+    return 1;
+}
+
+int hh_del(HotHash *h, BTKey k) {
+    size_t bi;
+    long j = hh_locate(h->tab, k, &bi);
+    if (j < 0) return 0;
+    HHBucket *b = &h->tab->b[bi];
+
+    // If the bucket already has a never-used slot, no probe ever went
+    // past it, so the slot can become never-used too.
+    int open = 0;
+    for (int s = 0; s < HH_SLOTS; s++) open |= (b->vals[s] == NULL);
+
+    hh_write_begin(h);
+    b->vals[j] = open ? NULL : HH_TOMB;
+    hh_write_end(h);
+    if (!open) h->ntomb++;
+    __atomic_store_n(&h->count, h->count - 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+void hh_reserve(HotHash *h, size_t capacity) {
+    size_t n = hh_buckets_for(capacity);
+    if (n > h->tab->mask + 1) hh_rehash(h, n);
+}
+
+size_t hh_count(const HotHash *h) {
+    return __atomic_load_n(&h->count, __ATOMIC_RELAXED);
+}
+
+size_t hh_keys(const HotHash *h, BTKey *out, size_t max) {
+    const HHTable *t = h->tab;
+    size_t n = 0;
+    for (size_t i = 0; i <= t->mask && n < max; i++) {
+        const HHBucket *b = &t->b[i];
+        for (int j = 0; j < HH_SLOTS && n < max; j++) {
+            if (b->vals[j] != NULL && b->vals[j] != HH_TOMB)
+                out[n++] = b->keys[j];
+        }
+    }
+    return n;
+}
+
+size_t hh_bytes(const HotHash *h) {
+    size_t bytes = sizeof(HotHash);
+    for (const HHTable *t = h->tab; t; t = t->retired)
+        bytes += sizeof(HHTable) + sizeof(HHBucket) * (t->mask + 1);
+    return bytes;
+}
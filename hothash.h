@@ -0,0 +1,53 @@
+// hothash.h
+#ifndef HOTHASH_H
+#define HOTHASH_H
+
+#include <stddef.h>
+#include "btree.h"
+
+// Open-addressing hash table used as an alternative hot tier (see
+// HCParams.hot_kind). Each bucket is one cache line holding 4 keys and
+// their payloads, so a lookup that hits in its home bucket touches one
+// line; the 4 keys are compared at once with AVX2 when the CPU has it.
+// Collisions probe the next bucket, and a probe ends at the first bucket
+// with a never-used slot.
+//
+// A NULL payload marks a free slot, so (as for the trees) NULL cannot
+// be stored. There is one writer at a time (the caller serializes puts
+// and deletes). With concurrent = 1, lookups from other threads run
+// lock-free under a table-wide sequence counter and retry when a write
+// overlapped them.
+typedef struct HotHash HotHash;
+
+// capacity: number of keys the table should hold without growing.
+HotHash*  hh_create(size_t capacity, int concurrent);
+void      hh_free(HotHash *h);
+
+// Page size and NUMA node of the table, now and after it grows
+// (hcnuma.h). Call before the table is shared with readers.
+void      hh_set_placement(HotHash *h, NMPolicy p);
+
+// Payload for k, or NULL. stats->node_visits counts buckets probed.
+BTPayload hh_get(HotHash *h, BTKey k, BTStats *stats);
+void      hh_get_batch(HotHash *h, const BTKey *keys, size_t n,
+                       BTPayload *out, BTStats *stats);
+
+int       hh_put(HotHash *h, BTKey k, BTPayload v);   // 1 = inserted, 0 = present
+int       hh_update(HotHash *h, BTKey k, BTPayload v); // 1 = replaced, 0 = absent
+int       hh_del(HotHash *h, BTKey k);                // 1 = removed
+
+// Grow so that capacity keys fit; never shrinks.
+void      hh_reserve(HotHash *h, size_t capacity);
+
+size_t    hh_count(const HotHash *h);
+
+// Copy up to max keys into out, in table order; returns how many. Like
+// puts and deletes, this must not run alongside a writer.
+size_t    hh_keys(const HotHash *h, BTKey *out, size_t max);
+
+size_t    hh_bytes(const HotHash *h);
+
+// Name of the selected bucket scan ("avx2" or "scalar").
+const char* hh_kernel_name(void);
+
+#endif // HOTHASH_H
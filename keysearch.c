@@ -0,0 +1,117 @@
+// keysearch.c
+#include "keysearch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define KS_X86 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define KS_NEON 1
+#endif
+
+// Branch-free scalar count: the compiler can vectorize this on its own,
+// and there is no data-dependent exit to mispredict.
+static int ks_lower_bound_scalar(const int64_t *keys, int n, int64_t k) {
+    int cnt = 0;
+    for (int i = 0; i < n; i++)
+        cnt += (keys[i] < k);
+    return cnt;
+}
+
+#ifdef KS_X86
+// Compare four keys at a time and popcount the "k > key" lanes. Keys are
+// sorted, so the first block that is not all-true ends the scan.
+__attribute__((target("avx2,popcnt")))
+static int ks_lower_bound_avx2(const int64_t *keys, int n, int64_t k) {
+    __m256i kv = _mm256_set1_epi64x(k);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(keys + i));
+        __m256i gt = _mm256_cmpgt_epi64(kv, v);
+        int m = _mm256_movemask_pd(_mm256_castsi256_pd(gt));
+        if (m != 0xF)
+            return i + __builtin_popcount(m);
+    }
+    while (i < n && keys[i] < k) i++;
+    return i;
+}
+
+// Eight keys per compare; the tail is handled with a masked load.
+__attribute__((target("avx512f,popcnt")))
+static int ks_lower_bound_avx512(const int64_t *keys, int n, int64_t k) {
+    __m512i kv = _mm512_set1_epi64(k);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m512i v = _mm512_loadu_si512((const void*)(keys + i));
+        __mmask8 m = _mm512_cmpgt_epi64_mask(kv, v);
+        if (m != 0xFF)
+            return i + __builtin_popcount(m);
+    }
+    if (i < n) {
+        __mmask8 tail = (__mmask8)((1u << (n - i)) - 1);
+        __m512i v = _mm512_maskz_loadu_epi64(tail, keys + i);
+        __mmask8 m = _mm512_mask_cmpgt_epi64_mask(tail, kv, v);
+        i += __builtin_popcount(m);
+    }
+    return i;
+}
+#endif
+
+#ifdef KS_NEON
+// NEON is part of the AArch64 baseline, so no runtime check is needed.
+static int ks_lower_bound_neon(const int64_t *keys, int n, int64_t k) {
+    int64x2_t kv = vdupq_n_s64(k);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint64x2_t a = vcgtq_s64(kv, vld1q_s64(keys + i));
+        uint64x2_t b = vcgtq_s64(kv, vld1q_s64(keys + i + 2));
+        int c = (int)vaddvq_u64(vaddq_u64(vshrq_n_u64(a, 63), vshrq_n_u64(b, 63)));
+        if (c != 4)
+            return i + c;
+    }
+    while (i < n && keys[i] < k) i++;
+    return i;
+}
+#endif
+
+KSLowerBoundFn ks_lower_bound_impl = ks_lower_bound_scalar;
+static const char *ks_name = "scalar";
+
+static void ks_select(const char *name, KSLowerBoundFn fn) {
+    ks_lower_bound_impl = fn;
+    ks_name = name;
+}
+
+// Runs before main(), so the pointer never changes once lookups start.
+__attribute__((constructor))
+static void ks_init(void) {
+    const char *force = getenv("HC_KEYSEARCH");
+    int any = (force == NULL || force[0] == '\0');
+
+#ifdef KS_X86
+    __builtin_cpu_init();
+    if ((any || !strcmp(force, "avx512")) && __builtin_cpu_supports("avx512f")) {
+        ks_select("avx512", ks_lower_bound_avx512);
+        return;
+    }
+    if ((any || !strcmp(force, "avx2")) && __builtin_cpu_supports("avx2")) {
+        ks_select("avx2", ks_lower_bound_avx2);
+        return;
+    }
+#endif
+#ifdef KS_NEON
+    if (any || !strcmp(force, "neon")) {
+        ks_select("neon", ks_lower_bound_neon);
+        return;
+    }
+#endif
+    ks_select("scalar", ks_lower_bound_scalar);
+}
+
+const char* ks_kernel_name(void) {
+    return ks_name;
+}
@@ -0,0 +1,25 @@
+// keysearch.h
+#ifndef KEYSEARCH_H
+#define KEYSEARCH_H
+
+#include <stdint.h>
+
+// Intra-node lower bound over a sorted int64 key array.
+//
+// Returns the number of keys strictly less than k, i.e. the first index i
+// with keys[i] >= k (n if there is none). The kernel is chosen once at
+// startup from what the CPU supports: AVX-512, AVX2, NEON or scalar.
+// Setting HC_KEYSEARCH=scalar|avx2|avx512|neon in the environment forces
+// a specific kernel (if the CPU supports it), which is handy for A/B runs.
+typedef int (*KSLowerBoundFn)(const int64_t *keys, int n, int64_t k);
+
+extern KSLowerBoundFn ks_lower_bound_impl;
+
+static inline int ks_lower_bound(const int64_t *keys, int n, int64_t k) {
+    return ks_lower_bound_impl(keys, n, k);
+}
+
+// Name of the selected kernel ("avx512", "avx2", "neon" or "scalar").
+const char* ks_kernel_name(void);
+
+#endif // KEYSEARCH_H
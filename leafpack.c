@@ -0,0 +1,355 @@
+// leafpack.c
+#include "leafpack.h"
+#include "keysearch.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LP_X86 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#define LP_NEON 1
+#endif
+
+typedef struct {
+    int64_t  kbase;   // first key (0 for a raw key column)
+    uint64_t vbase;   // smallest payload (0 for a raw payload column)
+    uint8_t  kcode;   // key lanes are 1 << kcode bytes; 3 = raw keys
+    uint8_t  vcode;   // payload lanes: 0 = none, else 1 << (vcode-1) bytes
+    uint8_t  pad[6];
+} LPHeader;
+
+_Static_assert(sizeof(LPHeader) == LP_HDR, "LP_HDR must match LPHeader");
+
+// Indexed by the masked codes, so a torn header still yields a width.
+static const int lp_kwidth[4] = { 1, 2, 4, 8 };
+static const int lp_vwidth[8] = { 0, 1, 2, 4, 8, 8, 8, 8 };
+static const uint64_t lp_kmax[3] = { 0xFFu, 0xFFFFu, 0xFFFFFFFFu };
+
+static inline int lp_code(uint64_t span) {
+    return span <= 0xFFu ? 0 : span <= 0xFFFFu ? 1 : span <= 0xFFFFFFFFu ? 2 : 3;
+}
+
+static inline uint64_t lp_load(const uint8_t *p, int w) {
+    switch (w) {
+    case 1: return *p;
+    case 2: { uint16_t x; memcpy(&x, p, 2); return x; }
+    case 4: { uint32_t x; memcpy(&x, p, 4); return x; }
+    case 8: { uint64_t x; memcpy(&x, p, 8); return x; }
+    default: return 0;
+    }
+}
+
+static inline void lp_store(uint8_t *p, int w, uint64_t x) {
+    switch (w) {
+    case 1: *p = (uint8_t)x; break;
+    case 2: { uint16_t y = (uint16_t)x; memcpy(p, &y, 2); break; }
+    case 4: { uint32_t y = (uint32_t)x; memcpy(p, &y, 4); break; }
+    case 8: memcpy(p, &x, 8); break;
+    default: break;
+    }
+}
+
+// Column codes and payload base for keys[0, n) / vals[0, n).
+static void lp_plan(const BTKey *keys, const BTPayload *vals, int n,
+                    int *kc, int *vc, uint64_t *vmin) {
+    uint64_t lo = 0, hi = 0;
+    if (n > 0) lo = hi = (uint64_t)(uintptr_t)vals[0];
+    for (int i = 1; i < n; i++) {
+        uint64_t v = (uint64_t)(uintptr_t)vals[i];
+        if (v < lo) lo = v;
+        if (v > hi) hi = v;
+    }
+    uint64_t kspan = n > 0 ? (uint64_t)keys[n-1] - (uint64_t)keys[0] : 0;
+    *kc = lp_code(kspan);
+    *vc = hi == lo ? 0 : 1 + lp_code(hi - lo);
+    *vmin = lo;
+}
+
+size_t lp_size(const BTKey *keys, const BTPayload *vals, int n) {
+    int kc, vc;
+    uint64_t vmin;
+    lp_plan(keys, vals, n, &kc, &vc, &vmin);
+    return LP_HDR + (size_t)n * (size_t)(lp_kwidth[kc] + lp_vwidth[vc]);
+}
+
+size_t lp_size_span(int n, uint64_t kspan, uint64_t vspan) {
+    int vc = vspan == 0 ? 0 : 1 + lp_code(vspan);
+    return LP_HDR + (size_t)n * (size_t)(lp_kwidth[lp_code(kspan)] + lp_vwidth[vc]);
+}
+
+size_t lp_block_bytes(const void *blk, int n) {
+    const LPHeader *h = (const LPHeader*)blk;
+    return LP_HDR + (size_t)n * (size_t)(lp_kwidth[h->kcode & 3] + lp_vwidth[h->vcode & 7]);
+}
+
+int lp_encode(void *blk, size_t room, const BTKey *keys, const BTPayload *vals, int n) {
+    int kc, vc;
+    uint64_t vmin;
+    lp_plan(keys, vals, n, &kc, &vc, &vmin);
+    int kw = lp_kwidth[kc], vw = lp_vwidth[vc];
+    if (LP_HDR + (size_t)n * (size_t)(kw + vw) > room) return -1;
+
+    LPHeader h;
+    memset(&h, 0, sizeof(h));
+    h.kbase = (kc == 3 || n == 0) ? 0 : keys[0];
+    h.vbase = vc == 4 ? 0 : vmin;
+    h.kcode = (uint8_t)kc;
+    h.vcode = (uint8_t)vc;
+    memcpy(blk, &h, sizeof(h));
+
+    uint8_t *col = (uint8_t*)blk + LP_HDR;
+    for (int i = 0; i < n; i++)
+        lp_store(col + (size_t)i * kw, kw, (uint64_t)keys[i] - (uint64_t)h.kbase);
+    col += (size_t)n * kw;
+    for (int i = 0; i < n && vw > 0; i++)
+        lp_store(col + (size_t)i * vw, vw, (uint64_t)(uintptr_t)vals[i] - h.vbase);
+    return 0;
+}
+
+void lp_decode(const void *blk, int n, BTKey *keys, BTPayload *vals) {
+    const LPHeader *h = (const LPHeader*)blk;
+    int kw = lp_kwidth[h->kcode & 3], vw = lp_vwidth[h->vcode & 7];
+    const uint8_t *col = (const uint8_t*)blk + LP_HDR;
+    for (int i = 0; i < n; i++)
+        keys[i] = (BTKey)((uint64_t)h->kbase + lp_load(col + (size_t)i * kw, kw));
+    col += (size_t)n * kw;
+    for (int i = 0; i < n; i++)
+        vals[i] = (BTPayload)(uintptr_t)(h->vbase + lp_load(col + (size_t)i * vw, vw));
+}
+
+BTKey lp_key(const void *blk, int i) {
+    const LPHeader *h = (const LPHeader*)blk;
+    int kw = lp_kwidth[h->kcode & 3];
+    const uint8_t *col = (const uint8_t*)blk + LP_HDR;
+    return (BTKey)((uint64_t)h->kbase + lp_load(col + (size_t)i * kw, kw));
+}
+
+BTPayload lp_val(const void *blk, int n, int i) {
+    const LPHeader *h = (const LPHeader*)blk;
+    int kw = lp_kwidth[h->kcode & 3], vw = lp_vwidth[h->vcode & 7];
+    const uint8_t *col = (const uint8_t*)blk + LP_HDR + (size_t)n * kw;
+    return (BTPayload)(uintptr_t)(h->vbase + lp_load(col + (size_t)i * vw, vw));
+}
+
+// Whether v fits the payload column of h as it stands.
+static inline int lp_val_fits(const LPHeader *h, uint64_t v) {
+    int vc = h->vcode & 7;
+    if (vc >= 4) return 1;
+    if (v < h->vbase) return 0;
+    return vc == 0 ? v == h->vbase : v - h->vbase <= lp_kmax[vc - 1];
+}
+
+int lp_insert(void *blk, size_t room, int n, int i, BTKey k, BTPayload v) {
+    LPHeader *h = (LPHeader*)blk;
+    int kc = h->kcode & 3, kw = lp_kwidth[kc], vw = lp_vwidth[h->vcode & 7];
+    uint64_t kd = (uint64_t)k - (uint64_t)h->kbase;
+    uint64_t vv = (uint64_t)(uintptr_t)v;
+    if (n == 0 || (kc < 3 && (k < h->kbase || kd > lp_kmax[kc]))) return -1;
+    if (!lp_val_fits(h, vv)) return -1;
+    if (LP_HDR + (size_t)(n + 1) * (size_t)(kw + vw) > room) return -1;
+
+    // Shift right: the payloads after i, the payloads before i, then the keys.
+    uint8_t *col = (uint8_t*)blk + LP_HDR;
+    size_t vold = (size_t)n * kw, vnew = vold + kw;
+    memmove(col + vnew + (size_t)(i + 1) * vw, col + vold + (size_t)i * vw,
+            (size_t)(n - i) * vw);
+    memmove(col + vnew, col + vold, (size_t)i * vw);
+    memmove(col + (size_t)(i + 1) * kw, col + (size_t)i * kw, (size_t)(n - i) * kw);
+    lp_store(col + (size_t)i * kw, kw, kd);
+    if (vw > 0) lp_store(col + vnew + (size_t)i * vw, vw, vv - h->vbase);
+    return 0;
+}
+
+int lp_set_val(void *blk, int n, int i, BTPayload v) {
+    LPHeader *h = (LPHeader*)blk;
+    int kw = lp_kwidth[h->kcode & 3], vw = lp_vwidth[h->vcode & 7];
+    uint64_t vv = (uint64_t)(uintptr_t)v;
+    if (!lp_val_fits(h, vv)) return -1;
+    if (vw > 0)
+        lp_store((uint8_t*)blk + LP_HDR + (size_t)n * kw + (size_t)i * vw, vw, vv - h->vbase);
+    return 0;
+}
+
+int lp_clamp(const void *blk, int n, size_t room) {
+    if (n < 0 || lp_block_bytes(blk, n) > room) return 0;
+    return n;
+}
+
+// --- Delta scans -------------------------------------------------------
+//
+// Each kernel counts the lanes of a sorted column that are < d, where d
+// fits the lane width. Same shape as keysearch.c: compare a vector of
+// lanes at a time, and the first block that is not all-true ends it.
+
+typedef int (*LPScanFn)(const uint8_t *col, int n, uint32_t d);
+
+static int lp_scan8_scalar(const uint8_t *col, int n, uint32_t d) {
+    int cnt = 0;
+    for (int i = 0; i < n; i++) cnt += (col[i] < d);
+    return cnt;
+}
+
+static int lp_scan16_scalar(const uint8_t *col, int n, uint32_t d) {
+    const uint16_t *a = (const uint16_t*)col;
+    int cnt = 0;
+    for (int i = 0; i < n; i++) cnt += (a[i] < d);
+    return cnt;
+}
+
+static int lp_scan32_scalar(const uint8_t *col, int n, uint32_t d) {
+    const uint32_t *a = (const uint32_t*)col;
+    int cnt = 0;
+    for (int i = 0; i < n; i++) cnt += (a[i] < d);
+    return cnt;
+}
+
+#ifdef LP_X86
+// AVX2 has no unsigned compare; lane < d is min(lane, d-1) == lane.
+__attribute__((target("avx2,popcnt")))
+static int lp_scan8_avx2(const uint8_t *col, int n, uint32_t d) {
+    if (d == 0) return 0;
+    __m256i dm = _mm256_set1_epi8((char)(d - 1));
+    int i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(col + i));
+        __m256i le = _mm256_cmpeq_epi8(_mm256_min_epu8(v, dm), v);
+        unsigned m = (unsigned)_mm256_movemask_epi8(le);
+        if (m != 0xFFFFFFFFu)
+            return i + __builtin_popcount(m);
+    }
+    while (i < n && col[i] < d) i++;
+    return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static int lp_scan16_avx2(const uint8_t *col, int n, uint32_t d) {
+    const uint16_t *a = (const uint16_t*)col;
+    if (d == 0) return 0;
+    __m256i dm = _mm256_set1_epi16((short)(d - 1));
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i le = _mm256_cmpeq_epi16(_mm256_min_epu16(v, dm), v);
+        unsigned m = (unsigned)_mm256_movemask_epi8(le);   // 2 bits per lane
+        if (m != 0xFFFFFFFFu)
+            return i + __builtin_popcount(m) / 2;
+    }
+    while (i < n && a[i] < d) i++;
+    return i;
+}
+
+__attribute__((target("avx2,popcnt")))
+static int lp_scan32_avx2(const uint8_t *col, int n, uint32_t d) {
+    const uint32_t *a = (const uint32_t*)col;
+    if (d == 0) return 0;
+    __m256i dm = _mm256_set1_epi32((int)(d - 1));
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        __m256i v  = _mm256_loadu_si256((const __m256i*)(a + i));
+        __m256i le = _mm256_cmpeq_epi32(_mm256_min_epu32(v, dm), v);
+        unsigned m = (unsigned)_mm256_movemask_epi8(le);   // 4 bits per lane
+        if (m != 0xFFFFFFFFu)
+            return i + __builtin_popcount(m) / 4;
+    }
+    while (i < n && a[i] < d) i++;
+    return i;
+}
+#endif
+
+#ifdef LP_NEON
+static int lp_scan8_neon(const uint8_t *col, int n, uint32_t d) {
+    uint8x16_t dv = vdupq_n_u8((uint8_t)d);
+    int i = 0;
+    for (; i + 16 <= n; i += 16) {
+        uint8x16_t lt = vcltq_u8(vld1q_u8(col + i), dv);
+        int c = (int)vaddvq_u8(vshrq_n_u8(lt, 7));
+        if (c != 16)
+            return i + c;
+    }
+    while (i < n && col[i] < d) i++;
+    return i;
+}
+
+static int lp_scan16_neon(const uint8_t *col, int n, uint32_t d) {
+    const uint16_t *a = (const uint16_t*)col;
+    uint16x8_t dv = vdupq_n_u16((uint16_t)d);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint16x8_t lt = vcltq_u16(vld1q_u16(a + i), dv);
+        int c = (int)vaddvq_u16(vshrq_n_u16(lt, 15));
+        if (c != 8)
+            return i + c;
+    }
+    while (i < n && a[i] < d) i++;
+    return i;
+}
+
+static int lp_scan32_neon(const uint8_t *col, int n, uint32_t d) {
+    const uint32_t *a = (const uint32_t*)col;
+    uint32x4_t dv = vdupq_n_u32(d);
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint32x4_t lt = vcltq_u32(vld1q_u32(a + i), dv);
+        int c = (int)vaddvq_u32(vshrq_n_u32(lt, 31));
+        if (c != 4)
+            return i + c;
+    }
+    while (i < n && a[i] < d) i++;
+    return i;
+}
+#endif
+
+static LPScanFn lp_scan[3] = { lp_scan8_scalar, lp_scan16_scalar, lp_scan32_scalar };
+static const char *lp_name = "scalar";
+
+__attribute__((constructor))
+static void lp_init(void) {
+    const char *force = getenv("HC_KEYSEARCH");
+    if (force && !strcmp(force, "scalar")) return;
+#ifdef LP_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        lp_scan[0] = lp_scan8_avx2;
+        lp_scan[1] = lp_scan16_avx2;
+        lp_scan[2] = lp_scan32_avx2;
+        lp_name = "avx2";
+    }
+#endif
+#ifdef LP_NEON
+    lp_scan[0] = lp_scan8_neon;
+    lp_scan[1] = lp_scan16_neon;
+    lp_scan[2] = lp_scan32_neon;
+    lp_name = "neon";
+#endif
+}
+
+const char* lp_kernel_name(void) {
+    return lp_name;
+}
+
+// Wide blocks are narrowed by binary search first, so a scan never
+// covers more than LP_LINEAR lanes.
+#define LP_LINEAR 64
+
+int lp_lower_bound(const void *blk, int n, BTKey k) {
+    if (n <= 0) return 0;
+    const LPHeader *h = (const LPHeader*)blk;
+    const uint8_t *col = (const uint8_t*)blk + LP_HDR;
+    int kc = h->kcode & 3;
+    if (kc == 3) return ks_lower_bound((const int64_t*)col, n, k);
+    if (k < h->kbase) return 0;
+    uint64_t d = (uint64_t)k - (uint64_t)h->kbase;
+    if (d > lp_kmax[kc]) return n;
+
+    int kw = lp_kwidth[kc], lo = 0, hi = n;
+    while (hi - lo > LP_LINEAR) {
+        int mid = lo + (hi - lo) / 2;
+        if (lp_load(col + (size_t)mid * kw, kw) < d) lo = mid + 1;
+        else                                         hi = mid;
+    }
+    return lo + lp_scan[kc](col + (size_t)lo * kw, hi - lo, (uint32_t)d);
+}
@@ -0,0 +1,63 @@
+// leafpack.h
+#ifndef LEAFPACK_H
+#define LEAFPACK_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "btree.h"
+
+// Frame-of-reference codec for the leaves of a packed B+tree
+// (bt_create_packed).
+//
+// A block holds n sorted keys as unsigned deltas from the first key and n
+// payloads as deltas from the smallest payload (payloads are taken as
+// 64-bit integers). Each column has one width per block: 1, 2, 4 or 8
+// bytes, and payloads also 0 bytes when they are all equal; an 8-byte
+// column holds the raw values. Whole-byte lanes let a lookup compare the
+// probe's delta against the key column with SIMD without unpacking it.
+//
+//   [ kbase | vbase | kcode | vcode | pad | key deltas[n] | payload deltas[n] ]
+//
+// Dense keys with integer payloads (the benchmark's k -> k) take 2 bytes
+// per entry instead of 16.
+#define LP_HDR 24   // bytes before the key column
+
+// Bytes needed to encode keys[0, n) / vals[0, n).
+size_t    lp_size(const BTKey *keys, const BTPayload *vals, int n);
+
+// Bytes of a block of n entries whose keys span kspan (last - first) and
+// whose payloads span vspan (largest - smallest).
+size_t    lp_size_span(int n, uint64_t kspan, uint64_t vspan);
+
+// Bytes in use by the n-entry block at blk.
+size_t    lp_block_bytes(const void *blk, int n);
+
+// Encode into blk, which has room bytes. Returns 0, or -1 (blk unchanged)
+// if the block would not fit.
+int       lp_encode(void *blk, size_t room, const BTKey *keys,
+                    const BTPayload *vals, int n);
+
+void      lp_decode(const void *blk, int n, BTKey *keys, BTPayload *vals);
+
+// Number of keys < k (the first index with key >= k), as ks_lower_bound.
+int       lp_lower_bound(const void *blk, int n, BTKey k);
+
+// In-place edits that keep the block's bases and widths: insert k -> v
+// as entry i of an n-entry block, or replace the payload of entry i.
+// Both return -1 (blk unchanged) when the entry needs a re-encode.
+int       lp_insert(void *blk, size_t room, int n, int i, BTKey k, BTPayload v);
+int       lp_set_val(void *blk, int n, int i, BTPayload v);
+
+BTKey     lp_key(const void *blk, int i);
+BTPayload lp_val(const void *blk, int n, int i);
+
+// n, or 0 if a block of n entries with blk's column widths would not fit
+// in room bytes. Optimistic readers apply it to a count read while a
+// writer may be re-encoding the block, before they touch the columns.
+int       lp_clamp(const void *blk, int n, size_t room);
+
+// Name of the selected delta-scan kernel ("avx2", "neon" or "scalar");
+// HC_KEYSEARCH=scalar forces the scalar one, as for keysearch.h.
+const char* lp_kernel_name(void);
+
+#endif // LEAFPACK_H
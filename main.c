@@ -1,4 +1,5 @@
 // main.c
+#define _GNU_SOURCE   // pthread_setaffinity_np() / sched_getaffinity()
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,63 +8,482 @@
 #include <math.h>
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stdarg.h>
+#include <pthread.h>
+#ifdef __linux__
+#include <sched.h>
+#endif
 
 #include "btree.h"
 #include "hctree.h"
+#include "hcshard.h"
+#include "keysearch.h"
+#include "leafpack.h"
+#include "cycles.h"
+#include "hist.h"
+#include "perfctr.h"
+#include "workload.h"
 
-// Simple payload: just store the key as a pointer-sized value.
+// Simple payload: the key plus one as a pointer-sized value. HCIndex
+// lookups return NULL for a miss, so payload 0 would make key 0 look
+// absent.
 static void* make_payload(int64_t k) {
-    return (void*)(intptr_t)k;
+    return (void*)(intptr_t)(k + 1);
 }
 
-// Uniform random in [0, n-1]
-static int64_t rand_uniform(int64_t n) {
-    return (int64_t)((double)rand() / ((double)RAND_MAX + 1.0) * (double)n);
+// Sorted (key, payload) arrays for the bulk loader: keys 0..n-1, the same
+// data the insert loop builds.
+static void make_sorted_input(int64_t n, BTKey **keys, BTPayload **vals) {
+    *keys = (BTKey*)malloc(sizeof(BTKey) * (size_t)(n > 0 ? n : 1));
+    *vals = (BTPayload*)malloc(sizeof(BTPayload) * (size_t)(n > 0 ? n : 1));
+    for (int64_t k = 0; k < n; k++) {
+        (*keys)[k] = k;
+        (*vals)[k] = make_payload(k);
+    }
+}
+
+// Promotion modes for --promote.
+typedef enum {
+    PROMOTE_INLINE = 0,   // inside the lookup that crosses the threshold
+    PROMOTE_QUEUE  = 1,   // queued; drained by hc_maintain() in the query loop
+    PROMOTE_THREAD = 2    // queued; drained by the maintenance thread
+} PromoteMode;
+
+// Queries between hc_maintain() calls in PROMOTE_QUEUE mode.
+#define MAINTAIN_EVERY 1024
+
+// The HCIndex under test: a single index, or a range-sharded one when
+// --shards is above 1.
+typedef struct {
+    HCIndex        *one;
+    HCShardedIndex *many;
+} HCBench;
+
+static void bench_search_batch(HCBench *b, const BTKey *keys, size_t n, BTPayload *out) {
+    if (b->many) hcs_search_batch(b->many, keys, n, out);
+    else         hc_search_batch(b->one, keys, n, out);
+}
+
+static BTPayload bench_search(HCBench *b, BTKey k) {
+    return b->many ? hcs_search(b->many, k) : hc_search(b->one, k);
+}
+
+static void bench_insert(HCBench *b, BTKey k, BTPayload v) {
+    if (b->many) hcs_insert(b->many, k, v);
+    else         hc_insert(b->one, k, v);
+}
+
+static void bench_update(HCBench *b, BTKey k, BTPayload v) {
+    if (b->many) hcs_update(b->many, k, v);
+    else         hc_update(b->one, k, v);
+}
+
+static void bench_range(HCBench *b, BTKey lo, BTKey hi, BTRangeCallback cb, void *arg) {
+    if (b->many) hcs_range_search(b->many, lo, hi, cb, arg);
+    else         hc_range_search(b->one, lo, hi, cb, arg);
+}
+
+static void bench_flush(HCBench *b) {
+    if (b->many) hcs_flush(b->many);
+    else         hc_flush(b->one);
+}
+
+static void bench_maintain(HCBench *b) {
+    if (b->many) hcs_maintain(b->many);
+    else         hc_maintain(b->one);
+}
+
+static HCStats bench_stats(HCBench *b) {
+    return b->many ? hcs_get_stats(b->many) : hc_get_stats(b->one);
+}
+
+static HCIndex* bench_part(HCBench *b, int i) {
+    return b->many ? b->many->shards[i] : b->one;
+}
+
+static int bench_nparts(HCBench *b) {
+    return b->many ? b->many->nshards : 1;
+}
+
+// --- Instrumentation (make INSTRUMENT=1) --------------------------------
+//
+// Built with HC_INSTRUMENT, every lookup call is timed with the cycle
+// counter into a latency histogram (a batch call counts as m samples of
+// its per-key average). Otherwise LAT_START / LAT_STOP compile to nothing
+// and the query loops are exactly the uninstrumented ones.
+#ifdef HC_INSTRUMENT
+#define LAT_START(t)       uint64_t t = hc_cycles()
+#define LAT_STOP(h, t, m)  hist_record_n((h), (hc_cycles() - (t)) / (uint64_t)(m), \
+                                         (uint64_t)(m))
+#define INSTRUMENTED 1
+#else
+#define LAT_START(t)       ((void)0)
+#define LAT_STOP(h, t, m)  ((void)(h))
+#define INSTRUMENTED 0
+#endif
+
+// Wall clock, cycle counter and (with --perf) hardware counters over the
+// timed query phase.
+typedef struct {
+    double       t0, t1;
+    uint64_t     c0, c1;
+    PerfCounters pc;
+    int          npc;       // hardware events opened; 0 = none
+} Measure;
+
+static double now_seconds(void);
+
+static void measure_start(Measure *m) {
+    if (m->npc) pc_start(&m->pc);
+    m->t0 = now_seconds();
+    m->c0 = hc_cycles();
+}
+
+static void measure_stop(Measure *m) {
+    m->c1 = hc_cycles();
+    m->t1 = now_seconds();
+    if (m->npc) pc_stop(&m->pc);
+}
+
+// Cycle-counter ticks per nanosecond, calibrated against the wall clock.
+static double measure_ticks_per_ns(const Measure *m) {
+    double ns = (m->t1 - m->t0) * 1e9;
+    return ns > 0.0 ? (double)(m->c1 - m->c0) / ns : 0.0;
 }
 
-// Zipf sampler with precomputed CDF O(log N) sampling.
+// Range-op callback: counts the keys a scan returned.
+static void count_key(BTKey k, BTPayload v, void *arg) {
+    (void)k; (void)v;
+    (*(long*)arg)++;
+}
+
+// Run ops [q0, q1) against the hot/cold index. A put is an insert of the
+// key's payload; a read-modify-write is a lookup followed by an update of
+// the same key. In batch mode, puts, read-modify-writes and range scans
+// run one at a time between batches of plain lookups.
+static long run_hc_queries(HCBench *b, const WLOp *ops, int64_t q0, int64_t q1,
+                           int64_t batch, BTKey *qkeys, BTPayload *qout,
+                           int maintain, Hist *lat) {
+    long scanned = 0;
+    int64_t m = 0;                 // lookups pending in qkeys
+    for (int64_t q = q0; q < q1; q++) {
+        const WLOp *op = &ops[q];
+        if (op->type == WL_GET && batch > 1) {
+            qkeys[m++] = op->key;
+            if (m == batch || q + 1 == q1) {
+                LAT_START(c0);
+                bench_search_batch(b, qkeys, (size_t)m, qout);
+                LAT_STOP(lat, c0, m);
+                m = 0;
+            }
+        } else {
+            if (m > 0) {
+                LAT_START(c0);
+                bench_search_batch(b, qkeys, (size_t)m, qout);
+                LAT_STOP(lat, c0, m);
+                m = 0;
+            }
+            LAT_START(c0);
+            if (op->type == WL_RANGE) {
+                bench_range(b, op->key, op->key + op->len - 1, count_key, &scanned);
+            } else if (op->type == WL_PUT) {
+                bench_insert(b, op->key, make_payload(op->key));
+            } else {
+                (void)bench_search(b, op->key);
+                if (op->type == WL_RMW)
+                    bench_update(b, op->key, make_payload(op->key));
+            }
+            LAT_STOP(lat, c0, 1);
+        }
+        if (maintain && (q + 1) % MAINTAIN_EVERY == 0)
+            bench_maintain(b);
+    }
+    return scanned;
+}
+
+// Baseline counterpart of run_hc_queries over a single tree. Adds the
+// node visits to *visits and the point lookups that missed to *nf.
+static long run_bt_queries(BTree *bt, const WLOp *ops, int64_t q0, int64_t q1,
+                           int64_t batch, BTKey *qkeys, BTPayload *qout, Hist *lat,
+                           long *visits, long *nf) {
+    long scanned = 0;
+    int64_t m = 0;
+    BTStats s = {0};
+    for (int64_t q = q0; q < q1; q++) {
+        const WLOp *op = &ops[q];
+        if (op->type == WL_GET && batch > 1) {
+            qkeys[m++] = op->key;
+            if (m < batch && q + 1 < q1) continue;
+        }
+        if (m > 0) {
+            LAT_START(c0);
+            bt_search_batch(bt, qkeys, (size_t)m, qout, &s);
+            LAT_STOP(lat, c0, m);
+            for (int64_t j = 0; j < m; j++) {
+                if (qout[j] == NULL)
+                    (*nf)++;
+            }
+            m = 0;
+            if (op->type == WL_GET) continue;
+        }
+        LAT_START(c0);
+        if (op->type == WL_RANGE) {
+            bt_range_search(bt, op->key, op->key + op->len - 1, count_key, &scanned, &s);
+        } else if (op->type == WL_PUT) {
+            bt_insert(bt, op->key, make_payload(op->key));
+        } else {
+            if (!bt_find(bt, op->key, NULL, &s))
+                (*nf)++;
+            if (op->type == WL_RMW)
+                bt_update(bt, op->key, make_payload(op->key));
+        }
+        LAT_STOP(lat, c0, 1);
+    }
+    *visits += s.node_visits;
+    return scanned;
+}
+
+typedef enum {
+    MODE_HCTREE = 0,
+    MODE_BASELINE = 1
+} RunMode;
+
+// Thread counts one --threads list may sweep over.
+#define MAX_SWEEP 64
+
+// Comma-separated positive integers ("1,2,4,8") into out[0, max). Returns
+// how many, or -1 on a malformed list.
+static int parse_int_list(const char *s, int *out, int max) {
+    int n = 0;
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || v < 1 || v > 4096 || n == max) return -1;
+        out[n++] = (int)v;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        s = end;
+    }
+    return n > 0 ? n : -1;
+}
+
+// Command-line settings of one experiment (see usage()).
+typedef struct {
+    int64_t  nkeys;
+    int64_t  nqueries;
+    const char *workload;
+    WLKind   wl_kind;        // parsed from workload
+    double   theta;
+    double   hot_thresh;
+    double   decay_alpha;
+    double   hot_frac;
+    unsigned seed;
+    RunMode  mode;
+    bool     csv;
+    bool     json;
+    bool     perf;
+    double   sample_init;
+    int      adapt_sample;
+    int64_t  batch;
+    int64_t  shift_every;
+    double   rmw_frac;
+    double   range_frac;
+    double   write_frac;
+    int64_t  range_len;
+    int64_t  warmup;         // ops run before the timed phase, over all threads
+    bool     pin;            // pin worker threads to CPUs
+    int      evict_policy;
+    int      freq_kind;
+    size_t   freq_budget;
+    int      bplus;
+    bool     packed;         // B+tree with packed leaves (implies bplus)
+    int      learned;        // learned leaf directory error bound (0 = off)
+    bool     exclusive;      // hctree mode: keys live in one tier only
+    size_t   write_buffer;   // hctree mode: HCParams.write_buffer
+    bool     random_build;   // build by inserting the keys in random order
+    bool     huge;           // hctree mode: hot tier in huge pages
+    bool     hot_replicas;   // hctree mode: a hot-tier copy per NUMA node
+    bool     cold_interleave;// cold / baseline tree interleaved over nodes
+    double   bulk_fill;
+    int      promote_mode;
+    int      nshards;
+    int      hot_kind;
+    unsigned filter_bits;
+    const char *save_cold;
+    const char *open_cold;
+    const char *snapshot;
+    const char *restore;
+    const char *adapt_trace;
+} BenchConfig;
+
+// --- Multi-threaded runs (--threads) ------------------------------------
+//
+// Each worker replays its own op stream (seeded per thread) against the
+// shared index: a warm-up prefix, then the timed part. Workers report in
+// at a start gate once warmed up; the main thread then records the
+// statistics baseline and starts the clock, and opens the gate.
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    int             ready;    // workers done with their warm-up
+    int             go;
+} StartGate;
+
 typedef struct {
-    double  *cdf; // size N
-    int64_t  N;
-    double   s;
-} ZipfGen;
-
-static ZipfGen* zipf_create(int64_t N, double s) {
-    ZipfGen *z = (ZipfGen*)malloc(sizeof(ZipfGen));
-    z->N = N;
-    z->s = s;
-    z->cdf = (double*)malloc(sizeof(double) * N);
-
-    double sum = 0.0;
-    for (int64_t k = 1; k <= N; k++) {
-        sum += 1.0 / pow((double)k, s);
+    HCBench    *hc;           // hctree mode; NULL in baseline mode
+    BTree      *bt;           // baseline mode
+    const WLOp *ops;
+    int64_t     nwarm;        // ops[0, nwarm) warm up, the next nops are timed
+    int64_t     nops;
+    int64_t     batch;
+    int         maintain;     // PROMOTE_QUEUE: drain the queue as it goes
+    int         cpu;          // CPU to pin to; -1 = none
+    StartGate  *gate;
+    BTKey      *qkeys;        // [batch]
+    BTPayload  *qout;
+    Hist       *lat;
+    double      t0, t1;       // this worker's timed phase
+    long        scanned;      // timed phase: keys returned by range ops,
+    long        visits;       // baseline node visits
+    long        nf;           // and baseline lookup misses
+    pthread_t   tid;
+} Worker;
+
+static void worker_run(Worker *w, int64_t q0, int64_t q1) {
+    if (w->hc)
+        w->scanned += run_hc_queries(w->hc, w->ops, q0, q1, w->batch, w->qkeys,
+                                     w->qout, w->maintain, w->lat);
+    else
+        w->scanned += run_bt_queries(w->bt, w->ops, q0, q1, w->batch, w->qkeys,
+                                     w->qout, w->lat, &w->visits, &w->nf);
+}
+
+// Warm up, then forget what the warm-up counted.
+static void worker_warm_up(Worker *w) {
+    worker_run(w, 0, w->nwarm);
+    w->scanned = w->visits = w->nf = 0;
+    hist_init(w->lat);
+}
+
+// The i-th CPU this process may run on (wrapping), or -1 if unknown.
+static int worker_cpu(int i) {
+#ifdef __linux__
+    cpu_set_t set;
+    if (sched_getaffinity(0, sizeof(set), &set) != 0) return -1;
+    int n = CPU_COUNT(&set);
+    if (n <= 0) return -1;
+    int want = i % n;
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &set) && want-- == 0) return c;
     }
+#else
+    (void)i;
+#endif
+    return -1;
+}
 
-    double cumsum = 0.0;
-    for (int64_t k = 1; k <= N; k++) {
-        cumsum += 1.0 / pow((double)k, s) / sum;
-        z->cdf[k-1] = cumsum;
+static void* worker_main(void *arg) {
+    Worker *w = (Worker*)arg;
+#ifdef __linux__
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
     }
-    return z;
+#endif
+    worker_warm_up(w);
+
+    StartGate *g = w->gate;
+    pthread_mutex_lock(&g->lock);
+    g->ready++;
+    pthread_cond_broadcast(&g->cond);
+    while (!g->go) pthread_cond_wait(&g->cond, &g->lock);
+    pthread_mutex_unlock(&g->lock);
+
+    w->t0 = now_seconds();
+    worker_run(w, w->nwarm, w->nwarm + w->nops);
+    w->t1 = now_seconds();
+    return NULL;
+}
+
+// Run workers[0, n) to completion. Once all have warmed up, *before gets
+// the statistics (hctree mode) and m starts; m stops when the last is done.
+static int run_workers(Worker *workers, int n, HCBench *b, HCStats *before,
+                       Measure *m) {
+    StartGate gate;
+    pthread_mutex_init(&gate.lock, NULL);
+    pthread_cond_init(&gate.cond, NULL);
+    gate.ready = 0;
+    gate.go = 0;
+    int started = 0;
+    for (; started < n; started++) {
+        workers[started].gate = &gate;
+        if (pthread_create(&workers[started].tid, NULL, worker_main, &workers[started]) != 0)
+            break;
+    }
+    pthread_mutex_lock(&gate.lock);
+    while (gate.ready < started) pthread_cond_wait(&gate.cond, &gate.lock);
+    if (b) *before = bench_stats(b);
+    measure_start(m);
+    gate.go = 1;
+    pthread_cond_broadcast(&gate.cond);
+    pthread_mutex_unlock(&gate.lock);
+    for (int i = 0; i < started; i++)
+        pthread_join(workers[i].tid, NULL);
+    measure_stop(m);
+    pthread_cond_destroy(&gate.cond);
+    pthread_mutex_destroy(&gate.lock);
+    return started == n ? 0 : -1;
+}
+
+// a - b, field by field, for the counters (cumulative fields) of HCStats.
+static HCStats stats_since(HCStats a, const HCStats *b) {
+#define STATS_SUB(f) a.f -= b->f;
+    HC_STATS_COUNTERS(STATS_SUB)
+#undef STATS_SUB
+    return a;
 }
 
-static void zipf_free(ZipfGen *z) {
-    if (!z) return;
-    free(z->cdf);
-    free(z);
+// n workers, each with its share of the warm-up and timed ops drawn from
+// spec under its own seed (worker 0 keeps spec's, so a one-thread run
+// replays the same ops as before). NULL on bad input or out of memory.
+static Worker* make_workers(const BenchConfig *cfg, const WLSpec *spec, int n) {
+    Worker *ws = (Worker*)calloc((size_t)n, sizeof(Worker));
+    if (!ws) return NULL;
+    for (int i = 0; i < n; i++) {
+        Worker *w = &ws[i];
+        WLSpec ts = *spec;
+        ts.seed  = spec->seed + (uint64_t)i * 0x9E3779B97F4A7C15ull;
+        w->nwarm = cfg->warmup * (i + 1) / n - cfg->warmup * i / n;
+        w->nops  = cfg->nqueries * (i + 1) / n - cfg->nqueries * i / n;
+        w->batch = cfg->batch;
+        w->maintain = cfg->promote_mode == PROMOTE_QUEUE;
+        w->cpu   = (cfg->pin && n > 1) ? worker_cpu(i) : -1;
+        w->ops   = wl_generate(&ts, w->nwarm + w->nops);
+        w->qkeys = (BTKey*)malloc(sizeof(BTKey) * (size_t)cfg->batch);
+        w->qout  = (BTPayload*)malloc(sizeof(BTPayload) * (size_t)cfg->batch);
+        w->lat   = (Hist*)malloc(sizeof(Hist));
+        if (!w->ops || !w->qkeys || !w->qout || !w->lat) {
+            for (int j = 0; j <= i; j++) {
+                free((void*)ws[j].ops); free(ws[j].qkeys); free(ws[j].qout); free(ws[j].lat);
+            }
+            free(ws);
+            return NULL;
+        }
+        hist_init(w->lat);
+    }
+    return ws;
 }
 
-static int64_t zipf_sample(ZipfGen *z) {
-    double u = (double)rand() / ((double)RAND_MAX + 1.0);
-    // binary search in cdf
-    int64_t lo = 0, hi = z->N - 1, mid;
-    while (lo < hi) {
-        mid = (lo + hi) / 2;
-        if (u <= z->cdf[mid]) hi = mid;
-        else lo = mid + 1;
+static void free_workers(Worker *ws, int n) {
+    for (int i = 0; i < n; i++) {
+        free((void*)ws[i].ops);
+        free(ws[i].qkeys);
+        free(ws[i].qout);
+        free(ws[i].lat);
     }
-    // lo is index in [0, N-1], representing rank (1-based)
-    return lo; // treat as key in [0, N-1]
+    free(ws);
 }
 
 // For timing
@@ -73,177 +493,416 @@ static double now_seconds(void) {
     return (double)tv.tv_sec + (double)tv.tv_usec / 1e6;
 }
 
+// --- Output ---------------------------------------------------------------
+//
+// --csv prints one row of these columns (--csv_header the names), --json
+// one object with the same keys. Metrics a run did not collect are empty
+// in CSV and null in JSON.
+static const char *const out_columns[] = {
+    "mode", "workload", "theta", "nkeys", "nqueries", "hot_threshold",
+    "decay_alpha", "hot_fraction", "seed",
+    "elapsed_sec", "qps", "hot_hits", "cold_hits", "not_found", "hot_keys",
+    "cold_keys", "avg_hot_nodes_per_q", "avg_cold_nodes_per_q", "build_sec",
+    "batch", "rmw_fraction", "range_fraction", "write_fraction", "threads",
+    "qps_thread_min", "qps_thread_max",
+    // hctree mode: tier layout and memory after the run
+    "tiering", "hot_bytes", "cold_bytes", "cold_height",
+    "write_buffer", "build_order", "leaf_format", "learned_eps",
+    "hot_pages", "hot_copies", "cold_placement",
+    "hot_kind", "evict", "freq", "filter_bits", "shards", "promote",
+    // HC_INSTRUMENT builds
+    "lat_p50_ns", "lat_p99_ns", "lat_p999_ns", "lat_max_ns",
+    "filter_cyc_per_q", "hot_cyc_per_q", "cold_cyc_per_q", "adapt_cyc_per_q",
+    "promote_cyc_per_q",
+    // --perf
+    "hw_cycles_per_q", "hw_instructions_per_q", "hw_llc_misses_per_q",
+    "hw_branch_misses_per_q"
+};
+#define NOUT (sizeof(out_columns) / sizeof(out_columns[0]))
+
+typedef struct {
+    char   val[NOUT][40];
+    size_t n;
+} OutRow;
+
+static void out_add(OutRow *r, const char *fmt, ...)
+    __attribute__((format(printf, 2, 3)));
+
+static void out_add(OutRow *r, const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(r->val[r->n++], sizeof(r->val[0]), fmt, ap);
+    va_end(ap);
+}
+
+static void out_skip(OutRow *r) {
+    r->val[r->n++][0] = '\0';
+}
+
+static void out_csv_header(void) {
+    for (size_t i = 0; i < NOUT; i++)
+        printf("%s%s", i ? "," : "", out_columns[i]);
+    printf("\n");
+}
+
+static void out_csv(const OutRow *r) {
+    for (size_t i = 0; i < r->n; i++)
+        printf("%s%s", i ? "," : "", r->val[i]);
+    printf("\n");
+}
+
+static void out_json(const OutRow *r) {
+    printf("{");
+    for (size_t i = 0; i < r->n; i++) {
+        const char *v = r->val[i];
+        char *end;
+        printf("%s\"%s\": ", i ? ", " : "", out_columns[i]);
+        if (!*v) {
+            printf("null");
+        } else {
+            strtod(v, &end);
+            printf(*end ? "\"%s\"" : "%s", v);
+        }
+    }
+    printf("}\n");
+}
+
 static void usage(const char *prog) {
     fprintf(stderr,
         "Usage: %s [options]\n"
         "Options:\n"
         "  --nkeys N         number of distinct keys (default 100000)\n"
         "  --nqueries Q      number of point queries (default 500000)\n"
-        "  --workload TYPE   'uniform' or 'zipf' (default zipf)\n"
+        "  --workload TYPE   key popularity: 'uniform', 'zipf' (default), 'scrambled' (zipf\n"
+        "                    ranks hashed over the key space), 'latest' (zipf from the\n"
+        "                    highest key down) or 'shift' (moving zipf hot spot)\n"
+        "  --shift_every Q   'shift': move the zipf hot spot every Q queries (default nqueries/4)\n"
         "  --theta S         zipf exponent (default 1.1)\n"
+        "  --rmw F           fraction F of ops that are read-modify-writes: a lookup, then\n"
+        "                    hc_update / bt_update (default 0)\n"
+        "  --range F         fraction F of ops that are range scans (default 0)\n"
+        "  --range_len L     range scans cover 1..L keys, uniformly (default 100)\n"
+        "  --write F         fraction F of ops that are blind writes (hc_insert / bt_insert)\n"
+        "  --threads N[,N..] run the queries on N threads, each with its own op stream; a\n"
+        "                    list runs one experiment per count (a scaling sweep; default 1)\n"
+        "  --warmup Q        ops run (split over the threads) before timing starts (default 0)\n"
+        "  --no_pin          do not pin query threads to CPUs\n"
         "  --hot_thresh H    hot threshold (default 8.0)\n"
         "  --decay A         decay alpha (default 0.9)\n"
         "  --hot_frac F      max hot fraction (default 0.05)\n"
+        "  --freq KIND       hit-score tracker: 'dense' (default), 'cms' or 'table'\n"
+        "  --freq_bytes B    memory budget for 'cms' / 'table' (default 1 MiB)\n"
+        "  --evict POLICY    hot-tier eviction when full: 'none' (default), 'clock' or 'sampled'\n"
+        "  --hot KIND        hot-tier structure: 'btree' (default) or 'hash'\n"
+        "  --filter BITS     Bloom filter of BITS bits per key in front of both tiers (default 0 = off)\n"
         "  --seed SEED       RNG seed (default 42)\n"
+        "  --bplus           use a linked-leaf B+tree for the cold / baseline tree\n"
+        "  --packed          as --bplus, with frame-of-reference compressed leaves\n"
+        "  --learned EPS     learned leaf directory with error bound EPS on the cold /\n"
+        "                    baseline B+tree, in place of its descent (implies --bplus)\n"
+        "  --exclusive       hctree mode: promotion moves keys out of the cold tier and\n"
+        "                    eviction moves them back (default: hot keys are copies)\n"
+        "  --write_buffer N  hctree mode: stage up to N inserts of non-hot keys and apply\n"
+        "                    them to the cold tier as one sorted batch (default 0 = off)\n"
+        "  --random_build    build by inserting the keys in a random order, like a burst\n"
+        "                    of random ingest (default: ascending)\n"
+        "  --huge            hctree mode: hot tier and hit scores in 2 MiB huge pages\n"
+        "                    (hugetlb pool, else transparent huge pages)\n"
+        "  --hot_replicas    hctree mode: one hot-tier copy per NUMA node, lookups read\n"
+        "                    their own node's copy (HC_NUMA_NODES=N fakes N nodes)\n"
+        "  --cold_interleave interleave the cold / baseline tree's pages over all nodes\n"
+        "  --bulk_fill F     build the tree with the bottom-up bulk loader at node fill F in (0,1]\n"
+        "                    (default 0 = one insert per key)\n"
+        "  --promote MODE    'inline' (default), 'queue' (async, drained every 1024 queries)\n"
+        "                    or 'thread' (async, drained by a background thread)\n"
+        "  --save_cold PATH  after building, write the cold / baseline tree to PATH\n"
+        "  --open_cold PATH  map a tree saved with --save_cold instead of building one\n"
+        "                    (read-only, shared through the page cache)\n"
+        "  --snapshot PATH   hctree mode: after the run, save hot keys, hit scores and D to PATH\n"
+        "  --restore PATH    hctree mode: warm-start from a --snapshot file before the run\n"
+        "  --shards N        hctree mode: split the key range over N HCIndex shards with\n"
+        "                    load-proportional hot budgets (default 1)\n"
+        "  --batch N         issue lookups in batches of N via *_search_batch (default 1 = one at a time)\n"
         "  --mode MODE       'hctree' (default) or 'baseline'\n"
         "  --disable_hot     alias for --mode baseline\n"
         "  --sample_init D    initial sampling rate D in (0,1] (default 1.0)\n"
-        "  --adapt_sample     enable adaptive (ML-style) tuning of D\n"
+        "  --adapt MODE       online tuning: 'none' (default), 'visits' (regress node\n"
+        "                     visits on D) or 'cost' (hill-climb D, hot threshold and\n"
+        "                     hot budget on measured cycles per query)\n"
+        "  --adapt_sample     alias for --adapt visits\n"
+        "  --adapt_trace PATH hctree mode, --adapt cost: write the tuning trace as CSV\n"
         "  --csv             output one line of CSV instead of human-readable text\n"
-        "  --csv_header      print CSV header and exit\n",
+        "  --csv_header      print CSV header and exit\n"
+        "  --json            output one JSON object (same fields as --csv)\n"
+        "  --perf            also count cycles, instructions, LLC and branch misses\n"
+        "                    through perf_event_open (Linux)\n"
+        "Instrumented build (make INSTRUMENT=1): per-lookup latency percentiles and\n"
+        "per-phase cycle counts are added to the output.\n"
+        "Environment:\n"
+        "  HC_KEYSEARCH=K    force node key search kernel: scalar|avx2|avx512|neon\n",
         prog);
 }
 
-typedef enum {
-    MODE_HCTREE = 0,
-    MODE_BASELINE = 1
-} RunMode;
-
-int main(int argc, char **argv) {
-    int64_t nkeys = 100000;
-    int64_t nqueries = 500000;
-    const char *workload = "zipf";
-    double theta = 1.1;
-    double hot_thresh = 8.0;
-    double decay_alpha = 0.9;
-    double hot_frac = 0.05;
-    unsigned int seed = 42;
-    RunMode mode = MODE_HCTREE;
-    bool csv = false;
-    bool csv_header = false;
-    double sample_init   = 1.0;
-    int    adapt_sample  = 0;
-
-    for (int i = 1; i < argc; i++) {
-        if (!strcmp(argv[i], "--nkeys") && i+1 < argc) {
-            nkeys = atoll(argv[++i]);
-        } else if (!strcmp(argv[i], "--nqueries") && i+1 < argc) {
-            nqueries = atoll(argv[++i]);
-        } else if (!strcmp(argv[i], "--workload") && i+1 < argc) {
-            workload = argv[++i];
-        } else if (!strcmp(argv[i], "--theta") && i+1 < argc) {
-            theta = atof(argv[++i]);
-        } else if (!strcmp(argv[i], "--hot_thresh") && i+1 < argc) {
-            hot_thresh = atof(argv[++i]);
-        } else if (!strcmp(argv[i], "--decay") && i+1 < argc) {
-            decay_alpha = atof(argv[++i]);
-        } else if (!strcmp(argv[i], "--hot_frac") && i+1 < argc) {
-            hot_frac = atof(argv[++i]);
-        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
-            seed = (unsigned int)atoi(argv[++i]);
-        } else if (!strcmp(argv[i], "--mode") && i+1 < argc) {
-            const char *m = argv[++i];
-            if (!strcmp(m, "hctree")) mode = MODE_HCTREE;
-            else if (!strcmp(m, "baseline")) mode = MODE_BASELINE;
-            else {
-                fprintf(stderr, "Unknown mode '%s'\n", m);
-                usage(argv[0]);
-                return 1;
-            }
-
-        // 🔽 NEW OPTIONS START HERE
-        } else if (!strcmp(argv[i], "--sample_init") && i+1 < argc) {
-            // Initial sampling rate D (0–1)
-            sample_init = atof(argv[++i]);
-        } else if (!strcmp(argv[i], "--adapt_sample")) {
-            // Turn on ML-style adaptation of D
-            adapt_sample = 1;
-        // 🔼 NEW OPTIONS END HERE
+// Learned-directory summary line of the human-readable report.
+static void print_learned(const BTLearnedStats *ls) {
+    printf("Learned dir:      %zu segments over %zu leaves, %zu stale, %" PRIu64 " builds\n",
+           ls->segments, ls->leaves, ls->stale, ls->builds);
+}
 
-        } else if (!strcmp(argv[i], "--disable_hot")) {
-            mode = MODE_BASELINE;
-        } else if (!strcmp(argv[i], "--csv")) {
-            csv = true;
-        } else if (!strcmp(argv[i], "--csv_header")) {
-            csv_header = true;
-        } else {
-            usage(argv[0]);
-            return 1;
-        }
-    }
-
-    if (csv_header) {
-        // Print header and exit; no experiment.
-        printf("mode,workload,theta,nkeys,nqueries,hot_threshold,decay_alpha,hot_fraction,seed,"
-               "elapsed_sec,qps,hot_hits,cold_hits,not_found,hot_keys,cold_keys,"
-               "avg_hot_nodes_per_q,avg_cold_nodes_per_q\n");
-        return 0;
+// Build order for --random_build: keys 0..nkeys-1 shuffled under the run's
+// seed, or NULL for the ascending build.
+static BTKey* build_order(const BenchConfig *cfg) {
+    if (!cfg->random_build || cfg->nkeys <= 0) return NULL;
+    BTKey *order = (BTKey*)malloc(sizeof(BTKey) * (size_t)cfg->nkeys);
+    for (int64_t i = 0; i < cfg->nkeys; i++) order[i] = i;
+    Rng r;
+    rng_seed(&r, (uint64_t)cfg->seed ^ 0xB0D1DEull);
+    for (int64_t i = cfg->nkeys - 1; i > 0; i--) {
+        int64_t j = (int64_t)rng_below(&r, (uint64_t)i + 1);
+        BTKey t = order[i]; order[i] = order[j]; order[j] = t;
     }
+    return order;
+}
 
-    srand(seed);
+// One experiment with nthreads query threads. More than one makes the
+// index concurrent (HCParams.concurrent / bt_set_concurrent).
+static int run_bench(const BenchConfig *cfg, int nthreads) {
+    bool human = !cfg->csv && !cfg->json;   // human-readable report
 
     int btree_degree = 32; // B-tree min degree (t)
 
-    double t0, t1, elapsed, qps;
+    double t0, elapsed, qps;
+    double build_sec = 0.0;
 
     long hot_hits = 0;
     long cold_hits = 0;
     long not_found = 0;
     size_t hot_keys = 0;
     size_t cold_keys = 0;
+    size_t hot_bytes = 0;
+    size_t cold_bytes = 0;
+    int    cold_height = 0;
+    int    hot_copies = 1;
     double avg_hot_nodes_q = 0.0;
     double avg_cold_nodes_q = 0.0;
+    HCStats phase;                // per-phase cycles (hctree mode)
+    memset(&phase, 0, sizeof(phase));
 
-    ZipfGen *zg = NULL;
-    if (!strcmp(workload, "zipf")) {
-        zg = zipf_create(nkeys, theta);
+    Hist *lat = (Hist*)malloc(sizeof(Hist));
+    hist_init(lat);
+    Measure meas;
+    memset(&meas, 0, sizeof(meas));
+    if (cfg->perf && (meas.npc = pc_open(&meas.pc)) == 0)
+        fprintf(stderr, "--perf: hardware counters are not available here\n");
+
+    // The whole op stream is drawn before the timed phase, so it measures
+    // the index alone and every mode replays the same ops.
+    WLSpec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.kind           = cfg->wl_kind;
+    spec.nkeys          = cfg->nkeys;
+    spec.theta          = cfg->theta;
+    spec.shift_every    = (cfg->shift_every > 0) ? cfg->shift_every : (cfg->nqueries / 4 > 0 ? cfg->nqueries / 4 : 1);
+    spec.rmw_fraction   = cfg->rmw_frac;
+    spec.range_fraction = cfg->range_frac;
+    spec.put_fraction   = cfg->write_frac;
+    spec.range_len      = (uint32_t)cfg->range_len;
+    spec.seed           = cfg->seed;
+    Worker *workers = make_workers(cfg, &spec, nthreads);
+    if (!workers) {
+        fprintf(stderr, "Bad workload: need nkeys > 0, theta > 0 and"
+                        " --rmw + --range + --write <= 1\n");
+        return 1;
     }
+    long scanned = 0;   // keys returned by range ops
 
-    if (mode == MODE_HCTREE) {
+    if (cfg->mode == MODE_HCTREE) {
         // --- Hot/Cold index mode ---
         HCParams params;
-        params.decay_alpha      = decay_alpha;
-        params.hot_threshold    = hot_thresh;
-        params.max_hot_fraction = hot_frac;
-        params.inclusive        = 1;
-        params.sampling_rate    = sample_init;   // NEW
-        params.adapt_sampling   = adapt_sample;  // NEW
-
-        if (!csv) {
+        params.decay_alpha      = cfg->decay_alpha;
+        params.hot_threshold    = cfg->hot_thresh;
+        params.max_hot_fraction = cfg->hot_frac;
+        params.inclusive        = !cfg->exclusive;
+        params.sampling_rate    = cfg->sample_init;   // NEW
+        params.adapt_sampling   = cfg->adapt_sample;  // NEW
+        params.evict_policy     = cfg->evict_policy;
+        params.freq_kind        = cfg->freq_kind;
+        params.freq_bytes       = cfg->freq_budget;
+        params.cold_bplus       = cfg->bplus;
+        params.cold_packed      = cfg->packed;
+        params.cold_learned     = cfg->learned;
+        params.concurrent       = (cfg->promote_mode == PROMOTE_THREAD || nthreads > 1);
+        params.async_promote    = (cfg->promote_mode != PROMOTE_INLINE);
+        params.promote_queue    = 0;
+        params.hot_kind         = cfg->hot_kind;
+        params.filter_bits      = cfg->filter_bits;
+        params.write_buffer     = cfg->write_buffer;
+        params.hot_pages        = cfg->huge ? NM_PAGES_HUGE : NM_PAGES_DEFAULT;
+        params.hot_replicas     = cfg->hot_replicas;
+        params.cold_interleave  = cfg->cold_interleave;
+
+        if (human) {
             printf("Mode:       HCIndex (hot/cold)\n");
-            printf("Workload:   %s\n", workload);
-            if (!strcmp(workload, "zipf"))
-                printf("Theta:      %.3f\n", theta);
-            printf("nkeys:      %" PRId64 "\n", nkeys);
-            printf("nqueries:   %" PRId64 "\n", nqueries);
-            printf("HotThresh:  %.3f\n", hot_thresh);
-            printf("Decay alpha:%.3f\n", decay_alpha);
-            printf("Hot frac:   %.3f\n", hot_frac);
+            printf("Key search: %s\n", ks_kernel_name());
+            if (cfg->packed)
+                printf("Leaves:     packed (%s)\n", lp_kernel_name());
+            if (cfg->hot_kind == HC_HOT_HASH)
+                printf("Hot tier:   hash (%s)\n", hh_kernel_name());
+            printf("Workload:   %s\n", cfg->workload);
+            if (spec.kind != WL_UNIFORM)
+                printf("Theta:      %.3f\n", cfg->theta);
+            if (cfg->rmw_frac > 0.0 || cfg->range_frac > 0.0 || cfg->write_frac > 0.0)
+                printf("Op mix:     %.3f rmw, %.3f write, %.3f range (1..%" PRId64 " keys)\n",
+                       cfg->rmw_frac, cfg->write_frac, cfg->range_frac, cfg->range_len);
+            if (nthreads > 1)
+                printf("Threads:    %d%s\n", nthreads, cfg->pin ? " (pinned)" : "");
+            printf("nkeys:      %" PRId64 "\n", cfg->nkeys);
+            printf("nqueries:   %" PRId64 "\n", cfg->nqueries);
+            printf("HotThresh:  %.3f\n", cfg->hot_thresh);
+            printf("Decay alpha:%.3f\n", cfg->decay_alpha);
+            printf("Hot frac:   %.3f\n", cfg->hot_frac);
+            printf("Tiering:    %s\n", cfg->exclusive ? "exclusive" : "inclusive");
+            if (cfg->huge || cfg->hot_replicas || cfg->cold_interleave)
+                printf("NUMA nodes: %d\n", nm_nodes());
+        }
+
+        if (cfg->nshards > 1 && (cfg->save_cold || cfg->open_cold || cfg->snapshot || cfg->restore || cfg->adapt_trace)) {
+            fprintf(stderr, "--save_cold, --open_cold, --snapshot, --restore and --adapt_trace"
+                            " need a single shard\n");
+            return 1;
+        }
+        FILE *trace = NULL;
+        if (cfg->adapt_trace && !(trace = fopen(cfg->adapt_trace, "w"))) {
+            fprintf(stderr, "Could not write trace file '%s'\n", cfg->adapt_trace);
+            return 1;
         }
 
-        HCIndex *idx = hc_create(nkeys - 1, btree_degree, params);
+        HCBench bench = { NULL, NULL };
+        t0 = now_seconds();
+        if (cfg->open_cold) {
+            BTree *cold = bt_open_mmap(cfg->open_cold);
+            if (!cold) {
+                fprintf(stderr, "Could not open tree file '%s'\n", cfg->open_cold);
+                return 1;
+            }
+            bench.one = hc_create_on(cold, 0, cfg->nkeys - 1, btree_degree, params);
+        } else if (cfg->nshards > 1) {
+            bench.many = hcs_create(0, cfg->nkeys - 1, cfg->nshards, btree_degree, params);
+        } else {
+            bench.one = hc_create(cfg->nkeys - 1, btree_degree, params);
+        }
 
         // Build cold index
-        for (int64_t k = 0; k < nkeys; k++) {
-            hc_insert(idx, k, make_payload(k));
+        if (cfg->open_cold) {
+            // Mapped: pages are faulted in by the lookups themselves.
+        } else if (cfg->bulk_fill > 0.0) {
+            BTKey *bk; BTPayload *bv;
+            make_sorted_input(cfg->nkeys, &bk, &bv);
+            if (bench.many) hcs_bulk_load(bench.many, bk, bv, (size_t)cfg->nkeys, cfg->bulk_fill);
+            else            hc_bulk_load(bench.one, bk, bv, (size_t)cfg->nkeys, cfg->bulk_fill);
+            free(bk); free(bv);
+        } else {
+            BTKey *order = build_order(cfg);
+            for (int64_t i = 0; i < cfg->nkeys; i++) {
+                BTKey k = order ? order[i] : i;
+                bench_insert(&bench, k, make_payload(k));
+            }
+            bench_flush(&bench);
+            free(order);
+        }
+        build_sec = now_seconds() - t0;
+        if (cfg->save_cold && bt_save(bench.one->cold, cfg->save_cold) != 0) {
+            fprintf(stderr, "Could not write tree file '%s'\n", cfg->save_cold);
+            return 1;
+        }
+        if (cfg->restore && hc_restore(bench.one, cfg->restore) != 0) {
+            fprintf(stderr, "Could not restore snapshot '%s'\n", cfg->restore);
+            return 1;
         }
+        if (trace) hc_set_adapt_trace(bench.one, trace);
 
-        t0 = now_seconds();
-        for (int64_t q = 0; q < nqueries; q++) {
-            int64_t k;
-            if (!strcmp(workload, "zipf")) {
-                k = zipf_sample(zg);
-            } else {
-                k = rand_uniform(nkeys);
+        // For the shifting hot spot, also record the hot-hit rate per
+        // window so hit-rate recovery after each shift is visible.
+        enum { NWINDOWS = 16 };
+        int nwin = (spec.kind == WL_SHIFT && human && nthreads == 1) ? NWINDOWS : 1;
+        double win_hot_rate[NWINDOWS];
+        long prev_hot = 0, prev_q = 0;
+
+        if (cfg->promote_mode == PROMOTE_THREAD) {
+            for (int i = 0; i < bench_nparts(&bench); i++) {
+                if (hc_start_maintenance(bench_part(&bench, i), 100) != 0) {
+                    fprintf(stderr, "Could not start the maintenance thread\n");
+                    return 1;
+                }
+            }
+        }
+
+        for (int i = 0; i < nthreads; i++)
+            workers[i].hc = &bench;
+        HCStats before;
+        if (nthreads > 1) {
+            if (run_workers(workers, nthreads, &bench, &before, &meas) != 0) {
+                fprintf(stderr, "Could not start the query threads\n");
+                return 1;
+            }
+        } else {
+            // On this thread, so the shift windows can be sampled between
+            // runs.
+            Worker *w0 = &workers[0];
+            worker_warm_up(w0);
+            before = bench_stats(&bench);
+            prev_hot = before.hot_hits;
+            prev_q = before.queries;
+            measure_start(&meas);
+            for (int w = 0; w < nwin; w++) {
+                worker_run(w0, w0->nwarm + w0->nops * w / nwin,
+                           w0->nwarm + w0->nops * (w + 1) / nwin);
+                if (nwin > 1) {
+                    HCStats ws = bench_stats(&bench);
+                    long dq = ws.queries - prev_q;
+                    win_hot_rate[w] = dq ? (double)(ws.hot_hits - prev_hot) / (double)dq : 0.0;
+                    prev_hot = ws.hot_hits;
+                    prev_q = ws.queries;
+                }
             }
-            (void)hc_search(idx, k);
+            measure_stop(&meas);
+            w0->t0 = meas.t0;
+            w0->t1 = meas.t1;
         }
-        t1 = now_seconds();
+        for (int i = 0; i < bench_nparts(&bench); i++)
+            hc_stop_maintenance(bench_part(&bench, i));
 
-        HCStats s = hc_get_stats(idx);
-        elapsed = t1 - t0;
-        qps = (elapsed > 0.0) ? (double)nqueries / elapsed : 0.0;
+        if (cfg->snapshot && hc_snapshot(bench.one, cfg->snapshot) != 0) {
+            fprintf(stderr, "Could not write snapshot '%s'\n", cfg->snapshot);
+            return 1;
+        }
+
+        HCStats s = stats_since(bench_stats(&bench), &before);
+        size_t tracker_bytes = 0;
+        for (int i = 0; i < bench_nparts(&bench); i++)
+            tracker_bytes += freq_bytes(bench_part(&bench, i)->freq);
+        elapsed = meas.t1 - meas.t0;
+        phase = s;
+        qps = (elapsed > 0.0) ? (double)cfg->nqueries / elapsed : 0.0;
 
         hot_hits = s.hot_hits;
         cold_hits = s.cold_hits;
         not_found = s.not_found;
         hot_keys = s.hot_keys;
         cold_keys = s.cold_keys;
+        hot_bytes = s.hot_bytes;
+        cold_bytes = s.cold_bytes;
+        for (int i = 0; i < bench_nparts(&bench); i++) {
+            int h = bt_height(bench_part(&bench, i)->cold);
+            if (h > cold_height) cold_height = h;
+        }
+        hot_copies = bench_part(&bench, 0)->hot_copies;
         avg_hot_nodes_q  = s.queries ? (double)s.hot_node_visits  / (double)s.queries : 0.0;
         avg_cold_nodes_q = s.queries ? (double)s.cold_node_visits / (double)s.queries : 0.0;
 
-        if (!csv) {
+        if (human) {
             printf("\n=== Results (HCIndex) ===\n");
+            printf("Build (sec):      %.6f\n", build_sec);
             printf("Elapsed (sec):    %.6f\n", elapsed);
             printf("Throughput (Q/s): %.2f\n", qps);
             printf("Hot hits:         %ld\n", hot_hits);
@@ -251,99 +910,547 @@ int main(int argc, char **argv) {
             printf("Not found:        %ld\n", not_found);
             printf("Hot keys:         %zu\n", hot_keys);
             printf("Cold keys:        %zu\n", cold_keys);
+            printf("Hot / cold bytes: %zu / %zu\n", hot_bytes, cold_bytes);
+            printf("Cold height:      %d\n", cold_height);
+            if (hot_copies > 1)
+                printf("Hot copies:       %d (one per node)\n", hot_copies);
+            if (cfg->huge) {
+                size_t asked, got;
+                nm_huge_stats(&asked, &got);
+                printf("Huge pages:       %zu of %zu MiB from the hugetlb pool\n",
+                       got >> 20, asked >> 20);
+            }
+            if (cfg->learned) {
+                BTLearnedStats sum = {0}, ls;
+                for (int i = 0; i < bench_nparts(&bench); i++) {
+                    bt_learned_stats(bench_part(&bench, i)->cold, &ls);
+                    sum.leaves += ls.leaves;
+                    sum.segments += ls.segments;
+                    sum.stale += ls.stale;
+                    sum.builds += ls.builds;
+                }
+                print_learned(&sum);
+            }
             printf("Avg hot nodes/q:  %.3f\n", avg_hot_nodes_q);
             printf("Avg cold nodes/q: %.3f\n", avg_cold_nodes_q);
-
+            printf("Promotions:       %ld\n", s.promotions);
+            printf("Evictions:        %ld\n", s.evictions);
+            if (cfg->promote_mode != PROMOTE_INLINE)
+                printf("Promote drops:    %ld\n", s.promote_drops);
+            if (cfg->rmw_frac > 0.0 || cfg->write_frac > 0.0)
+                printf("Write-backs:      %ld\n", s.writebacks);
+            if (cfg->write_buffer > 0)
+                printf("Buffer flushes:   %ld (%zu keys staged)\n", s.flushes, s.buffered_keys);
+            printf("Freq tracker:     %zu bytes\n", tracker_bytes);
+            if (cfg->filter_bits > 0) {
+                printf("Filter negatives: %ld\n", s.filter_negatives);
+                printf("Filter false pos: %ld\n", s.filter_false_pos);
+            }
+            if (cfg->adapt_sample != HC_ADAPT_NONE) {
+                HCIndex *p0 = bench_part(&bench, 0);
+                printf("Tuned D:          %.4f\n", p0->params.sampling_rate);
+                if (cfg->adapt_sample == HC_ADAPT_COST) {
+                    printf("Tuned threshold:  %.3f\n", p0->params.hot_threshold);
+                    printf("Tuned hot cap:    %zu\n", p0->hot_capacity);
+                }
+            }
+            if (bench.many) {
+                printf("Shard hot budgets:");
+                for (int i = 0; i < bench.many->nshards; i++)
+                    printf(" %zu", bench.many->shards[i]->hot_capacity);
+                printf("\n");
+            }
+            if (nwin > 1) {
+                printf("\nHot-hit rate per window (hot spot moves every %" PRId64 " queries):\n",
+                       spec.shift_every);
+                for (int w = 0; w < nwin; w++)
+                    printf("  window %2d: %.3f\n", w, win_hot_rate[w]);
+            }
         }
 
-        hc_free(idx);
+        if (bench.many) hcs_free(bench.many);
+        else            hc_free(bench.one);
+        if (trace) fclose(trace);
     } else {
         // --- Baseline mode: single B-tree only ---
-        if (!csv) {
+        if (human) {
             printf("Mode:       Baseline (single B-tree)\n");
-            printf("Workload:   %s\n", workload);
-            if (!strcmp(workload, "zipf"))
-                printf("Theta:      %.3f\n", theta);
-            printf("nkeys:      %" PRId64 "\n", nkeys);
-            printf("nqueries:   %" PRId64 "\n", nqueries);
+            printf("Key search: %s\n", ks_kernel_name());
+            if (cfg->packed)
+                printf("Leaves:     packed (%s)\n", lp_kernel_name());
+            printf("Workload:   %s\n", cfg->workload);
+            if (spec.kind != WL_UNIFORM)
+                printf("Theta:      %.3f\n", cfg->theta);
+            if (cfg->rmw_frac > 0.0 || cfg->range_frac > 0.0 || cfg->write_frac > 0.0)
+                printf("Op mix:     %.3f rmw, %.3f write, %.3f range (1..%" PRId64 " keys)\n",
+                       cfg->rmw_frac, cfg->write_frac, cfg->range_frac, cfg->range_len);
+            if (nthreads > 1)
+                printf("Threads:    %d%s\n", nthreads, cfg->pin ? " (pinned)" : "");
+            printf("nkeys:      %" PRId64 "\n", cfg->nkeys);
+            printf("nqueries:   %" PRId64 "\n", cfg->nqueries);
         }
 
-        BTree *bt = bt_create(btree_degree);
+        t0 = now_seconds();
+        BTree *bt = cfg->open_cold ? bt_open_mmap(cfg->open_cold)
+                  : cfg->packed    ? bt_create_packed(btree_degree)
+                  : cfg->bplus     ? bt_create_bplus(btree_degree)
+                              : bt_create(btree_degree);
+        if (!bt) {
+            fprintf(stderr, "Could not open tree file '%s'\n", cfg->open_cold);
+            return 1;
+        }
+        if (cfg->learned) bt_set_learned(bt, cfg->learned);
+        if (cfg->cold_interleave)
+            bt_set_placement(bt, (NMPolicy){ NM_PAGES_DEFAULT, NM_INTERLEAVE });
 
         // Build baseline index
-        for (int64_t k = 0; k < nkeys; k++) {
-            bt_insert(bt, k, make_payload(k));
+        if (cfg->open_cold) {
+            // Mapped: pages are faulted in by the lookups themselves.
+        } else if (cfg->bulk_fill > 0.0) {
+            BTKey *bk; BTPayload *bv;
+            make_sorted_input(cfg->nkeys, &bk, &bv);
+            bt_bulk_load(bt, bk, bv, (size_t)cfg->nkeys, cfg->bulk_fill);
+            free(bk); free(bv);
+        } else {
+            BTKey *order = build_order(cfg);
+            for (int64_t i = 0; i < cfg->nkeys; i++) {
+                BTKey k = order ? order[i] : i;
+                bt_insert(bt, k, make_payload(k));
+            }
+            free(order);
+        }
+        build_sec = now_seconds() - t0;
+        if (cfg->save_cold && bt_save(bt, cfg->save_cold) != 0) {
+            fprintf(stderr, "Could not write tree file '%s'\n", cfg->save_cold);
+            return 1;
         }
 
         long total_node_visits = 0;
         long nf = 0;
+        long npoint = 0;            // timed ops that looked up a key
+        for (int i = 0; i < nthreads; i++) {
+            Worker *w = &workers[i];
+            w->bt = bt;
+            for (int64_t q = w->nwarm; q < w->nwarm + w->nops; q++)
+                npoint += w->ops[q].type == WL_GET || w->ops[q].type == WL_RMW;
+        }
 
-        t0 = now_seconds();
-        for (int64_t q = 0; q < nqueries; q++) {
-            int64_t k;
-            if (!strcmp(workload, "zipf")) {
-                k = zipf_sample(zg);
-            } else {
-                k = rand_uniform(nkeys);
+        if (nthreads > 1) {
+            bt_set_concurrent(bt);
+            if (run_workers(workers, nthreads, NULL, NULL, &meas) != 0) {
+                fprintf(stderr, "Could not start the query threads\n");
+                return 1;
             }
-            BTStats s = {0};
-            void *v = bt_search(bt, k, &s);
-            total_node_visits += s.node_visits;
-            if (v == NULL)
-                nf++;
+        } else {
+            worker_warm_up(&workers[0]);
+            measure_start(&meas);
+            worker_run(&workers[0], workers[0].nwarm, workers[0].nwarm + workers[0].nops);
+            measure_stop(&meas);
+            workers[0].t0 = meas.t0;
+            workers[0].t1 = meas.t1;
+        }
+        for (int i = 0; i < nthreads; i++) {
+            total_node_visits += workers[i].visits;
+            nf += workers[i].nf;
         }
-        t1 = now_seconds();
 
-        elapsed = t1 - t0;
-        qps = (elapsed > 0.0) ? (double)nqueries / elapsed : 0.0;
+        elapsed = meas.t1 - meas.t0;
+        qps = (elapsed > 0.0) ? (double)cfg->nqueries / elapsed : 0.0;
 
         not_found = nf;
-        cold_hits = nqueries - nf;  // everything goes to "cold" conceptually
+        cold_hits = npoint - nf;    // everything goes to "cold" conceptually
         hot_hits = 0;
         hot_keys = 0;
         cold_keys = bt_count_keys(bt);
         avg_hot_nodes_q = 0.0;
-        avg_cold_nodes_q = nqueries ? (double)total_node_visits / (double)nqueries : 0.0;
+        avg_cold_nodes_q = cfg->nqueries ? (double)total_node_visits / (double)cfg->nqueries : 0.0;
 
-        if (!csv) {
+        if (human) {
             printf("\n=== Results (Baseline) ===\n");
+            printf("Build (sec):      %.6f\n", build_sec);
             printf("Elapsed (sec):    %.6f\n", elapsed);
             printf("Throughput (Q/s): %.2f\n", qps);
             printf("Cold hits:        %ld\n", cold_hits);
             printf("Not found:        %ld\n", not_found);
             printf("Cold keys:        %zu\n", cold_keys);
             printf("Avg nodes/q:      %.3f\n", avg_cold_nodes_q);
+            if (cfg->learned) {
+                BTLearnedStats ls;
+                bt_learned_stats(bt, &ls);
+                print_learned(&ls);
+            }
         }
 
         bt_free(bt);
     }
 
-    if (zg) zipf_free(zg);
-
-    if (csv) {
-        // Single CSV line. Note: we still print hot_* fields for baseline (they'll be 0).
-        const char *mode_str = (mode == MODE_HCTREE) ? "hctree" : "baseline";
-        printf("%s,%s,%.5f,%" PRId64 ",%" PRId64 ",%.5f,%.5f,%.5f,%u,"
-               "%.6f,%.2f,%ld,%ld,%ld,%zu,%zu,%.6f,%.6f\n",
-               mode_str,
-               workload,
-               theta,
-               nkeys,
-               nqueries,
-               hot_thresh,
-               decay_alpha,
-               hot_frac,
-               seed,
-               elapsed,
-               qps,
-               hot_hits,
-               cold_hits,
-               not_found,
-               hot_keys,
-               cold_keys,
-               avg_hot_nodes_q,
-               avg_cold_nodes_q);
+    // Per-thread throughput and the merged latency histogram.
+    double qps_min = 0.0, qps_max = 0.0;
+    for (int i = 0; i < nthreads; i++) {
+        Worker *w = &workers[i];
+        double dt = w->t1 - w->t0;
+        double tq = dt > 0.0 ? (double)w->nops / dt : 0.0;
+        if (i == 0 || tq < qps_min) qps_min = tq;
+        if (i == 0 || tq > qps_max) qps_max = tq;
+        if (human && nthreads > 1)
+            printf("Thread %2d (cpu %3d): %.2f Q/s\n", i, w->cpu, tq);
+        scanned += w->scanned;
+        hist_merge(lat, w->lat);
+    }
+    free_workers(workers, nthreads);
+
+    // Instrumentation: latency in ns, phase and hardware counts per query.
+    double tpn = measure_ticks_per_ns(&meas);
+    double lat_ns[4] = {
+        (double)hist_quantile(lat, 0.50), (double)hist_quantile(lat, 0.99),
+        (double)hist_quantile(lat, 0.999), (double)lat->max
+    };
+    for (int i = 0; i < 4; i++) lat_ns[i] = tpn > 0.0 ? lat_ns[i] / tpn : 0.0;
+    double nq = cfg->nqueries > 0 ? (double)cfg->nqueries : 1.0;
+    double phase_q[5] = {
+        phase.filter_cycles / nq, phase.hot_cycles / nq, phase.cold_cycles / nq,
+        phase.adapt_cycles / nq, phase.promote_cycles / nq
+    };
+    int have_phase = INSTRUMENTED && cfg->mode == MODE_HCTREE;
+
+    if (human && cfg->range_frac > 0.0)
+        printf("Range scan keys:  %ld\n", scanned);
+    if (human && INSTRUMENTED) {
+        printf("Latency (ns):     p50 %.0f  p99 %.0f  p99.9 %.0f  max %.0f\n",
+               lat_ns[0], lat_ns[1], lat_ns[2], lat_ns[3]);
+        if (have_phase)
+            printf("Cycles/q:         filter %.1f  hot %.1f  cold %.1f  adapt %.1f  promote %.1f\n",
+                   phase_q[0], phase_q[1], phase_q[2], phase_q[3], phase_q[4]);
+    }
+    if (human && meas.npc) {
+        printf("HW counters/q:   ");
+        for (int e = 0; e < PC_NEVENTS; e++) {
+            if (pc_has(&meas.pc, (PerfEvent)e))
+                printf(" %s %.2f", pc_event_name((PerfEvent)e),
+                       (double)meas.pc.value[e] / nq);
+        }
+        printf("\n");
+    }
+
+    if (!human) {
+        // Note: we still print hot_* fields for baseline (they'll be 0).
+        const char *mode_str = (cfg->mode == MODE_HCTREE) ? "hctree" : "baseline";
+        OutRow row;
+        row.n = 0;
+        out_add(&row, "%s", mode_str);
+        out_add(&row, "%s", cfg->workload);
+        out_add(&row, "%.5f", cfg->theta);
+        out_add(&row, "%" PRId64, cfg->nkeys);
+        out_add(&row, "%" PRId64, cfg->nqueries);
+        out_add(&row, "%.5f", cfg->hot_thresh);
+        out_add(&row, "%.5f", cfg->decay_alpha);
+        out_add(&row, "%.5f", cfg->hot_frac);
+        out_add(&row, "%u", cfg->seed);
+        out_add(&row, "%.6f", elapsed);
+        out_add(&row, "%.2f", qps);
+        out_add(&row, "%ld", hot_hits);
+        out_add(&row, "%ld", cold_hits);
+        out_add(&row, "%ld", not_found);
+        out_add(&row, "%zu", hot_keys);
+        out_add(&row, "%zu", cold_keys);
+        out_add(&row, "%.6f", avg_hot_nodes_q);
+        out_add(&row, "%.6f", avg_cold_nodes_q);
+        out_add(&row, "%.6f", build_sec);
+        out_add(&row, "%" PRId64, cfg->batch);
+        out_add(&row, "%.5f", cfg->rmw_frac);
+        out_add(&row, "%.5f", cfg->range_frac);
+        out_add(&row, "%.5f", cfg->write_frac);
+        out_add(&row, "%d", nthreads);
+        out_add(&row, "%.2f", qps_min);
+        out_add(&row, "%.2f", qps_max);
+        if (cfg->mode == MODE_HCTREE) {
+            out_add(&row, "%s", cfg->exclusive ? "exclusive" : "inclusive");
+            out_add(&row, "%zu", hot_bytes);
+            out_add(&row, "%zu", cold_bytes);
+            out_add(&row, "%d", cold_height);
+        } else {
+            for (int i = 0; i < 4; i++) out_skip(&row);
+        }
+        if (cfg->mode == MODE_HCTREE) out_add(&row, "%zu", cfg->write_buffer);
+        else                          out_skip(&row);
+        out_add(&row, "%s", cfg->random_build ? "random" : "ascending");
+        out_add(&row, "%s", cfg->packed ? "packed" : "raw");
+        out_add(&row, "%d", cfg->learned);
+        if (cfg->mode == MODE_HCTREE) {
+            out_add(&row, "%s", cfg->huge ? "huge" : "default");
+            out_add(&row, "%d", hot_copies);
+        } else {
+            out_skip(&row);
+            out_skip(&row);
+        }
+        out_add(&row, "%s", cfg->cold_interleave ? "interleave" : "local");
+        if (cfg->mode == MODE_HCTREE) {
+            static const char *const evict_str[] = { "none", "clock", "sampled" };
+            static const char *const freq_str[] = { "dense", "cms", "table" };
+            static const char *const promote_str[] = { "inline", "queue", "thread" };
+            out_add(&row, "%s", cfg->hot_kind == HC_HOT_HASH ? "hash" : "btree");
+            out_add(&row, "%s", evict_str[cfg->evict_policy]);
+            out_add(&row, "%s", freq_str[cfg->freq_kind]);
+            out_add(&row, "%u", cfg->filter_bits);
+            out_add(&row, "%d", cfg->nshards);
+            out_add(&row, "%s", promote_str[cfg->promote_mode]);
+        } else {
+            for (int i = 0; i < 6; i++) out_skip(&row);
+        }
+        for (int i = 0; i < 4; i++) {
+            if (INSTRUMENTED) out_add(&row, "%.1f", lat_ns[i]);
+            else              out_skip(&row);
+        }
+        for (int i = 0; i < 5; i++) {
+            if (have_phase) out_add(&row, "%.2f", phase_q[i]);
+            else            out_skip(&row);
+        }
+        for (int e = 0; e < PC_NEVENTS; e++) {
+            if (meas.npc && pc_has(&meas.pc, (PerfEvent)e))
+                out_add(&row, "%.3f", (double)meas.pc.value[e] / nq);
+            else
+                out_skip(&row);
+        }
+        if (cfg->json) out_json(&row);
+        else      out_csv(&row);
     }
+    if (meas.npc) pc_close(&meas.pc);
+    free(lat);
 
     return 0;
 }
+
+int main(int argc, char **argv) {
+    BenchConfig cfg;
+    cfg.nkeys        = 100000;
+    cfg.nqueries     = 500000;
+    cfg.workload     = "zipf";
+    cfg.wl_kind      = WL_ZIPF;
+    cfg.theta        = 1.1;
+    cfg.hot_thresh   = 8.0;
+    cfg.decay_alpha  = 0.9;
+    cfg.hot_frac     = 0.05;
+    cfg.seed         = 42;
+    cfg.mode         = MODE_HCTREE;
+    cfg.csv          = false;
+    cfg.json         = false;
+    cfg.perf         = false;
+    cfg.sample_init  = 1.0;
+    cfg.adapt_sample = 0;
+    cfg.batch        = 1;
+    cfg.shift_every  = 0;
+    cfg.rmw_frac     = 0.0;
+    cfg.range_frac   = 0.0;
+    cfg.write_frac   = 0.0;
+    cfg.range_len    = 100;
+    cfg.warmup       = 0;
+    cfg.pin          = true;
+    cfg.evict_policy = HC_EVICT_NONE;
+    cfg.freq_kind    = FREQ_DENSE;
+    cfg.freq_budget  = 0;
+    cfg.bplus        = 0;
+    cfg.packed       = false;
+    cfg.learned      = 0;
+    cfg.exclusive    = false;
+    cfg.write_buffer = 0;
+    cfg.random_build = false;
+    cfg.huge         = false;
+    cfg.hot_replicas = false;
+    cfg.cold_interleave = false;
+    cfg.bulk_fill    = 0.0;
+    cfg.promote_mode = PROMOTE_INLINE;
+    cfg.nshards      = 1;
+    cfg.hot_kind     = HC_HOT_BTREE;
+    cfg.filter_bits  = 0;
+    cfg.save_cold    = NULL;
+    cfg.open_cold    = NULL;
+    cfg.snapshot     = NULL;
+    cfg.restore      = NULL;
+    cfg.adapt_trace  = NULL;
+    bool csv_header = false;
+    int  sweep[MAX_SWEEP] = { 1 };   // --threads
+    int  nsweep = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--nkeys") && i+1 < argc) {
+            cfg.nkeys = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--nqueries") && i+1 < argc) {
+            cfg.nqueries = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--workload") && i+1 < argc) {
+            cfg.workload = argv[++i];
+            if (wl_parse_kind(cfg.workload, &cfg.wl_kind) != 0) {
+                fprintf(stderr, "Unknown workload '%s'\n", cfg.workload);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--theta") && i+1 < argc) {
+            cfg.theta = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--hot_thresh") && i+1 < argc) {
+            cfg.hot_thresh = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--decay") && i+1 < argc) {
+            cfg.decay_alpha = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--hot_frac") && i+1 < argc) {
+            cfg.hot_frac = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+            cfg.seed = (unsigned int)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--shift_every") && i+1 < argc) {
+            cfg.shift_every = atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--rmw") && i+1 < argc) {
+            cfg.rmw_frac = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--range") && i+1 < argc) {
+            cfg.range_frac = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--write") && i+1 < argc) {
+            cfg.write_frac = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+            nsweep = parse_int_list(argv[++i], sweep, MAX_SWEEP);
+            if (nsweep <= 0) {
+                fprintf(stderr, "Bad thread count list '%s'\n", argv[i]);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--warmup") && i+1 < argc) {
+            cfg.warmup = atoll(argv[++i]);
+            if (cfg.warmup < 0) cfg.warmup = 0;
+        } else if (!strcmp(argv[i], "--no_pin")) {
+            cfg.pin = false;
+        } else if (!strcmp(argv[i], "--range_len") && i+1 < argc) {
+            cfg.range_len = atoll(argv[++i]);
+            if (cfg.range_len < 1) cfg.range_len = 1;
+        } else if (!strcmp(argv[i], "--freq") && i+1 < argc) {
+            const char *f = argv[++i];
+            if (!strcmp(f, "dense")) cfg.freq_kind = FREQ_DENSE;
+            else if (!strcmp(f, "cms")) cfg.freq_kind = FREQ_CMS;
+            else if (!strcmp(f, "table")) cfg.freq_kind = FREQ_TABLE;
+            else {
+                fprintf(stderr, "Unknown frequency tracker '%s'\n", f);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--freq_bytes") && i+1 < argc) {
+            cfg.freq_budget = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--evict") && i+1 < argc) {
+            const char *e = argv[++i];
+            if (!strcmp(e, "none")) cfg.evict_policy = HC_EVICT_NONE;
+            else if (!strcmp(e, "clock")) cfg.evict_policy = HC_EVICT_CLOCK;
+            else if (!strcmp(e, "sampled")) cfg.evict_policy = HC_EVICT_SAMPLED;
+            else {
+                fprintf(stderr, "Unknown eviction policy '%s'\n", e);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--promote") && i+1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "inline")) cfg.promote_mode = PROMOTE_INLINE;
+            else if (!strcmp(m, "queue")) cfg.promote_mode = PROMOTE_QUEUE;
+            else if (!strcmp(m, "thread")) cfg.promote_mode = PROMOTE_THREAD;
+            else {
+                fprintf(stderr, "Unknown promotion mode '%s'\n", m);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--shards") && i+1 < argc) {
+            cfg.nshards = atoi(argv[++i]);
+            if (cfg.nshards < 1) cfg.nshards = 1;
+        } else if (!strcmp(argv[i], "--hot") && i+1 < argc) {
+            const char *h = argv[++i];
+            if (!strcmp(h, "btree")) cfg.hot_kind = HC_HOT_BTREE;
+            else if (!strcmp(h, "hash")) cfg.hot_kind = HC_HOT_HASH;
+            else {
+                fprintf(stderr, "Unknown hot tier '%s'\n", h);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--filter") && i+1 < argc) {
+            cfg.filter_bits = (unsigned)atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--save_cold") && i+1 < argc) {
+            cfg.save_cold = argv[++i];
+        } else if (!strcmp(argv[i], "--open_cold") && i+1 < argc) {
+            cfg.open_cold = argv[++i];
+        } else if (!strcmp(argv[i], "--snapshot") && i+1 < argc) {
+            cfg.snapshot = argv[++i];
+        } else if (!strcmp(argv[i], "--restore") && i+1 < argc) {
+            cfg.restore = argv[++i];
+        } else if (!strcmp(argv[i], "--bplus")) {
+            cfg.bplus = 1;
+        } else if (!strcmp(argv[i], "--packed")) {
+            cfg.packed = true;
+            cfg.bplus  = 1;
+        } else if (!strcmp(argv[i], "--learned") && i+1 < argc) {
+            cfg.learned = atoi(argv[++i]);
+            if (cfg.learned > 0) cfg.bplus = 1;
+        } else if (!strcmp(argv[i], "--exclusive")) {
+            cfg.exclusive = true;
+        } else if (!strcmp(argv[i], "--write_buffer") && i+1 < argc) {
+            cfg.write_buffer = (size_t)atoll(argv[++i]);
+        } else if (!strcmp(argv[i], "--random_build")) {
+            cfg.random_build = true;
+        } else if (!strcmp(argv[i], "--huge")) {
+            cfg.huge = true;
+        } else if (!strcmp(argv[i], "--hot_replicas")) {
+            cfg.hot_replicas = true;
+        } else if (!strcmp(argv[i], "--cold_interleave")) {
+            cfg.cold_interleave = true;
+        } else if (!strcmp(argv[i], "--bulk_fill") && i+1 < argc) {
+            cfg.bulk_fill = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--batch") && i+1 < argc) {
+            cfg.batch = atoll(argv[++i]);
+            if (cfg.batch < 1) cfg.batch = 1;
+        } else if (!strcmp(argv[i], "--mode") && i+1 < argc) {
+            const char *m = argv[++i];
+            if (!strcmp(m, "hctree")) cfg.mode = MODE_HCTREE;
+            else if (!strcmp(m, "baseline")) cfg.mode = MODE_BASELINE;
+            else {
+                fprintf(stderr, "Unknown mode '%s'\n", m);
+                usage(argv[0]);
+                return 1;
+            }
+
+        // 🔽 NEW OPTIONS START HERE
+        } else if (!strcmp(argv[i], "--sample_init") && i+1 < argc) {
+            // Initial sampling rate D (0–1)
+            cfg.sample_init = atof(argv[++i]);
+        } else if (!strcmp(argv[i], "--adapt_sample")) {
+            // Turn on ML-style adaptation of D
+            cfg.adapt_sample = HC_ADAPT_VISITS;
+        } else if (!strcmp(argv[i], "--adapt") && i+1 < argc) {
+            const char *a = argv[++i];
+            if (!strcmp(a, "none")) cfg.adapt_sample = HC_ADAPT_NONE;
+            else if (!strcmp(a, "visits")) cfg.adapt_sample = HC_ADAPT_VISITS;
+            else if (!strcmp(a, "cost")) cfg.adapt_sample = HC_ADAPT_COST;
+            else {
+                fprintf(stderr, "Unknown adapt mode '%s'\n", a);
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(argv[i], "--adapt_trace") && i+1 < argc) {
+            cfg.adapt_trace = argv[++i];
+        // 🔼 NEW OPTIONS END HERE
+
+        } else if (!strcmp(argv[i], "--disable_hot")) {
+            cfg.mode = MODE_BASELINE;
+        } else if (!strcmp(argv[i], "--csv")) {
+            cfg.csv = true;
+        } else if (!strcmp(argv[i], "--csv_header")) {
+            csv_header = true;
+        } else if (!strcmp(argv[i], "--json")) {
+            cfg.json = true;
+        } else if (!strcmp(argv[i], "--perf")) {
+            cfg.perf = true;
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (csv_header) {
+        // Print header and exit; no experiment.
+        out_csv_header();
+        return 0;
+    }
+    // One run per thread count; a list (--threads 1,2,4,8) is a sweep.
+    for (int i = 0; i < nsweep; i++) {
+        int rc = run_bench(&cfg, sweep[i]);
+        if (rc != 0) return rc;
+    }
+    return 0;
+}
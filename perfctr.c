@@ -0,0 +1,89 @@
+// perfctr.c
+#define _DEFAULT_SOURCE   // syscall()
+#include "perfctr.h"
+#include <string.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+static const char *const pc_names[PC_NEVENTS] = {
+    "cycles", "instructions", "llc_misses", "branch_misses"
+};
+
+const char* pc_event_name(PerfEvent e) {
+    return (unsigned)e < PC_NEVENTS ? pc_names[e] : "?";
+}
+
+int pc_has(const PerfCounters *pc, PerfEvent e) {
+    return pc->fd[e] >= 0;
+}
+
+#ifdef __linux__
+
+static const uint64_t pc_config[PC_NEVENTS] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,    // the kernel maps this to the LLC
+    PERF_COUNT_HW_BRANCH_MISSES
+};
+
+int pc_open(PerfCounters *pc) {
+    int opened = 0;
+    memset(pc->value, 0, sizeof(pc->value));
+    for (int e = 0; e < PC_NEVENTS; e++) {
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size           = sizeof(attr);
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.config         = pc_config[e];
+        attr.disabled       = 1;
+        attr.inherit        = 1;   // also count threads started later
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        pc->fd[e] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+        if (pc->fd[e] >= 0) opened++;
+    }
+    return opened;
+}
+
+void pc_close(PerfCounters *pc) {
+    for (int e = 0; e < PC_NEVENTS; e++) {
+        if (pc->fd[e] >= 0) close(pc->fd[e]);
+        pc->fd[e] = -1;
+    }
+}
+
+void pc_start(PerfCounters *pc) {
+    for (int e = 0; e < PC_NEVENTS; e++) {
+        if (pc->fd[e] < 0) continue;
+        ioctl(pc->fd[e], PERF_EVENT_IOC_RESET, 0);
+        ioctl(pc->fd[e], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void pc_stop(PerfCounters *pc) {
+    for (int e = 0; e < PC_NEVENTS; e++) {
+        if (pc->fd[e] < 0) continue;
+        ioctl(pc->fd[e], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t v = 0;
+        pc->value[e] = read(pc->fd[e], &v, sizeof(v)) == (ssize_t)sizeof(v) ? v : 0;
+    }
+}
+
+#else   // no perf_event_open
+
+int pc_open(PerfCounters *pc) {
+    for (int e = 0; e < PC_NEVENTS; e++) pc->fd[e] = -1;
+    memset(pc->value, 0, sizeof(pc->value));
+    return 0;
+}
+
+void pc_close(PerfCounters *pc) { (void)pc; }
+void pc_start(PerfCounters *pc) { (void)pc; }
+void pc_stop(PerfCounters *pc)  { (void)pc; }
+
+#endif
@@ -0,0 +1,37 @@
+// perfctr.h
+#ifndef PERFCTR_H
+#define PERFCTR_H
+
+#include <stdint.h>
+
+// Hardware event counters for the calling thread (and threads it creates
+// after pc_open), read through Linux perf_event_open. Each event is
+// opened on its own, so one the CPU or kernel does not offer is simply
+// missing. Opening fails as a whole on other systems, in containers
+// without perf access, or when perf_event_paranoid forbids it.
+typedef enum {
+    PC_CYCLES = 0,
+    PC_INSTRUCTIONS,
+    PC_LLC_MISSES,       // last-level cache misses
+    PC_BRANCH_MISSES,
+    PC_NEVENTS
+} PerfEvent;
+
+typedef struct {
+    int      fd[PC_NEVENTS];     // -1 = event unavailable
+    uint64_t value[PC_NEVENTS];  // counts between pc_start and pc_stop
+} PerfCounters;
+
+// Returns the number of events opened; 0 = none (pc_* are then no-ops).
+int         pc_open(PerfCounters *pc);
+void        pc_close(PerfCounters *pc);
+
+// Reset to zero and count / stop counting and read value[].
+void        pc_start(PerfCounters *pc);
+void        pc_stop(PerfCounters *pc);
+
+// 1 if event e was opened and value[e] is meaningful.
+int         pc_has(const PerfCounters *pc, PerfEvent e);
+const char* pc_event_name(PerfEvent e);
+
+#endif // PERFCTR_H
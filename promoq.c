@@ -0,0 +1,88 @@
+// promoq.c
+#include "promoq.h"
+#include <stdlib.h>
+#include <stdint.h>
+
+#define PQ_LINE 64
+
+typedef struct {
+    uint64_t  seq;   // == pos: free for the push at pos; == pos+1: full
+    BTKey     key;
+    BTPayload val;
+    uint64_t  stamp;
+} PQCell;
+
+struct PromoQueue {
+    PQCell  *cells;
+    uint64_t mask;
+    // Producers and the consumer each get their own cache line.
+    _Alignas(PQ_LINE) uint64_t head;   // next push position
+    _Alignas(PQ_LINE) uint64_t tail;   // next pop position
+};
+
+PromoQueue* pq_create(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity) n *= 2;
+    PromoQueue *q = (PromoQueue*)aligned_alloc(PQ_LINE, sizeof(PromoQueue));
+    q->cells = (PQCell*)malloc(sizeof(PQCell) * n);
+    for (size_t i = 0; i < n; i++) q->cells[i].seq = i;
+    q->mask = n - 1;
+    q->head = 0;
+    q->tail = 0;
+    return q;
+}
+
+void pq_free(PromoQueue *q) {
+    if (!q) return;
+    free(q->cells);
+    free(q);
+}
+
+int pq_push(PromoQueue *q, BTKey k, BTPayload v, uint64_t stamp) {
+    uint64_t pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    PQCell *c;
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        uint64_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t)(seq - pos);
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->head, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            return 0;   // full: the cell still holds an unconsumed entry
+        } else {
+            pos = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+        }
+    }
+    c->key = k;
+    c->val = v;
+    c->stamp = stamp;
+    __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int pq_pop(PromoQueue *q, BTKey *k, BTPayload *v, uint64_t *stamp) {
+    uint64_t pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+    PQCell *c;
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        uint64_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        int64_t dif = (int64_t)(seq - (pos + 1));
+        if (dif == 0) {
+            if (__atomic_compare_exchange_n(&q->tail, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        } else if (dif < 0) {
+            return 0;   // empty
+        } else {
+            pos = __atomic_load_n(&q->tail, __ATOMIC_RELAXED);
+        }
+    }
+    *k = c->key;
+    *v = c->val;
+    *stamp = c->stamp;
+    // Free the cell for the push one lap later.
+    __atomic_store_n(&c->seq, pos + q->mask + 1, __ATOMIC_RELEASE);
+    return 1;
+}
@@ -0,0 +1,25 @@
+// promoq.h
+#ifndef PROMOQ_H
+#define PROMOQ_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "btree.h"
+
+// Bounded lock-free queue of promotion candidates (key + the payload the
+// lookup already found + an opaque stamp the consumer uses to tell whether
+// that payload may have gone stale, see hc_promote_body). Any number of
+// threads may push and pop at once; each cell carries a sequence number,
+// so a push or pop is one CAS on the shared position plus a release store
+// on the cell (Vyukov's bounded MPMC queue). Neither call ever blocks:
+// pq_push fails when the queue is full and pq_pop when it is empty.
+typedef struct PromoQueue PromoQueue;
+
+// capacity is rounded up to a power of two (minimum 2).
+PromoQueue* pq_create(size_t capacity);
+void        pq_free(PromoQueue *q);
+
+int         pq_push(PromoQueue *q, BTKey k, BTPayload v, uint64_t stamp);  // 1 = queued
+int         pq_pop(PromoQueue *q, BTKey *k, BTPayload *v, uint64_t *stamp); // 1 = got one
+
+#endif // PROMOQ_H
@@ -0,0 +1,52 @@
+// rng.h
+#ifndef RNG_H
+#define RNG_H
+
+#include <stdint.h>
+
+// Small, fast PRNG for sampling decisions: xoshiro256** seeded through
+// splitmix64. Unlike rand() it keeps no hidden global state, so each
+// thread can own one and draws never contend on a lock.
+typedef struct {
+    uint64_t s[4];
+} Rng;
+
+static inline uint64_t rng_splitmix64(uint64_t *x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline void rng_seed(Rng *r, uint64_t seed) {
+    for (int i = 0; i < 4; i++) r->s[i] = rng_splitmix64(&seed);
+}
+
+static inline uint64_t rng_rotl(uint64_t x, int k) {
+    return (x << k) | (x >> (64 - k));
+}
+
+static inline uint64_t rng_next(Rng *r) {
+    uint64_t *s = r->s;
+    uint64_t out = rng_rotl(s[1] * 5, 7) * 9;
+    uint64_t t = s[1] << 17;
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rng_rotl(s[3], 45);
+    return out;
+}
+
+// Uniform double in [0, 1) from the top 53 bits.
+static inline double rng_uniform(Rng *r) {
+    return (double)(rng_next(r) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Integer in [0, n), n > 0 (modulo bias is negligible for n << 2^64).
+static inline uint64_t rng_below(Rng *r, uint64_t n) {
+    return rng_next(r) % n;
+}
+
+#endif // RNG_H
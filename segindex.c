@@ -0,0 +1,121 @@
+// segindex.c
+#include "segindex.h"
+#include "keysearch.h"
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+typedef struct {
+    double slope;    // positions per key unit from the segment's first key
+    size_t first;    // indices of the segment's first and last keys
+    size_t last;
+} SISeg;
+
+struct SegIndex {
+    BTKey  *keys;
+    size_t  n;
+    int     eps;
+    BTKey  *starts;  // starts[s] = keys[segs[s].first], for the segment search
+    SISeg  *segs;
+    size_t  nseg;
+};
+
+// Key distance as a double; differences of int64 keys need 64 unsigned bits.
+static inline double si_dx(BTKey a, BTKey b) {
+    return (double)((uint64_t)b - (uint64_t)a);
+}
+
+SegIndex* si_build(const BTKey *keys, size_t n, int eps) {
+    SegIndex *si = (SegIndex*)malloc(sizeof(SegIndex));
+    if (eps < 1) eps = 1;
+    si->n = n;
+    si->eps = eps;
+    si->keys = (BTKey*)malloc(sizeof(BTKey) * n);
+    memcpy(si->keys, keys, sizeof(BTKey) * n);
+
+    size_t cap = 16;
+    si->segs = (SISeg*)malloc(sizeof(SISeg) * cap);
+    si->nseg = 0;
+    for (size_t a = 0; a < n; ) {
+        // Narrow [lo, hi] to the slopes that keep every key so far within
+        // eps of its position; the segment ends when the range empties.
+        double lo = 0.0, hi = INFINITY;
+        size_t b = a;
+        for (size_t j = a + 1; j < n; j++) {
+            double dx = si_dx(keys[a], keys[j]), dy = (double)(j - a);
+            double l = (dy - eps) / dx, h = (dy + eps) / dx;
+            if (l < lo) l = lo;
+            if (h > hi) h = hi;
+            if (l > h) break;
+            lo = l;
+            hi = h;
+            b = j;
+        }
+        if (si->nseg == cap) {
+            cap *= 2;
+            si->segs = (SISeg*)realloc(si->segs, sizeof(SISeg) * cap);
+        }
+        SISeg *g = &si->segs[si->nseg++];
+        g->slope = b == a ? 0.0 : (lo + hi) / 2;
+        g->first = a;
+        g->last  = b;
+        a = b + 1;
+    }
+    si->starts = (BTKey*)malloc(sizeof(BTKey) * si->nseg);
+    for (size_t s = 0; s < si->nseg; s++)
+        si->starts[s] = keys[si->segs[s].first];
+    return si;
+}
+
+void si_free(SegIndex *si) {
+    if (!si) return;
+    free(si->keys);
+    free(si->starts);
+    free(si->segs);
+    free(si);
+}
+
+// First index in [lo, hi) with keys[i] >= k, for ranges too long for the
+// int-sized ks_lower_bound.
+static size_t si_lower(const BTKey *keys, size_t lo, size_t hi, BTKey k) {
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (keys[mid] < k) lo = mid + 1;
+        else               hi = mid;
+    }
+    return lo;
+}
+
+size_t si_find(const SegIndex *si, BTKey k) {
+    const BTKey *keys = si->keys;
+    size_t s = si->nseg <= 64
+             ? (size_t)ks_lower_bound(si->starts, (int)si->nseg, k)
+             : si_lower(si->starts, 0, si->nseg, k);
+    if (s < si->nseg && si->starts[s] == k) return si->segs[s].first;
+    if (s == 0) return 0;
+    const SISeg *g = &si->segs[s - 1];
+
+    double p = (double)g->first + g->slope * si_dx(keys[g->first], k);
+    size_t c = p >= (double)g->last ? g->last : (size_t)p;
+    size_t span = (size_t)si->eps + 1;   // +1 absorbs rounding in p
+    size_t lo = c > g->first + span ? c - span : g->first;
+    size_t hi = c + span < g->last ? c + span : g->last;
+    if (keys[lo] > k || (hi < g->last && keys[hi + 1] <= k)) {
+        // Only reachable through floating-point error; stay correct.
+        lo = g->first;
+        hi = g->last;
+    }
+    size_t i = hi - lo < 64
+             ? lo + (size_t)ks_lower_bound(keys + lo, (int)(hi - lo + 1), k)
+             : si_lower(keys, lo, hi + 1, k);
+    return (i <= hi && keys[i] == k) ? i : i - 1;
+}
+
+size_t si_segments(const SegIndex *si) {
+    return si->nseg;
+}
+
+size_t si_bytes(const SegIndex *si) {
+    return sizeof(SegIndex) + si->n * sizeof(BTKey)
+         + si->nseg * (sizeof(SISeg) + sizeof(BTKey));
+}
@@ -0,0 +1,31 @@
+// segindex.h
+#ifndef SEGINDEX_H
+#define SEGINDEX_H
+
+#include <stddef.h>
+#include "btree.h"
+
+// Learned index over a sorted key array, in the style of a one-level PGM
+// index. The keys are cut into piecewise-linear segments, each fitted so
+// that it predicts the position of every one of its keys to within eps.
+// A lookup searches the segment starts (a single segment for dense keys),
+// evaluates the segment's line and searches at most 2*eps+3 keys around
+// the prediction.
+//
+// Segments are grown greedily with a shrinking cone of feasible slopes
+// (one pass over the keys), which is close to the optimal segment count
+// for the near-linear key sets this is used for.
+typedef struct SegIndex SegIndex;
+
+// keys[0, n) must be strictly increasing, n >= 1. The index keeps its
+// own copy of the keys.
+SegIndex* si_build(const BTKey *keys, size_t n, int eps);
+void      si_free(SegIndex *si);
+
+// Index of the last key <= k (0 if k is below every key).
+size_t    si_find(const SegIndex *si, BTKey k);
+
+size_t    si_segments(const SegIndex *si);
+size_t    si_bytes(const SegIndex *si);
+
+#endif // SEGINDEX_H
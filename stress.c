@@ -0,0 +1,517 @@
+// stress.c
+//
+// Multi-threaded consistency checks for the concurrent paths: lock-free
+// readers run against a writer, and every answer they get must be one
+// that some interleaving of the writes could have produced.
+//
+//   ./stress [--threads T] [--ops N] [--seed S] [case ...]
+//
+// Without case names every case runs. Keys are split by parity: even keys
+// are always present and the writer only switches their payload between
+// two values, odd keys are inserted and deleted at random. A reader that
+// misses an even key, or sees a payload no write stored, counts an error.
+// Each case runs N writer operations with T reader threads and passes with
+// zero errors; the exit status is 0 only if every case passed. `make
+// check` builds and runs it. The promoq case tests the queue on its own:
+// T producers and T consumers, and every item must be popped once.
+//
+// Races show up reliably only with a core per thread (T + 1 here): on
+// fewer, threads mostly switch at time-slice boundaries and rarely
+// interleave inside a read.
+#define _POSIX_C_SOURCE 200809L
+#include "btree.h"
+#include "hctree.h"
+#include "promoq.h"
+#include "rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <sched.h>
+
+#define NKEYS      (1 << 17)   // key domain [0, NKEYS)
+#define HOT_KEYS   (NKEYS / 64) // readers aim most lookups here
+
+typedef struct {
+    int      threads;
+    long     ops;
+    uint64_t seed;
+} Cfg;
+
+// The payloads a write may leave behind for k.
+static inline BTPayload even_a(BTKey k) { return (BTPayload)(intptr_t)(2 * k + 1); }
+static inline BTPayload even_b(BTKey k) { return (BTPayload)(intptr_t)(2 * k + 2); }
+static inline BTPayload odd_v(BTKey k)  { return (BTPayload)(intptr_t)(3 * k); }
+
+static int valid(BTKey k, BTPayload v) {
+    if ((k & 1) == 0) return v == even_a(k) || v == even_b(k);
+    return v == NULL || v == odd_v(k);
+}
+
+// Mostly keys in [0, HOT_KEYS), so the hot tier has something to promote
+// and, being smaller than that, to evict.
+static BTKey pick_key(Rng *r) {
+    if (rng_below(r, 8) != 0) return (BTKey)rng_below(r, HOT_KEYS);
+    return (BTKey)rng_below(r, NKEYS);
+}
+
+// --- Reader threads ----------------------------------------------------
+
+typedef struct Run Run;
+
+typedef struct {
+    Run     *run;
+    uint64_t seed;
+    long     reads;
+    long     errors;
+} Reader;
+
+struct Run {
+    BTree   *tree;      // tree cases
+    HotHash *hash;      // HotHash case
+    HCIndex *idx;       // HCIndex cases
+    int      stop;
+    long     write_errors;   // errors seen by the writer thread
+    Reader   readers[64];
+};
+
+typedef struct {
+    BTKey lo, hi;
+    BTKey last;     // last key seen; lo - 1 before the first
+    long  evens;    // even keys seen
+    long  errors;
+} RangeCheck;
+
+static void range_cb(BTKey k, BTPayload v, void *arg) {
+    RangeCheck *rc = (RangeCheck*)arg;
+    if (k <= rc->last || k > rc->hi || v == NULL || !valid(k, v))
+        rc->errors++;
+    rc->evens += (k & 1) == 0;
+    rc->last = k;
+}
+
+// A range answer must be ascending, in [lo, hi] and hold every even key
+// there.
+static long check_range(Run *run, BTKey lo, BTKey hi) {
+    RangeCheck rc = { lo, hi, lo - 1, 0, 0 };
+    if (run->idx) hc_range_search(run->idx, lo, hi, range_cb, &rc);
+    else          bt_range_search(run->tree, lo, hi, range_cb, &rc, NULL);
+    return rc.errors + (rc.evens != hi / 2 - (lo + 1) / 2 + 1);
+}
+
+static void* reader_main(void *arg) {
+    Reader *rd = (Reader*)arg;
+    Run *run = rd->run;
+    Rng r;
+    rng_seed(&r, rd->seed);
+    BTKey keys[16];
+    BTPayload out[16];
+    BTStats s = {0};
+    while (!__atomic_load_n(&run->stop, __ATOMIC_ACQUIRE)) {
+        unsigned op = (unsigned)rng_below(&r, 64);
+        if (op == 0 && !run->hash) {
+            BTKey lo = (BTKey)rng_below(&r, NKEYS - 256);
+            rd->errors += check_range(run, lo, lo + (BTKey)rng_below(&r, 256));
+            rd->reads++;
+        } else if (op < 8) {
+            for (int j = 0; j < 16; j++) keys[j] = pick_key(&r);
+            if (run->idx)       hc_search_batch(run->idx, keys, 16, out);
+            else if (run->hash) hh_get_batch(run->hash, keys, 16, out, &s);
+            else                bt_search_batch(run->tree, keys, 16, out, NULL);
+            for (int j = 0; j < 16; j++) rd->errors += !valid(keys[j], out[j]);
+            rd->reads += 16;
+        } else {
+            BTKey k = pick_key(&r);
+            BTPayload v = run->idx  ? hc_search(run->idx, k)
+                        : run->hash ? hh_get(run->hash, k, &s)
+                        :             bt_search(run->tree, k, NULL);
+            rd->errors += !valid(k, v);
+            rd->reads++;
+        }
+    }
+    return NULL;
+}
+
+static void start_readers(Run *run, const Cfg *cfg, pthread_t *th) {
+    for (int i = 0; i < cfg->threads; i++) {
+        Reader *rd = &run->readers[i];
+        rd->run = run;
+        rd->seed = cfg->seed * 1000003u + (uint64_t)i + 1;
+        rd->reads = 0;
+        rd->errors = 0;
+        pthread_create(&th[i], NULL, reader_main, rd);
+    }
+}
+
+static long stop_readers(Run *run, const Cfg *cfg, pthread_t *th, long *reads) {
+    __atomic_store_n(&run->stop, 1, __ATOMIC_RELEASE);
+    long errors = run->write_errors;
+    *reads = 0;
+    for (int i = 0; i < cfg->threads; i++) {
+        pthread_join(th[i], NULL);
+        errors += run->readers[i].errors;
+        *reads += run->readers[i].reads;
+    }
+    return errors;
+}
+
+// --- Tree cases: bt_* OLC readers against the tree's writer -----------
+
+static BTree* make_tree(int layout) {
+    BTree *tree;
+    switch (layout) {
+    case 0:  tree = bt_create(8);        break;
+    case 1:  tree = bt_create_bplus(8);  break;
+    default: tree = bt_create_packed(8); break;
+    }
+    for (BTKey k = 0; k < NKEYS; k += 2) bt_insert(tree, k, even_a(k));
+    if (layout == 3) bt_set_learned(tree, 4);
+    bt_set_concurrent(tree);
+    return tree;
+}
+
+// Layout 0 classic, 1 B+tree, 2 packed leaves, 3 packed + learned
+// directory (rebuilt now and then, so readers cross directory swaps).
+static long run_tree(const Cfg *cfg, int layout) {
+    Run run;
+    memset(&run, 0, sizeof(run));
+    run.tree = make_tree(layout);
+    pthread_t th[64];
+    start_readers(&run, cfg, th);
+
+    Rng r;
+    rng_seed(&r, cfg->seed);
+    for (long i = 0; i < cfg->ops; i++) {
+        BTKey k = pick_key(&r);
+        if ((k & 1) == 0)
+            bt_update(run.tree, k, rng_below(&r, 2) ? even_a(k) : even_b(k));
+        else if (rng_below(&r, 2))
+            bt_insert(run.tree, k, odd_v(k));
+        else
+            bt_delete(run.tree, k);
+        if (layout == 3 && i % (cfg->ops / 8 + 1) == 0) bt_set_learned(run.tree, 4);
+    }
+
+    long reads;
+    long errors = stop_readers(&run, cfg, th, &reads);
+    printf("  reads %ld, keys %zu, height %d\n", reads, bt_count_keys(run.tree),
+           bt_height(run.tree));
+    bt_free(run.tree);
+    return errors;
+}
+
+static long case_olc_btree(const Cfg *c)   { return run_tree(c, 0); }
+static long case_olc_bplus(const Cfg *c)   { return run_tree(c, 1); }
+static long case_olc_packed(const Cfg *c)  { return run_tree(c, 2); }
+static long case_olc_learned(const Cfg *c) { return run_tree(c, 3); }
+
+// Lock-free HotHash readers against its writer. The table starts with no
+// room to spare and is grown to twice its size halfway, and odd keys
+// leave deleted slots behind, so readers also run across rehashes.
+static long case_hothash(const Cfg *cfg) {
+    Run run;
+    memset(&run, 0, sizeof(run));
+    run.hash = hh_create(NKEYS / 2, 1);
+    for (BTKey k = 0; k < NKEYS; k += 2) hh_put(run.hash, k, even_a(k));
+    pthread_t th[64];
+    start_readers(&run, cfg, th);
+
+    Rng r;
+    rng_seed(&r, cfg->seed);
+    for (long i = 0; i < cfg->ops; i++) {
+        BTKey k = pick_key(&r);
+        if ((k & 1) == 0) {
+            BTPayload v = rng_below(&r, 2) ? even_a(k) : even_b(k);
+            run.write_errors += !hh_update(run.hash, k, v);
+        } else if (rng_below(&r, 2)) {
+            hh_put(run.hash, k, odd_v(k));
+        } else {
+            hh_del(run.hash, k);
+        }
+        if (i == cfg->ops / 2) hh_reserve(run.hash, NKEYS);
+    }
+
+    long reads;
+    long errors = stop_readers(&run, cfg, th, &reads);
+    printf("  reads %ld, keys %zu, %zu bytes (%s)\n", reads, hh_count(run.hash),
+           hh_bytes(run.hash), hh_kernel_name());
+    hh_free(run.hash);
+    return errors;
+}
+
+// --- HCIndex cases: lookups, promotion and eviction against writers ---
+
+static HCParams hc_params(int evict_policy) {
+    HCParams p;
+    memset(&p, 0, sizeof(p));
+    p.decay_alpha      = 0.9;
+    p.hot_threshold    = 2.0;
+    p.max_hot_fraction = 0.005;   // well under HOT_KEYS: constant eviction
+    p.inclusive        = 1;
+    p.sampling_rate    = 1.0;
+    p.evict_policy     = evict_policy;
+    p.freq_kind        = FREQ_CMS;
+    p.cold_bplus       = 1;
+    p.concurrent       = 1;
+    return p;
+}
+
+// Writes go through hc_insert / hc_update / hc_delete; every so often
+// the hot budget is halved and restored, which evicts in bulk. Readers
+// only try-lock maint_lock to promote, so the writer also looks keys up
+// between its writes: back-to-back writes would hold that lock nearly
+// all the time and starve promotion.
+static long run_hc(const Cfg *cfg, HCParams p) {
+    Run run;
+    memset(&run, 0, sizeof(run));
+    run.idx = hc_create(NKEYS - 1, 8, p);
+    for (BTKey k = 0; k < NKEYS; k += 2) hc_insert(run.idx, k, even_a(k));
+    size_t budget = run.idx->hot_budget;
+    if (p.async_promote) hc_start_maintenance(run.idx, 50);
+    pthread_t th[64];
+    start_readers(&run, cfg, th);
+
+    Rng r;
+    rng_seed(&r, cfg->seed);
+    for (long i = 0; i < cfg->ops; i++) {
+        BTKey k = pick_key(&r);
+        if ((k & 1) == 0) {
+            BTPayload v = rng_below(&r, 2) ? even_a(k) : even_b(k);
+            if (rng_below(&r, 2)) run.write_errors += !hc_update(run.idx, k, v);
+            else                  hc_insert(run.idx, k, v);
+        } else if (rng_below(&r, 2)) {
+            hc_insert(run.idx, k, odd_v(k));
+        } else {
+            hc_delete(run.idx, k);
+        }
+        for (int j = 0; j < 4; j++) {
+            BTKey q = pick_key(&r);
+            run.write_errors += !valid(q, hc_search(run.idx, q));
+        }
+        if (i % 20000 == 19999)
+            hc_set_hot_capacity(run.idx, (i / 20000) % 2 ? budget : budget / 2);
+    }
+
+    long reads;
+    long errors = stop_readers(&run, cfg, th, &reads);
+    HCStats s = hc_get_stats(run.idx);
+    printf("  reads %ld, hot hits %ld, promotions %ld, evictions %ld, flushes %ld\n",
+           reads, s.hot_hits, s.promotions, s.evictions, s.flushes);
+    if (s.promotions == 0 || (p.evict_policy != HC_EVICT_NONE && s.evictions == 0) ||
+        (p.write_buffer && s.flushes == 0)) {
+        printf("  no promotions, evictions or flushes: the case did not exercise them\n");
+        errors++;
+    }
+    hc_free(run.idx);
+    return errors;
+}
+
+static long case_hc_clock(const Cfg *c) {
+    return run_hc(c, hc_params(HC_EVICT_CLOCK));
+}
+
+static long case_hc_sampled(const Cfg *c) {
+    return run_hc(c, hc_params(HC_EVICT_SAMPLED));
+}
+
+// Promotion and eviction move keys between the tiers here, so a lookup
+// can race a key in flight (hc_miss_raced).
+static long case_hc_exclusive(const Cfg *c) {
+    HCParams p = hc_params(HC_EVICT_CLOCK);
+    p.inclusive = 0;
+    return run_hc(c, p);
+}
+
+// Hash hot tier: range scans read cold and consult hot for dirty keys.
+static long case_hc_hash(const Cfg *c) {
+    HCParams p = hc_params(HC_EVICT_CLOCK);
+    p.hot_kind = HC_HOT_HASH;
+    return run_hc(c, p);
+}
+
+// Writes of keys that are not hot go to the write buffer, so lookups
+// read its log and hash under the buffer's seqlock while the writer
+// appends, overwrites, tombstones and flushes.
+static long case_hc_wbuf(const Cfg *c) {
+    HCParams p = hc_params(HC_EVICT_CLOCK);
+    p.write_buffer = 64;
+    return run_hc(c, p);
+}
+
+static long case_hc_wbuf_excl(const Cfg *c) {
+    HCParams p = hc_params(HC_EVICT_CLOCK);
+    p.write_buffer = 64;
+    p.inclusive = 0;
+    return run_hc(c, p);
+}
+
+// Lookups only queue candidates; the maintenance thread promotes them
+// and evicts while the readers and the writer run.
+static long case_hc_async(const Cfg *c) {
+    HCParams p = hc_params(HC_EVICT_CLOCK);
+    p.async_promote = 1;
+    p.promote_queue = 256;
+    return run_hc(c, p);
+}
+
+// --- Promotion queue: concurrent pushes and pops ----------------------
+
+typedef struct {
+    PromoQueue    *q;
+    int            id;       // producer number (producers only)
+    long           items;    // pushed by each producer
+    long           total;    // pushed by all producers
+    long          *popped;   // shared: items popped so far
+    unsigned char *seen;     // shared: times each item was popped
+    long           errors;
+} PQWorker;
+
+// Item j travels as key j with a payload and stamp derived from it, so a
+// torn or mixed-up cell shows up as a mismatch.
+static inline BTPayload pq_val(BTKey j)  { return (BTPayload)(intptr_t)(2 * j + 1); }
+static inline uint64_t  pq_stamp(BTKey j) { return (uint64_t)j ^ 0x5A5A5A5A5A5A5A5Aull; }
+
+static void* pq_producer(void *arg) {
+    PQWorker *w = (PQWorker*)arg;
+    for (long i = 0; i < w->items; i++) {
+        BTKey j = (BTKey)(w->id * w->items + i);
+        while (!pq_push(w->q, j, pq_val(j), pq_stamp(j))) sched_yield();
+    }
+    return NULL;
+}
+
+static void* pq_consumer(void *arg) {
+    PQWorker *w = (PQWorker*)arg;
+    while (__atomic_load_n(w->popped, __ATOMIC_RELAXED) < w->total) {
+        BTKey j;
+        BTPayload v;
+        uint64_t stamp;
+        if (!pq_pop(w->q, &j, &v, &stamp)) {
+            sched_yield();
+            continue;
+        }
+        if (j < 0 || j >= w->total || v != pq_val(j) || stamp != pq_stamp(j)) {
+            w->errors++;
+        } else {
+            __atomic_add_fetch(&w->seen[j], 1, __ATOMIC_RELAXED);
+        }
+        __atomic_add_fetch(w->popped, 1, __ATOMIC_RELAXED);
+    }
+    return NULL;
+}
+
+// T producers and T consumers share a small queue, so both the full and
+// the empty case come up all the time; every item must come out exactly
+// once. A single-threaded pass first checks capacity and FIFO order.
+static long case_promoq(const Cfg *cfg) {
+    long errors = 0;
+    PromoQueue *q = pq_create(8);
+    BTKey j;
+    BTPayload v;
+    uint64_t stamp;
+    for (BTKey i = 0; i < 8; i++) errors += !pq_push(q, i, pq_val(i), pq_stamp(i));
+    errors += pq_push(q, 8, pq_val(8), pq_stamp(8));   // full
+    for (BTKey i = 0; i < 8; i++)
+        errors += !pq_pop(q, &j, &v, &stamp) || j != i || v != pq_val(i);
+    errors += pq_pop(q, &j, &v, &stamp);                // empty
+    pq_free(q);
+
+    int n = cfg->threads;
+    long items = cfg->ops / n + 1;
+    long total = items * n, popped = 0;
+    unsigned char *seen = (unsigned char*)calloc((size_t)total, 1);
+    PQWorker w[128];
+    pthread_t th[128];
+    q = pq_create(64);
+    for (int i = 0; i < 2 * n; i++) {
+        w[i] = (PQWorker){ q, i, items, total, &popped, seen, 0 };
+        pthread_create(&th[i], NULL, i < n ? pq_producer : pq_consumer, &w[i]);
+    }
+    for (int i = 0; i < 2 * n; i++) {
+        pthread_join(th[i], NULL);
+        errors += w[i].errors;
+    }
+    long lost = 0, dup = 0;
+    for (long i = 0; i < total; i++) {
+        lost += seen[i] == 0;
+        dup  += seen[i] > 1;
+    }
+    printf("  items %ld, lost %ld, duplicated %ld\n", total, lost, dup);
+    free(seen);
+    pq_free(q);
+    return errors + lost + dup;
+}
+
+// --- Driver ------------------------------------------------------------
+
+typedef struct {
+    const char *name;
+    long      (*run)(const Cfg *cfg);
+} Case;
+
+static const Case cases[] = {
+    { "olc-btree",    case_olc_btree },
+    { "olc-bplus",    case_olc_bplus },
+    { "olc-packed",   case_olc_packed },
+    { "olc-learned",  case_olc_learned },
+    { "hothash",      case_hothash },
+    { "hc-clock",     case_hc_clock },
+    { "hc-sampled",   case_hc_sampled },
+    { "hc-exclusive", case_hc_exclusive },
+    { "hc-hash",      case_hc_hash },
+    { "hc-async",     case_hc_async },
+    { "hc-wbuf",      case_hc_wbuf },
+    { "hc-wbuf-excl", case_hc_wbuf_excl },
+    { "promoq",       case_promoq },
+};
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+static int run_case(const Case *c, const Cfg *cfg) {
+    printf("%s\n", c->name);
+    fflush(stdout);
+    long errors = c->run(cfg);
+    printf("%-14s %s (%ld errors)\n", c->name, errors ? "FAILED" : "ok", errors);
+    return errors == 0;
+}
+
+int main(int argc, char **argv) {
+    Cfg cfg = { 4, 100000, 42 };
+    int first_case = argc, ok = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads") && i+1 < argc) {
+            cfg.threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--ops") && i+1 < argc) {
+            cfg.ops = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+            cfg.seed = (uint64_t)atoll(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            first_case = i;
+            break;
+        } else {
+            fprintf(stderr, "Usage: %s [--threads T] [--ops N] [--seed S] [case ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.threads < 1 || cfg.threads > 64 || cfg.ops < 1) {
+        fprintf(stderr, "Need 1 <= threads <= 64 and ops >= 1\n");
+        return 1;
+    }
+
+    if (first_case == argc) {
+        for (size_t j = 0; j < NCASES; j++) ok &= run_case(&cases[j], &cfg);
+        return ok ? 0 : 1;
+    }
+    for (int i = first_case; i < argc; i++) {
+        size_t j = 0;
+        while (j < NCASES && strcmp(cases[j].name, argv[i]) != 0) j++;
+        if (j == NCASES) {
+            fprintf(stderr, "Unknown case '%s'; cases:", argv[i]);
+            for (j = 0; j < NCASES; j++) fprintf(stderr, " %s", cases[j].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        ok &= run_case(&cases[j], &cfg);
+    }
+    return ok ? 0 : 1;
+}
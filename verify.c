@@ -0,0 +1,632 @@
+// verify.c
+//
+// Single-threaded correctness checks: every tree layout and a range of
+// HCIndex configurations run a seeded series of writes and lookups, and
+// every answer is compared with a plain array holding what the index
+// should contain.
+//
+//   ./verify [--ops N] [--seed S] [case ...]
+//
+// Without case names every case runs. A tree case (one per layout) runs
+// random inserts, updates and deletes, then deletes every key down to an
+// empty tree, bt_insert_sorted over keys already present, bt_bulk_load
+// with its error cases, and a bt_save / bt_open_mmap round trip. After
+// each step the whole tree is compared with the reference through point
+// lookups, batched lookups, a cursor scan and range scans. An hc case
+// does the same through the HCIndex API for each cold layout, adds hot
+// budget changes, and ends with an hc_snapshot / hc_restore round trip.
+// A case passes with zero mismatches; the exit status is 0 only if every
+// case passed. `make check` builds and runs it before ./stress.
+#define _POSIX_C_SOURCE 200809L
+#include "btree.h"
+#include "hctree.h"
+#include "rng.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#define NKEYS    4096   // key domain [0, NKEYS)
+#define DEGREE   4      // small nodes: tall trees, frequent splits and merges
+#define HOT_KEYS 256    // hc cases aim most lookups here
+
+typedef struct {
+    long     ops;
+    uint64_t seed;
+} Cfg;
+
+// What the index under test should hold: ref[k] is k's payload, NULL if
+// k is absent. Payloads written by the cases are never NULL.
+static BTPayload ref[NKEYS];
+static long      mismatches;
+
+#define CHECK(cond) do { if (!(cond)) fail(__LINE__, #cond); } while (0)
+
+static void fail(int line, const char *what) {
+    if (mismatches++ < 10)
+        fprintf(stderr, "  verify.c:%d: %s\n", line, what);
+}
+
+// A payload for k: mostly small values near the key, which packed leaves
+// store in narrow lanes, sometimes a large one that widens them.
+static BTPayload new_val(Rng *r, BTKey k) {
+    if (rng_below(r, 4) != 0)
+        return (BTPayload)(intptr_t)(8 * k + 1 + (BTKey)rng_below(r, 8));
+    return (BTPayload)(intptr_t)((rng_next(r) >> 20) | 1);
+}
+
+static long ref_count(BTKey lo, BTKey hi) {
+    long n = 0;
+    for (BTKey k = lo; k <= hi; k++) n += ref[k] != NULL;
+    return n;
+}
+
+static void ref_clear(void) {
+    memset(ref, 0, sizeof(ref));
+}
+
+// Random k in [0, NKEYS), mostly in [0, HOT_KEYS) if skewed.
+static BTKey pick_key(Rng *r, int skewed) {
+    if (skewed && rng_below(r, 4) != 0) return (BTKey)rng_below(r, HOT_KEYS);
+    return (BTKey)rng_below(r, NKEYS);
+}
+
+// A scan result must be ascending, inside [lo, hi] and agree with ref;
+// with as many keys as ref has in the range, it is then exactly ref's.
+typedef struct {
+    BTKey lo, hi, last;
+    long  n;
+    int   bad;
+} Scan;
+
+static void scan_key(BTKey k, BTPayload v, void *arg) {
+    Scan *s = (Scan*)arg;
+    if ((s->n > 0 && k <= s->last) || k < s->lo || k > s->hi || ref[k] != v)
+        s->bad = 1;
+    s->last = k;
+    s->n++;
+}
+
+static void pick_range(Rng *r, BTKey *lo, BTKey *hi) {
+    *lo = (BTKey)rng_below(r, NKEYS);
+    *hi = *lo + (BTKey)rng_below(r, NKEYS / 8);
+    if (*hi >= NKEYS) *hi = NKEYS - 1;
+}
+
+// --- Trees ---------------------------------------------------------------
+
+enum { LAYOUT_BTREE, LAYOUT_BPLUS, LAYOUT_PACKED, LAYOUT_LEARNED };
+
+static BTree* new_tree(int layout) {
+    switch (layout) {
+    case LAYOUT_BTREE:  return bt_create(DEGREE);
+    case LAYOUT_BPLUS:  return bt_create_bplus(DEGREE);
+    case LAYOUT_PACKED: return bt_create_packed(DEGREE);
+    default: {
+        BTree *t = bt_create_bplus(DEGREE);
+        bt_set_learned(t, 4);
+        return t;
+    }
+    }
+}
+
+static void check_range(BTree *t, BTKey lo, BTKey hi) {
+    Scan s = { lo, hi, 0, 0, 0 };
+    bt_range_search(t, lo, hi, scan_key, &s, NULL);
+    CHECK(!s.bad && s.n == ref_count(lo, hi));
+
+    Scan c = { lo, hi, 0, 0, 0 };
+    BTCursor cur;
+    BTKey k;
+    BTPayload v;
+    bt_cursor_seek(&cur, t, lo, NULL);
+    while (bt_cursor_next(&cur, &k, &v) && k <= hi) scan_key(k, v, &c);
+    CHECK(!c.bad && c.n == ref_count(lo, hi));
+}
+
+// Compare the whole tree with ref.
+static void check_tree(BTree *t, Rng *r) {
+    static BTKey     keys[NKEYS];
+    static BTPayload out[NKEYS];
+    for (BTKey k = 0; k < NKEYS; k++) {
+        BTPayload v = (BTPayload)1;
+        CHECK(bt_search(t, k, NULL) == ref[k]);
+        CHECK(bt_find(t, k, &v, NULL) == (ref[k] != NULL) && v == ref[k]);
+        keys[k] = (BTKey)rng_below(r, NKEYS);
+    }
+    bt_search_batch(t, keys, NKEYS, out, NULL);
+    for (size_t j = 0; j < NKEYS; j++) CHECK(out[j] == ref[keys[j]]);
+    CHECK((long)bt_count_keys(t) == ref_count(0, NKEYS - 1));
+
+    check_range(t, 0, NKEYS - 1);
+    check_range(t, -10, -1);
+    check_range(t, NKEYS / 2, NKEYS / 2);
+    for (int i = 0; i < 8; i++) {
+        BTKey lo, hi;
+        pick_range(r, &lo, &hi);
+        check_range(t, lo, hi);
+    }
+}
+
+// Random inserts (plain and hinted), updates, deletes and lookups.
+static void tree_ops(BTree *t, Rng *r, long ops) {
+    for (long i = 0; i < ops; i++) {
+        BTKey k = pick_key(r, 0);
+        unsigned op = (unsigned)rng_below(r, 100);
+        if (op < 35) {
+            BTPayload v = new_val(r, k);
+            bt_insert(t, k, v);
+            ref[k] = v;
+        } else if (op < 45) {
+            BTHint h;
+            BTPayload v = new_val(r, k);
+            CHECK(bt_search_hint(t, k, NULL, &h) == ref[k]);
+            CHECK(bt_insert_hint(t, k, v, &h) == (ref[k] == NULL));
+            ref[k] = v;
+        } else if (op < 55) {
+            BTPayload v = new_val(r, k);
+            int found = bt_update(t, k, v);
+            CHECK(found == (ref[k] != NULL));
+            if (found) ref[k] = v;
+        } else if (op < 85) {
+            CHECK(bt_delete(t, k) == (ref[k] != NULL));
+            ref[k] = NULL;
+        } else {
+            CHECK(bt_search(t, k, NULL) == ref[k]);
+        }
+        if ((i + 1) % (ops / 8 + 1) == 0) check_tree(t, r);
+    }
+    check_tree(t, r);
+}
+
+static void shuffle(Rng *r, BTKey *a, size_t n) {
+    for (size_t i = n; i > 1; i--) {
+        size_t j = (size_t)rng_below(r, i);
+        BTKey x = a[i-1]; a[i-1] = a[j]; a[j] = x;
+    }
+}
+
+// Fill the domain, then delete every key in random order: each delete
+// borrows or merges, until the root is an empty leaf. The emptied tree
+// must then take inserts again.
+static void tree_drain(BTree *t, Rng *r) {
+    static BTKey order[NKEYS];
+    for (BTKey k = 0; k < NKEYS; k++) {
+        order[k] = k;
+        if (!ref[k]) {
+            ref[k] = new_val(r, k);
+            bt_insert(t, k, ref[k]);
+        }
+    }
+    check_tree(t, r);
+    shuffle(r, order, NKEYS);
+    for (size_t i = 0; i < NKEYS; i++) {
+        CHECK(bt_delete(t, order[i]) == 1);
+        CHECK(bt_delete(t, order[i]) == 0);
+        ref[order[i]] = NULL;
+        if ((i + 1) % (NKEYS / 8) == 0) check_tree(t, r);
+    }
+    CHECK(bt_count_keys(t) == 0);
+    CHECK(bt_height(t) == 1);
+    check_tree(t, r);
+    tree_ops(t, r, NKEYS);
+}
+
+// Sorted batches over a tree that already holds some of their keys:
+// present keys are overwritten, the others added, and the return value
+// counts only the added ones.
+static void tree_insert_sorted(BTree *t, Rng *r) {
+    static BTKey     keys[NKEYS];
+    static BTPayload vals[NKEYS];
+    CHECK(bt_insert_sorted(t, keys, vals, 0) == 0);
+    for (int round = 0; round < 4; round++) {
+        size_t n = 0;
+        long added = 0;
+        BTKey step = 1 + (BTKey)rng_below(r, 4);
+        for (BTKey k = (BTKey)rng_below(r, step); k < NKEYS; k += step) {
+            keys[n] = k;
+            vals[n] = new_val(r, k);
+            added += ref[k] == NULL;
+            n++;
+        }
+        CHECK((long)bt_insert_sorted(t, keys, vals, n) == added);
+        for (size_t j = 0; j < n; j++) ref[keys[j]] = vals[j];
+        check_tree(t, r);
+        tree_ops(t, r, NKEYS / 4);
+    }
+}
+
+// Bulk loads at several fill factors, each followed by writes that split
+// and merge the packed nodes, and every way a bulk load must refuse.
+static void tree_bulk(int layout, Rng *r) {
+    static BTKey     keys[NKEYS];
+    static BTPayload vals[NKEYS];
+    const double fills[] = { 1.0, 0.7, 0.0 };
+    for (int f = 0; f < 3; f++) {
+        BTree *t = new_tree(layout);
+        size_t n = 0;
+        ref_clear();
+        for (BTKey k = 0; k < NKEYS; k++) {
+            if (rng_below(r, 3) == 0) continue;
+            keys[n] = k;
+            vals[n] = ref[k] = new_val(r, k);
+            n++;
+        }
+        CHECK(bt_bulk_load(t, keys, vals, n, fills[f]) == 0);
+        check_tree(t, r);
+        // A second load into the now non-empty tree changes nothing.
+        CHECK(bt_bulk_load(t, keys, vals, 1, fills[f]) == -1);
+        check_tree(t, r);
+        tree_ops(t, r, NKEYS);
+        bt_free(t);
+    }
+
+    for (size_t j = 0; j < 16; j++) {
+        keys[j] = (BTKey)(3 * j);
+        vals[j] = (BTPayload)(intptr_t)(j + 1);
+    }
+    ref_clear();
+    BTree *t = new_tree(layout);
+    CHECK(bt_bulk_load(t, keys, vals, 0, 1.0) == 0);
+    keys[7] = keys[9];              // out of order
+    CHECK(bt_bulk_load(t, keys, vals, 16, 1.0) == -1);
+    keys[7] = keys[8];              // duplicate
+    CHECK(bt_bulk_load(t, keys, vals, 16, 1.0) == -1);
+    check_tree(t, r);
+    CHECK(bt_bulk_load(t, keys, vals, 1, 1.0) == 0);
+    ref[keys[0]] = vals[0];
+    check_tree(t, r);
+    bt_free(t);
+}
+
+static int temp_path(char *path, size_t len) {
+    snprintf(path, len, "/tmp/verify-XXXXXX");
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    close(fd);
+    return 0;
+}
+
+// bt_save, bt_open_mmap, lookups and scans on the mapping, writes that
+// must leave it unchanged, and a save of the mapped tree itself.
+static void tree_mmap(BTree *t, Rng *r) {
+    char path[64], path2[64];
+    static BTKey     keys[2] = { 1, 2 };
+    static BTPayload vals[2] = { (BTPayload)1, (BTPayload)2 };
+    if (temp_path(path, sizeof(path)) != 0 || temp_path(path2, sizeof(path2)) != 0) {
+        CHECK(!"mkstemp failed");
+        return;
+    }
+    CHECK(bt_save(t, path) == 0);
+    BTree *m = bt_open_mmap(path);
+    CHECK(m != NULL);
+    if (m) {
+        check_tree(m, r);
+        BTKey k = pick_key(r, 0);
+        bt_insert(m, k, (BTPayload)7);
+        CHECK(bt_delete(m, k) == 0);
+        CHECK(bt_update(m, k, (BTPayload)7) == 0);
+        CHECK(bt_insert_sorted(m, keys, vals, 2) == 0);
+        CHECK(bt_bulk_load(m, keys, vals, 2, 1.0) == -1);
+        check_tree(m, r);
+
+        CHECK(bt_save(m, path2) == 0);
+        BTree *m2 = bt_open_mmap(path2);
+        CHECK(m2 != NULL);
+        if (m2) {
+            check_tree(m2, r);
+            bt_free(m2);
+        }
+        bt_free(m);
+    }
+    FILE *f = fopen(path, "w");     // not a tree file
+    if (f) {
+        fputs("not a tree\n", f);
+        fclose(f);
+    }
+    CHECK(bt_open_mmap(path) == NULL);
+    unlink(path);
+    unlink(path2);
+}
+
+static long run_tree(const Cfg *cfg, int layout) {
+    Rng r;
+    rng_seed(&r, cfg->seed);
+    long before = mismatches;
+
+    BTree *t = new_tree(layout);
+    ref_clear();
+    check_tree(t, &r);
+    tree_ops(t, &r, cfg->ops);
+    tree_drain(t, &r);
+    tree_insert_sorted(t, &r);
+    tree_mmap(t, &r);
+    bt_free(t);
+    tree_bulk(layout, &r);
+    return mismatches - before;
+}
+
+static long case_btree(const Cfg *c)  { return run_tree(c, LAYOUT_BTREE); }
+static long case_bplus(const Cfg *c)  { return run_tree(c, LAYOUT_BPLUS); }
+static long case_packed(const Cfg *c) { return run_tree(c, LAYOUT_PACKED); }
+static long case_learned(const Cfg *c) { return run_tree(c, LAYOUT_LEARNED); }
+
+// --- HCIndex -------------------------------------------------------------
+
+// Base parameters of the hc cases: promote on the second hit, a hot tier
+// small enough next to HOT_KEYS that eviction runs constantly.
+static HCParams hc_params(int inclusive, int hot_kind, size_t write_buffer) {
+    HCParams p;
+    memset(&p, 0, sizeof(p));
+    p.decay_alpha      = 0.9;
+    p.hot_threshold    = 2.0;
+    p.max_hot_fraction = 0.02;
+    p.inclusive        = inclusive;
+    p.sampling_rate    = 1.0;
+    p.evict_policy     = HC_EVICT_CLOCK;
+    p.freq_kind        = FREQ_DENSE;
+    p.hot_kind         = hot_kind;
+    p.filter_bits      = 8;
+    p.write_buffer     = write_buffer;
+    return p;
+}
+
+// The cold layouts each hc case is run over.
+static HCParams with_layout(HCParams p, int layout) {
+    p.cold_bplus   = layout != LAYOUT_BTREE;
+    p.cold_packed  = layout == LAYOUT_PACKED;
+    p.cold_learned = layout == LAYOUT_LEARNED ? 4 : 0;
+    return p;
+}
+
+static void hc_check_range(HCIndex *idx, BTKey lo, BTKey hi) {
+    Scan s = { lo, hi, 0, 0, 0 };
+    hc_range_search(idx, lo, hi, scan_key, &s);
+    CHECK(!s.bad && s.n == ref_count(lo, hi));
+}
+
+// Compare the whole index with ref. Lookups also promote, so this moves
+// keys between the tiers as it goes.
+static void check_hc(HCIndex *idx, Rng *r) {
+    static BTKey     keys[NKEYS];
+    static BTPayload out[NKEYS];
+    for (BTKey k = 0; k < NKEYS; k++) {
+        CHECK(hc_search(idx, k) == ref[k]);
+        keys[k] = pick_key(r, 1);
+    }
+    hc_search_batch(idx, keys, NKEYS, out);
+    for (size_t j = 0; j < NKEYS; j++) CHECK(out[j] == ref[keys[j]]);
+    hc_check_range(idx, 0, NKEYS - 1);
+    for (int i = 0; i < 8; i++) {
+        BTKey lo, hi;
+        pick_range(r, &lo, &hi);
+        hc_check_range(idx, lo, hi);
+    }
+}
+
+static void hc_ops(HCIndex *idx, Rng *r, long ops) {
+    size_t budget = idx->hot_budget;
+    for (long i = 0; i < ops; i++) {
+        BTKey k = pick_key(r, 1);
+        unsigned op = (unsigned)rng_below(r, 100);
+        if (op < 50) {
+            CHECK(hc_search(idx, k) == ref[k]);
+        } else if (op < 65) {
+            BTPayload v = new_val(r, k);
+            hc_insert(idx, k, v);
+            ref[k] = v;
+        } else if (op < 75) {
+            BTPayload v = new_val(r, k);
+            int found = hc_update(idx, k, v);
+            CHECK(found == (ref[k] != NULL));
+            if (found) ref[k] = v;
+        } else if (op < 88) {
+            CHECK(hc_delete(idx, k) == (ref[k] != NULL));
+            ref[k] = NULL;
+        } else if (op < 98) {
+            BTKey keys[37];
+            BTPayload out[37];
+            for (int j = 0; j < 37; j++) keys[j] = pick_key(r, 1);
+            hc_search_batch(idx, keys, 37, out);
+            for (int j = 0; j < 37; j++) CHECK(out[j] == ref[keys[j]]);
+        } else {
+            BTKey lo, hi;
+            pick_range(r, &lo, &hi);
+            hc_check_range(idx, lo, hi);
+        }
+        // Shrink and regrow the hot tier now and then: resizing evicts.
+        if ((i + 1) % (ops / 5 + 1) == 0) {
+            hc_set_hot_capacity(idx, idx->hot_budget == budget ? budget / 4 : budget);
+            check_hc(idx, r);
+        }
+    }
+    hc_set_hot_capacity(idx, budget);
+    check_hc(idx, r);
+}
+
+// Delete every key; tombstones in the hot tier must hide them all.
+static void hc_drain(HCIndex *idx, Rng *r) {
+    static BTKey order[NKEYS];
+    for (BTKey k = 0; k < NKEYS; k++) order[k] = k;
+    shuffle(r, order, NKEYS);
+    for (size_t i = 0; i < NKEYS; i++) {
+        BTKey k = order[i];
+        CHECK(hc_delete(idx, k) == (ref[k] != NULL));
+        CHECK(hc_delete(idx, k) == 0);
+        ref[k] = NULL;
+        if ((i + 1) % (NKEYS / 4) == 0) check_hc(idx, r);
+    }
+    check_hc(idx, r);
+    // Evicting the tombstones deletes whatever cold copies they hide.
+    size_t budget = idx->hot_budget;
+    hc_set_hot_capacity(idx, 0);
+    hc_flush(idx);
+    HCStats s = hc_get_stats(idx);
+    CHECK(s.hot_keys == 0 && s.cold_keys == 0);
+    hc_set_hot_capacity(idx, budget);
+    check_hc(idx, r);
+}
+
+// hc_bulk_load errors: a refused load writes nothing, not even filter
+// bits, so its keys stay filter negatives.
+static void hc_bulk(HCParams p, Rng *r) {
+    static BTKey     keys[NKEYS];
+    static BTPayload vals[NKEYS];
+    size_t n = 0;
+    ref_clear();
+    for (BTKey k = 0; k < NKEYS; k += 2) {
+        keys[n] = k;
+        vals[n] = new_val(r, k);
+        n++;
+    }
+    HCIndex *idx = hc_create(NKEYS - 1, DEGREE, p);
+    BTKey last = keys[n - 1];
+    keys[n - 1] = keys[0];
+    CHECK(hc_bulk_load(idx, keys, vals, n, 1.0) == -1);
+    keys[n - 1] = last;
+    for (size_t j = 0; j < n; j++) CHECK(hc_search(idx, keys[j]) == NULL);
+    CHECK(hc_get_stats(idx).filter_negatives > (long)n / 2);
+
+    CHECK(hc_bulk_load(idx, keys, vals, n, 1.0) == 0);
+    for (size_t j = 0; j < n; j++) ref[keys[j]] = vals[j];
+    CHECK(hc_bulk_load(idx, keys, vals, n, 1.0) == -1);
+    check_hc(idx, r);
+    hc_ops(idx, r, NKEYS);
+    hc_free(idx);
+}
+
+// hc_snapshot, then a new index built from the old one's cold tier (as a
+// restart would find it) and hc_restore: it must hold the same keys and
+// start with a hot tier. Frees idx and returns the new index.
+static HCIndex* hc_restart(HCIndex *idx, HCParams p, Rng *r) {
+    static BTKey     keys[NKEYS];
+    static BTPayload vals[NKEYS];
+    char path[64];
+    if (temp_path(path, sizeof(path)) != 0) {
+        CHECK(!"mkstemp failed");
+        return idx;
+    }
+    for (long i = 0; i < 4 * NKEYS; i++) {   // warm the hot tier
+        BTKey k = pick_key(r, 1);
+        CHECK(hc_search(idx, k) == ref[k]);
+    }
+    CHECK(hc_snapshot(idx, path) == 0);
+
+    size_t n = 0;
+    BTCursor cur;
+    bt_cursor_seek(&cur, idx->cold, 0, NULL);
+    while (bt_cursor_next(&cur, &keys[n], &vals[n])) n++;
+
+    HCIndex *fresh = hc_create(NKEYS - 1, DEGREE, p);
+    CHECK(hc_bulk_load(fresh, keys, vals, n, 1.0) == 0);
+    CHECK(hc_restore(fresh, path) == 0);
+    HCStats s = hc_get_stats(fresh);
+    CHECK(s.hot_keys > 0 || ref_count(0, NKEYS - 1) == 0);
+    CHECK(s.hot_keys <= fresh->hot_capacity);
+    check_hc(fresh, r);
+
+    // A snapshot only restores into the same key domain.
+    HCIndex *other = hc_create(2 * NKEYS - 1, DEGREE, p);
+    CHECK(hc_restore(other, path) == -1);
+    hc_free(other);
+    unlink(path);
+    CHECK(hc_restore(idx, path) == -1);
+    hc_free(idx);
+    return fresh;
+}
+
+static long run_hc(const Cfg *cfg, HCParams base) {
+    long before = mismatches;
+    for (int layout = LAYOUT_BTREE; layout <= LAYOUT_LEARNED; layout++) {
+        Rng r;
+        rng_seed(&r, cfg->seed + (uint64_t)layout);
+        HCParams p = with_layout(base, layout);
+        p.evict_policy = layout % 2 ? HC_EVICT_SAMPLED : HC_EVICT_CLOCK;
+
+        HCIndex *idx = hc_create(NKEYS - 1, DEGREE, p);
+        ref_clear();
+        hc_ops(idx, &r, cfg->ops);
+        idx = hc_restart(idx, p, &r);
+        hc_ops(idx, &r, NKEYS);
+        hc_drain(idx, &r);
+        hc_ops(idx, &r, NKEYS);
+        hc_free(idx);
+        hc_bulk(p, &r);
+    }
+    return mismatches - before;
+}
+
+static long case_hc_inclusive(const Cfg *c) { return run_hc(c, hc_params(1, HC_HOT_BTREE, 0)); }
+static long case_hc_exclusive(const Cfg *c) { return run_hc(c, hc_params(0, HC_HOT_BTREE, 0)); }
+static long case_hc_hash(const Cfg *c)      { return run_hc(c, hc_params(1, HC_HOT_HASH, 0)); }
+static long case_hc_hash_excl(const Cfg *c) { return run_hc(c, hc_params(0, HC_HOT_HASH, 0)); }
+static long case_hc_wbuf(const Cfg *c)      { return run_hc(c, hc_params(1, HC_HOT_BTREE, 64)); }
+static long case_hc_wbuf_excl(const Cfg *c) { return run_hc(c, hc_params(0, HC_HOT_HASH, 64)); }
+
+// --- Driver ------------------------------------------------------------
+
+typedef struct {
+    const char *name;
+    long      (*run)(const Cfg *cfg);
+} Case;
+
+static const Case cases[] = {
+    { "btree",        case_btree },
+    { "bplus",        case_bplus },
+    { "packed",       case_packed },
+    { "learned",      case_learned },
+    { "hc-inclusive", case_hc_inclusive },
+    { "hc-exclusive", case_hc_exclusive },
+    { "hc-hash",      case_hc_hash },
+    { "hc-hash-excl", case_hc_hash_excl },
+    { "hc-wbuf",      case_hc_wbuf },
+    { "hc-wbuf-excl", case_hc_wbuf_excl },
+};
+#define NCASES (sizeof(cases) / sizeof(cases[0]))
+
+static int run_case(const Case *c, const Cfg *cfg) {
+    long errors = c->run(cfg);
+    printf("%-14s %s (%ld mismatches)\n", c->name, errors ? "FAILED" : "ok", errors);
+    fflush(stdout);
+    return errors == 0;
+}
+
+int main(int argc, char **argv) {
+    Cfg cfg = { 20000, 42 };
+    int first_case = argc, ok = 1;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--ops") && i+1 < argc) {
+            cfg.ops = atol(argv[++i]);
+        } else if (!strcmp(argv[i], "--seed") && i+1 < argc) {
+            cfg.seed = (uint64_t)atoll(argv[++i]);
+        } else if (argv[i][0] != '-') {
+            first_case = i;
+            break;
+        } else {
+            fprintf(stderr, "Usage: %s [--ops N] [--seed S] [case ...]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (cfg.ops < 1) {
+        fprintf(stderr, "Need ops >= 1\n");
+        return 1;
+    }
+
+    if (first_case == argc) {
+        for (size_t j = 0; j < NCASES; j++) ok &= run_case(&cases[j], &cfg);
+        return ok ? 0 : 1;
+    }
+    for (int i = first_case; i < argc; i++) {
+        size_t j = 0;
+        while (j < NCASES && strcmp(cases[j].name, argv[i]) != 0) j++;
+        if (j == NCASES) {
+            fprintf(stderr, "Unknown case '%s'; cases:", argv[i]);
+            for (j = 0; j < NCASES; j++) fprintf(stderr, " %s", cases[j].name);
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        ok &= run_case(&cases[j], &cfg);
+    }
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,164 @@
+// workload.c
+#include "workload.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// --- Zipf by rejection-inversion --------------------------------------
+//
+// With h(x) = x^-theta and H its antiderivative, a uniform u in
+// [H(n + 0.5), H(1.5) - 1] maps through H^-1 to x, which rounds to rank
+// k; k is accepted when u falls under the part of h's integral that k
+// owns. The helpers evaluate (e^x - 1)/x and log(1 + x)/x stably near 0,
+// so theta = 1 needs no special case.
+
+static double wl_helper1(double x) {   // log1p(x) / x
+    return fabs(x) > 1e-8 ? log1p(x) / x : 1.0 - x * (0.5 - x * (1.0 / 3.0 - 0.25 * x));
+}
+
+static double wl_helper2(double x) {   // expm1(x) / x
+    return fabs(x) > 1e-8 ? expm1(x) / x : 1.0 + x * 0.5 * (1.0 + x / 3.0 * (1.0 + 0.25 * x));
+}
+
+static double wl_h(double theta, double x) {
+    return exp(-theta * log(x));
+}
+
+static double wl_hint(double theta, double x) {
+    double lx = log(x);
+    return wl_helper2((1.0 - theta) * lx) * lx;
+}
+
+static double wl_hint_inv(double theta, double x) {
+    double t = x * (1.0 - theta);
+    if (t < -1.0) t = -1.0;   // rounding at the far end of the domain
+    return exp(wl_helper1(t) * x);
+}
+
+void wl_zipf_init(WLZipf *z, int64_t n, double theta) {
+    z->n     = n;
+    z->theta = theta;
+    z->h_x1  = wl_hint(theta, 1.5) - 1.0;
+    z->h_n   = wl_hint(theta, (double)n + 0.5);
+    z->s     = 2.0 - wl_hint_inv(theta, wl_hint(theta, 2.5) - wl_h(theta, 2.0));
+}
+
+int64_t wl_zipf_next(const WLZipf *z, Rng *r) {
+    for (;;) {
+        double u = z->h_n + rng_uniform(r) * (z->h_x1 - z->h_n);
+        double x = wl_hint_inv(z->theta, u);
+        int64_t k = (int64_t)(x + 0.5);
+        if (k < 1) k = 1;
+        else if (k > z->n) k = z->n;
+        if ((double)k - x <= z->s ||
+            u >= wl_hint(z->theta, (double)k + 0.5) - wl_h(z->theta, (double)k))
+            return k;
+    }
+}
+
+// --- Scrambling --------------------------------------------------------
+//
+// A bijection on [0, n): an invertible mix on the smallest power-of-two
+// range covering n, re-applied until the value lands below n (cycle
+// walking; under two rounds on average). Unlike hashing modulo n, no two
+// ranks share a key, so the popularity curve is preserved exactly.
+
+static uint64_t wl_mix(uint64_t x, uint64_t mask, int bits) {
+    // Each step is invertible modulo 2^bits: an added constant (so 0
+    // does not map to itself), odd multiplies and xor-shifts by at least
+    // one bit.
+    int sh = bits / 2 > 0 ? bits / 2 : 1;
+    x = (x + 0x2545F4914F6CDD1Dull) & mask;
+    x = (x * 0x9E3779B97F4A7C15ull) & mask;
+    x ^= x >> sh;
+    x = (x * 0xBF58476D1CE4E5B9ull) & mask;
+    x ^= x >> sh;
+    return x;
+}
+
+static int64_t wl_scramble(int64_t v, int64_t n) {
+    int bits = 1;
+    while (bits < 63 && ((int64_t)1 << bits) < n) bits++;
+    uint64_t mask = ((uint64_t)1 << bits) - 1;
+    uint64_t x = (uint64_t)v;
+    do {
+        x = wl_mix(x, mask, bits);
+    } while (x >= (uint64_t)n);
+    return (int64_t)x;
+}
+
+// --- Names -------------------------------------------------------------
+
+static const char *const wl_names[] = {
+    "uniform", "zipf", "scrambled", "latest", "shift"
+};
+
+int wl_parse_kind(const char *name, WLKind *out) {
+    for (int i = 0; i < (int)(sizeof(wl_names) / sizeof(wl_names[0])); i++) {
+        if (!strcmp(name, wl_names[i])) {
+            *out = (WLKind)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char* wl_kind_name(WLKind kind) {
+    return (unsigned)kind < sizeof(wl_names) / sizeof(wl_names[0]) ? wl_names[kind] : "?";
+}
+
+// --- Streams -----------------------------------------------------------
+
+static int64_t wl_key(const WLSpec *spec, const WLZipf *z, Rng *r, int64_t q) {
+    int64_t n = spec->nkeys;
+    switch (spec->kind) {
+    case WL_ZIPF:
+        return wl_zipf_next(z, r) - 1;
+    case WL_SCRAMBLED:
+        return wl_scramble(wl_zipf_next(z, r) - 1, n);
+    case WL_LATEST:
+        return n - wl_zipf_next(z, r);
+    case WL_SHIFT: {
+        // Same zipf popularity curve, rotated to a new region of the key
+        // space each phase, so yesterday's hot keys go cold at once.
+        int64_t phase  = q / spec->shift_every;
+        int64_t offset = (phase * (n / 4 + 1)) % n;
+        return (wl_zipf_next(z, r) - 1 + offset) % n;
+    }
+    default:
+        return (int64_t)rng_below(r, (uint64_t)n);
+    }
+}
+
+WLOp* wl_generate(const WLSpec *spec, int64_t nops) {
+    if (spec->nkeys <= 0 || nops < 0 || spec->theta <= 0.0 ||
+        (spec->kind == WL_SHIFT && spec->shift_every <= 0) ||
+        spec->rmw_fraction < 0.0 || spec->range_fraction < 0.0 ||
+        spec->put_fraction < 0.0 ||
+        spec->rmw_fraction + spec->range_fraction + spec->put_fraction > 1.0)
+        return NULL;
+    WLOp *ops = (WLOp*)malloc(sizeof(WLOp) * (size_t)(nops > 0 ? nops : 1));
+    if (!ops) return NULL;
+
+    WLZipf z;
+    wl_zipf_init(&z, spec->nkeys, spec->theta);
+    Rng r;
+    rng_seed(&r, spec->seed);
+    uint32_t max_len = spec->range_len > 0 ? spec->range_len : 1;
+    for (int64_t q = 0; q < nops; q++) {
+        WLOp *op = &ops[q];
+        op->key  = wl_key(spec, &z, &r, q);
+        op->len  = 0;
+        op->type = WL_GET;
+        double u = rng_uniform(&r);
+        if (u < spec->range_fraction) {
+            op->type = WL_RANGE;
+            op->len  = 1 + (uint32_t)rng_below(&r, max_len);
+        } else if ((u -= spec->range_fraction) < spec->rmw_fraction) {
+            op->type = WL_RMW;
+        } else if (u - spec->rmw_fraction < spec->put_fraction) {
+            op->type = WL_PUT;
+        }
+    }
+    return ops;
+}
@@ -0,0 +1,70 @@
+// workload.h
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <stdint.h>
+#include "btree.h"
+#include "rng.h"
+
+// Benchmark workloads. A whole run's operations are generated up front
+// into an array (wl_generate), so the timed loop only reads the next
+// entry and the measured rate is the index's alone.
+
+// Key popularity over [0, nkeys).
+typedef enum {
+    WL_UNIFORM   = 0,
+    WL_ZIPF      = 1,   // rank r is key r - 1: the hot keys are adjacent
+    WL_SCRAMBLED = 2,   // zipf ranks spread over the key space by a bijection
+    WL_LATEST    = 3,   // zipf anchored at the highest key (YCSB "latest")
+    WL_SHIFT     = 4    // zipf whose hot spot jumps every shift_every ops
+} WLKind;
+
+typedef enum {
+    WL_GET   = 0,       // point lookup
+    WL_RMW   = 1,       // lookup, then write the key back
+    WL_RANGE = 2,       // scan of len keys starting at key
+    WL_PUT   = 3        // blind write of the key
+} WLOpType;
+
+typedef struct {
+    BTKey    key;
+    uint32_t len;       // WL_RANGE: keys in [key, key + len - 1]
+    uint32_t type;      // WLOpType
+} WLOp;
+
+typedef struct {
+    WLKind   kind;
+    int64_t  nkeys;
+    double   theta;           // zipf exponent (> 0)
+    int64_t  shift_every;     // WL_SHIFT: ops per hot-spot position
+    double   rmw_fraction;    // share of WL_RMW ops
+    double   range_fraction;  // share of WL_RANGE ops
+    double   put_fraction;    // share of WL_PUT ops
+    uint32_t range_len;       // WL_RANGE lengths are uniform in [1, range_len]
+    uint64_t seed;
+} WLSpec;
+
+// Zipf sampler over ranks [1, n] with P(r) ∝ r^-theta, by rejection-
+// inversion (Hörmann & Derflinger 1996): O(1) time and no table, so its
+// memory does not grow with n. Fewer than 1.1 draws per sample on average.
+typedef struct {
+    int64_t n;
+    double  theta;
+    double  h_x1;       // H(1.5) - 1
+    double  h_n;        // H(n + 0.5)
+    double  s;          // acceptance shortcut
+} WLZipf;
+
+void    wl_zipf_init(WLZipf *z, int64_t n, double theta);
+int64_t wl_zipf_next(const WLZipf *z, Rng *r);
+
+// Parse / print a WLKind by name ("uniform", "zipf", ...); parse returns
+// -1 for an unknown name.
+int         wl_parse_kind(const char *name, WLKind *out);
+const char* wl_kind_name(WLKind kind);
+
+// nops operations drawn from spec, or NULL on bad input or out of
+// memory. Deterministic for a given spec. free() the result.
+WLOp*   wl_generate(const WLSpec *spec, int64_t nops);
+
+#endif // WORKLOAD_H